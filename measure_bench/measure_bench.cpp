@@ -0,0 +1,174 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// The overhead of an empty scope of the backends and policies of the library (see MeasureBenchmark).
+//
+// usage:
+//   measure_bench [--csv] [--cpu <index>] [--min-time <ms>] [<name filter>]
+
+#include "measure/measure_benchmark.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#if MEASURE_WINDOWS
+    #include "measure/qpc_measure.h"
+#endif
+
+namespace
+{
+    int Usage()
+    {
+        std::cerr << "usage:\n"
+                  << "  measure_bench [--csv] [--cpu <index>] [--min-time <ms>] [<name filter>]\n";
+        return 2;
+    }
+
+    // one iteration is an empty scope of a dynamic record of the policy
+    template<typename Policy>
+    void RegisterPolicy(const std::string& name)
+    {
+        typename Policy::MeasureRecord* record = Policy::GetDynamicRecord(name.c_str());
+        dtree::MeasureBenchmark::Register(name, [record]()
+        {
+            typename Policy::Scope scope(record);
+        });
+    }
+
+    template<typename TestedMeasure>
+    void RegisterAllPolicies(const std::string& name)
+    {
+        RegisterPolicy<typename TestedMeasure::Base>(name + "::Base");
+        RegisterPolicy<typename TestedMeasure::TSafe>(name + "::TSafe");
+        RegisterPolicy<typename TestedMeasure::RSafe>(name + "::RSafe");
+        RegisterPolicy<typename TestedMeasure::TRSafe>(name + "::TRSafe");
+        RegisterPolicy<typename TestedMeasure::Sharded>(name + "::Sharded");
+        RegisterPolicy<typename TestedMeasure::Atomic>(name + "::Atomic");
+        RegisterPolicy<typename TestedMeasure::TRSharded>(name + "::TRSharded");
+        RegisterPolicy<typename TestedMeasure::Histogram>(name + "::Histogram");
+        RegisterPolicy<typename TestedMeasure::Stats>(name + "::Stats");
+        RegisterPolicy<typename TestedMeasure::CallTree>(name + "::CallTree");
+        RegisterPolicy<typename TestedMeasure::Traced>(name + "::Traced");
+    }
+
+    // one iteration is a parent scope calling two children in turn, the children are found by the edge cache of the tree
+    template<typename TestedMeasure>
+    void RegisterCallTreeChildren(const std::string& name)
+    {
+        using Policy = typename TestedMeasure::CallTree;
+        typename Policy::MeasureRecord* parent = Policy::GetDynamicRecord(name.c_str());
+        typename Policy::MeasureRecord* first = Policy::GetDynamicRecord((name + "::first").c_str());
+        typename Policy::MeasureRecord* second = Policy::GetDynamicRecord((name + "::second").c_str());
+        dtree::MeasureBenchmark::Register(name, [parent, first, second]()
+        {
+            typename Policy::Scope parentScope(parent);
+            {
+                typename Policy::Scope firstScope(first);
+            }
+            {
+                typename Policy::Scope secondScope(second);
+            }
+        });
+    }
+
+    void RegisterBenchmarks()
+    {
+        // the cost of the loop itself
+        dtree::MeasureBenchmark::Register("EmptyLoop", []() { dtree::ClobberMemory(); });
+
+        // the dummy measure always returns 0 as time, it is the cost of the bookkeeping of the policies
+        RegisterAllPolicies<dtree::TMeasure<dtree::MeasureBackend>>("DummyMeasure");
+        RegisterAllPolicies<dtree::CppMeasure>("CppMeasure");
+        RegisterPolicy<dtree::CppMeasure::WithCpu<dtree::CppMeasure::Sharded>>("CppMeasure::WithCpu");
+        RegisterCallTreeChildren<dtree::CppMeasure>("CppMeasure::CallTree::TwoChildren");
+
+#if MEASURE_WINDOWS
+        RegisterAllPolicies<dtree::QPCMeasure>("QPCMeasure");
+#endif
+
+#if ARM64_MEASURE_IS_SUPPORTED
+        RegisterPolicy<dtree::Arm64Measure::Base>("Arm64Measure::Base");
+        RegisterPolicy<dtree::Arm64Measure::TSafe>("Arm64Measure::TSafe");
+        RegisterPolicy<dtree::Arm64Measure::RSafe>("Arm64Measure::RSafe");
+        RegisterPolicy<dtree::Arm64Measure::TRSafe>("Arm64Measure::TRSafe");
+        RegisterPolicy<dtree::Arm64Measure::Sharded>("Arm64Measure::Sharded");
+        RegisterPolicy<dtree::Arm64IsbMeasure::Base>("Arm64IsbMeasure::Base");
+#endif
+
+#if MEASURE_LINUX
+        RegisterPolicy<dtree::LinuxMeasure::Base>("LinuxMeasure::Base");
+        RegisterPolicy<dtree::LinuxMeasure::TSafe>("LinuxMeasure::TSafe");
+        RegisterPolicy<dtree::LinuxMeasure::Sharded>("LinuxMeasure::Sharded");
+        RegisterPolicy<dtree::LinuxRawMeasure::Base>("LinuxRawMeasure::Base");
+        RegisterPolicy<dtree::LinuxCoarseMeasure::Base>("LinuxCoarseMeasure::Base");
+#endif
+
+#if PERF_MEASURE_IS_SUPPORTED
+        RegisterPolicy<dtree::PerfMeasure::Base>("PerfMeasure::Base");
+#endif
+
+#if RDTSC_MEASURE_IS_SUPPORTED
+        RegisterAllPolicies<dtree::RdtscMeasure>("RdtscMeasure");
+        RegisterPolicy<dtree::RdtscLfenceMeasure::Base>("RdtscLfenceMeasure::Base");
+        if (dtree::MeasureUtils::HasRdtscp())
+            RegisterPolicy<dtree::RdtscpMeasure::Base>("RdtscpMeasure::Base");
+#endif
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace dtree;
+
+    MeasureBenchmark::Options options;
+    bool csv = false;
+    std::string filter;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--csv")
+            csv = true;
+        else if (arg == "--cpu" && i + 1 < argc)
+            options.cpu = std::atoi(argv[++i]);
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.minSec = std::atof(argv[++i]) * 1e-3;
+        else if (arg.compare(0, 2, "--") == 0 || !filter.empty())
+            return Usage();
+        else
+            filter = arg;
+    }
+
+#if RDTSC_MEASURE_IS_SUPPORTED
+    // the rdtsc backends need the frequency
+    MeasureUtils::TscCalibration::Start();
+    MeasureUtils::TscCalibration::WaitForFrequency();
+#endif
+
+    RegisterBenchmarks();
+    const std::vector<MeasureBenchmark::Result> results = MeasureBenchmark::RunAll(options, filter);
+    if (csv)
+        MeasureBenchmark::CsvReport(std::cout, results);
+    else
+        MeasureBenchmark::PrintReport(std::cout, results);
+    return 0;
+}
+
+/*
+time consumptions of the former PerformanceTest, core i5 @ 3.2GHz, VS2022:
+    DummyMeasure::Base: ~ -0.003 ns/call, ~  -0.0 clock/call, ~ ??? call/sec
+   DummyMeasure::TSafe: ~ 16.530 ns/call, ~  52.9 clock/call, ~ 60496941.5 call/sec
+   DummyMeasure::RSafe: ~  1.179 ns/call, ~   3.8 clock/call, ~ 848047272.1 call/sec
+  DummyMeasure::TRSafe: ~ 62.771 ns/call, ~ 200.8 clock/call, ~ 15930940.5 call/sec
+      CppMeasure::Base: ~ 31.490 ns/call, ~ 100.7 clock/call, ~ 31756495.2 call/sec
+     CppMeasure::TSafe: ~ 51.182 ns/call, ~ 163.7 clock/call, ~ 19538144.3 call/sec
+     CppMeasure::RSafe: ~ 30.757 ns/call, ~  98.4 clock/call, ~ 32512774.7 call/sec
+    CppMeasure::TRSafe: ~ 97.524 ns/call, ~ 311.9 clock/call, ~ 10253889.3 call/sec
+      QPCMeasure::Base: ~ 24.475 ns/call, ~  78.3 clock/call, ~ 40857818.0 call/sec
+     QPCMeasure::TSafe: ~ 44.064 ns/call, ~ 140.9 clock/call, ~ 22694032.5 call/sec
+     QPCMeasure::RSafe: ~ 25.006 ns/call, ~  80.0 clock/call, ~ 39990870.7 call/sec
+    QPCMeasure::TRSafe: ~ 90.124 ns/call, ~ 288.2 clock/call, ~ 11095829.0 call/sec
+    RdtscMeasure::Base: ~ 10.533 ns/call, ~  33.7 clock/call, ~ 94941924.7 call/sec
+   RdtscMeasure::TSafe: ~ 30.258 ns/call, ~  96.8 clock/call, ~ 33049643.3 call/sec
+   RdtscMeasure::RSafe: ~ 10.546 ns/call, ~  33.7 clock/call, ~ 94821272.1 call/sec
+  RdtscMeasure::TRSafe: ~ 76.112 ns/call, ~ 243.4 clock/call, ~ 13138504.5 call/sec
+*/
@@ -0,0 +1,100 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Time measurment based on the ARM64 generic timer (CNTVCT_EL0 virtual counter register).
+// Available in user mode on Linux (e.g. Graviton) and on Apple Silicon, the typical frequency is 24 MHz - 1 GHz.
+
+#pragma once
+
+#include "measure/measure_base.h"
+
+#if ARM64_MEASURE_IS_SUPPORTED
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace dtree
+{
+    struct Arm64CounterBackend
+    {
+        inline static const char* GetMeasureTitle() { return "arm64 counter times"; }
+
+        inline static uint64_t GetTick() noexcept
+        {
+#ifdef _MSC_VER
+            return uint64_t(_ReadStatusReg(0x5F02)); // ARM64_SYSREG(3, 3, 14, 0, 2): CNTVCT_EL0
+#else
+            uint64_t counter;
+            __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(counter));
+            return counter;
+#endif
+        }
+
+        inline static double TimeDiffToSec(uint64_t time)
+        {
+            return double(time) / double(GetFrequency());
+        }
+
+        // the frequency of the counter from CNTFRQ_EL0, exact, no measurement needed
+        inline static uint64_t GetFrequency()
+        {
+            static uint64_t frequency = []() -> uint64_t
+            {
+#ifdef _MSC_VER
+                return uint64_t(_ReadStatusReg(0x5F00)); // ARM64_SYSREG(3, 3, 14, 0, 0): CNTFRQ_EL0
+#else
+                uint64_t counterFrequency;
+                __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(counterFrequency));
+                return counterFrequency;
+#endif
+            }();
+            return frequency;
+        }
+    };
+
+    using Arm64Measure = TMeasure<Arm64CounterBackend>;
+
+    /// @brief the counter read after an isb instruction, so the previous instructions are finished
+    /// before the counter is read, and the measured code can't leak out of the scope
+    struct Arm64CounterIsbBackend : public Arm64CounterBackend
+    {
+        inline static const char* GetMeasureTitle() { return "isb arm64 counter times"; }
+
+        inline static uint64_t GetTick() noexcept
+        {
+#ifdef _MSC_VER
+            __isb(_ARM64_BARRIER_SY);
+#else
+            __asm__ __volatile__("isb" : : : "memory");
+#endif
+            return Arm64CounterBackend::GetTick();
+        }
+    };
+
+    using Arm64IsbMeasure = TMeasure<Arm64CounterIsbBackend>;
+
+} // namespace dtree
+
+#endif // ARM64_MEASURE_IS_SUPPORTED
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#if MEASURE_IS_ON && ARM64_MEASURE_IS_SUPPORTED
+    #define ARM64_MEASURE(NAME) \
+        static dtree::Arm64Measure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::Arm64Measure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
+    #define ARM64_MEASURE_S(TITLE) \
+        static dtree::Arm64Measure::Base::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
+        dtree::Arm64Measure::Base::Scope measureScope(&measureRecord)
+    #define ARM64_SAFE_MEASURE(NAME, POLICY) \
+        static dtree::Arm64Measure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::Arm64Measure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
+    #define ARM64_SAFE_MEASURE_S(TITLE, POLICY) \
+        static dtree::Arm64Measure::POLICY::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
+        dtree::Arm64Measure::POLICY::Scope measureScope(&measureRecord)
+#else
+    #define ARM64_MEASURE(NAME)
+    #define ARM64_MEASURE_S(TITLE)
+    #define ARM64_SAFE_MEASURE(NAME, POLICY)
+    #define ARM64_SAFE_MEASURE_S(TITLE, POLICY)
+#endif
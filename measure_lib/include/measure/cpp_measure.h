@@ -33,16 +33,16 @@ namespace dtree
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #if MEASURE_IS_ON
     #define CPP_MEASURE(NAME) \
-        static dtree::CppMeasure::Base::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::CppMeasure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::CppMeasure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
     #define CPP_MEASURE_S(TITLE) \
-        static dtree::CppMeasure::Base::MeasureRecord measureRecord(TITLE); \
+        static dtree::CppMeasure::Base::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::CppMeasure::Base::Scope measureScope(&measureRecord)
     #define CPP_SAFE_MEASURE(NAME, POLICY) \
-        static dtree::CppMeasure::POLICY::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::CppMeasure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::CppMeasure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
     #define CPP_SAFE_MEASURE_S(TITLE, POLICY) \
-        static dtree::CppMeasure::POLICY::MeasureRecord measureRecord(TITLE); \
+        static dtree::CppMeasure::POLICY::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::CppMeasure::POLICY::Scope measureScope(&measureRecord)
 #else
     #define CPP_MEASURE(NAME)
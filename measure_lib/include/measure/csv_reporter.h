@@ -1,37 +1,16 @@
 #include <fstream>
 #include <ostream>
-#include <iomanip>
 #include <string>
 
+#include "measure/measure_snapshot.h"
+
 namespace dtree
 {
-    /// @brief print measure report in CSV format
+    /// @brief print measure report in CSV format, rendered from a snapshot (see MeasureDatabase::Snapshot)
     template<typename Database>
     void CsvReport(std::ostream& os)
     {
-        using namespace std;
-        std::lock_guard<std::mutex> lock(Database::GetMutex());
-        auto records = Database::GetRecords();
-        if (!records.empty())
-        {
-            os << "name,num_calls,total_ns,average_ns\n";
-            for (auto measureRecord : records)
-            {
-                const double totalSec = measureRecord->GetTotalSec();
-                if (totalSec < 0 || measureRecord->numCall == 0)
-                    os
-                        << measureRecord->name << ","
-                        << measureRecord->numCall << ","
-                        << ",\n";
-                else
-                    os
-                        << measureRecord->name << ","
-                        << measureRecord->numCall << ","
-                        << fixed << totalSec * 1e9 << ","
-                        << fixed << totalSec * 1e9 / double(measureRecord->numCall)
-                        << "\n";
-            }
-        }
+        Database::Snapshot().CsvReport(os);
     }
 
     /// @brief print measure report in CSV format to a file
@@ -41,4 +20,20 @@ namespace dtree
         std::ofstream os(filename);
         CsvReport<Database>(os);
     }
+
+    /// @brief print the call tree (see TMeasure::WithTree) in CSV format, one line per caller path,
+    /// the names in the path are separated by ';'
+    template<typename Database>
+    void CsvTreeReport(std::ostream& os)
+    {
+        Database::MeasureRecord::Tree::CsvReport(os);
+    }
+
+    /// @brief print the call tree in CSV format to a file
+    template<typename Database>
+    void CsvTreeReport(std::string filename = "performance_tree_report.csv")
+    {
+        std::ofstream os(filename);
+        CsvTreeReport<Database>(os);
+    }
 } // namespace dtree
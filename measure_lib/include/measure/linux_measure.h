@@ -0,0 +1,87 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Time measurment based on clock_gettime (vDSO, no system call). Linux only.
+
+#pragma once
+
+#include "measure/measure_base.h"
+
+#if MEASURE_LINUX
+
+#include <time.h>
+
+// the clock of the LINUX_MEASURE macros: CLOCK_MONOTONIC, CLOCK_MONOTONIC_RAW or CLOCK_MONOTONIC_COARSE
+#ifndef LINUX_MEASURE_CLOCK
+    #define LINUX_MEASURE_CLOCK CLOCK_MONOTONIC
+#endif
+
+namespace dtree
+{
+    /// @brief clock_gettime backend, the ticks are nanoseconds
+    /// CLOCK_MONOTONIC: NTP adjusted rate, the default
+    /// CLOCK_MONOTONIC_RAW: hardware rate, not adjusted by NTP
+    /// CLOCK_MONOTONIC_COARSE: the time of the last timer tick, a few ns to read,
+    ///                         but its resolution is only 1-4 ms (see GetResolution), for long scopes
+    template<clockid_t ClockId>
+    struct TClockGettimeBackend
+    {
+        inline static const char* GetMeasureTitle()
+        {
+            return ClockId == CLOCK_MONOTONIC_RAW ? "clock_gettime raw times"
+                : ClockId == CLOCK_MONOTONIC_COARSE ? "clock_gettime coarse times"
+                : "clock_gettime times";
+        }
+
+        inline static int64_t GetTick() noexcept
+        {
+            timespec time;
+            clock_gettime(ClockId, &time);
+            return int64_t(time.tv_sec) * 1000000000 + int64_t(time.tv_nsec);
+        }
+
+        inline static double TimeDiffToSec(int64_t time)
+        {
+            return double(time) * 1e-9;
+        }
+
+        // the resolution of the clock in nanoseconds
+        inline static int64_t GetResolution()
+        {
+            timespec resolution = {};
+            clock_getres(ClockId, &resolution);
+            return int64_t(resolution.tv_sec) * 1000000000 + int64_t(resolution.tv_nsec);
+        }
+    };
+
+    using ClockGettimeBackend = TClockGettimeBackend<LINUX_MEASURE_CLOCK>;
+    using ClockGettimeRawBackend = TClockGettimeBackend<CLOCK_MONOTONIC_RAW>;
+    using ClockGettimeCoarseBackend = TClockGettimeBackend<CLOCK_MONOTONIC_COARSE>;
+
+    using LinuxMeasure = TMeasure<ClockGettimeBackend>;
+    using LinuxRawMeasure = TMeasure<ClockGettimeRawBackend>;
+    using LinuxCoarseMeasure = TMeasure<ClockGettimeCoarseBackend>;
+} // namespace dtree
+
+#endif // MEASURE_LINUX
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#if MEASURE_IS_ON && MEASURE_LINUX
+    #define LINUX_MEASURE(NAME) \
+        static dtree::LinuxMeasure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::LinuxMeasure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
+    #define LINUX_MEASURE_S(TITLE) \
+        static dtree::LinuxMeasure::Base::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
+        dtree::LinuxMeasure::Base::Scope measureScope(&measureRecord)
+    #define LINUX_SAFE_MEASURE(NAME, POLICY) \
+        static dtree::LinuxMeasure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::LinuxMeasure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
+    #define LINUX_SAFE_MEASURE_S(TITLE, POLICY) \
+        static dtree::LinuxMeasure::POLICY::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
+        dtree::LinuxMeasure::POLICY::Scope measureScope(&measureRecord)
+#else
+    #define LINUX_MEASURE(NAME)
+    #define LINUX_MEASURE_S(TITLE)
+    #define LINUX_SAFE_MEASURE(NAME, POLICY)
+    #define LINUX_SAFE_MEASURE_S(TITLE, POLICY)
+#endif
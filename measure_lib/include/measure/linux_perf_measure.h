@@ -0,0 +1,394 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Hardware performance counters (cycles, instructions, cache and branch misses) with perf_event_open. Linux only.
+
+#pragma once
+
+#include "measure/measure_base.h"
+
+#if MEASURE_LINUX
+    #define PERF_MEASURE_IS_SUPPORTED 1
+#else
+    #define PERF_MEASURE_IS_SUPPORTED 0
+#endif
+
+#if PERF_MEASURE_IS_SUPPORTED
+
+#include <cstring>
+#include <time.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the hardware counters of a PerfSample
+    enum class PerfCounter
+    {
+        Cycles,
+        Instructions,
+        L1DMisses,      // L1 data cache read misses
+        LLCMisses,      // last level cache misses
+        BranchMisses,
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a multi-value tick: the time in nanoseconds and the hardware counters of the current thread
+     *
+     * It is both the TimePoint and the TimeDiff of the PerfEventBackend, the records add the differences.
+     * The time is the Rep of the TimeDiffTraits, so the histograms, the stats, the call tree and the snapshots
+     * are based on the time. The Sharded and Atomic policies store only the Rep, they lose the counters,
+     * the Base, TSafe, RSafe and TRSafe policies (and their histogram and stats variants) keep them.
+     */
+    struct PerfSample
+    {
+        static constexpr int CounterNum = 5;
+
+        int64_t time;                   // CLOCK_MONOTONIC nanoseconds
+        int64_t counters[CounterNum];   // indexed by PerfCounter, 0 if the counter is not available
+        uint32_t scaled;                // bit per PerfCounter: the counter was multiplexed, its value is an estimate
+
+        PerfSample() : time(0), counters{}, scaled(0) {}
+        explicit PerfSample(int64_t inTime) : time(inTime), counters{}, scaled(0) {}
+
+        inline int64_t Get(PerfCounter counter) const
+        {
+            return counters[int(counter)];
+        }
+
+        // the kernel multiplexed the counter, its value is scaled by the time enabled / the time running
+        inline bool IsScaled(PerfCounter counter) const
+        {
+            return (scaled & (1u << int(counter))) != 0;
+        }
+
+        inline PerfSample& operator+=(const PerfSample& other)
+        {
+            time += other.time;
+            for (int i = 0; i < CounterNum; ++i)
+                counters[i] += other.counters[i];
+            scaled |= other.scaled;
+            return *this;
+        }
+
+        inline PerfSample operator-(const PerfSample& other) const
+        {
+            PerfSample diff;
+            diff.time = time - other.time;
+            for (int i = 0; i < CounterNum; ++i)
+                diff.counters[i] = counters[i] - other.counters[i];
+            diff.scaled = scaled | other.scaled;
+            return diff;
+        }
+    };
+
+    template<>
+    struct TimeDiffTraits<PerfSample>
+    {
+        using Rep = int64_t;
+        inline static Rep ToRep(const PerfSample& time) { return time.time; }
+        inline static PerfSample FromRep(Rep rep) { return PerfSample(rep); }
+
+        inline static PerfSample Scale(const PerfSample& time, double scale)
+        {
+            PerfSample scaled(int64_t(double(time.time) * scale));
+            for (int i = 0; i < PerfSample::CounterNum; ++i)
+                scaled.counters[i] = int64_t(double(time.counters[i]) * scale);
+            scaled.scaled = time.scaled;
+            return scaled;
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief perf_event backend, the ticks are PerfSamples
+     *
+     * Every thread opens its own counters at its first measurement (counting in user space only,
+     * so perf_event_paranoid <= 2 is enough), and closes them at thread exit.
+     * The counters are read with rdpmc from user space on x86-64, if the kernel allows it (cap_user_rdpmc),
+     * otherwise with a read system call, which is much slower.
+     * The cycles and the instructions are one group, so they are always counted in the same time windows,
+     * and the IPC is exact. If the PMU has too few counters, the kernel multiplexes the events: then the values are
+     * scaled by the time enabled / the time running, and they are marked as estimates (see PerfSample::IsScaled).
+     * A counter which cannot be opened (no PMU in a virtual machine, not permitted) is always 0.
+     */
+    struct PerfEventBackend
+    {
+        inline static const char* GetMeasureTitle()
+        {
+            return "perf_event counters";
+        }
+
+        inline static PerfSample GetTick() noexcept
+        {
+            const ThreadCounters& threadCounters = GetThreadCounters();
+            PerfSample sample;
+            for (int i = 0; i < PerfSample::CounterNum; ++i)
+            {
+                bool scaled;
+                sample.counters[i] = ReadCounter(threadCounters.counters[i], scaled);
+                if (scaled)
+                    sample.scaled |= 1u << i;
+            }
+            timespec time;
+            clock_gettime(CLOCK_MONOTONIC, &time);
+            sample.time = int64_t(time.tv_sec) * 1000000000 + int64_t(time.tv_nsec);
+            return sample;
+        }
+
+        inline static double TimeDiffToSec(const PerfSample& time)
+        {
+            return double(time.time) * 1e-9;
+        }
+
+        /// @brief the counter could be opened in the current thread
+        inline static bool IsCounterAvailable(PerfCounter counter)
+        {
+            return GetThreadCounters().counters[int(counter)].fd >= 0;
+        }
+
+        /// @brief the counter is read from user space (rdpmc) in the current thread, without system call
+        inline static bool IsUserSpaceRead(PerfCounter counter)
+        {
+            const Counter& threadCounter = GetThreadCounters().counters[int(counter)];
+            return threadCounter.page != nullptr && threadCounter.page->cap_user_rdpmc;
+        }
+
+    private:
+        struct Counter
+        {
+            int fd = -1;
+            const perf_event_mmap_page* page = nullptr;
+        };
+
+        struct ThreadCounters
+        {
+            Counter counters[PerfSample::CounterNum];
+
+            inline ThreadCounters()
+            {
+                static const uint32_t types[PerfSample::CounterNum] =
+                    { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+                static const uint64_t configs[PerfSample::CounterNum] =
+                {
+                    PERF_COUNT_HW_CPU_CYCLES,
+                    PERF_COUNT_HW_INSTRUCTIONS,
+                    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                    PERF_COUNT_HW_CACHE_MISSES,
+                    PERF_COUNT_HW_BRANCH_MISSES,
+                };
+                // the cycles lead the group of the instructions
+                for (int i = 0; i < PerfSample::CounterNum; ++i)
+                    Open(counters[i], types[i], configs[i], i == int(PerfCounter::Instructions) ? counters[int(PerfCounter::Cycles)].fd : -1);
+            }
+
+            inline ~ThreadCounters()
+            {
+                for (Counter& counter : counters)
+                {
+                    if (counter.page != nullptr)
+                        munmap(const_cast<perf_event_mmap_page*>(counter.page), size_t(sysconf(_SC_PAGESIZE)));
+                    if (counter.fd >= 0)
+                        close(counter.fd);
+                }
+            }
+
+            // a counter out of a group (groupFd -1) can be multiplexed with the others if there are not enough PMU counters,
+            // the times enabled and running tell the share of the time it was counting
+            inline static void Open(Counter& counter, uint32_t type, uint64_t config, int groupFd)
+            {
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = type;
+                attr.config = config;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                counter.fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+                if (counter.fd < 0)
+                    return;
+                void* page = mmap(nullptr, size_t(sysconf(_SC_PAGESIZE)), PROT_READ, MAP_SHARED, counter.fd, 0);
+                if (page != MAP_FAILED)
+                    counter.page = static_cast<const perf_event_mmap_page*>(page);
+            }
+        };
+
+        inline static const ThreadCounters& GetThreadCounters()
+        {
+            static thread_local ThreadCounters threadCounters;
+            return threadCounters;
+        }
+
+        // the value of the counter, scaled up if it was multiplexed (then scaled is true)
+        inline static int64_t ReadCounter(const Counter& counter, bool& scaled) noexcept
+        {
+            scaled = false;
+            if (counter.fd < 0)
+                return 0;
+            int64_t count = 0;
+            uint64_t enabled = 0;
+            uint64_t running = 0;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+            if (counter.page != nullptr && counter.page->cap_user_rdpmc)
+            {
+                // the seqlock protocol of the mmap page, see linux/perf_event.h,
+                // the index is 0 while the event is not on the PMU, then the offset is the whole count
+                const volatile perf_event_mmap_page* page = counter.page;
+                uint32_t seq;
+                do
+                {
+                    seq = page->lock;
+                    std::atomic_signal_fence(std::memory_order_acq_rel);
+                    enabled = page->time_enabled;
+                    running = page->time_running;
+                    const uint32_t index = page->index;
+                    if (page->cap_user_time && enabled != running)
+                    {
+                        // the times are updated at the scheduling only, the time since then is computed from the tsc
+                        const uint64_t cycles = __rdtsc();
+                        const uint16_t timeShift = page->time_shift;
+                        const uint64_t timeMult = page->time_mult;
+                        const uint64_t delta = page->time_offset + (cycles >> timeShift) * timeMult
+                                             + (((cycles & ((uint64_t(1) << timeShift) - 1)) * timeMult) >> timeShift);
+                        enabled += delta;
+                        if (index != 0)
+                            running += delta;
+                    }
+                    count = page->offset;
+                    if (index != 0)
+                    {
+                        const uint32_t shift = 64 - page->pmc_width;
+                        count += int64_t(Rdpmc(index - 1) << shift) >> shift;
+                    }
+                    std::atomic_signal_fence(std::memory_order_acq_rel);
+                } while (page->lock != seq);
+            }
+            else
+#endif
+            {
+                uint64_t values[3] = {}; // the read_format: value, time enabled, time running
+                if (read(counter.fd, values, sizeof(values)) != ssize_t(sizeof(values)))
+                    return 0;
+                count = int64_t(values[0]);
+                enabled = values[1];
+                running = values[2];
+            }
+            if (running >= enabled)
+                return count;
+            scaled = true;
+            return running != 0 ? int64_t(double(count) * double(enabled) / double(running)) : 0;
+        }
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+        inline static uint64_t Rdpmc(uint32_t index) noexcept
+        {
+            uint32_t low, high;
+            __asm__ __volatile__("rdpmc" : "=a"(low), "=d"(high) : "c"(index));
+            return uint64_t(low) | (uint64_t(high) << 32);
+        }
+#endif
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the hardware counters per call after the times, cycles, instructions per cycle and the misses
+    template<>
+    struct MeasureCounterReport<PerfSample>
+    {
+        template<typename MeasureRecord>
+        inline static void Print(std::ostream& os, const std::vector<MeasureRecord*>& records)
+        {
+            using namespace std;
+
+            const size_t width = 40 + 12 + 14 + 8 + 3 * 16;
+            const std::string title = std::string(MeasureRecord::MeasureBackend::GetMeasureTitle()) + " per call";
+            const std::string pad((width - title.length()) / 2 - 1, '-');
+            os << pad << " " << title << " " << pad << (title.length() % 2 ? "-" : "") << "\n";
+
+            os  << setw(40) << "Name"
+                << setw(12) << "Calls"
+                << setw(14) << "Cycles"
+                << setw(8) << "IPC"
+                << setw(16) << "L1D misses"
+                << setw(16) << "LLC misses"
+                << setw(16) << "Branch misses"
+                << "\n";
+            os << std::string(width, '-') << std::endl;
+            bool hasScaled = false;
+            for (const MeasureRecord* measureRecord : records)
+            {
+                PerfSample total;
+                uint64_t numCall;
+                measureRecord->GetCounters(total, numCall);
+                os  << setw(40) << measureRecord->name
+                    << setw(12) << numCall;
+                if (numCall == 0)
+                {
+                    os << "\n";
+                    continue;
+                }
+                const int64_t cycles = total.Get(PerfCounter::Cycles);
+                const bool ipcScaled = total.IsScaled(PerfCounter::Cycles) || total.IsScaled(PerfCounter::Instructions);
+                os  << setw(14) << PerCall(total, PerfCounter::Cycles, numCall)
+                    << setw(8) << (cycles > 0 ? Estimate(ipcScaled) + FormatDouble(double(total.Get(PerfCounter::Instructions)) / double(cycles), 2) : "-")
+                    << setw(16) << PerCall(total, PerfCounter::L1DMisses, numCall)
+                    << setw(16) << PerCall(total, PerfCounter::LLCMisses, numCall)
+                    << setw(16) << PerCall(total, PerfCounter::BranchMisses, numCall)
+                    << "\n";
+                hasScaled = hasScaled || total.scaled != 0;
+            }
+            os << std::string(width, '-') << std::endl;
+            if (hasScaled)
+                os << "~ estimated: the kernel multiplexed the counter, it is scaled by the time enabled / the time running\n";
+        }
+
+    private:
+        // "-" if the counter is not available (or it is always 0), "~" before an estimate
+        inline static std::string PerCall(const PerfSample& total, PerfCounter counter, uint64_t numCall)
+        {
+            const int64_t value = total.Get(counter);
+            return value > 0 ? Estimate(total.IsScaled(counter)) + FormatDouble(double(value) / double(numCall), 1) : std::string("-");
+        }
+
+        inline static std::string Estimate(bool scaled)
+        {
+            return scaled ? std::string("~") : std::string();
+        }
+
+        inline static std::string FormatDouble(double value, int precision)
+        {
+            std::ostringstream ss;
+            ss << std::fixed << std::setprecision(precision) << value;
+            return ss.str();
+        }
+    };
+
+    using PerfMeasure = TMeasure<PerfEventBackend>;
+} // namespace dtree
+
+#endif // PERF_MEASURE_IS_SUPPORTED
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#if MEASURE_IS_ON && PERF_MEASURE_IS_SUPPORTED
+    #define PERF_MEASURE(NAME) \
+        static dtree::PerfMeasure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::PerfMeasure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
+    #define PERF_MEASURE_S(TITLE) \
+        static dtree::PerfMeasure::Base::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
+        dtree::PerfMeasure::Base::Scope measureScope(&measureRecord)
+    #define PERF_SAFE_MEASURE(NAME, POLICY) \
+        static dtree::PerfMeasure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::PerfMeasure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
+    #define PERF_SAFE_MEASURE_S(TITLE, POLICY) \
+        static dtree::PerfMeasure::POLICY::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
+        dtree::PerfMeasure::POLICY::Scope measureScope(&measureRecord)
+#else
+    #define PERF_MEASURE(NAME)
+    #define PERF_MEASURE_S(TITLE)
+    #define PERF_SAFE_MEASURE(NAME, POLICY)
+    #define PERF_SAFE_MEASURE_S(TITLE, POLICY)
+#endif
@@ -7,11 +7,17 @@
 #include "measure/cpp_measure.h"
 #include "measure/rdtsc_measure.h"
 #include "measure/qpc_measure.h"
+#include "measure/linux_measure.h"
+#include "measure/linux_perf_measure.h"
+#include "measure/arm64_measure.h"
 
 #ifndef DEFAULT_MEASURE_TYPE
     #define DEFAULT_MEASURE_TYPE CppMeasure
     //#define DEFAULT_MEASURE_TYPE RdtscMeasure
     //#define DEFAULT_MEASURE_TYPE QPCMeasure
+    //#define DEFAULT_MEASURE_TYPE LinuxMeasure
+    //#define DEFAULT_MEASURE_TYPE PerfMeasure
+    //#define DEFAULT_MEASURE_TYPE Arm64Measure
 #endif
 
 namespace dtree
@@ -25,43 +31,62 @@ namespace dtree
     /// @brief basic measure macro, must be placed at the beginning of a scope
     /// @param NAME is a c++ identifier
     #define MEASURE(NAME) \
-        static dtree::Measure::Base::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::Measure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::Measure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
 
     /// @brief basic measure macro, must be placed at the beginning of a scope
     /// @param TITTLE is a string literal
     #define MEASURE_S(TITLE) \
-        static dtree::Measure::Base::MeasureRecord measureRecord(TITLE); \
+        static dtree::Measure::Base::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::Measure::Base::Scope measureScope(&measureRecord)
 
     /// @brief safe measure macro, must be placed at the beginning of a scope
     /// @param NAME is a c++ identifier
-    /// @param POLICY is Base, RSafe, TSafe or TRSafe
+    /// @param POLICY is Base, RSafe, TSafe, TRSafe, Sharded, Atomic or TRSharded
     ///                RSafe: recursive safe measurement
     ///                TSafe: thread safe measurement
     ///                TRSafe: thread and recursion safe measurement
+    ///                Sharded: thread safe measurement with per-thread counters
+    ///                Atomic: thread safe measurement with atomic counters
+    ///                TRSharded: thread and recursion safe measurement with per-thread counters
     #define SAFE_MEASURE(NAME, POLICY) \
-        static dtree::Measure::POLICY::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::Measure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::Measure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
 
     /// @brief safe measure macro, must be placed at the beginning of a scope
     /// @param TITLE is a string literal
-    /// @param POLICY is Base, RSafe, TSafe or TRSafe
+    /// @param POLICY is Base, RSafe, TSafe, TRSafe, Sharded, Atomic or TRSharded
     ///                RSafe: recursive safe measurement
     ///                TSafe: thread safe measurement
     ///                TRSafe: thread and recursion safe measurement
+    ///                Sharded: thread safe measurement with per-thread counters
+    ///                Atomic: thread safe measurement with atomic counters
+    ///                TRSharded: thread and recursion safe measurement with per-thread counters
     #define SAFE_MEASURE_S(TITLE, POLICY) \
-        static dtree::Measure::POLICY::MeasureRecord measureRecord(TITLE); \
+        static dtree::Measure::POLICY::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::Measure::POLICY::Scope measureScope(&measureRecord)
 
     /// @brief safe measure macro, must be placed at the beginning of a scope
     /// @param TITLE is a string (not just a string literal, can be a dynamically generated string)
-    /// @param POLICY is Base, RSafe, TSafe or TRSafe
+    /// @param POLICY is Base, RSafe, TSafe, TRSafe, Sharded, Atomic or TRSharded
     ///                RSafe: recursive safe measurement
     ///                TSafe: thread safe measurement
     ///                TRSafe: thread and recursion safe measurement
+    ///                Sharded: thread safe measurement with per-thread counters
+    ///                Atomic: thread safe measurement with atomic counters
+    ///                TRSharded: thread and recursion safe measurement with per-thread counters
     #define SAFE_MEASURE_DYNAMIC_S(TITLE, POLICY) \
-        dtree::Measure::POLICY::Scope measureScope(dtree::Measure::TSafe::GetDynamicRecord(TITLE));
+        dtree::Measure::POLICY::Scope measureScope(dtree::Measure::POLICY::GetDynamicRecord(TITLE));
+
+    /// @brief add a work amount to the scope of a MEASURE(NAME) or SAFE_MEASURE(NAME, POLICY) macro,
+    /// the reports show the throughput (MB/s, items/s) of the record
+    /// @param NAME is the c++ identifier of the measure macro
+    #define MEASURE_BYTES(NAME, BYTES) measureScope_##NAME.AddBytes(BYTES)
+    #define MEASURE_ITEMS(NAME, ITEMS) measureScope_##NAME.AddItems(ITEMS)
+
+    /// @brief add a work amount to the scope of a MEASURE_S, SAFE_MEASURE_S or SAFE_MEASURE_DYNAMIC_S macro
+    #define MEASURE_BYTES_S(BYTES) measureScope.AddBytes(BYTES)
+    #define MEASURE_ITEMS_S(ITEMS) measureScope.AddItems(ITEMS)
 
     /// @brief print measure report, typically called at the end of program
     namespace dtree {
@@ -74,5 +99,9 @@ namespace dtree
     #define SAFE_MEASURE(NAME, POLICY)
     #define SAFE_MEASURE_S(TITLE, POLICY)
     #define SAFE_MEASURE_DYNAMIC_S(TITLE, POLICY)
+    #define MEASURE_BYTES(NAME, BYTES)
+    #define MEASURE_ITEMS(NAME, ITEMS)
+    #define MEASURE_BYTES_S(BYTES)
+    #define MEASURE_ITEMS_S(ITEMS)
     namespace dtree { inline void PrintMeasure() {} }
 #endif
@@ -8,23 +8,45 @@
 #include <vector>
 #include <mutex>
 #include <map>
+#include <unordered_map>
 #include <memory>
 #include <string>
 #include <cstring>
 #include <map>
 #include <fstream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <utility>
+#include <type_traits>
 
 #include "measure/measure_utils.h"
+#include "measure/measure_histogram.h"
+#include "measure/measure_stats.h"
+#include "measure/measure_snapshot.h"
+#include "measure/measure_cpu.h"
+#include "measure/measure_tree.h"
+#include "measure/measure_trace.h"
 
 namespace dtree
 {
     struct MeasureBackend;
+    template<typename TimeDiff> struct TimeDiffTraits;
     template<typename MeasureBackend> struct TMeasureRecord;
     template<typename MeasureRecord> struct MeasureDatabase;
     template<typename MeasureRecord> struct DynamicMeasureDatabase;
+    template<typename MeasureRecord> struct MeasureShards;
+    template<typename Slot> struct MeasureThreadSlots;
     template<typename MeasureRecord> struct MeassureRecordTSafe;
     template<typename MeasureRecord> struct MeassureRecordRSafe;
     template<typename MeasureRecord> struct MeassureRecordTRSafe;
+    template<typename MeasureRecord> struct MeasureRecordSharded;
+    template<typename MeasureRecord> struct MeasureRecordAtomic;
+    template<typename MeasureRecord> struct MeasureRecordTRSharded;
+    template<typename MeasureRecord> struct MeasureRecordHistogram;
+    template<typename MeasureRecord> struct MeasureRecordStats;
+    template<typename MeasureRecord, MeasureCpuKey Key> struct MeasureRecordCpu;
     template<typename MeasureRecord> struct TMeasureScope;
     template<typename MeasureRecord> struct MeasureScopeRSafe;
     template<typename MeasureBackend> struct TMeasure;
@@ -55,6 +77,236 @@ namespace dtree
         }
     };
 
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief converts a TimeDiff to a plain tick count and back
+    /// the backends return integer ticks, except the CppBackend, which returns std::chrono types
+    /// a multi-value TimeDiff (see PerfSample) specializes it too, its Rep is the time part
+    template<typename TimeDiff>
+    struct TimeDiffTraits
+    {
+        using Rep = TimeDiff;
+        inline static Rep ToRep(TimeDiff time) { return time; }
+        inline static TimeDiff FromRep(Rep rep) { return rep; }
+        inline static TimeDiff Scale(TimeDiff time, double scale) { return TimeDiff(double(time) * scale); }
+    };
+
+    template<typename InRep, typename Period>
+    struct TimeDiffTraits<std::chrono::duration<InRep, Period>>
+    {
+        using Rep = InRep;
+        inline static Rep ToRep(std::chrono::duration<InRep, Period> time) { return time.count(); }
+        inline static std::chrono::duration<InRep, Period> FromRep(Rep rep) { return std::chrono::duration<InRep, Period>(rep); }
+        inline static std::chrono::duration<InRep, Period> Scale(std::chrono::duration<InRep, Period> time, double scale)
+            { return FromRep(Rep(double(time.count()) * scale)); }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the additional report of the records of a multi-value TimeDiff (see PerfSample),
+    /// printed by MeasureDatabase::PrintReport after the times, nothing for the plain ticks
+    template<typename TimeDiff>
+    struct MeasureCounterReport
+    {
+        template<typename MeasureRecord>
+        inline static void Print(std::ostream&, const std::vector<MeasureRecord*>&) {}
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the calibrated cost of an empty scope of a MeasureRecord type in ticks, see TMeasure::Calibrate
+    /// the reports subtract it from the totals and averages
+    struct MeasureOverhead
+    {
+        std::atomic<double> ticks;      // average ticks of an empty scope, 0 if it is not calibrated
+        std::atomic<double> noiseTicks; // spread of the calibration rounds
+
+        template<typename MeasureRecord>
+        static MeasureOverhead* Get()
+        {
+            static MeasureOverhead overhead; // zero initialized
+            return &overhead;
+        }
+
+        // a copy of the RecordOps of a wrapped record, with the own overhead of the wrapper record type
+        template<typename MeasureRecord, typename RecordOps>
+        static RecordOps WithOverhead(RecordOps recordOps)
+        {
+            recordOps.overhead = Get<MeasureRecord>();
+            return recordOps;
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief the name of a MeasureRecord and its hash (the id of the name)
+     *
+     * A name from a string literal (see MEASURE_NAME_LITERAL) is hashed at compile time,
+     * and the record stores only the pointer of the literal.
+     * Any other name is hashed at the construction of the record, and the record stores a copy of it.
+     */
+    struct MeasureName
+    {
+        // a name with static storage duration, it is not copied
+        constexpr MeasureName(const char* staticName, uint64_t id)
+            : str(staticName), id(id), isStatic(true) {}
+
+        // a temporary name, it is copied
+        inline MeasureName(const char* name)
+            : str(name), isStatic(false)
+        {
+            size_t length;
+            id = MeasureUtils::HashName(name, length);
+        }
+
+        const char* str;
+        uint64_t id;
+        bool isStatic;
+    };
+
+    /// @brief a MeasureName of a string literal, hashed at compile time
+    #define MEASURE_NAME_LITERAL(LITERAL) \
+        dtree::MeasureName("" LITERAL, std::integral_constant<uint64_t, dtree::MeasureUtils::ConstHashName("" LITERAL)>::value)
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief the runtime switch of all the scopes, and the default sampling of the new records
+     *
+     * MEASURE_IS_ON compiles the scopes in or out, this switch turns the compiled in scopes on or off at runtime.
+     * A switched off scope doesn't read the clock and doesn't touch its record, it costs one well predicted branch.
+     * Every record has its own sample period too, see TMeasureRecord::SetSamplePeriod.
+     */
+    struct MeasureControl
+    {
+        inline static void SetEnabled(bool enabled)
+        {
+            Enabled().store(enabled, std::memory_order_relaxed);
+        }
+
+        inline static bool IsEnabled()
+        {
+            return Enabled().load(std::memory_order_relaxed);
+        }
+
+        /// @brief the sample period of the records constructed after this call
+        /// 0: switched off, 1: every call is measured (default), N: 1 in N calls is measured
+        inline static void SetDefaultSamplePeriod(uint32_t period)
+        {
+            DefaultSamplePeriod().store(period, std::memory_order_relaxed);
+        }
+
+        inline static uint32_t GetDefaultSamplePeriod()
+        {
+            return DefaultSamplePeriod().load(std::memory_order_relaxed);
+        }
+
+    private:
+        // constant initialized, so there is no initialization guard on the hot path
+        inline static std::atomic<bool>& Enabled()
+        {
+            static std::atomic<bool> enabled(true);
+            return enabled;
+        }
+
+        inline static std::atomic<uint32_t>& DefaultSamplePeriod()
+        {
+            static std::atomic<uint32_t> period(1);
+            return period;
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief per-thread slots of the records, e.g. the sampling state or the stats of the Sharded policies
+     *
+     * The same layout as MeasureShards for any slot type: every thread owns a block of chunks, and every record
+     * owns a slot index, the slot of a record is at the same index in every block. A chunk is allocated
+     * by the first use of its slots in a thread. The blocks are never freed (see MeasureUtils::ThreadBlockList),
+     * so the readers can visit the slots of all the threads any time. There is one instance per slot type,
+     * only the owner thread writes the hot fields of its slots, the slot type decides how the readers access them.
+     */
+    template<typename Slot>
+    struct MeasureThreadSlots
+    {
+    public:
+        static constexpr uint32_t ChunkSize = 64;     // slots per chunk
+        static constexpr uint32_t MaxChunks = 1024;   // max number of records: ChunkSize * MaxChunks
+
+        // get a new slot index for a record
+        static uint32_t AllocateIndex();
+
+        // the slot of the current thread
+        inline static Slot& ThreadSlot(uint32_t index)
+        {
+            static thread_local ThreadHandle handle;
+            Chunk* chunk = handle.block->chunks[index / ChunkSize].load(std::memory_order_relaxed);
+            if (chunk == nullptr)
+                chunk = AddChunk(handle.block, index / ChunkSize);
+            return chunk->slots[index % ChunkSize];
+        }
+
+        // call the function with the slot of every thread which has used the index
+        template<typename Function>
+        static void ForEach(uint32_t index, Function function)
+        {
+            for (ThreadBlock* block = Instance()->threadBlocks.Head(); block; block = block->next)
+            {
+                Chunk* chunk = block->chunks[index / ChunkSize].load(std::memory_order_acquire);
+                if (chunk != nullptr)
+                    function(chunk->slots[index % ChunkSize]);
+            }
+        }
+
+    private:
+        // the padding keeps the slots of different threads on different cache lines
+        struct Chunk
+        {
+            char paddingBefore[MEASURE_CACHE_LINE_SIZE];
+            Slot slots[ChunkSize];
+            char paddingAfter[MEASURE_CACHE_LINE_SIZE];
+        };
+
+        struct ThreadBlock
+        {
+            std::atomic<Chunk*> chunks[MaxChunks];
+            std::atomic<bool> inUse;
+            ThreadBlock* next;
+        };
+
+        // acquire a ThreadBlock for the current thread, and release it at thread exit
+        struct ThreadHandle
+        {
+            ThreadHandle();
+            ~ThreadHandle();
+            ThreadBlock* block;
+        };
+
+        static Chunk* AddChunk(ThreadBlock* block, uint32_t chunkIndex);
+
+        static MeasureThreadSlots<Slot>* Instance()
+        {
+            static MeasureThreadSlots<Slot> instance;
+            return &instance;
+        }
+
+        MeasureUtils::ThreadBlockList<ThreadBlock> threadBlocks;
+        std::atomic<uint32_t> indexCount;
+    };
+
+    /// @brief the sampling state of a record in a thread (see TMeasureRecord::IsSampled), zero initialized
+    struct MeasureSampleSlot
+    {
+        uint32_t countdown;                     // the calls until the next measured one, used only by the owner thread
+        std::atomic<uint64_t> skippedCalls;     // written only by the owner thread
+        std::atomic<uint64_t> resetCalls;       // skippedCalls at the last Reset(), written only by the reset
+    };
+
+    /// @brief the min/max/variance of a record in a thread (see MeasureRecordStats),
+    /// the owner thread takes the lock on every call, but only the readers contend for it
+    template<typename Stats>
+    struct MeasureStatsSlot
+    {
+        Stats stats;
+        MeasureUtils::SpinLock lock;
+    };
+
     ///////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief a MeasureRecord store the total time and number of calls
     template <typename InMeasureBackend>
@@ -64,36 +316,330 @@ namespace dtree
         using MeasureBackend = InMeasureBackend;
         using TimePoint = decltype(MeasureBackend::GetTick());
         using TimeDiff = decltype(TimePoint() - TimePoint());
+        using TimeDiffRep = typename TimeDiffTraits<TimeDiff>::Rep;
         using Database = MeasureDatabase<TMeasureRecord<MeasureBackend>>;
+        using Shards = MeasureShards<TMeasureRecord<MeasureBackend>>;
+        using Tree = MeasureTree<TMeasureRecord<MeasureBackend>>;
+        using Trace = MeasureTrace<TMeasureRecord<MeasureBackend>>;
+
+        using Histogram = MeasureHistogram;
+        using Stats = MeasureStats;
+        using CpuBreakdown = MeasureCpuBreakdown;
+
+        // not threadsafe, the wrappers of the thread safe policies override it
+        static constexpr bool IsThreadSafe = false;
+        // the counters are not per-thread, the Sharded wrapper overrides it
+        static constexpr bool IsSharded = false;
+
+        /**
+         * @brief the cold functions of a MeasureRecord type
+         *
+         * Some policies don't store the counters in totalTime and numCall (see Sharded, Atomic),
+         * and some of them have a histogram, min/max/variance or a breakdown by processor. The MeasureDatabase only sees the base MeasureRecord,
+         * so the policies provide these functions. They are called only by the reports and ResetAll,
+         * never on the hot path, so the records still don't need any virtual function.
+         */
+        struct RecordOps
+        {
+            void (*getCounters)(const TMeasureRecord* record, TimeDiff& totalTime, uint64_t& numCall);
+            void (*resetCounters)(TMeasureRecord* record);
+            const Histogram* (*getHistogram)(const TMeasureRecord* record); // nullptr if there is no histogram
+            void (*getStats)(const TMeasureRecord* record, Stats& stats);   // nullptr if there is no stats
+            const CpuBreakdown* (*getCpuBreakdown)(const TMeasureRecord* record); // nullptr if there is no breakdown
+            MeasureOverhead* overhead;                                      // per record type
+            void (*getWork)(const TMeasureRecord* record, uint64_t& bytes, uint64_t& items); // nullptr if it is in the record
+        };
 
-        inline TMeasureRecord(const char* name, const bool autoRegister = true)
-            : name(name)
+        inline TMeasureRecord(MeasureName inName, const bool autoRegister = true, const RecordOps* recordOps = GetRecordOps())
+            : nameId(inName.id)
             , totalTime(0)
             , numCall(0)
+            , recordOps(recordOps)
+            , samplePeriod(MeasureControl::GetDefaultSamplePeriod())
+            , sampleIndex(NoSampleIndex)
+            , workBytes(0)
+            , workItems(0)
         {
+            if (!inName.isStatic)
+                nameStorage = inName.str;
+            name = inName.isStatic ? inName.str : nameStorage.c_str();
             if (autoRegister)
                 Database::AddRecord(this);
         }
 
+        // the name may point into the record
+        TMeasureRecord(const TMeasureRecord&) = delete;
+        TMeasureRecord& operator=(const TMeasureRecord&) = delete;
+
         inline TimePoint Now() const
         {
             return MeasureBackend::GetTick();
         }
 
+        /// @brief true if the current call has to be measured, called by the scopes before the clock is read
+        /// false if the scopes are switched off (see MeasureControl), or the record is switched off or skips this call
+        inline bool IsSampled()
+        {
+            if (!MeasureControl::IsEnabled())
+                return false;
+            const uint32_t period = samplePeriod.load(std::memory_order_relaxed);
+            return period == 1 || (period != 0 && NextSample(period));
+        }
+
+        /// @brief 0: the record is switched off, 1: every call is measured, N: 1 in N calls is measured
+        /// the reports scale the counters of a sampled record up to the estimated number of calls and total time
+        inline void SetSamplePeriod(uint32_t period)
+        {
+            samplePeriod.store(period, std::memory_order_relaxed);
+        }
+
+        inline uint32_t GetSamplePeriod() const
+        {
+            return samplePeriod.load(std::memory_order_relaxed);
+        }
+
+        inline void SetEnabled(bool enabled)
+        {
+            SetSamplePeriod(enabled ? 1 : 0);
+        }
+
+        inline bool IsEnabled() const
+        {
+            return GetSamplePeriod() != 0;
+        }
+
+        // both the scopes and the record are switched on, the sampling is not considered
+        // (used by the tree and trace scopes, they measure every call)
+        inline bool IsActive() const
+        {
+            return MeasureControl::IsEnabled() && IsEnabled();
+        }
+
         inline void StopMeasure(TimePoint start)
         {
-            totalTime += MeasureBackend::GetTick() - start;
+            AddTime(MeasureBackend::GetTick() - start);
+        }
+
+        // add one finished measurement
+        inline void AddTime(TimeDiff time)
+        {
+            totalTime += time;
             numCall++;
         }
 
+        /// @brief total time and number of calls together, the counters of the Sharded and Atomic policies are included
+        /// if some calls were skipped by the sampling, these are the estimated values of all the calls:
+        /// the skipped calls are counted, and the total time is scaled by the average of the measured calls
+        inline void GetCounters(TimeDiff& outTotalTime, uint64_t& outNumCall) const
+        {
+            recordOps->getCounters(this, outTotalTime, outNumCall);
+            const uint64_t skipped = GetSkippedCalls();
+            if (skipped != 0 && outNumCall != 0)
+            {
+                outTotalTime = TimeDiffTraits<TimeDiff>::Scale(outTotalTime, double(outNumCall + skipped) / double(outNumCall));
+                outNumCall += skipped;
+            }
+        }
+
+        /// @brief add the work amount of a call (see the AddBytes and AddItems of the scopes)
+        /// it is a relaxed atomic read-modify-write, so it is thread safe with every policy,
+        /// and it costs nothing for the scopes which don't report a work amount.
+        /// The sharded policies add it to the slot of the thread instead (see MeasureShards::AddWork)
+        inline void AddWork(uint64_t bytes, uint64_t items)
+        {
+            if (bytes != 0)
+                workBytes.fetch_add(bytes, std::memory_order_relaxed);
+            if (items != 0)
+                workItems.fetch_add(items, std::memory_order_relaxed);
+        }
+
+        /// @brief the total work amount of the calls, the reports show the throughput (bytes/s, items/s) by it
+        /// only the measured calls report work, so it is scaled up by the sampling like the total time (see GetCounters)
+        inline void GetWork(uint64_t& outBytes, uint64_t& outItems) const
+        {
+            if (recordOps->getWork)
+                recordOps->getWork(this, outBytes, outItems);
+            else
+            {
+                outBytes = workBytes.load(std::memory_order_relaxed);
+                outItems = workItems.load(std::memory_order_relaxed);
+            }
+            const uint64_t skipped = GetSkippedCalls();
+            if (skipped == 0 || (outBytes == 0 && outItems == 0))
+                return;
+            TimeDiff time;
+            uint64_t measuredCalls;
+            recordOps->getCounters(this, time, measuredCalls);
+            if (measuredCalls == 0)
+                return;
+            const double scale = double(measuredCalls + skipped) / double(measuredCalls);
+            outBytes = uint64_t(double(outBytes) * scale);
+            outItems = uint64_t(double(outItems) * scale);
+        }
+
+        // the number of calls skipped by the sampling, they are included in GetCounters
+        inline uint64_t GetSkippedCalls() const
+        {
+            const uint32_t index = sampleIndex.load(std::memory_order_acquire);
+            uint64_t skipped = 0;
+            if (index != NoSampleIndex)
+            {
+                SampleSlots::ForEach(index, [&skipped](const MeasureSampleSlot& slot)
+                {
+                    skipped += slot.skippedCalls.load(std::memory_order_relaxed) - slot.resetCalls.load(std::memory_order_relaxed);
+                });
+            }
+            return skipped;
+        }
+
+        inline TimeDiff GetTotalTime() const
+        {
+            TimeDiff time;
+            uint64_t calls;
+            GetCounters(time, calls);
+            return time;
+        }
+
+        inline uint64_t GetNumCall() const
+        {
+            TimeDiff time;
+            uint64_t calls;
+            GetCounters(time, calls);
+            return calls;
+        }
+
         inline double GetTotalSec() const
         {
-            return MeasureBackend::TimeDiffToSec(totalTime);
+            return MeasureBackend::TimeDiffToSec(GetTotalTime());
+        }
+
+        // convert raw ticks (e.g. the values of the histogram) to seconds
+        inline static double TicksToSec(uint64_t ticks)
+        {
+            return MeasureBackend::TimeDiffToSec(TimeDiffTraits<TimeDiff>::FromRep(TimeDiffRep(ticks)));
+        }
+
+        // the histogram of the durations in ticks, nullptr if the policy has no histogram
+        inline const Histogram* GetHistogram() const
+        {
+            return recordOps->getHistogram ? recordOps->getHistogram(this) : nullptr;
+        }
+
+        // the calibrated overhead of an empty scope of this record type in ticks, 0 if it is not calibrated
+        inline double GetOverheadTicks() const
+        {
+            return recordOps->overhead->ticks.load(std::memory_order_relaxed);
+        }
+
+        inline double GetOverheadNoiseTicks() const
+        {
+            return recordOps->overhead->noiseTicks.load(std::memory_order_relaxed);
+        }
+
+        /// @brief the total and average time without the calibrated overhead of the calls, in seconds, at least 0
+        /// @param withinNoise is set to true if the average is not distinguishable from the overhead of an empty scope
+        /// @return false if the record type is not calibrated, see TMeasure::Calibrate
+        inline bool GetNetTime(double totalSec, uint64_t calls, double& netTotalSec, double& netAverageSec, bool& withinNoise) const
+        {
+            return MeasureUtils::NetTime(totalSec, calls, GetOverheadTicks(), GetOverheadNoiseTicks(), TicksToSec(1),
+                                         netTotalSec, netAverageSec, withinNoise);
+        }
+
+        // copy of the min/max/variance, returns false if the policy has no stats
+        inline bool GetStats(Stats& stats) const
+        {
+            if (!recordOps->getStats)
+                return false;
+            recordOps->getStats(this, stats);
+            return true;
+        }
+
+        // the calls and ticks per processor or NUMA node, nullptr if the policy has no breakdown
+        inline const CpuBreakdown* GetCpuBreakdown() const
+        {
+            return recordOps->getCpuBreakdown ? recordOps->getCpuBreakdown(this) : nullptr;
+        }
+
+        // set numCall and totalTime to 0
+        inline void Reset()
+        {
+            recordOps->resetCounters(this);
+            const uint32_t index = sampleIndex.load(std::memory_order_acquire);
+            if (index != NoSampleIndex)
+            {
+                SampleSlots::ForEach(index, [](MeasureSampleSlot& slot)
+                {
+                    slot.resetCalls.store(slot.skippedCalls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                });
+            }
+            workBytes.store(0, std::memory_order_relaxed);
+            workItems.store(0, std::memory_order_relaxed);
+        }
+
+        static const RecordOps* GetRecordOps()
+        {
+            static const RecordOps recordOps = { &GetFieldCounters, &ResetFieldCounters, nullptr, nullptr, nullptr,
+                MeasureOverhead::Get<TMeasureRecord>(), nullptr };
+            return &recordOps;
         }
 
-        std::string name;
+        const char* name;
+        uint64_t nameId;        // the hash of the name, see MeasureName
         TimeDiff totalTime;
         uint64_t numCall;
+        const RecordOps* recordOps;
+
+    private:
+        using SampleSlots = MeasureThreadSlots<MeasureSampleSlot>;
+        static constexpr uint32_t NoSampleIndex = UINT32_MAX;
+
+        // the countdown and the skipped calls are per thread (see MeasureSampleSlot), so every thread measures
+        // 1 in N of its own calls, without writing a shared cache line. The slot is allocated by the first sampled call.
+        std::atomic<uint32_t> samplePeriod;
+        std::atomic<uint32_t> sampleIndex;
+
+        // the work amount reported by the scopes, it is not on the hot path of the counters
+        std::atomic<uint64_t> workBytes;
+        std::atomic<uint64_t> workItems;
+
+        std::string nameStorage; // the copy of a not static name
+
+        // the slow path of IsSampled, only if the record is sampled
+        inline bool NextSample(uint32_t period)
+        {
+            uint32_t index = sampleIndex.load(std::memory_order_acquire);
+            if (index == NoSampleIndex)
+                index = AllocateSampleIndex();
+            MeasureSampleSlot& slot = SampleSlots::ThreadSlot(index);
+            if (slot.countdown > 1 && slot.countdown <= period)
+            {
+                --slot.countdown;
+                slot.skippedCalls.store(slot.skippedCalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+            slot.countdown = period;
+            return true;
+        }
+
+        // the first sampled call of the record, the index of a concurrent loser thread is not reused
+        uint32_t AllocateSampleIndex()
+        {
+            uint32_t index = NoSampleIndex;
+            sampleIndex.compare_exchange_strong(index, SampleSlots::AllocateIndex(), std::memory_order_acq_rel);
+            return sampleIndex.load(std::memory_order_acquire);
+        }
+
+        static void GetFieldCounters(const TMeasureRecord* record, TimeDiff& totalTime, uint64_t& numCall)
+        {
+            totalTime = record->totalTime;
+            numCall = record->numCall;
+        }
+
+        static void ResetFieldCounters(TMeasureRecord* record)
+        {
+            record->numCall = 0;
+            record->totalTime = {};
+        }
     };
 
     ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -116,9 +662,12 @@ namespace dtree
         // add MeasureRecord or MeasureRecordSafe
         static void AddRecord(MeasureRecord* record);
 
-        // find MeasureRecord by name, slow
+        // find MeasureRecord by name, by the hash index of the names
         static MeasureRecord* FindMeasureRecord(const char* name);
 
+        // find MeasureRecord by the hash of its name (see MeasureName)
+        static MeasureRecord* FindMeasureRecordById(uint64_t nameId);
+
         // print report at the end of program in human readable format
         static void PrintReport(std::ostream& os = std::cout);
         static void PrintReport(std::string fileName);
@@ -126,7 +675,16 @@ namespace dtree
         // set all numCall and totalClock to 0. this can be useful if you want to print more than one report
         static void ResetAll();
 
-        // get measure records, it's usefull if you want a custom report
+        // set the sample period of all registered records, see TMeasureRecord::SetSamplePeriod
+        static void SetSamplePeriodAll(uint32_t period);
+
+        /// @brief a consistent copy of the counters of all records, see MeasureSnapshot
+        /// the mutex is held only while the list of the records is copied, the measured threads are not stopped,
+        /// the reports are rendered from it. The counters are read again if a ResetAll runs meanwhile,
+        /// so all of them are from the same reset epoch.
+        static MeasureSnapshot Snapshot();
+
+        // get measure records, it's usefull if you want a custom report (see Snapshot for a copy of the counters)
         static std::vector<MeasureRecord*>& GetRecords()    { return Instance()->records; }
 
         // you must use this if you work with the measure records in a multithread environment
@@ -140,8 +698,62 @@ namespace dtree
             return &instance;
         }
 
+        // the records are never removed, so the copy of the list can be used without the mutex
+        static std::vector<MeasureRecord*> CopyRecords();
+
         std::vector<MeasureRecord*> records;
+        std::unordered_multimap<uint64_t, MeasureRecord*> nameIndex;
         std::mutex mutex;
+        std::atomic<uint64_t> resetEpoch{ 0 };  // written under the mutex
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a slab of objects, the objects are never moved and they are freed only with the arena
+     *
+     * The objects are constructed into chunks of ChunkSize contiguous objects (aligned to alignof(T),
+     * even if it is bigger than the alignment of the operator new), so iterating over them doesn't chase
+     * separate heap allocations. Not thread safe, the caller is responsible for the locking.
+     */
+    template<typename T>
+    class MeasureArena
+    {
+    public:
+        static constexpr size_t ChunkSize = 64;
+
+        MeasureArena() = default;
+        MeasureArena(const MeasureArena&) = delete;
+        MeasureArena& operator=(const MeasureArena&) = delete;
+
+        inline ~MeasureArena()
+        {
+            for (size_t i = count; i > 0; --i)
+                (*this)[i - 1].~T();
+        }
+
+        template<typename... Args>
+        inline T* Create(Args&&... args)
+        {
+            if (count == chunks.size() * ChunkSize)
+                chunks.emplace_back(new char[ChunkSize * sizeof(T) + alignof(T)]);
+            T* object = new (Address(count)) T(std::forward<Args>(args)...);
+            ++count;
+            return object;
+        }
+
+        inline size_t Size() const              { return count; }
+        inline T& operator[](size_t index)      { return *static_cast<T*>(Address(index)); }
+
+    private:
+        inline void* Address(size_t index) const
+        {
+            char* chunk = chunks[index / ChunkSize].get();
+            chunk += (alignof(T) - reinterpret_cast<uintptr_t>(chunk) % alignof(T)) % alignof(T);
+            return chunk + (index % ChunkSize) * sizeof(T);
+        }
+
+        std::vector<std::unique_ptr<char[]>> chunks;
+        size_t count = 0;
     };
 
     ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -155,6 +767,13 @@ namespace dtree
      * because the static records are stored in static variables,
      * but the dynamic records are created at runtime,
      * so they need to be stored in a container.
+     *
+     * The container is an open addressing hash table of the name hashes (see MeasureUtils::HashName).
+     * The lookup of an existing name is lock free: the entries are immutable and never freed,
+     * and a growing table is copied into a new one, the old tables are kept for the concurrent readers.
+     * Every thread has a small front cache of the last found entries, so a repeated lookup
+     * doesn't touch the shared table at all. Only the insertion of a new name takes the mutex.
+     * The records are allocated in an arena, so they are contiguous, the names are in the entries.
      */
     template<typename InMeasureRecord>
     struct DynamicMeasureDatabase
@@ -166,143 +785,1117 @@ namespace dtree
         // measures with dynamic title
         static MeasureRecord* GetOrAddDynamicRecord(const char* name);
 
+        // the same with a precomputed hash and length (see MeasureUtils::HashName)
+        static MeasureRecord* GetOrAddDynamicRecord(const char* name, size_t length, uint64_t hash);
+
     private:
+        static constexpr size_t InitialTableSize = 64;   // power of 2, the table is grown at half load
+        static constexpr size_t FrontCacheSize = 16;     // entries per thread
+
+        struct Entry
+        {
+            uint64_t hash;
+            std::string name;
+            MeasureRecord* record;
+
+            inline bool Matches(const char* inName, size_t length, uint64_t inHash) const
+            {
+                return hash == inHash && name.size() == length && memcmp(name.data(), inName, length) == 0;
+            }
+        };
+
+        struct Table
+        {
+            explicit Table(size_t size) : mask(size - 1), buckets(new std::atomic<Entry*>[size])
+            {
+                for (size_t i = 0; i < size; ++i)
+                    buckets[i].store(nullptr, std::memory_order_relaxed);
+            }
+
+            // lock free
+            inline Entry* Find(const char* name, size_t length, uint64_t hash) const
+            {
+                for (size_t i = size_t(hash) & mask;; i = (i + 1) & mask)
+                {
+                    Entry* entry = buckets[i].load(std::memory_order_acquire);
+                    if (entry == nullptr || entry->Matches(name, length, hash))
+                        return entry;
+                }
+            }
+
+            // the caller holds the mutex
+            inline void Insert(Entry* entry)
+            {
+                size_t i = size_t(entry->hash) & mask;
+                while (buckets[i].load(std::memory_order_relaxed) != nullptr)
+                    i = (i + 1) & mask;
+                buckets[i].store(entry, std::memory_order_release);
+            }
+
+            const size_t mask;
+            std::unique_ptr<std::atomic<Entry*>[]> buckets;
+        };
+
+        DynamicMeasureDatabase()
+        {
+            tables.emplace_back(new Table(InitialTableSize));
+            table.store(tables.back().get(), std::memory_order_release);
+        }
+
         static DynamicMeasureDatabase<MeasureRecord>* Instance()
         {
             static DynamicMeasureDatabase<MeasureRecord> instance;
             return &instance;
         }
 
-        std::map<std::string, std::unique_ptr<MeasureRecord>> dynamicRecords;
+        // the slow path, under the mutex
+        static Entry* AddDynamicRecord(const char* name, size_t length, uint64_t hash);
+
+        std::atomic<Table*> table;
+        std::vector<std::unique_ptr<Table>> tables;     // every generation, the readers may still use an old one
+        std::vector<std::unique_ptr<Entry>> entries;
+        MeasureArena<MeasureRecord> records;
         std::mutex mutex;
     };
 
     ///////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief this class is wrapper around a MeassureRecord, it adds thread safety to it
-    template <typename MeasureRecord>
-    struct MeassureRecordTSafe : public MeasureRecord
+    /**
+     * @brief per-thread counters of the Sharded policy
+     *
+     * For each MeasureRecord type (so for each MeasureBackend) there is a MeasureShards instance.
+     * Every thread owns a ThreadShards block, and every sharded MeasureRecord owns a slot index,
+     * the slot of a record is at the same index in every block.
+     * Only the owner thread writes its slots, so the hot path is relaxed loads and stores,
+     * without mutex and without atomic read-modify-write (lock prefix).
+     * The number of calls of a slot is also the sequence of a seqlock: it is odd while the owner writes the slot,
+     * so the readers get the time and the number of calls as a consistent pair without stopping the owner.
+     * The blocks are never freed: when a thread exits its block is released,
+     * and the next new thread reuses it, so the counters of the finished threads are kept.
+     * The readers (reports, ResetAll) merge the slots of all blocks on demand.
+     */
+    template<typename InMeasureRecord>
+    struct MeasureShards
     {
     public:
-        using MeasureRecord::MeasureRecord;
+        using MeasureRecord = InMeasureRecord;
+        using TimeDiffRep = typename MeasureRecord::TimeDiffRep;
 
-        inline void StopMeasure(typename MeasureRecord::TimePoint start)
+        static constexpr uint32_t ChunkSize = 64;     // slots per chunk
+        static constexpr uint32_t MaxChunks = 1024;   // max number of sharded records: ChunkSize * MaxChunks
+
+        // get a new slot index for a sharded record
+        static uint32_t AllocateIndex();
+
+        // add one call to the slot of the current thread, lock free
+        // (the fences are free on x86, they only stop the compiler to reorder the stores)
+        inline static void Add(uint32_t index, TimeDiffRep time)
         {
-            const std::lock_guard<std::mutex> lock(mutex);
-            MeasureRecord::StopMeasure(start);
+            Slot& slot = ThreadChunk(index)->slots[index % ChunkSize];
+            const uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.totalTime.store(slot.totalTime.load(std::memory_order_relaxed) + time, std::memory_order_relaxed);
+            slot.sequence.store(sequence + 2, std::memory_order_release);
         }
 
-        std::mutex mutex;
-    };
+        // add a work amount to the slot of the current thread (see TMeasureRecord::AddWork), lock free
+        inline static void AddWork(uint32_t index, uint64_t bytes, uint64_t items)
+        {
+            WorkSlot& slot = ThreadChunk(index)->workSlots[index % ChunkSize];
+            if (bytes != 0)
+                slot.bytes.store(slot.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+            if (items != 0)
+                slot.items.store(slot.items.load(std::memory_order_relaxed) + items, std::memory_order_relaxed);
+        }
 
-    ///////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief this class is wrapper around a MeassureRecord, it adds recursion safety to it
-    template <typename MeasureRecord>
-    struct MeasureRecordRSafe : public MeasureRecord
-    {
-        using MeasureRecord::MeasureRecord;
+        // merge the slots of all threads
+        static void Sum(uint32_t index, TimeDiffRep& totalTime, uint64_t& numCall);
+
+        // merge the work amounts of all threads
+        static void SumWork(uint32_t index, uint64_t& bytes, uint64_t& items);
+
+        // set the merged counters to 0, the owner threads are not disturbed
+        static void Reset(uint32_t index);
+
+    private:
+        // the hot counters, written by the owner thread
+        struct Slot
+        {
+            std::atomic<TimeDiffRep> totalTime;
+            std::atomic<uint64_t> sequence;     // 2 * the number of calls, odd while a call is being added
+        };
+
+        // the consistent counters of a slot, it retries while the owner thread writes it
+        static void ReadSlot(const Slot& slot, TimeDiffRep& totalTime, uint64_t& numCall);
+
+        // the counters at the last Reset(), written only by the reset, the readers get them as one set
+        struct ResetSlot
+        {
+            MeasureUtils::SeqLock lock;
+            std::atomic<TimeDiffRep> resetTime;
+            std::atomic<uint64_t> resetCall;
+            std::atomic<uint64_t> resetBytes;
+            std::atomic<uint64_t> resetItems;
+        };
+
+        // a copy of a ResetSlot, read before the counters, so the counters are never below it
+        struct ResetCounters
+        {
+            TimeDiffRep time;
+            uint64_t calls;
+            uint64_t bytes;
+            uint64_t items;
+        };
+
+        static ResetCounters ReadResetSlot(const ResetSlot& resetSlot);
+
+        // the work amounts, written by the owner thread
+        struct WorkSlot
+        {
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> items;
+        };
+
+        // the hot slots are contiguous, 4 records per cache line, the cold reset and work slots are after them,
+        // so the owner thread and the merges of the counters touch only a part of the memory.
+        // the padding keeps the slots of different threads on different cache lines
+        struct Chunk
+        {
+            char paddingBefore[MEASURE_CACHE_LINE_SIZE];
+            Slot slots[ChunkSize];
+            ResetSlot resetSlots[ChunkSize];
+            WorkSlot workSlots[ChunkSize];
+            char paddingAfter[MEASURE_CACHE_LINE_SIZE];
+        };
+
+        struct ThreadShards
+        {
+            std::atomic<Chunk*> chunks[MaxChunks];
+            std::atomic<bool> inUse;
+            ThreadShards* next;
+        };
+
+        // acquire a ThreadShards block for the current thread, and release it at thread exit
+        struct ThreadHandle
+        {
+            ThreadHandle();
+            ~ThreadHandle();
+            ThreadShards* shards;
+        };
+
+        // the chunk of the slot in the current thread
+        inline static Chunk* ThreadChunk(uint32_t index)
+        {
+            static thread_local ThreadHandle handle;
+            ThreadShards* shards = handle.shards;
+            Chunk* chunk = shards->chunks[index / ChunkSize].load(std::memory_order_relaxed);
+            if (chunk == nullptr)
+                chunk = AddChunk(shards, index / ChunkSize);
+            return chunk;
+        }
+
+        static Chunk* AddChunk(ThreadShards* shards, uint32_t chunkIndex);
+
+        static MeasureShards<MeasureRecord>* Instance()
+        {
+            static MeasureShards<MeasureRecord> instance;
+            return &instance;
+        }
+
+        MeasureUtils::ThreadBlockList<ThreadShards> threadShards;
+        std::atomic<uint32_t> indexCount;
+        std::mutex resetMutex;                  // serializes the writers of the reset slots
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord, it adds thread safety to it
+    template <typename MeasureRecord>
+    struct MeassureRecordTSafe : public MeasureRecord
+    {
+    public:
+        static constexpr bool IsThreadSafe = true;
+
+        inline MeassureRecordTSafe(MeasureName name, const bool autoRegister = true,
+                                   const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecord(name, false, recordOps)
+        {
+            // the most derived layer registers the record, once all its members are initialized
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        inline void StopMeasure(typename MeasureRecord::TimePoint start)
+        {
+            AddTime(MeasureRecord::MeasureBackend::GetTick() - start);
+        }
+
+        inline void AddTime(typename MeasureRecord::TimeDiff time)
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            MeasureRecord::AddTime(time);
+        }
+
+        // the same as the wrapped record, with its own calibrated overhead,
+        // the counters are read under the mutex, so the time and the number of calls are a consistent pair
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps = []()
+            {
+                typename MeasureRecord::RecordOps ops = *MeasureRecord::GetRecordOps();
+                ops.getCounters = &GetLockedCounters;
+                ops.overhead = MeasureOverhead::Get<MeassureRecordTSafe>();
+                return ops;
+            }();
+            return &recordOps;
+        }
+
+        std::mutex mutex;
+
+    private:
+        static void GetLockedCounters(const typename MeasureRecord::Database::MeasureRecord* record,
+                                      typename MeasureRecord::TimeDiff& totalTime, uint64_t& numCall)
+        {
+            std::mutex& recordMutex = const_cast<MeassureRecordTSafe*>(static_cast<const MeassureRecordTSafe*>(record))->mutex;
+            const std::lock_guard<std::mutex> lock(recordMutex);
+            MeasureRecord::GetRecordOps()->getCounters(record, totalTime, numCall);
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord, it adds recursion safety to it
+    template <typename MeasureRecord>
+    struct MeasureRecordRSafe : public MeasureRecord
+    {
+        inline MeasureRecordRSafe(MeasureName name, const bool autoRegister = true,
+                                  const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecord(name, false, recordOps)
+        {
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        bool IncrementDepth()
+        {
+            return ++depth == 1;
+        }
+
+        bool DecrementDepth()
+        {
+            return --depth == 0;
+        }
+
+        int32_t GetDepth() const
+        {
+            return depth;
+        }
+
+        // the same as the wrapped record, with its own calibrated overhead
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps
+                = MeasureOverhead::WithOverhead<MeasureRecordRSafe>(*MeasureRecord::GetRecordOps());
+            return &recordOps;
+        }
+
+    protected:
+        int32_t depth = 0;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief per-thread recursion depth counters of the TRSafe and TRSharded policies
+     *
+     * Every thread and recursion safe record owns a depth index,
+     * and every thread stores its depths in a thread local array, indexed by the depth index.
+     * Only the owner thread reads and writes its array, so no lock is needed.
+     * The array has a fixed size (MaxRecords * 4 bytes of zero initialized thread local storage),
+     * so a scope never allocates and never checks the size.
+     */
+    struct MeasureThreadDepth
+    {
+        static constexpr uint32_t MaxRecords = 4096;    // max number of thread and recursion safe records
+
+        static uint32_t AllocateIndex()
+        {
+            static std::atomic<uint32_t> indexCount(0);
+            const uint32_t index = indexCount.fetch_add(1);
+            if (index >= MaxRecords)
+                throw std::length_error("too many thread and recursion safe measure records");
+            return index;
+        }
+
+        inline static int32_t& Depth(uint32_t index)
+        {
+            static thread_local int32_t depths[MaxRecords];
+            return depths[index];
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord, it adds thread and recursion safety to it
+    /// the depth is per-thread and lock free (see MeasureThreadDepth),
+    /// only the outermost scope locks the mutex in StopMeasure
+    template <typename MeasureRecord>
+    struct MeasureRecordTRSafe : public MeassureRecordTSafe<MeasureRecord>
+    {
+        inline MeasureRecordTRSafe(MeasureName name, const bool autoRegister = true,
+                                   const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeassureRecordTSafe<MeasureRecord>(name, false, recordOps)
+        {
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        bool IncrementDepth()
+        {
+            return ++MeasureThreadDepth::Depth(depthIndex) == 1;
+        }
+
+        bool DecrementDepth()
+        {
+            return --MeasureThreadDepth::Depth(depthIndex) == 0;
+        }
+
+        // depth in the current thread
+        int32_t GetDepth() const
+        {
+            return MeasureThreadDepth::Depth(depthIndex);
+        }
+
+        // the same as the wrapped record, with its own calibrated overhead
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps
+                = MeasureOverhead::WithOverhead<MeasureRecordTRSafe>(*MeassureRecordTSafe<MeasureRecord>::GetRecordOps());
+            return &recordOps;
+        }
+
+    protected:
+        const uint32_t depthIndex = MeasureThreadDepth::AllocateIndex();
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord, it adds thread safety to it
+    /// every thread counts in its own slot (see MeasureShards), they are merged only by the reports
+    template <typename MeasureRecord>
+    struct MeasureRecordSharded : public MeasureRecord
+    {
+        using Traits = TimeDiffTraits<typename MeasureRecord::TimeDiff>;
+        using Shards = typename MeasureRecord::Shards;
+
+        static constexpr bool IsThreadSafe = true;
+        static constexpr bool IsSharded = true;
+
+        inline MeasureRecordSharded(MeasureName name, const bool autoRegister = true,
+                                    const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecord(name, false, recordOps)
+            , shardIndex(Shards::AllocateIndex())
+        {
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        inline void StopMeasure(typename MeasureRecord::TimePoint start)
+        {
+            AddTime(MeasureRecord::MeasureBackend::GetTick() - start);
+        }
+
+        inline void AddTime(typename MeasureRecord::TimeDiff time)
+        {
+            Shards::Add(shardIndex, Traits::ToRep(time));
+        }
+
+        // the work amount goes to the slot of the thread too, without a shared read-modify-write
+        inline void AddWork(uint64_t bytes, uint64_t items)
+        {
+            Shards::AddWork(shardIndex, bytes, items);
+        }
+
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps = { &GetShardCounters, &ResetShardCounters, nullptr, nullptr, nullptr,
+                MeasureOverhead::Get<MeasureRecordSharded>(), &GetShardWork };
+            return &recordOps;
+        }
+
+        const uint32_t shardIndex;
+
+    private:
+        static void GetShardCounters(const MeasureRecord* record, typename MeasureRecord::TimeDiff& totalTime, uint64_t& numCall)
+        {
+            typename Shards::TimeDiffRep shardTime;
+            Shards::Sum(static_cast<const MeasureRecordSharded*>(record)->shardIndex, shardTime, numCall);
+            totalTime = Traits::FromRep(shardTime);
+        }
+
+        static void ResetShardCounters(MeasureRecord* record)
+        {
+            Shards::Reset(static_cast<MeasureRecordSharded*>(record)->shardIndex);
+        }
+
+        static void GetShardWork(const MeasureRecord* record, uint64_t& bytes, uint64_t& items)
+        {
+            Shards::SumWork(static_cast<const MeasureRecordSharded*>(record)->shardIndex, bytes, items);
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord, it adds thread safety to it
+    /// by relaxed atomic counters, faster than the mutex of MeassureRecordTSafe,
+    /// but the counters are still shared between the threads
+    template <typename MeasureRecord>
+    struct MeasureRecordAtomic : public MeasureRecord
+    {
+        using Traits = TimeDiffTraits<typename MeasureRecord::TimeDiff>;
+        using TimeDiffRep = typename MeasureRecord::TimeDiffRep;
+
+        static constexpr bool IsThreadSafe = true;
+
+        inline MeasureRecordAtomic(MeasureName name, const bool autoRegister = true,
+                                   const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecord(name, false, recordOps)
+        {
+            counters.totalTime.store(0, std::memory_order_relaxed);
+            counters.numCall.store(0, std::memory_order_relaxed);
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        inline void StopMeasure(typename MeasureRecord::TimePoint start)
+        {
+            AddTime(MeasureRecord::MeasureBackend::GetTick() - start);
+        }
+
+        inline void AddTime(typename MeasureRecord::TimeDiff time)
+        {
+            counters.totalTime.fetch_add(Traits::ToRep(time), std::memory_order_relaxed);
+            counters.numCall.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps = { &GetAtomicCounters, &ResetAtomicCounters, nullptr, nullptr, nullptr,
+                MeasureOverhead::Get<MeasureRecordAtomic>(), nullptr };
+            return &recordOps;
+        }
+
+        // 16 byte aligned, so the two counters are always on the same cache line
+        struct alignas(16) Counters
+        {
+            std::atomic<TimeDiffRep> totalTime;
+            std::atomic<uint64_t> numCall;
+        };
+
+        Counters counters;
+
+    private:
+        // the two counters are written by separate read-modify-writes, so the pair is read again until no call is finished meanwhile,
+        // the calls which are just being added (at most one per thread) may be counted only in one of the counters
+        static void GetAtomicCounters(const MeasureRecord* record, typename MeasureRecord::TimeDiff& totalTime, uint64_t& numCall)
+        {
+            const Counters& counters = static_cast<const MeasureRecordAtomic*>(record)->counters;
+            TimeDiffRep time;
+            do
+            {
+                numCall = counters.numCall.load(std::memory_order_relaxed);
+                time = counters.totalTime.load(std::memory_order_relaxed);
+            } while (counters.numCall.load(std::memory_order_relaxed) != numCall);
+            totalTime = Traits::FromRep(time);
+        }
+
+        static void ResetAtomicCounters(MeasureRecord* record)
+        {
+            Counters& counters = static_cast<MeasureRecordAtomic*>(record)->counters;
+            counters.totalTime.store(0, std::memory_order_relaxed);
+            counters.numCall.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord, it adds thread and recursion safety to it
+    /// the depth is per-thread (see MeasureThreadDepth), and the counters are per-thread (see MeasureShards),
+    /// so there is no lock and no atomic read-modify-write at all
+    template <typename MeasureRecord>
+    struct MeasureRecordTRSharded : public MeasureRecordSharded<MeasureRecord>
+    {
+        inline MeasureRecordTRSharded(MeasureName name, const bool autoRegister = true,
+                                      const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecordSharded<MeasureRecord>(name, false, recordOps)
+        {
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        bool IncrementDepth()
+        {
+            return ++MeasureThreadDepth::Depth(depthIndex) == 1;
+        }
+
+        bool DecrementDepth()
+        {
+            return --MeasureThreadDepth::Depth(depthIndex) == 0;
+        }
+
+        // depth in the current thread
+        int32_t GetDepth() const
+        {
+            return MeasureThreadDepth::Depth(depthIndex);
+        }
+
+        // the same as the wrapped record, with its own calibrated overhead
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps
+                = MeasureOverhead::WithOverhead<MeasureRecordTRSharded>(*MeasureRecordSharded<MeasureRecord>::GetRecordOps());
+            return &recordOps;
+        }
+
+    protected:
+        const uint32_t depthIndex = MeasureThreadDepth::AllocateIndex();
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord of any policy, it adds a latency histogram to it
+    /// the histogram is updated with atomic read-modify-write only if the wrapped policy is thread safe
+    template <typename MeasureRecord>
+    struct MeasureRecordHistogram : public MeasureRecord
+    {
+        using Traits = TimeDiffTraits<typename MeasureRecord::TimeDiff>;
+        using Histogram = typename MeasureRecord::Histogram;
+
+        inline MeasureRecordHistogram(MeasureName name, const bool autoRegister = true,
+                                      const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecord(name, false, recordOps)
+        {
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        inline void StopMeasure(typename MeasureRecord::TimePoint start)
+        {
+            AddTime(MeasureRecord::MeasureBackend::GetTick() - start);
+        }
+
+        inline void AddTime(typename MeasureRecord::TimeDiff time)
+        {
+            MeasureRecord::AddTime(time);
+            const typename MeasureRecord::TimeDiffRep ticks = Traits::ToRep(time);
+            histogram.template Add<MeasureRecord::IsThreadSafe>(ticks > 0 ? uint64_t(ticks) : 0);
+        }
+
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps = []()
+            {
+                typename MeasureRecord::RecordOps ops = *MeasureRecord::GetRecordOps();
+                ops.resetCounters = &ResetHistogramCounters;
+                ops.getHistogram = &GetRecordHistogram;
+                ops.overhead = MeasureOverhead::Get<MeasureRecordHistogram>();
+                return ops;
+            }();
+            return &recordOps;
+        }
+
+        Histogram histogram;
+
+    private:
+        static void ResetHistogramCounters(typename MeasureRecord::Database::MeasureRecord* record)
+        {
+            MeasureRecord::GetRecordOps()->resetCounters(record);
+            static_cast<MeasureRecordHistogram*>(record)->histogram.Reset();
+        }
+
+        static const Histogram* GetRecordHistogram(const typename MeasureRecord::Database::MeasureRecord* record)
+        {
+            return &static_cast<const MeasureRecordHistogram*>(record)->histogram;
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord of any policy, it adds min/max/variance to it
+    /// if the wrapped policy is thread safe, the stats are guarded by a spin lock,
+    /// if the wrapped policy is sharded, the stats are per-thread too (see MeasureStatsSlot)
+    template <typename MeasureRecord>
+    struct MeasureRecordStats : public MeasureRecord
+    {
+        using Traits = TimeDiffTraits<typename MeasureRecord::TimeDiff>;
+        using Stats = typename MeasureRecord::Stats;
+
+        inline MeasureRecordStats(MeasureName name, const bool autoRegister = true,
+                                  const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecord(name, false, recordOps)
+        {
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        inline void StopMeasure(typename MeasureRecord::TimePoint start)
+        {
+            AddTime(MeasureRecord::MeasureBackend::GetTick() - start);
+        }
+
+        inline void AddTime(typename MeasureRecord::TimeDiff time)
+        {
+            MeasureRecord::AddTime(time);
+            const typename MeasureRecord::TimeDiffRep ticks = Traits::ToRep(time);
+            statsStorage.Add(ticks > 0 ? uint64_t(ticks) : 0);
+        }
+
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps = []()
+            {
+                typename MeasureRecord::RecordOps ops = *MeasureRecord::GetRecordOps();
+                ops.resetCounters = &ResetStatsCounters;
+                ops.getStats = &GetRecordStats;
+                ops.overhead = MeasureOverhead::Get<MeasureRecordStats>();
+                return ops;
+            }();
+            return &recordOps;
+        }
+
+        // the stats and its lock are together on a separate cache line (if the platform can align it),
+        // so the stats don't touch the cache line of the counters of the base record
+        struct MEASURE_CACHE_LINE_ALIGNED StatsBlock
+        {
+            inline void Add(uint64_t value)
+            {
+                if (MeasureRecord::IsThreadSafe)
+                {
+                    const std::lock_guard<MeasureUtils::SpinLock> guard(lock);
+                    stats.Add(value);
+                }
+                else
+                    stats.Add(value);
+            }
+
+            void Get(Stats& result)
+            {
+                const std::lock_guard<MeasureUtils::SpinLock> guard(lock);
+                result = stats;
+            }
+
+            void Reset()
+            {
+                const std::lock_guard<MeasureUtils::SpinLock> guard(lock);
+                stats.Reset();
+            }
+
+            Stats stats;
+            MeasureUtils::SpinLock lock;
+        };
+
+        // the stats of the sharded policies are in the slots of the threads, they are merged by the reports
+        struct ShardedStats
+        {
+            using Slot = MeasureStatsSlot<Stats>;
+            using Slots = MeasureThreadSlots<Slot>;
+
+            inline void Add(uint64_t value)
+            {
+                Slot& slot = Slots::ThreadSlot(index);
+                const std::lock_guard<MeasureUtils::SpinLock> guard(slot.lock);
+                slot.stats.Add(value);
+            }
+
+            void Get(Stats& result)
+            {
+                result.Reset();
+                Slots::ForEach(index, [&result](Slot& slot)
+                {
+                    const std::lock_guard<MeasureUtils::SpinLock> guard(slot.lock);
+                    result.Merge(slot.stats);
+                });
+            }
+
+            void Reset()
+            {
+                Slots::ForEach(index, [](Slot& slot)
+                {
+                    const std::lock_guard<MeasureUtils::SpinLock> guard(slot.lock);
+                    slot.stats.Reset();
+                });
+            }
+
+            const uint32_t index = Slots::AllocateIndex();
+        };
+
+        typename std::conditional<MeasureRecord::IsSharded, ShardedStats, StatsBlock>::type statsStorage;
+
+    private:
+        static void ResetStatsCounters(typename MeasureRecord::Database::MeasureRecord* record)
+        {
+            MeasureRecord::GetRecordOps()->resetCounters(record);
+            static_cast<MeasureRecordStats*>(record)->statsStorage.Reset();
+        }
+
+        static void GetRecordStats(const typename MeasureRecord::Database::MeasureRecord* record, Stats& stats)
+        {
+            const_cast<MeasureRecordStats*>(static_cast<const MeasureRecordStats*>(record))->statsStorage.Get(stats);
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief this class is wrapper around a MeassureRecord of any policy, it adds a breakdown by processor or NUMA node to it
+    /// the breakdown is updated with atomic read-modify-write only if the wrapped policy is thread safe
+    template <typename MeasureRecord, MeasureCpuKey Key>
+    struct MeasureRecordCpu : public MeasureRecord
+    {
+        using Traits = TimeDiffTraits<typename MeasureRecord::TimeDiff>;
+        using CpuBreakdown = typename MeasureRecord::CpuBreakdown;
+
+        inline MeasureRecordCpu(MeasureName name, const bool autoRegister = true,
+                                const typename MeasureRecord::RecordOps* recordOps = GetRecordOps())
+            : MeasureRecord(name, false, recordOps)
+            , cpuBreakdown(Key)
+        {
+            if (autoRegister)
+                MeasureRecord::Database::AddRecord(this);
+        }
+
+        inline void StopMeasure(typename MeasureRecord::TimePoint start)
+        {
+            AddTime(MeasureRecord::MeasureBackend::GetTick() - start);
+        }
+
+        inline void AddTime(typename MeasureRecord::TimeDiff time)
+        {
+            MeasureRecord::AddTime(time);
+            const typename MeasureRecord::TimeDiffRep ticks = Traits::ToRep(time);
+            cpuBreakdown.template Add<MeasureRecord::IsThreadSafe>(ticks > 0 ? uint64_t(ticks) : 0);
+        }
+
+        static const typename MeasureRecord::RecordOps* GetRecordOps()
+        {
+            static const typename MeasureRecord::RecordOps recordOps = []()
+            {
+                typename MeasureRecord::RecordOps ops = *MeasureRecord::GetRecordOps();
+                ops.resetCounters = &ResetCpuCounters;
+                ops.getCpuBreakdown = &GetRecordCpuBreakdown;
+                ops.overhead = MeasureOverhead::Get<MeasureRecordCpu>();
+                return ops;
+            }();
+            return &recordOps;
+        }
+
+        CpuBreakdown cpuBreakdown;
+
+    private:
+        static void ResetCpuCounters(typename MeasureRecord::Database::MeasureRecord* record)
+        {
+            MeasureRecord::GetRecordOps()->resetCounters(record);
+            static_cast<MeasureRecordCpu*>(record)->cpuBreakdown.Reset();
+        }
+
+        static const CpuBreakdown* GetRecordCpuBreakdown(const typename MeasureRecord::Database::MeasureRecord* record)
+        {
+            return &static_cast<const MeasureRecordCpu*>(record)->cpuBreakdown;
+        }
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief a simple measure scope
+    /// it starts and stops a MeasureRecord in the constructor and destructor,
+    /// if the call is not sampled (see TMeasureRecord::IsSampled), the clock is not read at all
+    template<typename MeasureRecord>
+    struct TMeasureScope
+    {
+        inline TMeasureScope(MeasureRecord* record_)
+#if MEASURE_IS_ON
+            : record{ record_->IsSampled() ? record_ : nullptr }
+            , start{ record ? record->Now() : typename MeasureRecord::TimePoint() }
+        {
+        }
+
+        inline ~TMeasureScope()
+        {
+            if (record)
+                record->StopMeasure(start);
+        }
+
+        // the work amount of the call, the reports show the throughput by it (see TMeasureRecord::AddWork)
+        inline void AddBytes(uint64_t bytes)
+        {
+            if (record)
+                record->AddWork(bytes, 0);
+        }
+
+        inline void AddItems(uint64_t items)
+        {
+            if (record)
+                record->AddWork(0, items);
+        }
+
+        MeasureRecord* record;  // nullptr if the call is not measured
+        typename MeasureRecord::TimePoint start;
+#else
+        {}
+        inline void AddBytes(uint64_t) {}
+        inline void AddItems(uint64_t) {}
+#endif
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief a measure scope for recursive measurement
+    /// it starts and stops a MeasureRecord in the constructor and destructor,
+    /// the sampling is decided by the outermost scope
+    template<typename MeasureRecord>
+    struct MeasureScopeRSafe
+    {
+        inline MeasureScopeRSafe(MeasureRecord* record_)
+#if MEASURE_IS_ON
+            : record{ MeasureControl::IsEnabled() ? record_ : nullptr }
+            , sampled{ false }
+        {
+            if (record && record->IncrementDepth() && record->IsSampled())
+            {
+                sampled = true;
+                start = record->Now();
+            }
+        }
+
+        inline ~MeasureScopeRSafe()
+        {
+            if (record && record->DecrementDepth() && sampled)
+                record->StopMeasure(start);
+        }
+
+        // the work amount of the call, only the outermost scope reports it, like the time
+        inline void AddBytes(uint64_t bytes)
+        {
+            if (sampled)
+                record->AddWork(bytes, 0);
+        }
+
+        inline void AddItems(uint64_t items)
+        {
+            if (sampled)
+                record->AddWork(0, items);
+        }
+
+        MeasureRecord* record;  // nullptr if the scopes are switched off
+        bool sampled;           // the outermost scope is measured
+        typename MeasureRecord::TimePoint start;
+#else
+        {}
+        inline void AddBytes(uint64_t) {}
+        inline void AddItems(uint64_t) {}
+#endif
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a measurement without a C++ block: it is started and stopped explicitly, and it can be moved
+     *
+     * A token can be started on one thread and stopped on an other one (e.g. a request passed through futures),
+     * the time between Start and Stop is added to the record as one call, into the same MeasureDatabase records.
+     * Pause and Resume exclude a part of the time, e.g. the suspended time of a coroutine (see MeasureAwait).
+     * The token itself is not thread safe, it must be handed over (moved) from one thread to the other,
+     * and if it is stopped on an other thread than where the record is used, the record must be thread safe
+     * (TSafe, Sharded, Atomic). The token doesn't take part in the recursion tracking of the RSafe policies,
+     * and the counters of the PerfMeasure are per thread, so they are meaningful only on one thread.
+     * A token which is destroyed while it is running or paused is stopped.
+     */
+    template<typename MeasureRecord>
+    class TMeasureToken
+    {
+    public:
+        using TimePoint = typename MeasureRecord::TimePoint;
+        using TimeDiff = typename MeasureRecord::TimeDiff;
+
+        inline TMeasureToken() noexcept
+            : record(nullptr)
+            , start()
+            , elapsed()
+            , running(false)
+        {
+        }
+
+        // started
+        inline explicit TMeasureToken(MeasureRecord* record_)
+            : TMeasureToken()
+        {
+            Start(record_);
+        }
+
+        inline TMeasureToken(TMeasureToken&& other) noexcept
+            : record(other.record)
+            , start(other.start)
+            , elapsed(other.elapsed)
+            , running(other.running)
+        {
+            other.record = nullptr;
+        }
+
+        // the current measurement of this token is stopped first
+        inline TMeasureToken& operator=(TMeasureToken&& other)
+        {
+            if (this != &other)
+            {
+                Stop();
+                record = other.record;
+                start = other.start;
+                elapsed = other.elapsed;
+                running = other.running;
+                other.record = nullptr;
+            }
+            return *this;
+        }
+
+        TMeasureToken(const TMeasureToken&) = delete;
+        TMeasureToken& operator=(const TMeasureToken&) = delete;
+
+        inline ~TMeasureToken()
+        {
+            Stop();
+        }
+
+        // start a new measurement, the current one is stopped first
+        // if the call is not sampled (see TMeasureRecord::IsSampled), the token stays inactive
+        inline void Start(MeasureRecord* record_)
+        {
+#if MEASURE_IS_ON
+            Stop();
+            elapsed = TimeDiff();
+            record = record_->IsSampled() ? record_ : nullptr;
+            running = record != nullptr;
+            if (running)
+                start = record->Now();
+#else
+            (void)record_;
+#endif
+        }
 
-        bool IncrementDepth()
+        // the time until Resume is not measured
+        inline void Pause()
         {
-            return ++depth == 1;
+            if (record && running)
+            {
+                elapsed += record->Now() - start;
+                running = false;
+            }
         }
 
-        bool DecrementDepth()
+        inline void Resume()
         {
-            return --depth == 0;
+            if (record && !running)
+            {
+                start = record->Now();
+                running = true;
+            }
         }
 
-        int32_t GetDepth() const
+        // add the measured time to the record as one call
+        inline void Stop()
         {
-            return depth;
+            if (record)
+            {
+                Pause();
+                record->AddTime(elapsed);
+                record = nullptr;
+            }
         }
 
-    protected:
-        int32_t depth = 0;
-    };
-
-    ///////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief this class is wrapper around a MeassureRecord, it adds thread and recursion safety to it
-    template <typename MeasureRecord>
-    struct MeasureRecordTRSafe : public MeassureRecordTSafe<MeasureRecord>
-    {
-        using MeassureRecordTSafe<MeasureRecord>::MeassureRecordTSafe;
-
-        bool IncrementDepth()
+        // the work amount of the measured operation (see TMeasureRecord::AddWork)
+        inline void AddBytes(uint64_t bytes)
         {
-            const std::lock_guard<std::mutex> lock(this->mutex);
-            return ++Depth() == 1;
+            if (record)
+                record->AddWork(bytes, 0);
         }
 
-        bool DecrementDepth()
+        inline void AddItems(uint64_t items)
         {
-            const std::lock_guard<std::mutex> lock(this->mutex);
-            return --Depth() == 0;
+            if (record)
+                record->AddWork(0, items);
         }
 
-        int32_t GetDepth() const
+        // drop the measurement, nothing is added to the record
+        inline void Cancel()
         {
-            const std::lock_guard<std::mutex> lock(this->mutex);
-            return Depth();
+            record = nullptr;
         }
 
-    protected:
-        int32_t& Depth()
+        // started and not stopped yet, it is not active if the call is not sampled
+        inline bool IsActive() const    { return record != nullptr; }
+        inline bool IsPaused() const    { return record != nullptr && !running; }
+
+        // the measured time so far, without the paused time
+        inline TimeDiff GetElapsed() const
         {
-            static thread_local std::map<std::pair<std::thread::id, void*>, int32_t> depths;
-            return depths[std::make_pair(std::this_thread::get_id(), this)];
+            if (record && running)
+            {
+                TimeDiff total = elapsed;
+                total += record->Now() - start;
+                return total;
+            }
+            return elapsed;
         }
+
+    private:
+        MeasureRecord* record;  // nullptr if the token is not active
+        TimePoint start;        // the start of the current running part
+        TimeDiff elapsed;       // the finished running parts
+        bool running;
     };
 
+    // the token of a policy, e.g. MeasureToken<Measure::Sharded> token(&record);
+    template<typename Policy>
+    using MeasureToken = TMeasureToken<typename Policy::MeasureRecord>;
+
     ///////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief a simple measure scope
-    /// it starts and stops a MeasureRecord in the constructor and destructor
-    template<typename MeasureRecord>
-    struct TMeasureScope
+    /**
+     * @brief an awaiter wrapper for C++20 coroutines, the token is paused while the coroutine is suspended
+     *
+     * co_await MeasureAwait(token, awaiter) is the same as co_await awaiter, but the suspended time is not measured.
+     * The wrapped object must be an awaiter (await_ready, await_suspend, await_resume), not an awaitable
+     * with operator co_await. It is plain C++11, so it compiles with any standard, but it is useful only with C++20.
+     */
+    template<typename Token, typename Awaiter>
+    struct TMeasureAwaiter
     {
-        inline TMeasureScope(MeasureRecord* record_)
-#if MEASURE_IS_ON
-            : record{ record_ }
-            , start{ record->Now() }
+        inline bool await_ready()
         {
+            return awaiter.await_ready();
         }
 
-        inline ~TMeasureScope()
+        template<typename Handle>
+        inline auto await_suspend(Handle handle) -> decltype(std::declval<Awaiter&>().await_suspend(handle))
         {
-            record->StopMeasure(start);
+            token.Pause();
+            return awaiter.await_suspend(handle);
         }
 
-        MeasureRecord* record;
-        typename MeasureRecord::TimePoint start;
-#else
-        {}
-#endif
+        // also called without suspension (await_ready is true, or await_suspend returned false)
+        inline auto await_resume() -> decltype(std::declval<Awaiter&>().await_resume())
+        {
+            token.Resume();
+            return awaiter.await_resume();
+        }
+
+        Token& token;
+        Awaiter awaiter;
     };
 
-    ///////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief a measure scope for recursive measurement
-    /// it starts and stops a MeasureRecord in the constructor and destructor
-    template<typename MeasureRecord>
-    struct MeasureScopeRSafe
+    template<typename Token, typename Awaiter>
+    inline TMeasureAwaiter<Token, typename std::decay<Awaiter>::type> MeasureAwait(Token& token, Awaiter&& awaiter)
     {
-        inline MeasureScopeRSafe(MeasureRecord* record_)
-#if MEASURE_IS_ON
-            : record{ record_ }
-        {
-            if (record->IncrementDepth())
-                start = record->Now();
-        }
+        return TMeasureAwaiter<Token, typename std::decay<Awaiter>::type>{ token, std::forward<Awaiter>(awaiter) };
+    }
 
-        inline ~MeasureScopeRSafe()
-        {
-            if (record->DecrementDepth())
-                record->StopMeasure(start);
-        }
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the same kind of scope for an other MeasureRecord type, used by the policy modifiers
+    template<typename Scope, typename MeasureRecord> struct RebindScope;
 
-        MeasureRecord* record;
-        typename MeasureRecord::TimePoint start;
-#else
-        {}
-#endif
+    template<typename OldMeasureRecord, typename MeasureRecord>
+    struct RebindScope<TMeasureScope<OldMeasureRecord>, MeasureRecord>
+    {
+        using type = TMeasureScope<MeasureRecord>;
+    };
+
+    template<typename OldMeasureRecord, typename MeasureRecord>
+    struct RebindScope<MeasureScopeRSafe<OldMeasureRecord>, MeasureRecord>
+    {
+        using type = MeasureScopeRSafe<MeasureRecord>;
     };
 
     ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -344,6 +1937,27 @@ namespace dtree
                 { return DynamicDatabase::GetOrAddDynamicRecord(name); }
         };
 
+        // threadsafe measure with per-thread counters, not handle recursive function calls, almost as fast as base
+        struct Sharded
+        {
+            using MeasureRecord = MeasureRecordSharded<MeasureRecordBase>;
+            using Scope = TMeasureScope<MeasureRecord>;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
+        // threadsafe measure with relaxed atomic counters, not handle recursive function calls,
+        // between base and tsafe, good for records used by only a few threads
+        struct Atomic
+        {
+            using MeasureRecord = MeasureRecordAtomic<MeasureRecordBase>;
+            using Scope = TMeasureScope<MeasureRecord>;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
         // threadsafe and handle recursive function calls, slowest
         struct TRSafe
         {
@@ -353,6 +1967,159 @@ namespace dtree
             static MeasureRecord* GetDynamicRecord(const char* name)
                 { return DynamicDatabase::GetOrAddDynamicRecord(name); }
         };
+
+        // threadsafe and handle recursive function calls, with per-thread counters, almost as fast as rsafe
+        struct TRSharded
+        {
+            using MeasureRecord = MeasureRecordTRSharded<MeasureRecordBase>;
+            using Scope = MeasureScopeRSafe<MeasureRecord>;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
+        // any of the policies above with a latency histogram (percentiles in the reports),
+        // e.g. CppMeasure::WithHistogram<CppMeasure::TRSafe>
+        template<typename Policy>
+        struct WithHistogram
+        {
+            using MeasureRecord = MeasureRecordHistogram<typename Policy::MeasureRecord>;
+            using Scope = typename RebindScope<typename Policy::Scope, MeasureRecord>::type;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
+        // any of the policies above with min, max and standard deviation in the reports,
+        // e.g. CppMeasure::WithStats<CppMeasure::TSafe>
+        template<typename Policy>
+        struct WithStats
+        {
+            using MeasureRecord = MeasureRecordStats<typename Policy::MeasureRecord>;
+            using Scope = typename RebindScope<typename Policy::Scope, MeasureRecord>::type;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
+        // any of the policies above with the calls and times per processor (Key = Core) or per NUMA node (Key = Node),
+        // e.g. CppMeasure::WithCpu<CppMeasure::Sharded, dtree::MeasureCpuKey::Node>
+        template<typename Policy, MeasureCpuKey Key = MeasureCpuKey::Core>
+        struct WithCpu
+        {
+            using MeasureRecord = MeasureRecordCpu<typename Policy::MeasureRecord, Key>;
+            using Scope = typename RebindScope<typename Policy::Scope, MeasureRecord>::type;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
+        // any of the policies above in call tree mode, the reports show the inclusive and exclusive time
+        // of every caller path too, and the records are recursion safe, e.g. CppMeasure::WithTree<CppMeasure::TSafe>
+        template<typename Policy>
+        struct WithTree
+        {
+            using MeasureRecord = typename Policy::MeasureRecord;
+            using Scope = MeasureTreeScope<MeasureRecord>;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
+        // any of the policies above (or in tree mode) in trace mode, every call is added to a per-thread ring buffer too,
+        // for a timeline of the last calls, see ChromeTraceReport, e.g. CppMeasure::WithTrace<CppMeasure::TSafe>
+        template<typename Policy>
+        struct WithTrace
+        {
+            using MeasureRecord = typename Policy::MeasureRecord;
+            using Scope = MeasureTraceScope<typename Policy::Scope>;
+            using DynamicDatabase = DynamicMeasureDatabase<MeasureRecord>;
+            static MeasureRecord* GetDynamicRecord(const char* name)
+                { return DynamicDatabase::GetOrAddDynamicRecord(name); }
+        };
+
+        // basic measure with min, max and standard deviation, not threadsafe
+        using Stats = WithStats<Base>;
+
+        // basic measure with latency histogram, not threadsafe
+        using Histogram = WithHistogram<Base>;
+
+        // threadsafe measure with latency histogram, based on the atomic policy
+        using AtomicHistogram = WithHistogram<Atomic>;
+
+        // threadsafe and recursion safe call tree measure, based on the sharded policy
+        using CallTree = WithTree<Sharded>;
+
+        // threadsafe measure with timeline, based on the sharded policy
+        using Traced = WithTrace<Sharded>;
+
+        /**
+         * @brief measures the overhead of an empty scope of a policy, the reports subtract it from its records
+         * @param loopNum the number of empty scopes in a calibration round
+         * @param roundNum the number of calibration rounds, the fastest round is the overhead,
+         *                 the difference of the slowest and the fastest round is the noise
+         * @return the overhead of one scope in ticks, 0 if no call was measured (e.g. MeasureControl switched it off),
+         *         then the stored overhead is not changed
+         *
+         * Call it at startup, from an otherwise idle thread, after the backend is initialized.
+         * It can be called again on demand, the unregistered record of the policy is reused,
+         * since the shard and the depth indexes of the records are never released.
+         */
+        template<typename Policy>
+        static double Calibrate(uint64_t loopNum = 100000, uint32_t roundNum = 10)
+        {
+            using MeasureRecord = typename Policy::MeasureRecord;
+            using TimeDiff = typename MeasureRecord::TimeDiff;
+
+            static MeasureRecord record("calibration", false);
+            record.SetSamplePeriod(1);
+            double minTicks = 0;
+            double maxTicks = 0;
+            bool measured = false;
+            for (uint32_t round = 0; round < roundNum; ++round)
+            {
+                record.Reset();
+                for (uint64_t loop = 0; loop < loopNum; ++loop)
+                {
+                    typename Policy::Scope scope(&record);
+                }
+
+                TimeDiff totalTime;
+                uint64_t numCall;
+                record.GetCounters(totalTime, numCall);
+                if (numCall == 0)
+                    continue;
+                const double ticks = double(TimeDiffTraits<TimeDiff>::ToRep(totalTime)) / double(numCall);
+                if (!measured || ticks < minTicks)
+                    minTicks = ticks;
+                if (!measured || ticks > maxTicks)
+                    maxTicks = ticks;
+                measured = true;
+            }
+            record.Reset();
+            if (!measured)
+                return 0.0;
+
+            MeasureOverhead* overhead = record.recordOps->overhead;
+            overhead->ticks.store(minTicks, std::memory_order_relaxed);
+            overhead->noiseTicks.store(maxTicks - minTicks, std::memory_order_relaxed);
+            return minTicks;
+        }
+
+        // calibrates all the predefined policies, see Calibrate
+        static void CalibrateAll(uint64_t loopNum = 100000, uint32_t roundNum = 10)
+        {
+            Calibrate<Base>(loopNum, roundNum);
+            Calibrate<TSafe>(loopNum, roundNum);
+            Calibrate<RSafe>(loopNum, roundNum);
+            Calibrate<Sharded>(loopNum, roundNum);
+            Calibrate<Atomic>(loopNum, roundNum);
+            Calibrate<TRSafe>(loopNum, roundNum);
+            Calibrate<TRSharded>(loopNum, roundNum);
+            Calibrate<Stats>(loopNum, roundNum);
+            Calibrate<Histogram>(loopNum, roundNum);
+            Calibrate<AtomicHistogram>(loopNum, roundNum);
+        }
     };
 
 } // namespace dtree
@@ -364,6 +2131,7 @@ void dtree::MeasureDatabase<MeasureRecord>::AddRecord(MeasureRecord* record)
 #if MEASURE_IS_ON
     const std::lock_guard<std::mutex> lock(Instance()->mutex);
     Instance()->records.push_back(record);
+    Instance()->nameIndex.emplace(record->nameId, record);
 #endif
 }
 
@@ -371,53 +2139,82 @@ template<typename MeasureRecord>
 auto dtree::MeasureDatabase<MeasureRecord>::FindMeasureRecord(const char* name) -> MeasureRecord*
 {
 #if MEASURE_IS_ON
+    size_t length;
+    const uint64_t nameId = MeasureUtils::HashName(name, length);
     const std::lock_guard<std::mutex> lock(Instance()->mutex);
-    for (MeasureRecord* mr : Instance()->records)
-        if (mr->name == name)
-            return mr;
+    const auto range = Instance()->nameIndex.equal_range(nameId);
+    for (auto iter = range.first; iter != range.second; ++iter)
+        if (strcmp(iter->second->name, name) == 0)
+            return iter->second;
 #endif
     return nullptr;
 }
 
 template<typename MeasureRecord>
-void dtree::MeasureDatabase<MeasureRecord>::PrintReport(std::ostream& os)
+auto dtree::MeasureDatabase<MeasureRecord>::FindMeasureRecordById(uint64_t nameId) -> MeasureRecord*
 {
 #if MEASURE_IS_ON
-    using namespace std;
-    const lock_guard<std::mutex> lock(Instance()->mutex);
-
-    auto records = Instance()->records;
-    if (!records.empty())
-    {
-        constexpr size_t width = 86;
-        const char* title = MeasureRecord::MeasureBackend::GetMeasureTitle();
-        const size_t titleLen = strlen(title);
-
-        const std::string pad((width-titleLen)/2 - 1, '-');
-        os << pad << " " << title << " " << pad << (titleLen%2?"-":"") << "\n";
-
-        os  << setw(40) << "Name"
-            << setw(12) << "Calls"
-            << setw(17) << "Total (ns)"
-            << setw(17) << "Average (ns)"
-            << "\n";
-        os << std::string(width, '-') << std::endl;
-        for (MeasureRecord* measureRecord : records)
-        {
-            const double totalSec = measureRecord->GetTotalSec();
-            if (totalSec < 0 || measureRecord->numCall == 0)
-                os  << setw(40) << measureRecord->name
-                    << setw(12) << measureRecord->numCall
-                    << "\n";
-            else
-                os  << setw(40) << measureRecord->name
-                    << setw(12) << measureRecord->numCall
-                    << setw(17) << MeasureUtils::TimeToStrNs(totalSec)
-                    << setw(17) << MeasureUtils::TimeToStrNs(totalSec / double(measureRecord->numCall))
-                    << "\n";
+    const std::lock_guard<std::mutex> lock(Instance()->mutex);
+    const auto iter = Instance()->nameIndex.find(nameId);
+    if (iter != Instance()->nameIndex.end())
+        return iter->second;
+#endif
+    return nullptr;
+}
+
+template<typename MeasureRecord>
+auto dtree::MeasureDatabase<MeasureRecord>::CopyRecords() -> std::vector<MeasureRecord*>
+{
+    const std::lock_guard<std::mutex> lock(Instance()->mutex);
+    return Instance()->records;
+}
+
+template<typename MeasureRecord>
+dtree::MeasureSnapshot dtree::MeasureDatabase<MeasureRecord>::Snapshot()
+{
+#if MEASURE_IS_ON
+    for (;;)
+    {
+        std::vector<MeasureRecord*> records;
+        uint64_t resetEpoch;
+        {
+            const std::lock_guard<std::mutex> lock(Instance()->mutex);
+            records = Instance()->records;
+            resetEpoch = Instance()->resetEpoch.load(std::memory_order_relaxed);
+        }
+        MeasureSnapshot snapshot = MeasureSnapshot::FromRecords(records);
+        // if a counter was read after a reset, the fences make its new epoch visible here
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (Instance()->resetEpoch.load(std::memory_order_relaxed) == resetEpoch)
+        {
+            snapshot.resetEpoch = resetEpoch;
+            return snapshot;
         }
-        os << std::string(width, '-') << std::endl;
     }
+#else
+    return MeasureSnapshot();
+#endif
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureDatabase<MeasureRecord>::PrintReport(std::ostream& os)
+{
+#if MEASURE_IS_ON
+    const std::vector<MeasureRecord*> records = CopyRecords();
+    if (records.empty())
+        return;
+
+    MeasureUtils::ReportBuffer report;
+    MeasureSnapshot::FromRecords(records).PrintReport(report);
+
+    // the optional reports are usually empty, they are appended, so the whole report is one write
+    std::ostringstream optionalReports;
+    MeasureCounterReport<typename MeasureRecord::TimeDiff>::Print(optionalReports, records);
+    MeasureCpuReport(optionalReports, records);
+    MeasureRecord::Tree::PrintReport(optionalReports);
+    report.Append(optionalReports.str());
+
+    report.WriteTo(os);
 #endif
 }
 
@@ -433,11 +2230,22 @@ void dtree::MeasureDatabase<MeasureRecord>::ResetAll()
 {
 #if MEASURE_IS_ON
     const std::lock_guard<std::mutex> lock(Instance()->mutex);
+    // the new epoch is published before any counter is reset, so a Snapshot which meanwhile reads them retries
+    Instance()->resetEpoch.store(Instance()->resetEpoch.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
     for (MeasureRecord* mr : Instance()->records)
-    {
-        mr->numCall = 0;
-        mr->totalTime = {};
-    }
+        mr->Reset();
+    MeasureRecord::Tree::Reset();
+#endif
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureDatabase<MeasureRecord>::SetSamplePeriodAll(uint32_t period)
+{
+#if MEASURE_IS_ON
+    const std::lock_guard<std::mutex> lock(Instance()->mutex);
+    for (MeasureRecord* mr : Instance()->records)
+        mr->SetSamplePeriod(period);
 #endif
 }
 
@@ -445,19 +2253,242 @@ void dtree::MeasureDatabase<MeasureRecord>::ResetAll()
 template<typename MeasureRecord>
 auto dtree::DynamicMeasureDatabase<MeasureRecord>::GetOrAddDynamicRecord(const char* name) -> MeasureRecord*
 {
-    const std::lock_guard<std::mutex> lock(Instance()->mutex);
-    auto& dynamicRecords = Instance()->dynamicRecords;
+    size_t length;
+    const uint64_t hash = MeasureUtils::HashName(name, length);
+    return GetOrAddDynamicRecord(name, length, hash);
+}
+
+template<typename MeasureRecord>
+auto dtree::DynamicMeasureDatabase<MeasureRecord>::GetOrAddDynamicRecord(const char* name, size_t length, uint64_t hash) -> MeasureRecord*
+{
+    thread_local Entry* frontCache[FrontCacheSize] = {};
+    Entry*& cached = frontCache[size_t(hash) % FrontCacheSize];
+    if (cached != nullptr && cached->Matches(name, length, hash))
+        return cached->record;
+
+    Entry* entry = Instance()->table.load(std::memory_order_acquire)->Find(name, length, hash);
+    if (entry == nullptr)
+        entry = AddDynamicRecord(name, length, hash);
+    cached = entry;
+    return entry->record;
+}
+
+template<typename MeasureRecord>
+auto dtree::DynamicMeasureDatabase<MeasureRecord>::AddDynamicRecord(const char* name, size_t length, uint64_t hash) -> Entry*
+{
+    DynamicMeasureDatabase<MeasureRecord>* instance = Instance();
+    const std::lock_guard<std::mutex> lock(instance->mutex);
+
+    // an other thread may have added it meanwhile
+    Table* table = instance->table.load(std::memory_order_relaxed);
+    Entry* found = table->Find(name, length, hash);
+    if (found != nullptr)
+        return found;
+
+    if (2 * (instance->entries.size() + 1) > table->mask + 1)
+    {
+        instance->tables.emplace_back(new Table(2 * (table->mask + 1)));
+        table = instance->tables.back().get();
+        for (const std::unique_ptr<Entry>& entry : instance->entries)
+            table->Insert(entry.get());
+        instance->table.store(table, std::memory_order_release);
+    }
+
+    std::unique_ptr<Entry> entry(new Entry{ hash, std::string(name, length), nullptr });
+    // the entry is never freed, so the record can point to its name
+    entry->record = instance->records.Create(MeasureName(entry->name.c_str(), hash));
+    table->Insert(entry.get());
+    instance->entries.push_back(std::move(entry));
+    return instance->entries.back().get();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename MeasureBackend>
+constexpr bool dtree::TMeasureRecord<MeasureBackend>::IsThreadSafe;
+
+template<typename MeasureBackend>
+constexpr bool dtree::TMeasureRecord<MeasureBackend>::IsSharded;
+
+template<typename MeasureBackend>
+constexpr uint32_t dtree::TMeasureRecord<MeasureBackend>::NoSampleIndex;
+
+template<typename MeasureRecord>
+constexpr bool dtree::MeassureRecordTSafe<MeasureRecord>::IsThreadSafe;
+
+template<typename MeasureRecord>
+constexpr bool dtree::MeasureRecordSharded<MeasureRecord>::IsThreadSafe;
+
+template<typename MeasureRecord>
+constexpr bool dtree::MeasureRecordSharded<MeasureRecord>::IsSharded;
+
+template<typename MeasureRecord>
+constexpr bool dtree::MeasureRecordAtomic<MeasureRecord>::IsThreadSafe;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename T>
+constexpr size_t dtree::MeasureArena<T>::ChunkSize;
 
-    auto recordIter = dynamicRecords.find(name);
-    if (recordIter != dynamicRecords.end())
-        return recordIter->second.get();
+template<typename MeasureRecord>
+constexpr uint32_t dtree::MeasureShards<MeasureRecord>::ChunkSize;
+
+template<typename MeasureRecord>
+constexpr uint32_t dtree::MeasureShards<MeasureRecord>::MaxChunks;
+
+template<typename Slot>
+constexpr uint32_t dtree::MeasureThreadSlots<Slot>::ChunkSize;
+
+template<typename Slot>
+constexpr uint32_t dtree::MeasureThreadSlots<Slot>::MaxChunks;
+
+template<typename MeasureRecord>
+uint32_t dtree::MeasureShards<MeasureRecord>::AllocateIndex()
+{
+    const uint32_t index = Instance()->indexCount.fetch_add(1);
+    if (index >= ChunkSize * MaxChunks)
+        throw std::length_error("too many sharded measure records");
+    return index;
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureShards<MeasureRecord>::Sum(uint32_t index, TimeDiffRep& totalTime, uint64_t& numCall)
+{
+    totalTime = 0;
+    numCall = 0;
+    for (ThreadShards* shards = Instance()->threadShards.Head(); shards; shards = shards->next)
+    {
+        const Chunk* chunk = shards->chunks[index / ChunkSize].load(std::memory_order_acquire);
+        if (chunk == nullptr)
+            continue;
+        // the baselines first: a Reset() after them can't make them newer than the slot
+        const ResetCounters reset = ReadResetSlot(chunk->resetSlots[index % ChunkSize]);
+        TimeDiffRep slotTime;
+        uint64_t slotCall;
+        ReadSlot(chunk->slots[index % ChunkSize], slotTime, slotCall);
+        totalTime += slotTime - reset.time;
+        numCall += slotCall - reset.calls;
+    }
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureShards<MeasureRecord>::Reset(uint32_t index)
+{
+    const std::lock_guard<std::mutex> lock(Instance()->resetMutex);
+    for (ThreadShards* shards = Instance()->threadShards.Head(); shards; shards = shards->next)
+    {
+        Chunk* chunk = shards->chunks[index / ChunkSize].load(std::memory_order_acquire);
+        if (chunk == nullptr)
+            continue;
+        ResetSlot& resetSlot = chunk->resetSlots[index % ChunkSize];
+        TimeDiffRep slotTime;
+        uint64_t slotCall;
+        ReadSlot(chunk->slots[index % ChunkSize], slotTime, slotCall);
+        const WorkSlot& workSlot = chunk->workSlots[index % ChunkSize];
+        const uint64_t bytes = workSlot.bytes.load(std::memory_order_relaxed);
+        const uint64_t items = workSlot.items.load(std::memory_order_relaxed);
+        resetSlot.lock.Write([&]()
+        {
+            resetSlot.resetTime.store(slotTime, std::memory_order_relaxed);
+            resetSlot.resetCall.store(slotCall, std::memory_order_relaxed);
+            resetSlot.resetBytes.store(bytes, std::memory_order_relaxed);
+            resetSlot.resetItems.store(items, std::memory_order_relaxed);
+        });
+    }
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureShards<MeasureRecord>::SumWork(uint32_t index, uint64_t& bytes, uint64_t& items)
+{
+    bytes = 0;
+    items = 0;
+    for (ThreadShards* shards = Instance()->threadShards.Head(); shards; shards = shards->next)
+    {
+        const Chunk* chunk = shards->chunks[index / ChunkSize].load(std::memory_order_acquire);
+        if (chunk == nullptr)
+            continue;
+        const ResetCounters reset = ReadResetSlot(chunk->resetSlots[index % ChunkSize]);
+        const WorkSlot& workSlot = chunk->workSlots[index % ChunkSize];
+        bytes += workSlot.bytes.load(std::memory_order_relaxed) - reset.bytes;
+        items += workSlot.items.load(std::memory_order_relaxed) - reset.items;
+    }
+}
+
+template<typename MeasureRecord>
+auto dtree::MeasureShards<MeasureRecord>::ReadResetSlot(const ResetSlot& resetSlot) -> ResetCounters
+{
+    ResetCounters reset;
+    resetSlot.lock.Read([&]()
+    {
+        reset.time = resetSlot.resetTime.load(std::memory_order_relaxed);
+        reset.calls = resetSlot.resetCall.load(std::memory_order_relaxed);
+        reset.bytes = resetSlot.resetBytes.load(std::memory_order_relaxed);
+        reset.items = resetSlot.resetItems.load(std::memory_order_relaxed);
+    });
+    return reset;
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureShards<MeasureRecord>::ReadSlot(const Slot& slot, TimeDiffRep& totalTime, uint64_t& numCall)
+{
+    for (;;)
+    {
+        const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        totalTime = slot.totalTime.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence % 2 == 0 && slot.sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            numCall = sequence / 2;
+            return;
+        }
+        std::this_thread::yield(); // the owner is in the middle of an Add, it may be preempted
+    }
+}
+
+template<typename MeasureRecord>
+auto dtree::MeasureShards<MeasureRecord>::AddChunk(ThreadShards* shards, uint32_t chunkIndex) -> Chunk*
+{
+    Chunk* chunk = new Chunk(); // zero initialized
+    shards->chunks[chunkIndex].store(chunk, std::memory_order_release);
+    return chunk;
+}
+
+template<typename MeasureRecord>
+dtree::MeasureShards<MeasureRecord>::ThreadHandle::ThreadHandle()
+    : shards(Instance()->threadShards.Acquire())
+{
+}
+
+template<typename MeasureRecord>
+dtree::MeasureShards<MeasureRecord>::ThreadHandle::~ThreadHandle()
+{
+    MeasureUtils::ThreadBlockList<ThreadShards>::Release(shards);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename Slot>
+uint32_t dtree::MeasureThreadSlots<Slot>::AllocateIndex()
+{
+    const uint32_t index = Instance()->indexCount.fetch_add(1);
+    if (index >= ChunkSize * MaxChunks)
+        throw std::length_error("too many measure records with per-thread slots");
+    return index;
+}
+
+template<typename Slot>
+auto dtree::MeasureThreadSlots<Slot>::AddChunk(ThreadBlock* block, uint32_t chunkIndex) -> Chunk*
+{
+    Chunk* chunk = new Chunk(); // value initialized
+    block->chunks[chunkIndex].store(chunk, std::memory_order_release);
+    return chunk;
+}
 
-    typename std::remove_reference<decltype(dynamicRecords)>::type::iterator iter;
-    bool newItemCreated;
-    std::tie(iter, newItemCreated) = dynamicRecords.emplace(name, nullptr);
+template<typename Slot>
+dtree::MeasureThreadSlots<Slot>::ThreadHandle::ThreadHandle()
+    : block(Instance()->threadBlocks.Acquire())
+{
+}
 
-    std::unique_ptr<MeasureRecord>& uniqueRecord{ iter->second };
-    //if (!uniqueRecord)
-        uniqueRecord = std::unique_ptr<MeasureRecord>(new MeasureRecord(name));
-    return uniqueRecord.get();
-}
\ No newline at end of file
+template<typename Slot>
+dtree::MeasureThreadSlots<Slot>::ThreadHandle::~ThreadHandle()
+{
+    MeasureUtils::ThreadBlockList<ThreadBlock>::Release(block);
+}
@@ -0,0 +1,303 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Microbenchmark harness: auto-scaled iterations, warmup, repetitions, median and MAD with outlier rejection.
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <ostream>
+
+#include "measure/measure.h"
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the compiler must compute the value, and it must assume that the value is read
+    template<typename T>
+    inline void DoNotOptimize(const T& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __asm__ __volatile__("" : : "r,m"(value) : "memory");
+#else
+        static const volatile char* volatile sink;
+        sink = &reinterpret_cast<const volatile char&>(value);
+        _ReadWriteBarrier();
+#endif
+    }
+
+    /// @brief the compiler must compute the value, and it must assume that the value is read and modified
+    template<typename T>
+    inline void DoNotOptimize(T& value)
+    {
+#if defined(__clang__)
+        __asm__ __volatile__("" : "+r,m"(value) : : "memory");
+#elif defined(__GNUC__)
+        __asm__ __volatile__("" : "+m,r"(value) : : "memory");
+#else
+        static volatile char* volatile sink;
+        sink = &reinterpret_cast<volatile char&>(value);
+        _ReadWriteBarrier();
+#endif
+    }
+
+    /// @brief the compiler must assume that every memory is read and written here
+    inline void ClobberMemory()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __asm__ __volatile__("" : : : "memory");
+#else
+        _ReadWriteBarrier();
+#endif
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the settings of TMeasureBenchmark
+    struct MeasureBenchmarkOptions
+    {
+        double minSec = 0.05;               // the minimal time of a repetition
+        double warmupSec = 0.05;            // the minimal time of the warmup, the scaling runs are included
+        uint32_t repetitions = 10;
+        double outlierLimit = 3.0;          // in the standard deviation estimated from the MAD, 0: no rejection
+        uint64_t maxIterations = uint64_t(1) << 32;
+        int cpu = -1;                       // pin the calling thread to this cpu (Windows and Linux), -1: no pinning
+    };
+
+    /// @brief the statistics of a benchmark, the times are per iteration
+    struct MeasureBenchmarkResult
+    {
+        std::string name;
+        uint64_t iterations = 0;            // per repetition
+        uint32_t repetitions = 0;           // without the outliers
+        uint32_t outliers = 0;
+        double medianSec = 0;
+        double madSec = 0;
+        double minSec = 0;
+        double maxSec = 0;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief runs small functions many times and reports the robust statistics of the time of one call
+     *
+     * The number of iterations is scaled up by the last time (at most 10 times) until a repetition takes at least minSec,
+     * these runs are the warmup too. After that every repetition runs the same number of iterations,
+     * and the time per iteration of the repetitions gives the median and the median absolute deviation (MAD).
+     * A repetition farther from the median than outlierLimit * 1.4826 * MAD is an outlier (an interrupt,
+     * a context switch), it is rejected, and the statistics are computed again from the rest.
+     * The times are measured by a MeasureRecord of the backend, outside of the measured loop.
+     */
+    template<typename InMeasureBackend>
+    class TMeasureBenchmark
+    {
+    public:
+        using MeasureBackend = InMeasureBackend;
+        using MeasureRecord = typename TMeasure<MeasureBackend>::Base::MeasureRecord;
+
+        using Options = MeasureBenchmarkOptions;
+        using Result = MeasureBenchmarkResult;
+
+        // runs the given number of iterations of a benchmark
+        using Body = std::function<void(uint64_t iterations)>;
+
+        /// @brief run a function (one iteration) as a benchmark
+        template<typename Function>
+        static Result Run(const std::string& name, Function function, const Options& options = Options())
+        {
+            return RunBody(name, MakeBody(function), options);
+        }
+
+        /// @brief register a function (one iteration) as a benchmark for RunAll
+        template<typename Function>
+        static void Register(const std::string& name, Function function)
+        {
+            Registry().push_back(Entry{ name, MakeBody(function) });
+        }
+
+        /// @brief run the registered benchmarks in the order of the registration
+        /// @param filter only the benchmarks with this substring in the name, all if it is empty
+        static std::vector<Result> RunAll(const Options& options = Options(), const std::string& filter = std::string())
+        {
+            std::vector<Result> results;
+            for (const Entry& entry : Registry())
+                if (entry.name.find(filter) != std::string::npos)
+                    results.push_back(RunBody(entry.name, entry.body, options));
+            return results;
+        }
+
+        static void PrintReport(std::ostream& os, const std::vector<Result>& results);
+
+        // one line per benchmark: name,iterations,repetitions,outliers,median_ns,mad_ns,min_ns,max_ns
+        static void CsvReport(std::ostream& os, const std::vector<Result>& results);
+
+        static Result RunBody(const std::string& name, const Body& body, const Options& options);
+
+    private:
+        struct Entry
+        {
+            std::string name;
+            Body body;
+        };
+
+        static std::vector<Entry>& Registry()
+        {
+            static std::vector<Entry> registry;
+            return registry;
+        }
+
+        // the loop is in the body, so the function is inlined into it, only the body is called indirectly
+        template<typename Function>
+        static Body MakeBody(Function function)
+        {
+            return [function](uint64_t iterations) mutable
+            {
+                for (uint64_t i = 0; i < iterations; ++i)
+                    function();
+            };
+        }
+
+        static double TimeBody(MeasureRecord& record, const Body& body, uint64_t iterations)
+        {
+            record.Reset();
+            const typename MeasureRecord::TimePoint start = record.Now();
+            body(iterations);
+            record.StopMeasure(start);
+            return record.GetTotalSec();
+        }
+
+        static double Median(std::vector<double> values)
+        {
+            std::sort(values.begin(), values.end());
+            const size_t half = values.size() / 2;
+            return values.size() % 2 ? values[half] : (values[half - 1] + values[half]) / 2;
+        }
+
+        static double Mad(const std::vector<double>& values, double median)
+        {
+            std::vector<double> deviations;
+            for (double value : values)
+                deviations.push_back(std::fabs(value - median));
+            return Median(deviations);
+        }
+    };
+
+    using MeasureBenchmark = TMeasureBenchmark<Measure::MeasureBackend>;
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename MeasureBackend>
+auto dtree::TMeasureBenchmark<MeasureBackend>::RunBody(const std::string& name, const Body& body, const Options& options) -> Result
+{
+#if MEASURE_WINDOWS || MEASURE_LINUX
+    if (options.cpu >= 0)
+        MeasureUtils::SetThreadAffinity(options.cpu);
+#endif
+
+    MeasureRecord record(name.c_str(), false);
+
+    // scale the iterations up to minSec, the scaling runs are the warmup too
+    uint64_t iterations = 1;
+    double warmupSec = 0;
+    for (;;)
+    {
+        const double sec = TimeBody(record, body, iterations);
+        warmupSec += sec;
+        if (sec >= options.minSec || iterations >= options.maxIterations)
+            break;
+        uint64_t next = iterations * 10;
+        if (sec > 0)
+        {
+            // 20% above the target, at least one more, and at most 10 times more
+            const double scaled = double(iterations) * options.minSec * 1.2 / sec;
+            next = std::min(next, std::max(iterations + 1, uint64_t(scaled)));
+        }
+        iterations = std::min(next, options.maxIterations);
+    }
+    while (warmupSec < options.warmupSec)
+    {
+        const double sec = TimeBody(record, body, iterations);
+        if (sec <= 0)
+            break;
+        warmupSec += sec;
+    }
+
+    std::vector<double> samples;
+    for (uint32_t i = 0; i < options.repetitions; ++i)
+        samples.push_back(TimeBody(record, body, iterations) / double(iterations));
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    if (samples.empty())
+        return result;
+
+    // reject the outliers by the first median and MAD
+    const double median = Median(samples);
+    const double limit = options.outlierLimit * 1.4826 * Mad(samples, median);
+    std::vector<double> kept;
+    for (double sample : samples)
+        if (options.outlierLimit <= 0 || std::fabs(sample - median) <= limit)
+            kept.push_back(sample);
+
+    result.repetitions = uint32_t(kept.size());
+    result.outliers = uint32_t(samples.size() - kept.size());
+    result.medianSec = Median(kept);
+    result.madSec = Mad(kept, result.medianSec);
+    result.minSec = *std::min_element(kept.begin(), kept.end());
+    result.maxSec = *std::max_element(kept.begin(), kept.end());
+    return result;
+}
+
+template<typename MeasureBackend>
+void dtree::TMeasureBenchmark<MeasureBackend>::PrintReport(std::ostream& os, const std::vector<Result>& results)
+{
+    const size_t width = 40 + 14 + 4 * 14 + 10;
+    const std::string title = std::string(MeasureBackend::GetMeasureTitle()) + " benchmark";
+    MeasureUtils::ReportBuffer report((results.size() + 4) * (width + 1));
+    report.Title(title.c_str(), width);
+
+    report.Right("Name", 40)
+          .Right("Iterations", 14)
+          .Right("Median (ns)", 14)
+          .Right("MAD (ns)", 14)
+          .Right("Min (ns)", 14)
+          .Right("Max (ns)", 14)
+          .Right("Outliers", 10)
+          .Append('\n').Append('-', width).Append('\n');
+    for (const Result& result : results)
+    {
+        report.Right(result.name, 40)
+              .Separated(result.iterations, 14)
+              .Fixed(result.medianSec * 1e9, 3, 14)
+              .Fixed(result.madSec * 1e9, 3, 14)
+              .Fixed(result.minSec * 1e9, 3, 14)
+              .Fixed(result.maxSec * 1e9, 3, 14)
+              .Number(result.outliers, 10)
+              .Append('\n');
+    }
+    report.Append('-', width).Append('\n');
+    report.WriteTo(os);
+}
+
+template<typename MeasureBackend>
+void dtree::TMeasureBenchmark<MeasureBackend>::CsvReport(std::ostream& os, const std::vector<Result>& results)
+{
+    MeasureUtils::ReportBuffer report((results.size() + 1) * 128);
+    report.Append("name,iterations,repetitions,outliers,median_ns,mad_ns,min_ns,max_ns\n");
+    for (const Result& result : results)
+        report.Append(result.name).Append(',')
+              .Number(result.iterations).Append(',')
+              .Number(result.repetitions).Append(',')
+              .Number(result.outliers).Append(',')
+              .Fixed(result.medianSec * 1e9).Append(',')
+              .Fixed(result.madSec * 1e9).Append(',')
+              .Fixed(result.minSec * 1e9).Append(',')
+              .Fixed(result.maxSec * 1e9).Append('\n');
+    report.WriteTo(os);
+}
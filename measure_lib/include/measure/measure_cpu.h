@@ -0,0 +1,190 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Breakdown of the durations by logical processor or by NUMA node.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "measure/measure_utils.h"
+
+namespace dtree
+{
+    /// @brief the key of a MeasureCpuBreakdown
+    enum class MeasureCpuKey
+    {
+        Core,   // logical processor, see MeasureUtils::GetCurrentCpu
+        Node,   // NUMA node, see MeasureUtils::GetCurrentNumaNode
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief the number of calls and the total duration (in raw backend ticks) per processor or per NUMA node
+     *
+     * A call is counted where it has finished, so a scope which migrated to an other processor
+     * is counted at the second one. The slots are allocated at the construction,
+     * one per processor (or node) and one more for the unknown ones, every slot is on its own cache line,
+     * so the threads running on different processors don't write the same cache line.
+     */
+    struct MeasureCpuBreakdown
+    {
+    public:
+        inline explicit MeasureCpuBreakdown(MeasureCpuKey inKey)
+            : key(inKey)
+            , slotNum(inKey == MeasureCpuKey::Core ? MeasureUtils::GetCpuCount() : MeasureUtils::GetNumaNodeCount())
+            , buffer(new char[(slotNum + 1) * sizeof(Slot) + alignof(Slot)])
+        {
+            // the operator new doesn't respect the alignment of the slots before C++17, so it is aligned by hand
+            char* address = buffer.get();
+            address += (alignof(Slot) - reinterpret_cast<uintptr_t>(address) % alignof(Slot)) % alignof(Slot);
+            slots = reinterpret_cast<Slot*>(address);
+            for (unsigned i = 0; i <= slotNum; ++i)
+                new (&slots[i]) Slot();
+            Reset();
+        }
+
+        MeasureCpuBreakdown(const MeasureCpuBreakdown&) = delete;
+        MeasureCpuBreakdown& operator=(const MeasureCpuBreakdown&) = delete;
+
+        /// @brief add a duration to the slot of the current processor or node
+        /// @tparam ThreadSafe if true the counters are updated with relaxed atomic read-modify-write,
+        ///                    otherwise with a relaxed load and store (same cost as a plain increment)
+        template<bool ThreadSafe>
+        inline void Add(uint64_t ticks)
+        {
+            unsigned cpu, node;
+            MeasureUtils::GetCurrentCpuAndNode(cpu, node);
+            Slot& slot = slots[SlotIndex(key == MeasureCpuKey::Core ? cpu : node)];
+            if (ThreadSafe)
+            {
+                slot.ticks.fetch_add(ticks, std::memory_order_relaxed);
+                slot.calls.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                slot.ticks.store(slot.ticks.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+                slot.calls.store(slot.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+
+        inline void Reset()
+        {
+            for (unsigned i = 0; i <= slotNum; ++i)
+            {
+                slots[i].ticks.store(0, std::memory_order_relaxed);
+                slots[i].calls.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        inline MeasureCpuKey GetKey() const         { return key; }
+
+        // the number of the processors or nodes, the slot of the unknown ones is at this index
+        inline unsigned GetSlotNum() const          { return slotNum; }
+
+        inline uint64_t GetCalls(unsigned index) const
+        {
+            return slots[SlotIndex(index)].calls.load(std::memory_order_relaxed);
+        }
+
+        inline uint64_t GetTicks(unsigned index) const
+        {
+            return slots[SlotIndex(index)].ticks.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct alignas(MEASURE_CACHE_LINE_SIZE) Slot
+        {
+            std::atomic<uint64_t> ticks;
+            std::atomic<uint64_t> calls;
+        };
+
+        // an unknown or hot plugged processor (or node) is in the last slot
+        inline unsigned SlotIndex(unsigned index) const
+        {
+            return index < slotNum ? index : slotNum;
+        }
+
+        const MeasureCpuKey key;
+        const unsigned slotNum;
+        std::unique_ptr<char[]> buffer;
+        Slot* slots;                        // in the buffer, aligned to cache line
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief print the breakdown of the records with WithCpu policy, printed by MeasureDatabase::PrintReport
+    /// the relative column is the average of the processor (node) per the average of all the calls of the record,
+    /// e.g. a scope which is slow only on the remote node has a higher relative average on that node
+    template<typename MeasureRecord>
+    void MeasureCpuReport(std::ostream& os, const std::vector<MeasureRecord*>& records)
+    {
+        using namespace std;
+
+        const size_t width = 40 + 12 + 12 + 17 + 17 + 12;
+        bool hasBreakdown = false;
+        for (MeasureRecord* measureRecord : records)
+        {
+            const MeasureCpuBreakdown* breakdown = measureRecord->GetCpuBreakdown();
+            if (!breakdown)
+                continue;
+
+            uint64_t allCalls = 0;
+            uint64_t allTicks = 0;
+            for (unsigned i = 0; i <= breakdown->GetSlotNum(); ++i)
+            {
+                allCalls += breakdown->GetCalls(i);
+                allTicks += breakdown->GetTicks(i);
+            }
+            if (allCalls == 0)
+                continue;
+
+            if (!hasBreakdown)
+            {
+                hasBreakdown = true;
+                const std::string title = "per processor and NUMA node";
+                const std::string pad((width - title.length()) / 2 - 1, '-');
+                os << pad << " " << title << " " << pad << (title.length() % 2 ? "-" : "") << "\n";
+                os  << setw(40) << "Name"
+                    << setw(12) << "Where"
+                    << setw(12) << "Calls"
+                    << setw(17) << "Total (ns)"
+                    << setw(17) << "Average (ns)"
+                    << setw(12) << "Relative"
+                    << "\n";
+                os << std::string(width, '-') << std::endl;
+            }
+
+            const double allAverage = double(allTicks) / double(allCalls);
+            for (unsigned i = 0; i <= breakdown->GetSlotNum(); ++i)
+            {
+                const uint64_t calls = breakdown->GetCalls(i);
+                if (calls == 0)
+                    continue;
+                const uint64_t ticks = breakdown->GetTicks(i);
+                const double average = double(ticks) / double(calls);
+                const std::string where = i == breakdown->GetSlotNum() ? std::string("unknown")
+                    : (breakdown->GetKey() == MeasureCpuKey::Core ? "cpu " : "node ") + std::to_string(i);
+                std::ostringstream relative;
+                relative << fixed << setprecision(2) << (allAverage > 0 ? average / allAverage : 1.0) << "x";
+                os  << setw(40) << measureRecord->name
+                    << setw(12) << where
+                    << setw(12) << calls
+                    << setw(17) << MeasureUtils::TimeToStrNs(MeasureRecord::TicksToSec(ticks))
+                    << setw(17) << MeasureUtils::TimeToStrNs(MeasureRecord::TicksToSec(ticks) / double(calls))
+                    << setw(12) << relative.str()
+                    << "\n";
+            }
+        }
+        if (hasBreakdown)
+            os << std::string(width, '-') << std::endl;
+    }
+
+} // namespace dtree
@@ -0,0 +1,405 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Regression comparison of two snapshots, e.g. of the previous and the new build (see measure_tools/measure_snapshot).
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <unordered_map>
+
+#include "measure/measure_utils.h"
+#include "measure/measure_snapshot.h"
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct MeasureDiffOptions
+    {
+        // a record is a regression if its average is slower by more than this percent
+        double thresholdPercent = 5.0;
+
+        // and the change is significant: the z-score of the averages is at least this (3 is about 99.7%),
+        // the records without stats or histogram have no z-score, they are judged by the threshold only
+        double minZScore = 3.0;
+
+        // the records with less calls in either snapshot are not judged
+        uint64_t minCalls = 1;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief the per record differences of two snapshots, and the regressions by the options
+     *
+     * The records are matched by the name (and by the order of the records with the same name).
+     * The significance is the z-score of Welch's test of the two averages: the variances are taken
+     * from the stats of the records (see TMeasure::WithStats), or estimated from the histograms
+     * (see TMeasure::WithHistogram) by the midpoints of the buckets.
+     * The entries are sorted by the absolute regression, the change of the average multiplied by the calls
+     * of the new snapshot, so the slowdowns which cost the most time are at the top, then the improvements,
+     * then the new and the removed records.
+     */
+    struct MeasureDiff
+    {
+    public:
+        enum class Status
+        {
+            Same,
+            Improved,
+            Regression,
+            New,
+            Removed,
+            NotJudged       // too few calls, see MeasureDiffOptions::minCalls
+        };
+
+        struct Entry
+        {
+            std::string name;
+            Status status = Status::Same;
+            uint64_t callsBefore = 0;
+            uint64_t callsAfter = 0;
+            double totalBeforeSec = 0;
+            double totalAfterSec = 0;
+            double averageBeforeSec = 0;
+            double averageAfterSec = 0;
+            double changePercent = 0;           // of the average
+            double impactSec = 0;               // the change of the average * the calls after, 0 if new or removed
+            bool hasPercentiles = false;        // both records have histogram
+            double p50BeforeSec = 0;
+            double p50AfterSec = 0;
+            double p99BeforeSec = 0;
+            double p99AfterSec = 0;
+            bool hasZScore = false;             // both records have stats or histogram
+            double zScore = 0;                  // positive if slower
+        };
+
+        MeasureDiffOptions options;
+        std::vector<Entry> entries;
+
+        inline static MeasureDiff Compare(const MeasureSnapshot& before, const MeasureSnapshot& after,
+                                          const MeasureDiffOptions& options = MeasureDiffOptions());
+
+        inline bool HasRegression() const
+        {
+            for (const Entry& entry : entries)
+                if (entry.status == Status::Regression)
+                    return true;
+            return false;
+        }
+
+        inline static const char* StatusName(Status status);
+
+        /// @brief the human readable report, the percentile columns are printed only if a record has them
+        inline void PrintReport(MeasureUtils::ReportBuffer& report, const std::string& title) const;
+        inline void PrintReport(std::ostream& os, const std::string& title) const;
+
+        inline void CsvReport(MeasureUtils::ReportBuffer& report) const;
+        inline void CsvReport(std::ostream& os) const;
+
+    private:
+        // the count and the sample variance of the durations of a record in seconds^2, false without stats and histogram
+        inline static bool GetVariance(const MeasureSnapshot& snapshot, const MeasureSnapshot::Record& record,
+                                       double& count, double& variance);
+
+        inline static MeasureUtils::ReportBuffer& SignedNs(MeasureUtils::ReportBuffer& report, double sec, size_t width);
+    };
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+dtree::MeasureDiff dtree::MeasureDiff::Compare(const MeasureSnapshot& before, const MeasureSnapshot& after,
+                                               const MeasureDiffOptions& options)
+{
+    using Record = MeasureSnapshot::Record;
+
+    MeasureDiff diff;
+    diff.options = options;
+
+    // the records of the same name are matched in their order
+    std::unordered_map<std::string, std::vector<const Record*>> previous;
+    for (const Record& record : before.records)
+        previous[record.name].push_back(&record);
+    std::unordered_map<std::string, size_t> occurrences;
+
+    auto average = [](const MeasureSnapshot& snapshot, const Record& record)
+    {
+        return record.numCall ? snapshot.GetTotalSec(record) / double(record.numCall) : 0.0;
+    };
+    auto fill = [&average](Entry& entry, const MeasureSnapshot& snapshot, const Record& record, bool isAfter)
+    {
+        (isAfter ? entry.callsAfter : entry.callsBefore) = record.numCall;
+        (isAfter ? entry.totalAfterSec : entry.totalBeforeSec) = snapshot.GetTotalSec(record);
+        (isAfter ? entry.averageAfterSec : entry.averageBeforeSec) = average(snapshot, record);
+        if (record.hasHistogram)
+        {
+            (isAfter ? entry.p50AfterSec : entry.p50BeforeSec) = snapshot.TicksToSec(double(record.histogram.GetPercentile(0.5)));
+            (isAfter ? entry.p99AfterSec : entry.p99BeforeSec) = snapshot.TicksToSec(double(record.histogram.GetPercentile(0.99)));
+        }
+    };
+
+    for (const Record& record : after.records)
+    {
+        Entry entry;
+        entry.name = record.name;
+        fill(entry, after, record, true);
+
+        std::vector<const Record*>& candidates = previous[record.name];
+        const size_t occurrence = occurrences[record.name]++;
+        const Record* old = occurrence < candidates.size() ? candidates[occurrence] : nullptr;
+        if (!old)
+        {
+            entry.status = Status::New;
+            diff.entries.push_back(std::move(entry));
+            continue;
+        }
+        fill(entry, before, *old, false);
+        entry.hasPercentiles = old->hasHistogram && record.hasHistogram;
+        entry.impactSec = (entry.averageAfterSec - entry.averageBeforeSec) * double(entry.callsAfter);
+        if (entry.averageBeforeSec > 0)
+            entry.changePercent = (entry.averageAfterSec / entry.averageBeforeSec - 1.0) * 100.0;
+
+        // Welch's test of the two averages
+        double countBefore, varianceBefore, countAfter, varianceAfter;
+        if (GetVariance(before, *old, countBefore, varianceBefore) && GetVariance(after, record, countAfter, varianceAfter))
+        {
+            const double standardError = std::sqrt(varianceBefore / countBefore + varianceAfter / countAfter);
+            const double delta = entry.averageAfterSec - entry.averageBeforeSec;
+            entry.hasZScore = true;
+            if (standardError > 0)
+                entry.zScore = delta / standardError;
+            else if (delta != 0)
+                entry.zScore = delta > 0 ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+        }
+
+        const bool significant = !entry.hasZScore || std::abs(entry.zScore) >= options.minZScore;
+        if (entry.callsBefore < options.minCalls || entry.callsAfter < options.minCalls || entry.callsBefore == 0 || entry.callsAfter == 0)
+            entry.status = Status::NotJudged;
+        else if (significant && entry.changePercent > options.thresholdPercent)
+            entry.status = Status::Regression;
+        else if (significant && entry.changePercent < -options.thresholdPercent)
+            entry.status = Status::Improved;
+        diff.entries.push_back(std::move(entry));
+    }
+
+    // the records which are only in the old snapshot
+    occurrences.clear();
+    std::unordered_map<std::string, size_t> afterCounts;
+    for (const Record& record : after.records)
+        ++afterCounts[record.name];
+    for (const Record& record : before.records)
+    {
+        if (occurrences[record.name]++ < afterCounts[record.name])
+            continue;
+        Entry entry;
+        entry.name = record.name;
+        entry.status = Status::Removed;
+        fill(entry, before, record, false);
+        diff.entries.push_back(std::move(entry));
+    }
+
+    // the new and the removed records are at the end
+    std::stable_sort(diff.entries.begin(), diff.entries.end(), [](const Entry& a, const Entry& b)
+    {
+        const bool aMatched = a.status != Status::New && a.status != Status::Removed;
+        const bool bMatched = b.status != Status::New && b.status != Status::Removed;
+        if (aMatched != bMatched)
+            return aMatched;
+        return a.impactSec > b.impactSec;
+    });
+    return diff;
+}
+
+const char* dtree::MeasureDiff::StatusName(Status status)
+{
+    switch (status)
+    {
+    case Status::Same:          return "";
+    case Status::Improved:      return "improved";
+    case Status::Regression:    return "REGRESSION";
+    case Status::New:           return "new";
+    case Status::Removed:       return "removed";
+    case Status::NotJudged:     return "few calls";
+    }
+    return "";
+}
+
+void dtree::MeasureDiff::PrintReport(MeasureUtils::ReportBuffer& report, const std::string& title) const
+{
+    bool hasPercentiles = false;
+    for (const Entry& entry : entries)
+        hasPercentiles = hasPercentiles || entry.hasPercentiles;
+
+    const size_t width = 40 + 12 + 12 + 17 + 14 + 14 + 10 + 17 + (hasPercentiles ? 4 * 14 : 0) + 9 + 12;
+    report.Reserve((entries.size() + 6) * (width + 1));
+    report.Title((title + " difference").c_str(), width);
+
+    report.Right("Name", 40)
+          .Right("Calls", 12)
+          .Right("Calls diff", 12)
+          .Right("Total diff (ns)", 17)
+          .Right("Average (ns)", 14)
+          .Right("Avg diff (ns)", 14)
+          .Right("Change", 10)
+          .Right("Impact (ns)", 17);
+    if (hasPercentiles)
+        report.Right("p50 (ns)", 14)
+              .Right("p50 diff", 14)
+              .Right("p99 (ns)", 14)
+              .Right("p99 diff", 14);
+    report.Right("z", 9)
+          .Right("Status", 12)
+          .Append('\n').Append('-', width).Append('\n');
+
+    char buffer[32];
+    for (const Entry& entry : entries)
+    {
+        const bool removed = entry.status == Status::Removed;
+        const bool matched = entry.status != Status::New && !removed;
+        report.Right(entry.name, 40)
+              .Number(entry.callsAfter, 12);
+        const int64_t callsDiff = int64_t(entry.callsAfter - entry.callsBefore);
+        report.Right(std::string(callsDiff >= 0 ? "+" : "-") + MeasureUtils::FormatWithSeparator(uint64_t(callsDiff >= 0 ? callsDiff : -callsDiff)), 12);
+        SignedNs(report, entry.totalAfterSec - entry.totalBeforeSec, 17);
+        if (removed)
+            report.Append(' ', 14);
+        else
+            report.Ns(entry.averageAfterSec, 14);
+        if (matched)
+        {
+            SignedNs(report, entry.averageAfterSec - entry.averageBeforeSec, 14);
+            snprintf(buffer, sizeof(buffer), "%+.1f%%", entry.changePercent);
+            report.Right(buffer, 10);
+        }
+        else
+            report.Append(' ', 14 + 10);
+        SignedNs(report, entry.impactSec, 17);
+
+        if (hasPercentiles && entry.hasPercentiles)
+        {
+            report.Ns(entry.p50AfterSec, 14);
+            SignedNs(report, entry.p50AfterSec - entry.p50BeforeSec, 14);
+            report.Ns(entry.p99AfterSec, 14);
+            SignedNs(report, entry.p99AfterSec - entry.p99BeforeSec, 14);
+        }
+        else if (hasPercentiles)
+            report.Append(' ', 4 * 14);
+
+        if (entry.hasZScore)
+        {
+            snprintf(buffer, sizeof(buffer), "%.1f", entry.zScore);
+            report.Right(buffer, 9);
+        }
+        else
+            report.Append(' ', 9);
+        report.Right(StatusName(entry.status), 12).Append('\n');
+    }
+    report.Append('-', width).Append('\n');
+
+    snprintf(buffer, sizeof(buffer), "%.1f%%", options.thresholdPercent);
+    report.Append("Regression: the average is slower by more than ").Append(buffer);
+    snprintf(buffer, sizeof(buffer), "%.1f", options.minZScore);
+    report.Append(" with a z-score of at least ").Append(buffer).Append(" (if the records have stats or histogram)\n");
+}
+
+void dtree::MeasureDiff::PrintReport(std::ostream& os, const std::string& title) const
+{
+    MeasureUtils::ReportBuffer report;
+    PrintReport(report, title);
+    report.WriteTo(os);
+}
+
+void dtree::MeasureDiff::CsvReport(MeasureUtils::ReportBuffer& report) const
+{
+    bool hasPercentiles = false;
+    for (const Entry& entry : entries)
+        hasPercentiles = hasPercentiles || entry.hasPercentiles;
+
+    report.Reserve((entries.size() + 1) * 192);
+    report.Append("name,status,calls_before,calls_after,total_before_ns,total_after_ns,average_before_ns,average_after_ns,"
+                  "average_change_percent,impact_ns");
+    if (hasPercentiles)
+        report.Append(",p50_before_ns,p50_after_ns,p99_before_ns,p99_after_ns");
+    report.Append(",z_score\n");
+
+    for (const Entry& entry : entries)
+    {
+        const bool matched = entry.status != Status::New && entry.status != Status::Removed;
+        report.Append(entry.name).Append(',').Append(StatusName(entry.status))
+              .Append(',').Number(entry.callsBefore)
+              .Append(',').Number(entry.callsAfter)
+              .Append(',').Fixed(entry.totalBeforeSec * 1e9)
+              .Append(',').Fixed(entry.totalAfterSec * 1e9)
+              .Append(',').Fixed(entry.averageBeforeSec * 1e9)
+              .Append(',').Fixed(entry.averageAfterSec * 1e9)
+              .Append(',');
+        if (matched)
+            report.Fixed(entry.changePercent);
+        report.Append(',').Fixed(entry.impactSec * 1e9);
+        if (hasPercentiles && entry.hasPercentiles)
+            report.Append(',').Fixed(entry.p50BeforeSec * 1e9)
+                  .Append(',').Fixed(entry.p50AfterSec * 1e9)
+                  .Append(',').Fixed(entry.p99BeforeSec * 1e9)
+                  .Append(',').Fixed(entry.p99AfterSec * 1e9);
+        else if (hasPercentiles)
+            report.Append(",,,,");
+        report.Append(',');
+        if (entry.hasZScore && std::isfinite(entry.zScore))
+            report.Fixed(entry.zScore);
+        else if (entry.hasZScore)
+            report.Append(entry.zScore > 0 ? "inf" : "-inf");
+        report.Append('\n');
+    }
+}
+
+void dtree::MeasureDiff::CsvReport(std::ostream& os) const
+{
+    MeasureUtils::ReportBuffer report;
+    CsvReport(report);
+    report.WriteTo(os);
+}
+
+bool dtree::MeasureDiff::GetVariance(const MeasureSnapshot& snapshot, const MeasureSnapshot::Record& record,
+                                     double& count, double& variance)
+{
+    if (record.hasStats && record.stats.GetCount() > 1)
+    {
+        count = double(record.stats.GetCount());
+        variance = record.stats.GetVariance() * snapshot.secondsPerTick * snapshot.secondsPerTick;
+        return true;
+    }
+    if (!record.hasHistogram)
+        return false;
+
+    // the midpoints of the buckets, the quantization only adds to the variance
+    const MeasureHistogramCounts& histogram = record.histogram;
+    count = double(histogram.GetTotalCount());
+    if (count < 2)
+        return false;
+    double sum = 0;
+    double sumSquares = 0;
+    for (const std::pair<uint32_t, uint64_t>& bucket : histogram.buckets)
+    {
+        // the smallest value of a bucket is after the largest value of the previous one
+        const uint64_t lower = bucket.first == 0 ? 0 : MeasureHistogramCounts::BucketUpperBound(histogram.subBucketBits, bucket.first - 1) + 1;
+        const uint64_t upper = std::min(MeasureHistogramCounts::BucketUpperBound(histogram.subBucketBits, bucket.first), histogram.maxValue);
+        const double midpoint = (double(lower) + double(std::max(lower, upper))) / 2;
+        sum += midpoint * double(bucket.second);
+        sumSquares += midpoint * midpoint * double(bucket.second);
+    }
+    const double varianceTicks = std::max(0.0, (sumSquares - sum * sum / count) / (count - 1));
+    variance = varianceTicks * snapshot.secondsPerTick * snapshot.secondsPerTick;
+    return true;
+}
+
+dtree::MeasureUtils::ReportBuffer& dtree::MeasureDiff::SignedNs(MeasureUtils::ReportBuffer& report, double sec, size_t width)
+{
+    const double ns = sec * 1e9;
+    return report.Right(std::string(ns <= -1.0 ? "-" : "+") + MeasureUtils::FormatWithSeparator(uint64_t(std::abs(ns))), width);
+}
@@ -0,0 +1,311 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Log-linear (HDR style) latency histogram of raw backend ticks.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include "measure/measure_utils.h"
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a plain copy of the non-empty buckets of a TMeasureHistogram, see MeasureSnapshot
+     *
+     * The buckets are sorted by the index. The copies of the histograms with the same SubBucketBits
+     * can be merged exactly by adding the counts of the same buckets.
+     */
+    struct MeasureHistogramCounts
+    {
+        uint32_t subBucketBits = 0;
+        uint64_t maxValue = 0;
+        std::vector<std::pair<uint32_t, uint64_t>> buckets;    // index, count
+
+        // the bucket of a value, the same as TMeasureHistogram::BucketIndex
+        inline static uint32_t BucketIndex(uint32_t subBucketBits, uint64_t value)
+        {
+            const uint32_t subBucketCount = 1u << subBucketBits;
+            if (value < subBucketCount)
+                return uint32_t(value);
+            const uint32_t exponent = MeasureUtils::HighestBitIndex(value) - subBucketBits + 1;
+            return (exponent << subBucketBits) + uint32_t(value >> (exponent - 1)) - subBucketCount;
+        }
+
+        // the largest value of a bucket, the same as TMeasureHistogram::BucketUpperBound
+        inline static uint64_t BucketUpperBound(uint32_t subBucketBits, uint32_t index)
+        {
+            const uint32_t subBucketCount = 1u << subBucketBits;
+            if (index < subBucketCount)
+                return index;
+            const uint32_t exponent = index >> subBucketBits;
+            const uint64_t mantissa = (index & (subBucketCount - 1)) + subBucketCount;
+            return ((mantissa + 1) << (exponent - 1)) - 1; // wraps to UINT64_MAX in the last bucket
+        }
+
+        inline uint64_t GetTotalCount() const
+        {
+            uint64_t count = 0;
+            for (const std::pair<uint32_t, uint64_t>& bucket : buckets)
+                count += bucket.second;
+            return count;
+        }
+
+        // the same as TMeasureHistogram::GetPercentile
+        inline uint64_t GetPercentile(double fraction) const
+        {
+            const uint64_t totalCount = GetTotalCount();
+            if (totalCount == 0)
+                return 0;
+            uint64_t target = uint64_t(fraction * double(totalCount) + 0.5);
+            if (target < 1)
+                target = 1;
+            uint64_t count = 0;
+            for (const std::pair<uint32_t, uint64_t>& bucket : buckets)
+            {
+                count += bucket.second;
+                if (count >= target)
+                {
+                    const uint64_t upperBound = BucketUpperBound(subBucketBits, bucket.first);
+                    return upperBound < maxValue ? upperBound : maxValue;
+                }
+            }
+            return maxValue;
+        }
+
+        /// @brief add the counts of another histogram, as if its values were added here
+        /// It is exact if the SubBucketBits are the same and the scale is 1. Otherwise the buckets of both
+        /// are moved into the buckets of the coarser resolution by their largest value (multiplied by the scale,
+        /// e.g. the ratio of the tick lengths), so the percentiles remain upper bounds within that resolution.
+        inline void Merge(const MeasureHistogramCounts& other, double scale = 1.0);
+
+    private:
+        inline static uint64_t Scale(uint64_t value, double scale)
+        {
+            const double scaled = double(value) * scale + 0.5;
+            return scaled < 18446744073709551615.0 ? uint64_t(scaled) : UINT64_MAX;
+        }
+
+        // move the buckets into the given resolution, by the largest value of the buckets
+        inline void Rebucket(uint32_t bits, double scale);
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a fixed size log-linear histogram of durations, in raw backend ticks
+     *
+     * The values below 2^SubBucketBits have their own buckets,
+     * above that every power of two range is divided into 2^SubBucketBits linear sub-buckets,
+     * so the relative error of a bucket is at most 1 / 2^SubBucketBits (6.25% with the default 4 bits).
+     * The whole uint64_t range is covered, the bucket index is computed in constant time
+     * from the highest set bit, without any conversion to seconds and without allocation.
+     */
+    template<uint32_t InSubBucketBits = 4>
+    struct TMeasureHistogram
+    {
+    public:
+        static constexpr uint32_t SubBucketBits = InSubBucketBits;
+        static constexpr uint32_t SubBucketCount = 1u << SubBucketBits;
+        static constexpr uint32_t BucketCount = (65 - SubBucketBits) * SubBucketCount;
+
+        inline TMeasureHistogram()
+        {
+            Reset();
+        }
+
+        inline static uint32_t BucketIndex(uint64_t value)
+        {
+            if (value < SubBucketCount)
+                return uint32_t(value);
+            const uint32_t exponent = MeasureUtils::HighestBitIndex(value) - SubBucketBits + 1;
+            return (exponent << SubBucketBits) + uint32_t(value >> (exponent - 1)) - SubBucketCount;
+        }
+
+        // the smallest value of a bucket
+        inline static uint64_t BucketLowerBound(uint32_t index)
+        {
+            if (index < SubBucketCount)
+                return index;
+            const uint32_t exponent = index >> SubBucketBits;
+            const uint64_t mantissa = (index & (SubBucketCount - 1)) + SubBucketCount;
+            return mantissa << (exponent - 1);
+        }
+
+        // the largest value of a bucket
+        inline static uint64_t BucketUpperBound(uint32_t index)
+        {
+            return MeasureHistogramCounts::BucketUpperBound(SubBucketBits, index);
+        }
+
+        /// @brief add a duration, constant time
+        /// @tparam ThreadSafe if true the counters are updated with relaxed atomic read-modify-write,
+        ///                    otherwise with a relaxed load and store (same cost as a plain increment)
+        template<bool ThreadSafe>
+        inline void Add(uint64_t value)
+        {
+            std::atomic<uint64_t>& bucket = buckets[BucketIndex(value)];
+            if (ThreadSafe)
+                bucket.fetch_add(1, std::memory_order_relaxed);
+            else
+                bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            uint64_t currentMax = maxValue.load(std::memory_order_relaxed);
+            if (value > currentMax)
+            {
+                if (ThreadSafe)
+                {
+                    while (value > currentMax
+                        && !maxValue.compare_exchange_weak(currentMax, value, std::memory_order_relaxed))
+                        ;
+                }
+                else
+                    maxValue.store(value, std::memory_order_relaxed);
+            }
+        }
+
+        inline void Reset()
+        {
+            for (std::atomic<uint64_t>& bucket : buckets)
+                bucket.store(0, std::memory_order_relaxed);
+            maxValue.store(0, std::memory_order_relaxed);
+        }
+
+        inline uint64_t GetCount(uint32_t index) const
+        {
+            return buckets[index].load(std::memory_order_relaxed);
+        }
+
+        inline uint64_t GetTotalCount() const
+        {
+            uint64_t count = 0;
+            for (const std::atomic<uint64_t>& bucket : buckets)
+                count += bucket.load(std::memory_order_relaxed);
+            return count;
+        }
+
+        inline uint64_t GetMax() const
+        {
+            return maxValue.load(std::memory_order_relaxed);
+        }
+
+        /// @brief the value below which the given fraction of the durations fall
+        /// @param fraction is in [0, 1], e.g. 0.99 for p99
+        /// @return the upper bound of the bucket, but at most the maximum, 0 if the histogram is empty
+        inline uint64_t GetPercentile(double fraction) const
+        {
+            const uint64_t totalCount = GetTotalCount();
+            if (totalCount == 0)
+                return 0;
+            uint64_t target = uint64_t(fraction * double(totalCount) + 0.5);
+            if (target < 1)
+                target = 1;
+            uint64_t count = 0;
+            for (uint32_t index = 0; index < BucketCount; ++index)
+            {
+                count += GetCount(index);
+                if (count >= target)
+                {
+                    const uint64_t upperBound = BucketUpperBound(index);
+                    return upperBound < GetMax() ? upperBound : GetMax();
+                }
+            }
+            return GetMax();
+        }
+
+        // copy the non-empty buckets, the buckets are read one by one, without stopping the writers
+        inline void CopyTo(MeasureHistogramCounts& counts) const
+        {
+            counts.subBucketBits = SubBucketBits;
+            counts.maxValue = GetMax();
+            counts.buckets.clear();
+            for (uint32_t index = 0; index < BucketCount; ++index)
+            {
+                const uint64_t count = GetCount(index);
+                if (count != 0)
+                    counts.buckets.emplace_back(index, count);
+            }
+        }
+
+    private:
+        std::atomic<uint64_t> buckets[BucketCount];
+        std::atomic<uint64_t> maxValue;
+    };
+
+    using MeasureHistogram = TMeasureHistogram<>;
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void dtree::MeasureHistogramCounts::Merge(const MeasureHistogramCounts& other, double scale)
+{
+    if (other.buckets.empty() && other.maxValue == 0)
+        return;
+    if (buckets.empty() && maxValue == 0)
+        subBucketBits = other.subBucketBits;
+
+    const uint32_t bits = std::min(subBucketBits, other.subBucketBits);
+    if (bits != subBucketBits)
+        Rebucket(bits, 1.0);
+    MeasureHistogramCounts added = other;
+    if (bits != other.subBucketBits || scale != 1.0)
+        added.Rebucket(bits, scale);
+
+    // both are sorted by the index
+    std::vector<std::pair<uint32_t, uint64_t>> merged;
+    merged.reserve(buckets.size() + added.buckets.size());
+    size_t i = 0, j = 0;
+    while (i < buckets.size() || j < added.buckets.size())
+    {
+        if (j == added.buckets.size() || (i < buckets.size() && buckets[i].first < added.buckets[j].first))
+            merged.push_back(buckets[i++]);
+        else if (i == buckets.size() || added.buckets[j].first < buckets[i].first)
+            merged.push_back(added.buckets[j++]);
+        else
+        {
+            merged.emplace_back(buckets[i].first, buckets[i].second + added.buckets[j].second);
+            ++i;
+            ++j;
+        }
+    }
+    buckets.swap(merged);
+    maxValue = std::max(maxValue, added.maxValue);
+}
+
+void dtree::MeasureHistogramCounts::Rebucket(uint32_t bits, double scale)
+{
+    for (std::pair<uint32_t, uint64_t>& bucket : buckets)
+    {
+        const uint64_t upperBound = std::min(BucketUpperBound(subBucketBits, bucket.first), maxValue);
+        bucket.first = BucketIndex(bits, Scale(upperBound, scale));
+    }
+    std::sort(buckets.begin(), buckets.end());
+
+    // add the counts of the buckets which are merged into one
+    size_t last = 0;
+    for (size_t i = 1; i < buckets.size(); ++i)
+    {
+        if (buckets[i].first == buckets[last].first)
+            buckets[last].second += buckets[i].second;
+        else
+            buckets[++last] = buckets[i];
+    }
+    if (!buckets.empty())
+        buckets.resize(last + 1);
+    subBucketBits = bits;
+    maxValue = Scale(maxValue, scale);
+}
+
+template<uint32_t InSubBucketBits>
+constexpr uint32_t dtree::TMeasureHistogram<InSubBucketBits>::SubBucketBits;
+
+template<uint32_t InSubBucketBits>
+constexpr uint32_t dtree::TMeasureHistogram<InSubBucketBits>::SubBucketCount;
+
+template<uint32_t InSubBucketBits>
+constexpr uint32_t dtree::TMeasureHistogram<InSubBucketBits>::BucketCount;
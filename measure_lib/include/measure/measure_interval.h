@@ -0,0 +1,289 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Periodic per-interval reports (calls/sec, average latency) from a background thread.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "measure/measure_utils.h"
+#include "measure/measure_snapshot.h"
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief the differences of the records between two snapshots
+     *
+     * Only the records with calls in the interval are listed.
+     * If the database was reset between the snapshots (see MeasureSnapshot::resetEpoch), the whole current value
+     * is the difference.
+     */
+    struct MeasureInterval
+    {
+    public:
+        struct Record
+        {
+            std::string name;
+            uint64_t nameId;
+            uint64_t numCall;
+            double totalSec;
+            double callsPerSec;
+            double averageSec;
+        };
+
+        std::string title;
+        uint64_t timestampNs = 0;   // system_clock time of the end of the interval since the epoch
+        double seconds = 0;         // the length of the interval
+        std::vector<Record> records;
+
+        inline static MeasureInterval Delta(const MeasureSnapshot& before, const MeasureSnapshot& after, double seconds);
+
+        inline void PrintReport(std::ostream& os) const;
+
+        // one line per record: timestamp_ms,name,num_calls,calls_per_sec,average_ns
+        inline void CsvReport(std::ostream& os, bool withHeader = false) const;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief reports the differences of the records of a database in every interval from a background thread
+     *
+     * The thread takes a MeasureSnapshot in every interval (the database mutex is held only while the counters
+     * are copied), so the measured threads are never stopped and the cumulative counters are not reset.
+     * The sink is called from the background thread (or from Report()), one interval at a time and in order,
+     * without the lock of the reporter, so a slow sink doesn't block IsRunning(). It must not call the reporter.
+     * There is one reporter per database.
+     */
+    template<typename Database>
+    class MeasureIntervalReporter
+    {
+    public:
+        using Sink = std::function<void(const MeasureInterval&)>;
+
+        /// @brief start the background thread, the first interval begins now
+        /// @return false if it is already running
+        static bool Start(Sink sink, std::chrono::milliseconds interval = std::chrono::milliseconds(10000))
+        {
+            State& state = GetState();
+            const std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.running)
+                return false;
+            state.running = true;
+            state.stop = false;
+            state.sink = std::move(sink);
+            state.previous = MeasureSnapshot::Take<Database>();
+            state.previousTime = std::chrono::steady_clock::now();
+            state.thread = std::thread(&MeasureIntervalReporter::Run, std::ref(state), interval);
+            return true;
+        }
+
+        /// @brief stop the background thread, the last partial interval is not reported
+        static void Stop()
+        {
+            GetState().Stop();
+        }
+
+        static bool IsRunning()
+        {
+            State& state = GetState();
+            const std::lock_guard<std::mutex> lock(state.mutex);
+            return state.running;
+        }
+
+        /// @brief close the current interval immediately, false if the reporter is not running
+        static bool Report()
+        {
+            return Report(GetState());
+        }
+
+        /// @brief a sink which prints the human readable report of every interval
+        static Sink PrintSink(std::ostream& os)
+        {
+            return [&os](const MeasureInterval& interval) { interval.PrintReport(os); };
+        }
+
+        /// @brief a sink which appends the CSV lines of every interval, the header is printed first
+        static Sink CsvSink(std::ostream& os)
+        {
+            auto first = std::make_shared<bool>(true);
+            return [&os, first](const MeasureInterval& interval)
+            {
+                interval.CsvReport(os, *first);
+                *first = false;
+            };
+        }
+
+    private:
+        struct State
+        {
+            std::mutex mutex;
+            std::mutex sinkMutex;   // the sink is called under it, it is locked before the mutex
+            std::condition_variable cv;
+            std::thread thread;
+            bool running = false;
+            bool stop = false;
+            Sink sink;
+            MeasureSnapshot previous;
+            std::chrono::steady_clock::time_point previousTime;
+
+            inline void Stop()
+            {
+                {
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+                cv.notify_all();
+                if (thread.joinable())
+                    thread.join();
+                // waits for the sink called by Report() from another thread
+                const std::lock_guard<std::mutex> sinkLock(sinkMutex);
+                const std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+                sink = nullptr;
+            }
+
+            inline ~State()
+            {
+                Stop();
+            }
+        };
+
+        static State& GetState()
+        {
+            // the database is constructed first, so it is destroyed after the thread is stopped at exit
+            Database::GetMutex();
+            static State state;
+            return state;
+        }
+
+        static bool Report(State& state)
+        {
+            const std::lock_guard<std::mutex> sinkLock(state.sinkMutex);
+            Sink sink;
+            MeasureInterval interval;
+            {
+                const std::lock_guard<std::mutex> lock(state.mutex);
+                if (!state.running || state.stop)
+                    return false;
+                MeasureSnapshot current = MeasureSnapshot::Take<Database>();
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                const double seconds = std::chrono::duration<double>(now - state.previousTime).count();
+                interval = MeasureInterval::Delta(state.previous, current, seconds);
+                state.previous = std::move(current);
+                state.previousTime = now;
+                sink = state.sink;
+            }
+            if (sink)
+                sink(interval);
+            return true;
+        }
+
+        static void Run(State& state, std::chrono::milliseconds interval)
+        {
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(state.mutex);
+                    if (state.cv.wait_for(lock, interval, [&state]() { return state.stop; }))
+                        return;
+                }
+                Report(state);
+            }
+        }
+    };
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+dtree::MeasureInterval dtree::MeasureInterval::Delta(const MeasureSnapshot& before, const MeasureSnapshot& after, double seconds)
+{
+    MeasureInterval interval;
+    interval.title = after.title;
+    interval.timestampNs = after.timestampNs;
+    interval.seconds = seconds;
+
+    std::unordered_multimap<uint64_t, const MeasureSnapshot::Record*> previous;
+    for (const MeasureSnapshot::Record& record : before.records)
+        previous.emplace(record.nameId, &record);
+
+    for (const MeasureSnapshot::Record& record : after.records)
+    {
+        const MeasureSnapshot::Record* old = nullptr;
+        const auto range = previous.equal_range(record.nameId);
+        for (auto iter = range.first; iter != range.second && !old; ++iter)
+            if (iter->second->name == record.name)
+            {
+                old = iter->second;
+                previous.erase(iter);
+            }
+
+        uint64_t numCall = record.numCall;
+        int64_t totalTicks = record.totalTicks;
+        if (old && before.resetEpoch == after.resetEpoch)
+        {
+            numCall -= old->numCall;
+            totalTicks -= old->totalTicks;
+        }
+        if (numCall == 0)
+            continue;
+
+        Record delta;
+        delta.name = record.name;
+        delta.nameId = record.nameId;
+        delta.numCall = numCall;
+        delta.totalSec = double(totalTicks) * after.secondsPerTick;
+        delta.callsPerSec = seconds > 0 ? double(numCall) / seconds : 0.0;
+        delta.averageSec = delta.totalSec / double(numCall);
+        interval.records.push_back(std::move(delta));
+    }
+    return interval;
+}
+
+void dtree::MeasureInterval::PrintReport(std::ostream& os) const
+{
+    const size_t width = 86;
+    MeasureUtils::ReportBuffer fullTitle(title.size() + 64);
+    fullTitle.Append(title).Append(" in the last ").Fixed(seconds, 3).Append(" sec");
+
+    MeasureUtils::ReportBuffer report((records.size() + 4) * (width + 1));
+    report.Title(fullTitle.Str().c_str(), width);
+    report.Right("Name", 40).Right("Calls", 12).Right("Calls/sec", 17).Right("Average (ns)", 17)
+        .Append('\n').Append('-', width).Append('\n');
+    for (const Record& record : records)
+    {
+        report.Right(record.name, 40).Number(record.numCall, 12).Separated(uint64_t(record.callsPerSec + 0.5), 17);
+        if (record.averageSec >= 0)
+            report.Ns(record.averageSec, 17);
+        else
+            report.Append(' ', 17);
+        report.Append('\n');
+    }
+    report.Append('-', width).Append('\n');
+    report.WriteTo(os);
+}
+
+void dtree::MeasureInterval::CsvReport(std::ostream& os, bool withHeader) const
+{
+    // formatted without iostream, so the flags of the caller's stream (e.g. std::fixed) are not changed
+    MeasureUtils::ReportBuffer report((records.size() + 1) * 96);
+    if (withHeader)
+        report.Append("timestamp_ms,name,num_calls,calls_per_sec,average_ns\n");
+    for (const Record& record : records)
+    {
+        report.Number(timestampNs / 1000000).Append(',').Append(record.name).Append(',').Number(record.numCall).Append(',')
+            .Fixed(record.callsPerSec).Append(',').Fixed(record.averageSec * 1e9).Append('\n');
+    }
+    report.WriteTo(os);
+}
@@ -0,0 +1,379 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Exact merge of the snapshots of many processes into one report (see measure_tools/measure_merge).
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <unordered_map>
+
+#include "measure/measure_utils.h"
+#include "measure/measure_snapshot.h"
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief folds the snapshots of the same program (e.g. of many processes and hosts) into one
+     *
+     * The records are matched by the name (and by the order of the records with the same name).
+     * The times, the calls, the work amounts and the histogram buckets are added, the stats are combined
+     * by the parallel variance formula, so the merged percentiles, min, max and deviation are the same
+     * as if one process had made all the calls, not averages of the averages.
+     * The snapshots of different tick lengths (e.g. RdtscMeasure on different hosts) are converted to the ticks
+     * of the source with the smallest index, their histograms are exact only within the histogram resolution.
+     * The memory depends only on the number of the records, and the result is a snapshot itself, so the snapshots
+     * can be folded in parallel or per host first. With the same tick length in all the snapshots merging the partial
+     * merges gives the same result as merging all snapshots into one. With different tick lengths every conversion
+     * rounds the times and rebuckets the histograms, so the result may differ by the rounding with the merge order.
+     * Per record the spread of the sources is kept too: the number of the sources with calls,
+     * and the sources of the smallest and the largest average.
+     */
+    class MeasureMerge
+    {
+    public:
+        struct Spread
+        {
+            uint64_t sourceCount = 0;       // the number of the sources with calls
+            double minAverageSec = 0;
+            uint64_t minSource = 0;         // the index of the source
+            double maxAverageSec = 0;
+            uint64_t maxSource = 0;
+        };
+
+        /// @brief add a snapshot
+        /// @param source the index of the snapshot, e.g. in the file list, the record order of the result
+        ///               is the order of the first appearance by this index
+        inline void Add(const MeasureSnapshot& snapshot, uint64_t source);
+
+        /// @brief add the snapshots of another merge, the sources of the two must be different
+        inline void Add(const MeasureMerge& other);
+
+        inline uint64_t GetSourceCount() const  { return sourceCount; }
+
+        /// @brief the merged records in the order of their first appearance, with the title of the first source
+        inline MeasureSnapshot GetSnapshot() const;
+
+        /// @brief the spread of the sources, in the order of the records of GetSnapshot
+        inline std::vector<Spread> GetSpreads() const;
+
+        /// @brief the report of the merged snapshot and the spread of the sources
+        /// @param sourceNames the names of the sources by their index, e.g. the file names
+        inline void PrintReport(MeasureUtils::ReportBuffer& report, const std::vector<std::string>& sourceNames) const;
+        inline void PrintReport(std::ostream& os, const std::vector<std::string>& sourceNames) const;
+
+        /// @brief the CSV report of the merged snapshot, then an empty line and the spread of the sources
+        inline void CsvReport(MeasureUtils::ReportBuffer& report, const std::vector<std::string>& sourceNames) const;
+        inline void CsvReport(std::ostream& os, const std::vector<std::string>& sourceNames) const;
+
+    private:
+        struct Entry
+        {
+            MeasureSnapshot::Record record;
+            Spread spread;
+            uint64_t firstSource;
+            uint32_t firstIndex;
+            uint32_t occurrence;    // the number of the records with the same name before this one in its source
+        };
+
+        // the entry of the occurrence of a name, a new one if there is no such
+        inline Entry& GetEntry(const std::string& name, uint32_t occurrence, uint64_t source, uint32_t index);
+
+        inline static void MergeRecord(MeasureSnapshot::Record& into, const MeasureSnapshot::Record& from, double scale);
+        inline static void MergeSpread(Spread& into, const Spread& from);
+
+        // convert the ticks of all records to the given tick length
+        inline void ConvertTo(double newSecondsPerTick);
+
+        inline std::vector<size_t> GetOrder() const;
+
+        std::string title;
+        double secondsPerTick = 0;
+        uint64_t timestampNs = 0;
+        uint64_t sourceCount = 0;
+        uint64_t firstSource = 0;
+        std::vector<Entry> entries;
+        std::unordered_map<std::string, std::vector<size_t>> entryIndex;    // the entries of a name by the occurrence
+    };
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void dtree::MeasureMerge::Add(const MeasureSnapshot& snapshot, uint64_t source)
+{
+    if (sourceCount == 0 || source < firstSource)
+    {
+        if (sourceCount != 0 && snapshot.secondsPerTick != secondsPerTick)
+            ConvertTo(snapshot.secondsPerTick);
+        title = snapshot.title;
+        secondsPerTick = snapshot.secondsPerTick;
+        firstSource = source;
+    }
+    ++sourceCount;
+    timestampNs = std::max(timestampNs, snapshot.timestampNs);
+    const double scale = snapshot.secondsPerTick / secondsPerTick;
+
+    std::unordered_map<std::string, uint32_t> occurrences;
+    for (size_t i = 0; i < snapshot.records.size(); ++i)
+    {
+        const MeasureSnapshot::Record& record = snapshot.records[i];
+        Entry& entry = GetEntry(record.name, occurrences[record.name]++, source, uint32_t(i));
+        MergeRecord(entry.record, record, scale);
+
+        if (record.numCall != 0 && record.totalTicks >= 0)
+        {
+            Spread spread;
+            spread.sourceCount = 1;
+            spread.minAverageSec = spread.maxAverageSec = snapshot.GetTotalSec(record) / double(record.numCall);
+            spread.minSource = spread.maxSource = source;
+            MergeSpread(entry.spread, spread);
+        }
+    }
+}
+
+void dtree::MeasureMerge::Add(const MeasureMerge& other)
+{
+    if (other.sourceCount == 0)
+        return;
+    if (sourceCount == 0 || other.firstSource < firstSource)
+    {
+        if (sourceCount != 0 && other.secondsPerTick != secondsPerTick)
+            ConvertTo(other.secondsPerTick);
+        title = other.title;
+        secondsPerTick = other.secondsPerTick;
+        firstSource = other.firstSource;
+    }
+    sourceCount += other.sourceCount;
+    timestampNs = std::max(timestampNs, other.timestampNs);
+    const double scale = other.secondsPerTick / secondsPerTick;
+
+    for (const Entry& otherEntry : other.entries)
+    {
+        Entry& entry = GetEntry(otherEntry.record.name, otherEntry.occurrence, otherEntry.firstSource, otherEntry.firstIndex);
+        MergeRecord(entry.record, otherEntry.record, scale);
+        MergeSpread(entry.spread, otherEntry.spread);
+    }
+}
+
+dtree::MeasureSnapshot dtree::MeasureMerge::GetSnapshot() const
+{
+    MeasureSnapshot snapshot;
+    snapshot.title = title;
+    snapshot.secondsPerTick = secondsPerTick;
+    snapshot.timestampNs = timestampNs;
+    snapshot.records.reserve(entries.size());
+    for (const size_t i : GetOrder())
+        snapshot.records.push_back(entries[i].record);
+    return snapshot;
+}
+
+std::vector<dtree::MeasureMerge::Spread> dtree::MeasureMerge::GetSpreads() const
+{
+    std::vector<Spread> spreads;
+    spreads.reserve(entries.size());
+    for (const size_t i : GetOrder())
+        spreads.push_back(entries[i].spread);
+    return spreads;
+}
+
+void dtree::MeasureMerge::PrintReport(MeasureUtils::ReportBuffer& report, const std::vector<std::string>& sourceNames) const
+{
+    MeasureSnapshot snapshot = GetSnapshot();
+    snapshot.title += ", " + std::to_string(sourceCount) + " snapshots merged";
+    snapshot.PrintReport(report);
+    if (snapshot.records.empty())
+        return;
+
+    auto sourceName = [&sourceNames](uint64_t source)
+    {
+        return source < sourceNames.size() ? sourceNames[source] : std::to_string(source);
+    };
+
+    const size_t width = 40 + 10 + 2 * 17 + 2 * 30;
+    report.Reserve((snapshot.records.size() + 4) * (width + 1));
+    report.Title("Sources", width);
+    report.Right("Name", 40)
+          .Right("Sources", 10)
+          .Right("Min avg (ns)", 17)
+          .Right("Max avg (ns)", 17)
+          .Right("Min source", 30)
+          .Right("Max source", 30)
+          .Append('\n').Append('-', width).Append('\n');
+
+    const std::vector<Spread> spreads = GetSpreads();
+    for (size_t i = 0; i < spreads.size(); ++i)
+    {
+        const Spread& spread = spreads[i];
+        report.Right(snapshot.records[i].name, 40)
+              .Number(spread.sourceCount, 10);
+        if (spread.sourceCount != 0)
+            report.Ns(spread.minAverageSec, 17)
+                  .Ns(spread.maxAverageSec, 17)
+                  .Right(sourceName(spread.minSource), 30)
+                  .Right(sourceName(spread.maxSource), 30);
+        report.Append('\n');
+    }
+    report.Append('-', width).Append('\n');
+}
+
+void dtree::MeasureMerge::PrintReport(std::ostream& os, const std::vector<std::string>& sourceNames) const
+{
+    MeasureUtils::ReportBuffer report;
+    PrintReport(report, sourceNames);
+    report.WriteTo(os);
+}
+
+void dtree::MeasureMerge::CsvReport(MeasureUtils::ReportBuffer& report, const std::vector<std::string>& sourceNames) const
+{
+    const MeasureSnapshot snapshot = GetSnapshot();
+    snapshot.CsvReport(report);
+    if (snapshot.records.empty())
+        return;
+
+    auto sourceName = [&sourceNames](uint64_t source)
+    {
+        return source < sourceNames.size() ? sourceNames[source] : std::to_string(source);
+    };
+
+    report.Reserve((snapshot.records.size() + 2) * 128);
+    report.Append("\nname,sources,min_average_ns,max_average_ns,min_source,max_source\n");
+    const std::vector<Spread> spreads = GetSpreads();
+    for (size_t i = 0; i < spreads.size(); ++i)
+    {
+        const Spread& spread = spreads[i];
+        report.Append(snapshot.records[i].name).Append(',').Number(spread.sourceCount);
+        if (spread.sourceCount != 0)
+            report.Append(',').Fixed(spread.minAverageSec * 1e9)
+                  .Append(',').Fixed(spread.maxAverageSec * 1e9)
+                  .Append(',').Append(sourceName(spread.minSource))
+                  .Append(',').Append(sourceName(spread.maxSource));
+        else
+            report.Append(",,,,");
+        report.Append('\n');
+    }
+}
+
+void dtree::MeasureMerge::CsvReport(std::ostream& os, const std::vector<std::string>& sourceNames) const
+{
+    MeasureUtils::ReportBuffer report;
+    CsvReport(report, sourceNames);
+    report.WriteTo(os);
+}
+
+dtree::MeasureMerge::Entry& dtree::MeasureMerge::GetEntry(const std::string& name, uint32_t occurrence, uint64_t source, uint32_t index)
+{
+    std::vector<size_t>& nameEntries = entryIndex[name];
+    while (nameEntries.size() <= occurrence)
+    {
+        Entry entry;
+        entry.record.name = name;
+        entry.firstSource = source;
+        entry.firstIndex = index;
+        entry.occurrence = uint32_t(nameEntries.size());
+        nameEntries.push_back(entries.size());
+        entries.push_back(std::move(entry));
+    }
+
+    Entry& entry = entries[nameEntries[occurrence]];
+    if (source < entry.firstSource || (source == entry.firstSource && index < entry.firstIndex))
+    {
+        entry.firstSource = source;
+        entry.firstIndex = index;
+    }
+    return entry;
+}
+
+void dtree::MeasureMerge::MergeRecord(MeasureSnapshot::Record& into, const MeasureSnapshot::Record& from, double scale)
+{
+    // the overhead is weighted by the calls, so the merged net total is the sum of the net totals
+    const double calls = double(into.numCall) + double(from.numCall);
+    if (calls > 0)
+        into.overheadTicks = (into.overheadTicks * double(into.numCall) + from.overheadTicks * scale * double(from.numCall)) / calls;
+    else
+        into.overheadTicks = std::max(into.overheadTicks, from.overheadTicks * scale);
+    into.overheadNoiseTicks = std::max(into.overheadNoiseTicks, from.overheadNoiseTicks * scale);
+
+    into.nameId = from.nameId;
+    into.totalTicks += scale == 1.0 ? from.totalTicks : int64_t(double(from.totalTicks) * scale + 0.5);
+    into.numCall += from.numCall;
+    into.bytes += from.bytes;
+    into.items += from.items;
+
+    if (from.hasStats)
+    {
+        if (scale == 1.0)
+            into.stats.Merge(from.stats);
+        else
+            into.stats.Merge(MeasureStats::FromMoments(from.stats.GetCount(),
+                                                       from.stats.GetMean() * scale,
+                                                       from.stats.GetM2() * scale * scale,
+                                                       uint64_t(double(from.stats.GetMin()) * scale + 0.5),
+                                                       uint64_t(double(from.stats.GetMax()) * scale + 0.5)));
+        into.hasStats = true;
+    }
+    if (from.hasHistogram)
+    {
+        into.histogram.Merge(from.histogram, scale);
+        into.hasHistogram = true;
+    }
+}
+
+void dtree::MeasureMerge::MergeSpread(Spread& into, const Spread& from)
+{
+    if (from.sourceCount == 0)
+        return;
+    if (into.sourceCount == 0)
+    {
+        into = from;
+        return;
+    }
+    into.sourceCount += from.sourceCount;
+
+    // the same source wins on a tie, whatever the order of the merges is
+    if (from.minAverageSec < into.minAverageSec || (from.minAverageSec == into.minAverageSec && from.minSource < into.minSource))
+    {
+        into.minAverageSec = from.minAverageSec;
+        into.minSource = from.minSource;
+    }
+    if (from.maxAverageSec > into.maxAverageSec || (from.maxAverageSec == into.maxAverageSec && from.maxSource < into.maxSource))
+    {
+        into.maxAverageSec = from.maxAverageSec;
+        into.maxSource = from.maxSource;
+    }
+}
+
+void dtree::MeasureMerge::ConvertTo(double newSecondsPerTick)
+{
+    const double scale = secondsPerTick / newSecondsPerTick;
+    for (Entry& entry : entries)
+    {
+        MeasureSnapshot::Record converted;
+        converted.name = entry.record.name;
+        MergeRecord(converted, entry.record, scale);
+        entry.record = std::move(converted);
+    }
+    secondsPerTick = newSecondsPerTick;
+}
+
+std::vector<size_t> dtree::MeasureMerge::GetOrder() const
+{
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b)
+    {
+        const Entry& entryA = entries[a];
+        const Entry& entryB = entries[b];
+        if (entryA.firstSource != entryB.firstSource)
+            return entryA.firstSource < entryB.firstSource;
+        if (entryA.firstIndex != entryB.firstIndex)
+            return entryA.firstIndex < entryB.firstIndex;
+        return entryA.occurrence < entryB.occurrence;
+    });
+    return order;
+}
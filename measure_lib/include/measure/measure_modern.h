@@ -0,0 +1,193 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Macro free C++17/20 API: records at namespace scope, policies selected at compile time, automatic names.
+
+#pragma once
+
+#include "measure/measure.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if __cplusplus >= 201703L
+    #define MEASURE_MODERN_IS_SUPPORTED 1
+#else
+    #define MEASURE_MODERN_IS_SUPPORTED 0
+#endif
+
+// the records of string template arguments, e.g. MeasureNamedScope<"Parse">
+#if MEASURE_MODERN_IS_SUPPORTED && defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    #define MEASURE_NAMED_SCOPE_IS_SUPPORTED 1
+#else
+    #define MEASURE_NAMED_SCOPE_IS_SUPPORTED 0
+#endif
+
+#if MEASURE_MODERN_IS_SUPPORTED && defined(__has_include)
+    #if __has_include(<source_location>)
+        #include <source_location>
+    #endif
+#endif
+#if defined(__cpp_lib_source_location) && __cpp_lib_source_location >= 201907L
+    #define MEASURE_SOURCE_LOCATION_IS_SUPPORTED 1
+#else
+    #define MEASURE_SOURCE_LOCATION_IS_SUPPORTED 0
+#endif
+
+#if MEASURE_MODERN_IS_SUPPORTED
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the policies of TMeasure, see measure.h
+    enum class MeasurePolicy
+    {
+        Base,
+        TSafe,
+        RSafe,
+        TRSafe,
+        Sharded,
+        Atomic,
+        TRSharded
+    };
+
+    template<typename T>
+    struct MeasureTypeTag
+    {
+        using type = T;
+    };
+
+    /// @brief the policy type of a TMeasure, selected at compile time
+    template<typename Measure, MeasurePolicy Policy>
+    constexpr auto SelectMeasurePolicy()
+    {
+        if constexpr (Policy == MeasurePolicy::Base)
+            return MeasureTypeTag<typename Measure::Base>();
+        else if constexpr (Policy == MeasurePolicy::TSafe)
+            return MeasureTypeTag<typename Measure::TSafe>();
+        else if constexpr (Policy == MeasurePolicy::RSafe)
+            return MeasureTypeTag<typename Measure::RSafe>();
+        else if constexpr (Policy == MeasurePolicy::TRSafe)
+            return MeasureTypeTag<typename Measure::TRSafe>();
+        else if constexpr (Policy == MeasurePolicy::Sharded)
+            return MeasureTypeTag<typename Measure::Sharded>();
+        else if constexpr (Policy == MeasurePolicy::Atomic)
+            return MeasureTypeTag<typename Measure::Atomic>();
+        else
+            return MeasureTypeTag<typename Measure::TRSharded>();
+    }
+
+    /// @brief e.g. MeasurePolicyOf<MeasurePolicy::TSafe> is Measure::TSafe, the backend is the default (see DEFAULT_MEASURE_TYPE)
+    template<MeasurePolicy Policy = MeasurePolicy::Base, typename Measure = dtree::Measure>
+    using MeasurePolicyOf = typename decltype(SelectMeasurePolicy<Measure, Policy>())::type;
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a record of a policy type (any policy, e.g. Measure::WithHistogram<Measure::TSafe> too)
+     *
+     * Defined as an inline variable at namespace scope it is constructed and registered before main,
+     * so the scopes don't pay the initialization guard of a function local static:
+     *     inline dtree::MeasureRecordOf<dtree::MeasurePolicy::TSafe> parseRecord{ "Parse" };
+     *     void Parse() { dtree::MeasureScope scope(parseRecord); ... }
+     * The record must not be used by the initialization of another namespace scope variable.
+     * Without a name (C++20) the name is the function of the definition, or the file and the line at namespace scope.
+     */
+    template<typename Policy>
+    struct TMeasureRecordOf : public Policy::MeasureRecord
+    {
+    public:
+        using PolicyType = Policy;
+        using Scope = typename Policy::Scope;
+
+        inline explicit TMeasureRecordOf(MeasureName name)
+            : Policy::MeasureRecord(name)
+        {}
+
+#if MEASURE_SOURCE_LOCATION_IS_SUPPORTED
+        inline explicit TMeasureRecordOf(std::source_location location = std::source_location::current())
+            : Policy::MeasureRecord(MeasureName(LocationName(location).c_str()))
+        {}
+
+        inline static std::string LocationName(const std::source_location& location)
+        {
+            if (location.function_name()[0] != '\0')
+                return location.function_name();
+            std::string fileName = location.file_name();
+            const size_t slash = fileName.find_last_of("/\\");
+            if (slash != std::string::npos)
+                fileName.erase(0, slash + 1);
+            return fileName + ":" + std::to_string(location.line());
+        }
+#endif
+    };
+
+    /// @brief a record of a policy by the enum, e.g. MeasureRecordOf<MeasurePolicy::Sharded, RdtscMeasure>
+    template<MeasurePolicy Policy = MeasurePolicy::Base, typename Measure = dtree::Measure>
+    using MeasureRecordOf = TMeasureRecordOf<MeasurePolicyOf<Policy, Measure>>;
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the scope of a TMeasureRecordOf, the type of the scope is deduced from the record:
+    ///     dtree::MeasureScope scope(parseRecord);
+    template<typename Record>
+    struct MeasureScope : public Record::Scope
+    {
+        inline explicit MeasureScope(Record& record)
+            : Record::Scope(&record)
+        {}
+    };
+
+#if MEASURE_NAMED_SCOPE_IS_SUPPORTED
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief a string literal as a template argument, its hash is computed at compile time
+    template<size_t Size>
+    struct MeasureFixedString
+    {
+        constexpr MeasureFixedString(const char (&literal)[Size])
+        {
+            for (size_t i = 0; i < Size; ++i)
+                str[i] = literal[i];
+        }
+
+        constexpr uint64_t Hash() const
+        {
+            return MeasureUtils::ConstHashName(str);
+        }
+
+        char str[Size] = {};
+    };
+
+    /// @brief the record of a name and a policy at namespace scope, one record for all the scopes of the same name
+    template<MeasureFixedString Name, MeasurePolicy Policy = MeasurePolicy::Base, typename Measure = dtree::Measure>
+    inline MeasureRecordOf<Policy, Measure> measureRecordOf{
+        MeasureName(Name.str, std::integral_constant<uint64_t, Name.Hash()>::value) };
+
+    /**
+     * @brief a scope of a record by its name (C++20), without any macro and without an initialization guard:
+     *     dtree::MeasureNamedScope<"Parse"> scope;
+     *     dtree::MeasureNamedScope<"Parse", dtree::MeasurePolicy::TSafe, dtree::RdtscMeasure> scope;
+     * With MEASURE_IS_ON 0 the record is not even instantiated.
+     */
+    template<MeasureFixedString Name, MeasurePolicy Policy = MeasurePolicy::Base, typename Measure = dtree::Measure>
+    struct MeasureNamedScope : public MeasureRecordOf<Policy, Measure>::Scope
+    {
+        using Record = MeasureRecordOf<Policy, Measure>;
+
+        inline MeasureNamedScope()
+            : Record::Scope(GetRecord())
+        {}
+
+        /// @brief the record of the scope, nullptr with MEASURE_IS_ON 0
+        inline static Record* GetRecord()
+        {
+            if constexpr (MEASURE_IS_ON)
+                return &measureRecordOf<Name, Policy, Measure>;
+            else
+                return nullptr;
+        }
+    };
+#endif // MEASURE_NAMED_SCOPE_IS_SUPPORTED
+
+} // namespace dtree
+
+#endif // MEASURE_MODERN_IS_SUPPORTED
@@ -0,0 +1,251 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// OpenMetrics (Prometheus) text exposition of the measure records.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include <fstream>
+
+#include "measure/measure_utils.h"
+#include "measure/measure_snapshot.h"
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct MeasureOpenMetricsOptions
+    {
+        // the prefix of the metric family names, the invalid characters are replaced by '_'
+        std::string prefix = "measure";
+
+        // the upper bounds of the histogram buckets in seconds, increasing, the +Inf bucket is always added
+        std::vector<double> bucketsSec = {
+            1e-7, 2.5e-7, 5e-7, 1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+            1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief renders a MeasureSnapshot in the OpenMetrics text format, which Prometheus scrapes
+     *
+     * Every record is a series of the same metric families, the name of the record is the "name" label:
+     *   <prefix>_seconds_total{name="..."}     the total time of the calls
+     *   <prefix>_calls_total{name="..."}       the number of the calls
+     *   <prefix>_duration_seconds              a histogram, only of the records with histogram (see TMeasure::WithHistogram)
+     * The label values are escaped, so any dynamic name is valid, and the series of a record is the same in every scrape.
+     * The records of the same name (e.g. of different policies, see MeasureDatabase::FindMeasureRecord) are folded
+     * into one series, their times and calls are summed and their histograms are merged, since a scrape with
+     * duplicate series is rejected.
+     * The histogram buckets are the fixed bounds of the options: a bucket of the record histogram is counted
+     * in the first bound which is not below its largest value, so the counts are exact at the bounds within
+     * the resolution of the record histogram, and they are never overestimated.
+     * It works on a snapshot, so the rendering never stops the measured threads.
+     */
+    struct MeasureOpenMetrics
+    {
+    public:
+        /// @brief the HTTP content type of the exposition
+        inline static const char* ContentType()
+        {
+            return "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        }
+
+        inline static void Render(MeasureUtils::ReportBuffer& report, const MeasureSnapshot& snapshot,
+                                  const MeasureOpenMetricsOptions& options = MeasureOpenMetricsOptions());
+
+        inline static void Render(std::ostream& os, const MeasureSnapshot& snapshot,
+                                  const MeasureOpenMetricsOptions& options = MeasureOpenMetricsOptions())
+        {
+            MeasureUtils::ReportBuffer report;
+            Render(report, snapshot, options);
+            report.WriteTo(os);
+        }
+
+        /// @brief a metric name of the letters, digits, '_' and ':', the other characters are replaced by '_'
+        inline static std::string MetricName(const std::string& name);
+
+        /// @brief append a label value with the escapes of the format: \\ \" and \n
+        inline static void AppendLabelValue(MeasureUtils::ReportBuffer& report, const std::string& value);
+
+    private:
+        // the records of the snapshot, the records of the same name are folded into the first one
+        inline static std::vector<MeasureSnapshot::Record> FoldRecords(const MeasureSnapshot& snapshot);
+
+        inline static void AppendFamily(MeasureUtils::ReportBuffer& report, const std::string& family,
+                                        const char* type, const char* unit, const char* help);
+
+        inline static void AppendSeries(MeasureUtils::ReportBuffer& report, const std::string& metric, const std::string& name);
+    };
+
+    /// @brief print the snapshot of a database in the OpenMetrics format, e.g. into the response of a /metrics endpoint
+    template<typename Database>
+    void OpenMetricsReport(std::ostream& os, const MeasureOpenMetricsOptions& options = MeasureOpenMetricsOptions())
+    {
+        MeasureOpenMetrics::Render(os, Database::Snapshot(), options);
+    }
+
+    /// @brief write the snapshot of a database in the OpenMetrics format into a file, e.g. for the textfile collector
+    /// of the node exporter, it is written into a temporary file first and renamed, so a reader never sees a partial file
+    template<typename Database>
+    bool OpenMetricsReport(const std::string& fileName, const MeasureOpenMetricsOptions& options = MeasureOpenMetricsOptions())
+    {
+        const std::string tempName = fileName + ".tmp";
+        {
+            std::ofstream os(tempName, std::ios::binary);
+            OpenMetricsReport<Database>(os, options);
+            if (!os)
+                return false;
+        }
+        std::remove(fileName.c_str()); // rename doesn't overwrite on Windows
+        return std::rename(tempName.c_str(), fileName.c_str()) == 0;
+    }
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void dtree::MeasureOpenMetrics::Render(MeasureUtils::ReportBuffer& report, const MeasureSnapshot& snapshot,
+                                       const MeasureOpenMetricsOptions& options)
+{
+    const std::string prefix = MetricName(options.prefix);
+    const std::vector<MeasureSnapshot::Record> records = FoldRecords(snapshot);
+    report.Reserve((records.size() + 4) * 128);
+
+    AppendFamily(report, prefix + "_seconds", "counter", "seconds", "Total time of the measured calls.");
+    for (const MeasureSnapshot::Record& record : records)
+    {
+        const double totalSec = snapshot.GetTotalSec(record);
+        AppendSeries(report, prefix + "_seconds_total", record.name);
+        report.General(totalSec > 0 ? totalSec : 0.0).Append('\n');
+    }
+
+    AppendFamily(report, prefix + "_calls", "counter", nullptr, "Number of the measured calls.");
+    for (const MeasureSnapshot::Record& record : records)
+    {
+        AppendSeries(report, prefix + "_calls_total", record.name);
+        report.Number(record.numCall).Append('\n');
+    }
+
+    bool hasHistogram = false;
+    for (const MeasureSnapshot::Record& record : records)
+        hasHistogram = hasHistogram || record.hasHistogram;
+    if (hasHistogram)
+    {
+        const std::string family = prefix + "_duration_seconds";
+        AppendFamily(report, family, "histogram", "seconds", "Durations of the measured calls.");
+        for (const MeasureSnapshot::Record& record : records)
+        {
+            if (!record.hasHistogram)
+                continue;
+
+            const MeasureHistogramCounts& histogram = record.histogram;
+            size_t bucket = 0;
+            uint64_t count = 0;
+            for (const double bound : options.bucketsSec)
+            {
+                for (; bucket < histogram.buckets.size(); ++bucket)
+                {
+                    uint64_t upperTicks = MeasureHistogramCounts::BucketUpperBound(histogram.subBucketBits, histogram.buckets[bucket].first);
+                    if (upperTicks > histogram.maxValue)
+                        upperTicks = histogram.maxValue;
+                    if (snapshot.TicksToSec(double(upperTicks)) > bound)
+                        break;
+                    count += histogram.buckets[bucket].second;
+                }
+                report.Append(family).Append("_bucket{name=\"");
+                AppendLabelValue(report, record.name);
+                report.Append("\",le=\"").General(bound).Append("\"} ").Number(count).Append('\n');
+            }
+
+            // the histogram counts only the measured calls, the sum is their share of the total time
+            const uint64_t totalCount = histogram.GetTotalCount();
+            const double totalSec = snapshot.GetTotalSec(record);
+            const double sumSec = record.numCall && totalSec > 0 ? totalSec * double(totalCount) / double(record.numCall) : 0.0;
+            report.Append(family).Append("_bucket{name=\"");
+            AppendLabelValue(report, record.name);
+            report.Append("\",le=\"+Inf\"} ").Number(totalCount).Append('\n');
+            AppendSeries(report, family + "_count", record.name);
+            report.Number(totalCount).Append('\n');
+            AppendSeries(report, family + "_sum", record.name);
+            report.General(sumSec).Append('\n');
+        }
+    }
+    report.Append("# EOF\n");
+}
+
+std::vector<dtree::MeasureSnapshot::Record> dtree::MeasureOpenMetrics::FoldRecords(const MeasureSnapshot& snapshot)
+{
+    std::vector<MeasureSnapshot::Record> records;
+    records.reserve(snapshot.records.size());
+    std::unordered_map<std::string, size_t> recordIndex;
+    for (const MeasureSnapshot::Record& record : snapshot.records)
+    {
+        const auto inserted = recordIndex.emplace(record.name, records.size());
+        if (inserted.second)
+        {
+            records.push_back(record);
+            continue;
+        }
+
+        // an invalid (negative) total is not subtracted from the others
+        MeasureSnapshot::Record& into = records[inserted.first->second];
+        into.totalTicks = std::max<int64_t>(into.totalTicks, 0) + std::max<int64_t>(record.totalTicks, 0);
+        into.numCall += record.numCall;
+        if (record.hasHistogram)
+        {
+            into.histogram.Merge(record.histogram);
+            into.hasHistogram = true;
+        }
+    }
+    return records;
+}
+
+std::string dtree::MeasureOpenMetrics::MetricName(const std::string& name)
+{
+    std::string result = name.empty() ? std::string("_") : name;
+    for (size_t i = 0; i < result.size(); ++i)
+    {
+        const char c = result[i];
+        const bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':' || (i != 0 && c >= '0' && c <= '9');
+        if (!valid)
+            result[i] = '_';
+    }
+    return result;
+}
+
+void dtree::MeasureOpenMetrics::AppendLabelValue(MeasureUtils::ReportBuffer& report, const std::string& value)
+{
+    for (const char c : value)
+    {
+        if (c == '\\')
+            report.Append("\\\\");
+        else if (c == '"')
+            report.Append("\\\"");
+        else if (c == '\n')
+            report.Append("\\n");
+        else
+            report.Append(c);
+    }
+}
+
+void dtree::MeasureOpenMetrics::AppendFamily(MeasureUtils::ReportBuffer& report, const std::string& family,
+                                             const char* type, const char* unit, const char* help)
+{
+    report.Append("# TYPE ").Append(family).Append(' ').Append(type).Append('\n');
+    if (unit)
+        report.Append("# UNIT ").Append(family).Append(' ').Append(unit).Append('\n');
+    report.Append("# HELP ").Append(family).Append(' ').Append(help).Append('\n');
+}
+
+void dtree::MeasureOpenMetrics::AppendSeries(MeasureUtils::ReportBuffer& report, const std::string& metric, const std::string& name)
+{
+    report.Append(metric).Append("{name=\"");
+    AppendLabelValue(report, name);
+    report.Append("\"} ");
+}
@@ -0,0 +1,409 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Live export of the measure records into a named shared memory segment, for out-of-process readers (see measure_top).
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "measure/measure_utils.h"
+#include "measure/measure_snapshot.h"
+
+#if MEASURE_WINDOWS
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #define MEASURE_SHARED_MEMORY_IS_SUPPORTED 1
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <signal.h>
+    #include <cerrno>
+    #define MEASURE_SHARED_MEMORY_IS_SUPPORTED 1
+#else
+    #define MEASURE_SHARED_MEMORY_IS_SUPPORTED 0
+#endif
+
+#ifndef MEASURE_SHARED_MEMORY_CAPACITY
+    // the maximum size of the binary snapshot in the segment, about 20000 records with 20 characters long names
+    #define MEASURE_SHARED_MEMORY_CAPACITY (1024 * 1024)
+#endif
+
+#if MEASURE_SHARED_MEMORY_IS_SUPPORTED
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a named shared memory segment which holds one binary MeasureSnapshot
+     *
+     * The layout is a Header and the bytes of the snapshot (see MeasureSnapshot::Serialize).
+     * Only the creator process writes it, the readers map it read only, and they never block the writer:
+     * the sequence is odd while the writer updates the data, a reader copies the data, and it retries
+     * if the sequence was odd or it has changed meanwhile (seqlock).
+     * The name is a simple identifier, it is "/name" on POSIX and "Local\name" on Windows.
+     * A name has only one writer: the creation fails if another living process has created the segment
+     * (on POSIX the segment of a crashed process is removed, its process id is in the header).
+     */
+    class MeasureSharedMemory
+    {
+    public:
+        static constexpr uint32_t Version = 1;
+
+        struct Header
+        {
+            char magic[8];                      // "DTMSHM\0\0"
+            uint32_t version;
+            uint32_t creatorPid;                // the process id of the writer
+            uint64_t capacity;                  // the size of the data after the header
+            std::atomic<uint64_t> sequence;     // odd while the writer updates the data
+            std::atomic<uint64_t> size;         // the size of the current snapshot
+        };
+
+        static_assert(sizeof(Header) == 40, "the shared memory header must not have padding");
+        static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the shared memory sequence must be lock free");
+
+        MeasureSharedMemory() = default;
+        MeasureSharedMemory(const MeasureSharedMemory&) = delete;
+        MeasureSharedMemory& operator=(const MeasureSharedMemory&) = delete;
+
+        inline ~MeasureSharedMemory()
+        {
+            Close();
+        }
+
+        /// @brief create the segment for writing, false if another process writes a segment of this name
+        inline bool Create(const std::string& name, size_t capacity = MEASURE_SHARED_MEMORY_CAPACITY);
+
+        /// @brief open an existing segment for reading
+        inline bool Open(const std::string& name);
+
+        /// @brief unmap the segment, the creator removes its name too
+        inline void Close();
+
+        inline bool IsOpen() const { return header != nullptr; }
+
+        /// @brief replace the content, false if it does not fit. Only one thread may write.
+        inline bool Write(const std::vector<char>& data);
+
+        /// @brief copy a consistent content, false if there is no content yet or the writer was too busy
+        inline bool Read(std::vector<char>& data) const;
+
+    private:
+        inline static const char* Magic() { return "DTMSHM\0"; } // with the terminating zero it is 8 bytes
+
+#if !MEASURE_WINDOWS
+        // true if the creator of an existing segment has exited without removing it
+        inline static bool IsAbandoned(const std::string& fullName);
+#endif
+
+        Header* header = nullptr;
+        size_t mappedSize = 0;
+        bool owner = false;
+        std::string name;
+#if MEASURE_WINDOWS
+        HANDLE mapping = nullptr;
+#endif
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief publishes the snapshot of a database into a shared memory segment periodically
+     *
+     * The background thread takes a snapshot in every interval (the database mutex is held only
+     * while the counters are copied, as in MeasureSnapshot::Take), so the measured code does nothing
+     * more than its counter updates. The segment is removed by Stop() and at exit.
+     * There is one export per database.
+     */
+    template<typename Database>
+    class MeasureSharedMemoryExport
+    {
+    public:
+        /// @brief create the segment and start the background thread
+        /// @return false if the segment cannot be created or the export is already running
+        static bool Start(const std::string& name = "dtree_measure",
+                          std::chrono::milliseconds interval = std::chrono::milliseconds(1000),
+                          size_t capacity = MEASURE_SHARED_MEMORY_CAPACITY)
+        {
+            State& state = GetState();
+            const std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.running || !state.memory.Create(name, capacity))
+                return false;
+            state.running = true;
+            state.stop = false;
+            state.thread = std::thread(&MeasureSharedMemoryExport::Run, std::ref(state), interval);
+            return true;
+        }
+
+        /// @brief stop the background thread and remove the segment
+        static void Stop()
+        {
+            GetState().Stop();
+        }
+
+        static bool IsRunning()
+        {
+            State& state = GetState();
+            const std::lock_guard<std::mutex> lock(state.mutex);
+            return state.running;
+        }
+
+        /// @brief publish the current counters immediately, false if the export is not running or the snapshot does not fit
+        static bool Publish()
+        {
+            State& state = GetState();
+            const std::lock_guard<std::mutex> lock(state.mutex);
+            return state.running && Publish(state);
+        }
+
+    private:
+        struct State
+        {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::thread thread;
+            bool running = false;
+            bool stop = false;
+            MeasureSharedMemory memory;
+
+            inline void Stop()
+            {
+                {
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+                cv.notify_all();
+                if (thread.joinable())
+                    thread.join();
+                const std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+                memory.Close();
+            }
+
+            inline ~State()
+            {
+                Stop();
+            }
+        };
+
+        static State& GetState()
+        {
+            // the database is constructed first, so it is destroyed after the thread is stopped at exit
+            Database::GetMutex();
+            static State state;
+            return state;
+        }
+
+        static bool Publish(State& state)
+        {
+            return state.memory.Write(MeasureSnapshot::Take<Database>().Serialize());
+        }
+
+        static void Run(State& state, std::chrono::milliseconds interval)
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            do
+                Publish(state);
+            while (!state.cv.wait_for(lock, interval, [&state]() { return state.stop; }));
+        }
+    };
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool dtree::MeasureSharedMemory::Create(const std::string& inName, size_t capacity)
+{
+    Close();
+    const size_t size = sizeof(Header) + capacity;
+#if MEASURE_WINDOWS
+    const std::string fullName = "Local\\" + inName;
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                 DWORD(uint64_t(size) >> 32), DWORD(size & 0xffffffff), fullName.c_str());
+    if (mapping == nullptr)
+        return false;
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+    void* address = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (address == nullptr)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+#else
+    const std::string fullName = "/" + inName;
+    int fd = shm_open(fullName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && IsAbandoned(fullName))
+    {
+        // a segment left by a crashed process is removed
+        shm_unlink(fullName.c_str());
+        fd = shm_open(fullName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0)
+        return false;
+    void* address = ftruncate(fd, off_t(size)) == 0
+        ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : MAP_FAILED;
+    close(fd);
+    if (address == MAP_FAILED)
+    {
+        shm_unlink(fullName.c_str());
+        return false;
+    }
+#endif
+    header = static_cast<Header*>(address);
+    mappedSize = size;
+    owner = true;
+    name = fullName;
+
+    header->version = Version;
+#if MEASURE_WINDOWS
+    header->creatorPid = uint32_t(GetCurrentProcessId());
+#else
+    header->creatorPid = uint32_t(getpid());
+#endif
+    header->capacity = capacity;
+    header->sequence.store(0, std::memory_order_relaxed);
+    header->size.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, Magic(), sizeof(header->magic));
+    return true;
+}
+
+bool dtree::MeasureSharedMemory::Open(const std::string& inName)
+{
+    Close();
+#if MEASURE_WINDOWS
+    const std::string fullName = "Local\\" + inName;
+    mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, fullName.c_str());
+    if (mapping == nullptr)
+        return false;
+    void* address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info = {};
+    if (address == nullptr || VirtualQuery(address, &info, sizeof(info)) == 0)
+    {
+        if (address != nullptr)
+            UnmapViewOfFile(address);
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+    const size_t size = info.RegionSize;
+#else
+    const std::string fullName = "/" + inName;
+    const int fd = shm_open(fullName.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    const size_t size = fstat(fd, &info) == 0 ? size_t(info.st_size) : 0;
+    void* address = size >= sizeof(Header) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (address == MAP_FAILED)
+        return false;
+#endif
+    header = static_cast<Header*>(address);
+    mappedSize = size;
+    owner = false;
+    name = fullName;
+
+    if (memcmp(header->magic, Magic(), sizeof(header->magic)) != 0 || header->version != Version
+        || header->capacity > mappedSize - sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+#if !MEASURE_WINDOWS
+bool dtree::MeasureSharedMemory::IsAbandoned(const std::string& fullName)
+{
+    const int fd = shm_open(fullName.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    const bool hasHeader = fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(Header);
+    void* address = hasHeader ? mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (address == MAP_FAILED)
+        return false; // maybe it is being created right now
+    const Header* other = static_cast<const Header*>(address);
+    // the magic is written last, without it the creator may be still initializing the segment
+    const bool abandoned = memcmp(other->magic, Magic(), sizeof(other->magic)) == 0
+        && kill(pid_t(other->creatorPid), 0) != 0 && errno == ESRCH;
+    munmap(address, sizeof(Header));
+    return abandoned;
+}
+#endif
+
+void dtree::MeasureSharedMemory::Close()
+{
+    if (header == nullptr)
+        return;
+#if MEASURE_WINDOWS
+    UnmapViewOfFile(header);
+    CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    munmap(header, mappedSize);
+    if (owner)
+        shm_unlink(name.c_str());
+#endif
+    header = nullptr;
+    mappedSize = 0;
+    owner = false;
+}
+
+bool dtree::MeasureSharedMemory::Write(const std::vector<char>& data)
+{
+    if (header == nullptr || !owner || data.size() > header->capacity)
+        return false;
+
+    const uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(reinterpret_cast<char*>(header + 1), data.data(), data.size());
+    header->size.store(data.size(), std::memory_order_relaxed);
+    header->sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+bool dtree::MeasureSharedMemory::Read(std::vector<char>& data) const
+{
+    if (header == nullptr)
+        return false;
+
+    for (int attempt = 0; attempt < 1000; ++attempt)
+    {
+        const uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+        const uint64_t size = header->size.load(std::memory_order_relaxed);
+        if (sequence % 2 == 0 && size <= header->capacity)
+        {
+            data.resize(size_t(size));
+            memcpy(data.data(), reinterpret_cast<const char*>(header + 1), size_t(size));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header->sequence.load(std::memory_order_relaxed) == sequence)
+                return size != 0;
+        }
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+#endif // MEASURE_SHARED_MEMORY_IS_SUPPORTED
@@ -0,0 +1,684 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Compact binary snapshot of the measure records, for offline reports (see measure_tools).
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <chrono>
+
+#include "measure/measure_utils.h"
+#include "measure/measure_histogram.h"
+#include "measure/measure_stats.h"
+
+namespace dtree
+{
+    template<typename TimeDiff> struct TimeDiffTraits;
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief a consistent copy of the counters of all records of a database, in raw ticks, and the binary file format of them
+     *
+     * The database mutex is held only while the list of the records is copied (see MeasureDatabase::Snapshot),
+     * the counters are read after that, without stopping the measured threads.
+     * The time and the number of calls of a record are read together: the thread safe policies return a consistent pair
+     * (see MeassureRecordTSafe and MeasureShards), only the shared counters of the Atomic policy
+     * may differ by the calls which are just being added. The reports are rendered from the snapshot.
+     * The file layout (in the native byte order of the writer, the reader expects the same byte order):
+     *   FileHeader
+     *   FileRecord[recordCount]
+     *   extra section: the extra values of the records in the order of the records, see FileRecord::flags
+     *   string table: the names and the title, not zero terminated
+     * The extra values are the raw counters (not averages), so the snapshots of many processes can be merged
+     * exactly (see MeasureMerge). The files of Version 2 have no extra section, and they are still read.
+     * The converter tool (measure_snapshot) prints the snapshots in the human readable and CSV formats offline.
+     */
+    struct MeasureSnapshot
+    {
+    public:
+        static constexpr uint32_t Version = 3;
+
+        struct FileHeader
+        {
+            char magic[8];              // "DTMSNAP\0"
+            uint32_t version;
+            uint32_t recordCount;
+            double secondsPerTick;      // the frequency of the backend
+            uint64_t timestampNs;       // system_clock time of the snapshot since the epoch
+            uint64_t titleOffset;       // in the string table
+            uint32_t titleLength;
+            uint32_t extraSize;         // the size of the extra section, 0 in Version 2
+        };
+
+        // the extra values of a record follow each other in this order, if the flag is set
+        enum FileRecordFlags : uint32_t
+        {
+            FlagWork = 1,               // uint64_t bytes, uint64_t items
+            FlagOverhead = 2,           // double overheadTicks, double overheadNoiseTicks
+            FlagStats = 4,              // uint64_t count, double mean, double m2, uint64_t min, uint64_t max
+            FlagHistogram = 8           // uint32_t subBucketBits, uint32_t bucketCount, uint64_t maxValue,
+                                        // bucketCount * { uint32_t index, uint32_t 0, uint64_t count }
+        };
+
+        struct FileRecord
+        {
+            uint64_t nameOffset;        // in the string table
+            uint32_t nameLength;
+            uint32_t flags;             // FileRecordFlags, 0 in Version 2
+            uint64_t nameId;            // the hash of the name, see MeasureName
+            int64_t totalTicks;
+            uint64_t numCall;
+        };
+
+        struct Record
+        {
+            std::string name;
+            uint64_t nameId = 0;
+            int64_t totalTicks = 0;
+            uint64_t numCall = 0;
+
+            // the extra values of the policies
+            uint64_t bytes = 0;                 // the work amount, see TMeasureRecord::GetWork
+            uint64_t items = 0;
+            double overheadTicks = 0;           // the calibration of the record type, see TMeasure::Calibrate
+            double overheadNoiseTicks = 0;
+            bool hasStats = false;              // see TMeasure::WithStats
+            MeasureStats stats;
+            bool hasHistogram = false;          // see TMeasure::WithHistogram
+            MeasureHistogramCounts histogram;
+        };
+
+        std::string title;
+        double secondsPerTick = 0;
+        uint64_t timestampNs = 0;
+        uint64_t resetEpoch = 0;        // the number of the ResetAll calls of the database before it, not serialized
+        std::vector<Record> records;
+
+        /// @brief copy the counters of all records of a database, the same as Database::Snapshot()
+        template<typename Database>
+        static MeasureSnapshot Take()
+        {
+            return Database::Snapshot();
+        }
+
+        /// @brief copy the counters of the given records, without any lock
+        /// the records must not be destroyed meanwhile, the records of a database are never destroyed
+        template<typename MeasureRecord>
+        static MeasureSnapshot FromRecords(const std::vector<MeasureRecord*>& records)
+        {
+            using TimeDiff = typename MeasureRecord::TimeDiff;
+
+            MeasureSnapshot snapshot;
+            snapshot.title = MeasureRecord::MeasureBackend::GetMeasureTitle();
+            snapshot.secondsPerTick = MeasureRecord::TicksToSec(1);
+            snapshot.timestampNs = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+
+            snapshot.records.resize(records.size());
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                const MeasureRecord* measureRecord = records[i];
+                TimeDiff totalTime;
+                uint64_t numCall;
+                measureRecord->GetCounters(totalTime, numCall);
+                Record& record = snapshot.records[i];
+                record.name = measureRecord->name;
+                record.nameId = measureRecord->nameId;
+                record.totalTicks = int64_t(TimeDiffTraits<TimeDiff>::ToRep(totalTime));
+                record.numCall = numCall;
+                measureRecord->GetWork(record.bytes, record.items);
+                record.overheadTicks = measureRecord->GetOverheadTicks();
+                record.overheadNoiseTicks = measureRecord->GetOverheadNoiseTicks();
+                record.hasStats = measureRecord->GetStats(record.stats);
+                const typename MeasureRecord::Histogram* histogram = measureRecord->GetHistogram();
+                record.hasHistogram = histogram != nullptr;
+                if (histogram)
+                    histogram->CopyTo(record.histogram);
+            }
+            return snapshot;
+        }
+
+        inline double GetTotalSec(const Record& record) const
+        {
+            return double(record.totalTicks) * secondsPerTick;
+        }
+
+        inline double TicksToSec(double ticks) const
+        {
+            return ticks * secondsPerTick;
+        }
+
+        /// @brief the total and average time of a record without the calibrated overhead, see TMeasureRecord::GetNetTime
+        inline bool GetNetTime(const Record& record, double& netTotalSec, double& netAverageSec, bool& withinNoise) const
+        {
+            const double totalSec = GetTotalSec(record);
+            return totalSec >= 0 && MeasureUtils::NetTime(totalSec, record.numCall, record.overheadTicks, record.overheadNoiseTicks,
+                                                          secondsPerTick, netTotalSec, netAverageSec, withinNoise);
+        }
+
+        // the binary form of the snapshot
+        inline std::vector<char> Serialize() const;
+
+        // parse the binary form, returns false if the data is not a valid snapshot
+        inline bool Deserialize(const char* data, size_t size);
+
+        inline bool WriteFile(const std::string& fileName) const;
+        inline bool ReadFile(const std::string& fileName);
+
+        /// @brief the report of MeasureDatabase::PrintReport, the optional columns are printed only if a record has such values
+        inline void PrintReport(MeasureUtils::ReportBuffer& report) const;
+        inline void PrintReport(std::ostream& os) const;
+
+        /// @brief the report of CsvReport, the optional columns are printed only if a record has such values
+        inline void CsvReport(MeasureUtils::ReportBuffer& report) const;
+        inline void CsvReport(std::ostream& os) const;
+
+        /// @brief the differences of the records of two snapshots, matched by the name
+        /// the records only in one of the snapshots are listed too
+        inline static void PrintDiff(std::ostream& os, const MeasureSnapshot& before, const MeasureSnapshot& after);
+
+    private:
+        inline static const char* Magic() { return "DTMSNAP"; } // with the terminating zero it is 8 bytes
+
+        inline static uint32_t GetFlags(const Record& record);
+        inline static size_t GetExtraSize(const Record& record, uint32_t flags);
+    };
+
+    static_assert(sizeof(MeasureSnapshot::FileHeader) == 48, "the snapshot file header must not have padding");
+    static_assert(sizeof(MeasureSnapshot::FileRecord) == 40, "the snapshot file record must not have padding");
+
+    /// @brief write the snapshot of a database into a file, the database mutex is held only for copying the counters
+    template<typename Database>
+    bool SnapshotReport(std::string fileName = "performance_report.snapshot")
+    {
+        return MeasureSnapshot::Take<Database>().WriteFile(fileName);
+    }
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<char> dtree::MeasureSnapshot::Serialize() const
+{
+    size_t stringSize = title.size();
+    size_t extraSize = 0;
+    for (const Record& record : records)
+    {
+        stringSize += record.name.size();
+        extraSize += GetExtraSize(record, GetFlags(record));
+    }
+
+    const size_t recordsOffset = sizeof(FileHeader);
+    const size_t extraOffset = recordsOffset + records.size() * sizeof(FileRecord);
+    const size_t stringsOffset = extraOffset + extraSize;
+    std::vector<char> buffer(stringsOffset + stringSize);
+
+    FileHeader header = {};
+    memcpy(header.magic, Magic(), sizeof(header.magic));
+    header.version = Version;
+    header.recordCount = uint32_t(records.size());
+    header.secondsPerTick = secondsPerTick;
+    header.timestampNs = timestampNs;
+    header.extraSize = uint32_t(extraSize);
+
+    uint64_t stringOffset = 0;
+    char* extra = buffer.data() + extraOffset;
+    auto write = [&extra](const void* value, size_t size)
+    {
+        memcpy(extra, value, size);
+        extra += size;
+    };
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const Record& record = records[i];
+        FileRecord fileRecord = {};
+        fileRecord.nameOffset = stringOffset;
+        fileRecord.nameLength = uint32_t(record.name.size());
+        fileRecord.flags = GetFlags(record);
+        fileRecord.nameId = record.nameId;
+        fileRecord.totalTicks = record.totalTicks;
+        fileRecord.numCall = record.numCall;
+        memcpy(buffer.data() + recordsOffset + i * sizeof(FileRecord), &fileRecord, sizeof(FileRecord));
+        memcpy(buffer.data() + stringsOffset + stringOffset, record.name.data(), record.name.size());
+        stringOffset += record.name.size();
+
+        if (fileRecord.flags & FlagWork)
+        {
+            write(&record.bytes, sizeof(uint64_t));
+            write(&record.items, sizeof(uint64_t));
+        }
+        if (fileRecord.flags & FlagOverhead)
+        {
+            write(&record.overheadTicks, sizeof(double));
+            write(&record.overheadNoiseTicks, sizeof(double));
+        }
+        if (fileRecord.flags & FlagStats)
+        {
+            const uint64_t count = record.stats.GetCount();
+            const double mean = record.stats.GetMean();
+            const double m2 = record.stats.GetM2();
+            const uint64_t minValue = record.stats.GetMin();
+            const uint64_t maxValue = record.stats.GetMax();
+            write(&count, sizeof(count));
+            write(&mean, sizeof(mean));
+            write(&m2, sizeof(m2));
+            write(&minValue, sizeof(minValue));
+            write(&maxValue, sizeof(maxValue));
+        }
+        if (fileRecord.flags & FlagHistogram)
+        {
+            const uint32_t bucketCount = uint32_t(record.histogram.buckets.size());
+            write(&record.histogram.subBucketBits, sizeof(uint32_t));
+            write(&bucketCount, sizeof(bucketCount));
+            write(&record.histogram.maxValue, sizeof(uint64_t));
+            for (const std::pair<uint32_t, uint64_t>& bucket : record.histogram.buckets)
+            {
+                const uint32_t index[2] = { bucket.first, 0 };
+                write(index, sizeof(index));
+                write(&bucket.second, sizeof(uint64_t));
+            }
+        }
+    }
+
+    header.titleOffset = stringOffset;
+    header.titleLength = uint32_t(title.size());
+    memcpy(buffer.data() + stringsOffset + stringOffset, title.data(), title.size());
+    memcpy(buffer.data(), &header, sizeof(FileHeader));
+    return buffer;
+}
+
+bool dtree::MeasureSnapshot::Deserialize(const char* data, size_t size)
+{
+    FileHeader header;
+    if (size < sizeof(FileHeader))
+        return false;
+    memcpy(&header, data, sizeof(FileHeader));
+    if (memcmp(header.magic, Magic(), sizeof(header.magic)) != 0 || (header.version != Version && header.version != 2))
+        return false;
+    if (header.version == 2)
+        header.extraSize = 0; // it was reserved
+
+    const uint64_t extraOffset = sizeof(FileHeader) + uint64_t(header.recordCount) * sizeof(FileRecord);
+    const uint64_t stringsOffset = extraOffset + header.extraSize;
+    if (stringsOffset > size)
+        return false;
+    const uint64_t stringSize = size - stringsOffset;
+    const char* strings = data + stringsOffset;
+    if (header.titleOffset > stringSize || header.titleLength > stringSize - header.titleOffset)
+        return false;
+
+    title.assign(strings + header.titleOffset, header.titleLength);
+    secondsPerTick = header.secondsPerTick;
+    timestampNs = header.timestampNs;
+    records.assign(header.recordCount, Record());
+
+    const char* extra = data + extraOffset;
+    const char* extraEnd = extra + header.extraSize;
+    auto read = [&extra, extraEnd](void* value, size_t size)
+    {
+        if (size_t(extraEnd - extra) < size)
+            return false;
+        memcpy(value, extra, size);
+        extra += size;
+        return true;
+    };
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        Record& record = records[i];
+        FileRecord fileRecord;
+        memcpy(&fileRecord, data + sizeof(FileHeader) + i * sizeof(FileRecord), sizeof(FileRecord));
+        if (fileRecord.nameOffset > stringSize || fileRecord.nameLength > stringSize - fileRecord.nameOffset)
+            return false;
+        record.name.assign(strings + fileRecord.nameOffset, fileRecord.nameLength);
+        record.nameId = fileRecord.nameId;
+        record.totalTicks = fileRecord.totalTicks;
+        record.numCall = fileRecord.numCall;
+        if (header.version == 2)
+            continue;
+
+        if (fileRecord.flags & FlagWork)
+        {
+            if (!read(&record.bytes, sizeof(uint64_t)) || !read(&record.items, sizeof(uint64_t)))
+                return false;
+        }
+        if (fileRecord.flags & FlagOverhead)
+        {
+            if (!read(&record.overheadTicks, sizeof(double)) || !read(&record.overheadNoiseTicks, sizeof(double)))
+                return false;
+        }
+        if (fileRecord.flags & FlagStats)
+        {
+            uint64_t count, minValue, maxValue;
+            double mean, m2;
+            if (!read(&count, sizeof(count)) || !read(&mean, sizeof(mean)) || !read(&m2, sizeof(m2))
+                || !read(&minValue, sizeof(minValue)) || !read(&maxValue, sizeof(maxValue)))
+                return false;
+            record.hasStats = true;
+            record.stats = MeasureStats::FromMoments(count, mean, m2, minValue, maxValue);
+        }
+        if (fileRecord.flags & FlagHistogram)
+        {
+            uint32_t bucketCount;
+            if (!read(&record.histogram.subBucketBits, sizeof(uint32_t)) || !read(&bucketCount, sizeof(bucketCount))
+                || !read(&record.histogram.maxValue, sizeof(uint64_t)) || size_t(extraEnd - extra) / 16 < bucketCount
+                || record.histogram.subBucketBits > 16)
+                return false;
+            record.hasHistogram = true;
+            record.histogram.buckets.resize(bucketCount);
+            const uint32_t indexCount = (65 - record.histogram.subBucketBits) << record.histogram.subBucketBits;
+            for (size_t j = 0; j < bucketCount; ++j)
+            {
+                std::pair<uint32_t, uint64_t>& bucket = record.histogram.buckets[j];
+                uint32_t index[2];
+                if (!read(index, sizeof(index)) || !read(&bucket.second, sizeof(uint64_t)))
+                    return false;
+                bucket.first = index[0];
+                // the buckets are sorted by the index
+                if (bucket.first >= indexCount || (j != 0 && bucket.first <= record.histogram.buckets[j - 1].first))
+                    return false;
+            }
+        }
+    }
+    return extra == extraEnd;
+}
+
+bool dtree::MeasureSnapshot::WriteFile(const std::string& fileName) const
+{
+    const std::vector<char> buffer = Serialize();
+    std::ofstream os(fileName, std::ios::binary);
+    os.write(buffer.data(), std::streamsize(buffer.size()));
+    return bool(os);
+}
+
+bool dtree::MeasureSnapshot::ReadFile(const std::string& fileName)
+{
+    std::ifstream is(fileName, std::ios::binary);
+    if (!is)
+        return false;
+    const std::vector<char> buffer((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    return Deserialize(buffer.data(), buffer.size());
+}
+
+uint32_t dtree::MeasureSnapshot::GetFlags(const Record& record)
+{
+    return (record.bytes != 0 || record.items != 0 ? uint32_t(FlagWork) : 0u)
+         | (record.overheadTicks > 0 ? uint32_t(FlagOverhead) : 0u)
+         | (record.hasStats ? uint32_t(FlagStats) : 0u)
+         | (record.hasHistogram ? uint32_t(FlagHistogram) : 0u);
+}
+
+size_t dtree::MeasureSnapshot::GetExtraSize(const Record& record, uint32_t flags)
+{
+    return (flags & FlagWork ? 16 : 0)
+         + (flags & FlagOverhead ? 16 : 0)
+         + (flags & FlagStats ? 40 : 0)
+         + (flags & FlagHistogram ? 16 + record.histogram.buckets.size() * 16 : 0);
+}
+
+void dtree::MeasureSnapshot::PrintReport(MeasureUtils::ReportBuffer& report) const
+{
+    if (records.empty())
+        return;
+
+    // the percentile and min/max/deviation columns are printed only if there is a record with histogram or stats
+    bool hasHistogram = false;
+    bool hasStats = false;
+    bool hasOverhead = false;
+    bool hasWork = false;
+    for (const Record& record : records)
+    {
+        hasHistogram = hasHistogram || record.hasHistogram;
+        hasStats = hasStats || record.hasStats;
+        hasOverhead = hasOverhead || record.overheadTicks > 0;
+        hasWork = hasWork || record.bytes != 0 || record.items != 0;
+    }
+
+    const size_t width = 86 + (hasWork ? 2 * 14 : 0) + (hasOverhead ? 2 * 17 : 0) + (hasHistogram ? 4 * 14 : 0) + (hasHistogram || hasStats ? 14 : 0) + (hasStats ? 2 * 14 : 0);
+    report.Reserve((records.size() + 6) * (width + 1));
+    report.Title(title.c_str(), width);
+
+    report.Right("Name", 40)
+          .Right("Calls", 12)
+          .Right("Total (ns)", 17)
+          .Right("Average (ns)", 17);
+    if (hasWork)
+        report.Right("MB/s", 14)
+              .Right("Items/s", 14);
+    if (hasOverhead)
+        report.Right("Net total (ns)", 17)
+              .Right("Net average (ns)", 17);
+    if (hasHistogram)
+        report.Right("p50 (ns)", 14)
+              .Right("p90 (ns)", 14)
+              .Right("p99 (ns)", 14)
+              .Right("p99.9 (ns)", 14);
+    if (hasHistogram || hasStats)
+        report.Right("Max (ns)", 14);
+    if (hasStats)
+        report.Right("Min (ns)", 14)
+              .Right("Std dev (ns)", 14);
+    report.Append('\n').Append('-', width).Append('\n');
+
+    for (const Record& record : records)
+    {
+        const double totalSec = GetTotalSec(record);
+        report.Right(record.name, 40)
+              .Number(record.numCall, 12);
+        if (totalSec < 0 || record.numCall == 0)
+        {
+            report.Append('\n');
+            continue;
+        }
+
+        report.Ns(totalSec, 17)
+              .Ns(totalSec / double(record.numCall), 17);
+
+        // the throughput of the calls, by the total time (with the overhead)
+        if (hasWork)
+        {
+            if (record.bytes && totalSec > 0)
+                report.Rate(double(record.bytes) / totalSec * 1e-6, 14);
+            else
+                report.Append(' ', 14);
+            if (record.items && totalSec > 0)
+                report.Rate(double(record.items) / totalSec, 14);
+            else
+                report.Append(' ', 14);
+        }
+
+        double netTotalSec, netAverageSec;
+        bool withinNoise;
+        if (GetNetTime(record, netTotalSec, netAverageSec, withinNoise))
+            report.Ns(netTotalSec, 17)
+                  .Ns(netAverageSec, 16)
+                  .Append(withinNoise ? '*' : ' ');
+        else if (hasOverhead)
+            report.Append(' ', 2 * 17);
+
+        if (!record.hasHistogram && !record.hasStats)
+        {
+            report.Append('\n');
+            continue;
+        }
+
+        if (hasHistogram && record.hasHistogram)
+            report.Ns(TicksToSec(double(record.histogram.GetPercentile(0.5))), 14)
+                  .Ns(TicksToSec(double(record.histogram.GetPercentile(0.9))), 14)
+                  .Ns(TicksToSec(double(record.histogram.GetPercentile(0.99))), 14)
+                  .Ns(TicksToSec(double(record.histogram.GetPercentile(0.999))), 14);
+        else if (hasHistogram)
+            report.Append(' ', 4 * 14);
+
+        // the max is exact in both the stats and the histogram
+        const uint64_t maxTicks = record.hasStats ? record.stats.GetMax() : record.histogram.maxValue;
+        report.Ns(TicksToSec(double(maxTicks)), 14);
+
+        if (record.hasStats)
+            report.Ns(TicksToSec(double(record.stats.GetMin())), 14)
+                  .Ns(TicksToSec(record.stats.GetStdDev()), 14);
+        report.Append('\n');
+    }
+    report.Append('-', width).Append('\n');
+    if (hasOverhead)
+        report.Append("Net times are without the calibrated overhead of the scopes, * marks averages within the calibration noise\n");
+}
+
+void dtree::MeasureSnapshot::PrintReport(std::ostream& os) const
+{
+    MeasureUtils::ReportBuffer report;
+    PrintReport(report);
+    report.WriteTo(os);
+}
+
+void dtree::MeasureSnapshot::CsvReport(MeasureUtils::ReportBuffer& report) const
+{
+    if (records.empty())
+        return;
+
+    // the percentile and min/max/deviation columns are printed only if there is a record with histogram or stats
+    bool hasHistogram = false;
+    bool hasStats = false;
+    bool hasOverhead = false;
+    bool hasWork = false;
+    for (const Record& record : records)
+    {
+        hasHistogram = hasHistogram || record.hasHistogram;
+        hasStats = hasStats || record.hasStats;
+        hasOverhead = hasOverhead || record.overheadTicks > 0;
+        hasWork = hasWork || record.bytes != 0 || record.items != 0;
+    }
+
+    report.Reserve((records.size() + 1) * 128);
+    report.Append("name,num_calls,total_ns,average_ns");
+    if (hasWork)
+        report.Append(",bytes,items,bytes_per_sec,items_per_sec");
+    if (hasHistogram)
+        report.Append(",p50_ns,p90_ns,p99_ns,p999_ns");
+    if (hasHistogram || hasStats)
+        report.Append(",max_ns");
+    if (hasStats)
+        report.Append(",min_ns,stddev_ns");
+    if (hasOverhead)
+        report.Append(",net_total_ns,net_average_ns,within_noise");
+    report.Append('\n');
+
+    for (const Record& record : records)
+    {
+        const double totalSec = GetTotalSec(record);
+        const bool hasCalls = record.numCall != 0;
+        report.Append(record.name).Append(',').Number(record.numCall).Append(',');
+        if (totalSec < 0 || !hasCalls)
+            report.Append(',');
+        else
+            report.Fixed(totalSec * 1e9).Append(',')
+                  .Fixed(totalSec * 1e9 / double(record.numCall));
+
+        if (hasWork)
+        {
+            report.Append(',').Number(record.bytes).Append(',').Number(record.items).Append(',');
+            if (record.bytes && totalSec > 0)
+                report.Fixed(double(record.bytes) / totalSec);
+            report.Append(',');
+            if (record.items && totalSec > 0)
+                report.Fixed(double(record.items) / totalSec);
+        }
+
+        const bool recordHasHistogram = hasCalls && record.hasHistogram;
+        const bool recordHasStats = hasCalls && record.hasStats;
+        if (recordHasHistogram)
+            report.Append(',').Fixed(TicksToSec(double(record.histogram.GetPercentile(0.5))) * 1e9)
+                  .Append(',').Fixed(TicksToSec(double(record.histogram.GetPercentile(0.9))) * 1e9)
+                  .Append(',').Fixed(TicksToSec(double(record.histogram.GetPercentile(0.99))) * 1e9)
+                  .Append(',').Fixed(TicksToSec(double(record.histogram.GetPercentile(0.999))) * 1e9);
+        else if (hasHistogram)
+            report.Append(",,,,");
+
+        if (recordHasStats)
+            report.Append(',').Fixed(TicksToSec(double(record.stats.GetMax())) * 1e9);
+        else if (recordHasHistogram)
+            report.Append(',').Fixed(TicksToSec(double(record.histogram.maxValue)) * 1e9);
+        else if (hasHistogram || hasStats)
+            report.Append(',');
+
+        if (recordHasStats)
+            report.Append(',').Fixed(TicksToSec(double(record.stats.GetMin())) * 1e9)
+                  .Append(',').Fixed(TicksToSec(record.stats.GetStdDev()) * 1e9);
+        else if (hasStats)
+            report.Append(",,");
+
+        double netTotalSec, netAverageSec;
+        bool withinNoise;
+        if (GetNetTime(record, netTotalSec, netAverageSec, withinNoise))
+            report.Append(',').Fixed(netTotalSec * 1e9)
+                  .Append(',').Fixed(netAverageSec * 1e9)
+                  .Append(',').Append(withinNoise ? '1' : '0');
+        else if (hasOverhead)
+            report.Append(",,,");
+        report.Append('\n');
+    }
+}
+
+void dtree::MeasureSnapshot::CsvReport(std::ostream& os) const
+{
+    MeasureUtils::ReportBuffer report;
+    CsvReport(report);
+    report.WriteTo(os);
+}
+
+void dtree::MeasureSnapshot::PrintDiff(std::ostream& os, const MeasureSnapshot& before, const MeasureSnapshot& after)
+{
+    const size_t width = 98;
+    MeasureUtils::ReportBuffer report((after.records.size() + before.records.size() + 4) * (width + 1));
+    report.Title((after.title + " difference").c_str(), width);
+    report.Right("Name", 40).Right("Calls", 12).Right("Calls diff", 12).Right("Average (ns)", 17).Right("Average diff", 17)
+        .Append('\n').Append('-', width).Append('\n');
+
+    auto average = [](const MeasureSnapshot& snapshot, const Record& record)
+    {
+        return record.numCall ? snapshot.GetTotalSec(record) / double(record.numCall) : 0.0;
+    };
+    // the differences are formatted by their sign and their absolute value, so the unsigned counters don't wrap around
+    auto printLine = [&report](const std::string& name, uint64_t calls, uint64_t oldCalls, double averageSec, double oldAverageSec)
+    {
+        const std::string callsDiff = (calls < oldCalls ? "-" : "+")
+            + std::to_string(calls < oldCalls ? oldCalls - calls : calls - oldCalls);
+        const double averageDiffNs = (averageSec - oldAverageSec) * 1e9;
+        const std::string averageDiff = (averageDiffNs < 0 ? "-" : "+")
+            + MeasureUtils::FormatWithSeparator(uint64_t(std::abs(averageDiffNs) + 0.5));
+        report.Right(name, 40).Number(calls, 12).Right(callsDiff, 12).Ns(averageSec, 17).Right(averageDiff, 17).Append('\n');
+    };
+
+    std::vector<bool> matched(before.records.size(), false);
+    for (const Record& record : after.records)
+    {
+        const Record* old = nullptr;
+        for (size_t i = 0; i < before.records.size() && !old; ++i)
+            if (!matched[i] && before.records[i].nameId == record.nameId && before.records[i].name == record.name)
+            {
+                matched[i] = true;
+                old = &before.records[i];
+            }
+
+        const double averageSec = average(after, record);
+        if (old)
+            printLine(record.name, record.numCall, old->numCall, averageSec, average(before, *old));
+        else
+            printLine(record.name + " (new)", record.numCall, 0, averageSec, 0.0);
+    }
+    for (size_t i = 0; i < before.records.size(); ++i)
+        if (!matched[i])
+        {
+            const Record& record = before.records[i];
+            printLine(record.name + " (removed)", 0, record.numCall, 0.0, average(before, record));
+        }
+    report.Append('-', width).Append('\n');
+    report.WriteTo(os);
+}
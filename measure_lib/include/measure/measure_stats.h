@@ -0,0 +1,118 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Min, max and running variance (Welford) of durations in raw backend ticks.
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+#include "measure/measure_utils.h"
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief min, max and running variance of durations in raw backend ticks
+     *
+     * The variance is computed by Welford's online algorithm, so it is numerically stable
+     * even after billions of calls. All the fields are 8 bytes and the whole struct is 40 bytes,
+     * so it fits into one cache line when it is cache line aligned (see MeasureRecordStats).
+     * Not thread safe, the caller is responsible for the locking.
+     */
+    struct MeasureStats
+    {
+    public:
+        inline MeasureStats()
+        {
+            Reset();
+        }
+
+        // add a duration in ticks
+        inline void Add(uint64_t value)
+        {
+            ++count;
+            if (value < minValue)
+                minValue = value;
+            if (value > maxValue)
+                maxValue = value;
+            const double delta = double(value) - mean;
+            mean += delta / double(count);
+            m2 += delta * (double(value) - mean);
+        }
+
+        inline void Reset()
+        {
+            count = 0;
+            mean = 0;
+            m2 = 0;
+            minValue = UINT64_MAX;
+            maxValue = 0;
+        }
+
+        inline uint64_t GetCount() const    { return count; }
+        inline uint64_t GetMin() const      { return count ? minValue : 0; }
+        inline uint64_t GetMax() const      { return maxValue; }
+        inline double GetMean() const       { return mean; }
+
+        // sample variance in ticks^2
+        inline double GetVariance() const
+        {
+            return count > 1 ? m2 / double(count - 1) : 0.0;
+        }
+
+        // sample standard deviation in ticks
+        inline double GetStdDev() const
+        {
+            return std::sqrt(GetVariance());
+        }
+
+        // the sum of the squared differences from the mean, for the serialization
+        inline double GetM2() const         { return m2; }
+
+        /// @brief the stats of the given moments, the inverse of the getters (GetMin is 0 without values)
+        inline static MeasureStats FromMoments(uint64_t count, double mean, double m2, uint64_t minValue, uint64_t maxValue)
+        {
+            MeasureStats stats;
+            stats.count = count;
+            stats.mean = mean;
+            stats.m2 = m2;
+            stats.minValue = count ? minValue : UINT64_MAX;
+            stats.maxValue = maxValue;
+            return stats;
+        }
+
+        /// @brief add the values of other stats, as if they were added here one by one
+        /// the moments are combined by the parallel variance formula of Chan et al.
+        inline void Merge(const MeasureStats& other)
+        {
+            if (other.count == 0)
+                return;
+            if (count == 0)
+            {
+                *this = other;
+                return;
+            }
+            const double total = double(count) + double(other.count);
+            const double delta = other.mean - mean;
+            mean += delta * double(other.count) / total;
+            m2 += other.m2 + delta * delta * double(count) * double(other.count) / total;
+            count += other.count;
+            if (other.minValue < minValue)
+                minValue = other.minValue;
+            if (other.maxValue > maxValue)
+                maxValue = other.maxValue;
+        }
+
+    private:
+        uint64_t count;
+        double mean;
+        double m2;          // sum of squared differences from the mean
+        uint64_t minValue;
+        uint64_t maxValue;
+    };
+
+    static_assert(sizeof(MeasureStats) == 40, "MeasureStats must fit into one cache line");
+
+} // namespace dtree
@@ -0,0 +1,267 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// StatsD / DogStatsD push of the interval reports over UDP.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "measure/measure_utils.h"
+#include "measure/measure_interval.h"
+
+#if MEASURE_WINDOWS
+    #if defined(_WINSOCKAPI_) && !defined(_WINSOCK2API_)
+        #error "windows.h is included with winsock.h, include measure_statsd.h first or define WIN32_LEAN_AND_MEAN"
+    #endif
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "ws2_32.lib")
+    #endif
+    #define MEASURE_STATSD_IS_SUPPORTED 1
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netdb.h>
+    #include <unistd.h>
+    #define MEASURE_STATSD_IS_SUPPORTED 1
+#else
+    #define MEASURE_STATSD_IS_SUPPORTED 0
+#endif
+
+#if MEASURE_STATSD_IS_SUPPORTED
+
+namespace dtree
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct MeasureStatsdOptions
+    {
+        // the first part of the metric names
+        std::string prefix = "measure";
+
+        // DogStatsD: the record name is a tag (|#name:...), not a part of the metric name
+        bool tags = false;
+
+        // the lines are batched into datagrams of at most this size, 1432 bytes fit into the 1500 bytes
+        // Ethernet MTU with the IP and UDP headers, so the datagrams are never fragmented
+        size_t maxDatagramSize = 1432;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief sends the records of the interval reports (see MeasureIntervalReporter) to a StatsD or DogStatsD agent over UDP
+     *
+     * Every record with calls in the interval is three metrics:
+     *   <prefix>.<name>.calls:<calls>|c            the number of the calls in the interval
+     *   <prefix>.<name>.total_ms:<ms>|c            the time of the calls in the interval
+     *   <prefix>.<name>.average_ms:<ms>|g          the average time of a call
+     * With tags the name is a tag: <prefix>.calls:<calls>|c|#name:<name>.
+     * The characters of the names which have a meaning in the protocol are replaced by '_'.
+     * The lines are batched into as few datagrams as possible, and the sending never blocks,
+     * it runs in the thread of the interval reporter, so the measured threads are never stopped.
+     */
+    class MeasureStatsd
+    {
+    public:
+        MeasureStatsd() = default;
+        MeasureStatsd(const MeasureStatsd&) = delete;
+        MeasureStatsd& operator=(const MeasureStatsd&) = delete;
+
+        inline ~MeasureStatsd()
+        {
+            Close();
+        }
+
+        /// @brief resolve the address of the agent and open the socket
+        /// @return false if the address cannot be resolved or the socket cannot be created
+        inline bool Open(const std::string& host = "127.0.0.1", uint16_t port = 8125,
+                         const MeasureStatsdOptions& inOptions = MeasureStatsdOptions());
+
+        inline void Close();
+
+        inline bool IsOpen() const  { return socketHandle != InvalidSocket(); }
+
+        /// @brief send the records of an interval
+        /// @return the number of the sent datagrams
+        inline size_t Send(const MeasureInterval& interval);
+
+        /// @brief the datagrams of an interval, without sending them
+        inline static std::vector<std::string> Format(const MeasureInterval& interval,
+                                                      const MeasureStatsdOptions& options = MeasureStatsdOptions());
+
+        /// @brief a sink of MeasureIntervalReporter which sends every interval with the client
+        inline static std::function<void(const MeasureInterval&)> Sink(std::shared_ptr<MeasureStatsd> client)
+        {
+            return [client](const MeasureInterval& interval) { client->Send(interval); };
+        }
+
+    private:
+#if MEASURE_WINDOWS
+        using Socket = SOCKET;
+        inline static Socket InvalidSocket()    { return INVALID_SOCKET; }
+#else
+        using Socket = int;
+        inline static Socket InvalidSocket()    { return -1; }
+#endif
+
+        // the letters, digits and "_-./" are kept, the others are replaced by '_'
+        inline static void AppendName(std::string& line, const std::string& name);
+
+        inline static void AppendMetric(std::string& line, const MeasureStatsdOptions& options, const std::string& name,
+                                        const char* metric, double value, const char* type);
+
+        MeasureStatsdOptions options;
+        Socket socketHandle = InvalidSocket();
+        sockaddr_storage address = {};
+        socklen_t addressLength = 0;
+    };
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool dtree::MeasureStatsd::Open(const std::string& host, uint16_t port, const MeasureStatsdOptions& inOptions)
+{
+    Close();
+#if MEASURE_WINDOWS
+    struct WinsockInit
+    {
+        WinsockInit()   { WSADATA data; ok = WSAStartup(MAKEWORD(2, 2), &data) == 0; }
+        ~WinsockInit()  { if (ok) WSACleanup(); }
+        bool ok;
+    };
+    static WinsockInit winsockInit;
+    if (!winsockInit.ok)
+        return false;
+#endif
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    addrinfo* result = nullptr;
+    const std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0 || result == nullptr)
+        return false;
+
+    socketHandle = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (socketHandle != InvalidSocket())
+    {
+        memcpy(&address, result->ai_addr, result->ai_addrlen);
+        addressLength = socklen_t(result->ai_addrlen);
+        options = inOptions;
+#if MEASURE_WINDOWS
+        u_long nonBlocking = 1;
+        ioctlsocket(socketHandle, FIONBIO, &nonBlocking);
+#endif
+    }
+    freeaddrinfo(result);
+    return IsOpen();
+}
+
+void dtree::MeasureStatsd::Close()
+{
+    if (!IsOpen())
+        return;
+#if MEASURE_WINDOWS
+    closesocket(socketHandle);
+#else
+    close(socketHandle);
+#endif
+    socketHandle = InvalidSocket();
+}
+
+size_t dtree::MeasureStatsd::Send(const MeasureInterval& interval)
+{
+    if (!IsOpen())
+        return 0;
+    size_t sent = 0;
+    for (const std::string& datagram : Format(interval, options))
+    {
+        // a lost datagram is not retried, the next interval has its own counters
+#if MEASURE_WINDOWS
+        const int length = int(datagram.size());
+        const int flags = 0; // the socket is non-blocking
+#else
+        const size_t length = datagram.size();
+        const int flags = MSG_DONTWAIT;
+#endif
+        if (sendto(socketHandle, datagram.data(), length, flags, reinterpret_cast<const sockaddr*>(&address), addressLength) >= 0)
+            ++sent;
+    }
+    return sent;
+}
+
+std::vector<std::string> dtree::MeasureStatsd::Format(const MeasureInterval& interval, const MeasureStatsdOptions& options)
+{
+    std::vector<std::string> datagrams;
+    std::string datagram;
+    std::string line;
+    auto add = [&](const std::string& metricLine)
+    {
+        // a line longer than the limit is sent alone
+        if (!datagram.empty() && datagram.size() + 1 + metricLine.size() > options.maxDatagramSize)
+        {
+            datagrams.push_back(std::move(datagram));
+            datagram.clear();
+        }
+        if (!datagram.empty())
+            datagram += '\n';
+        datagram += metricLine;
+    };
+
+    for (const MeasureInterval::Record& record : interval.records)
+    {
+        AppendMetric(line, options, record.name, "calls", double(record.numCall), "c");
+        add(line);
+        AppendMetric(line, options, record.name, "total_ms", record.totalSec * 1e3, "c");
+        add(line);
+        AppendMetric(line, options, record.name, "average_ms", record.averageSec * 1e3, "g");
+        add(line);
+    }
+    if (!datagram.empty())
+        datagrams.push_back(std::move(datagram));
+    return datagrams;
+}
+
+void dtree::MeasureStatsd::AppendName(std::string& line, const std::string& name)
+{
+    for (const char c : name)
+    {
+        const bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                        || c == '_' || c == '-' || c == '.' || c == '/';
+        line += valid ? c : '_';
+    }
+}
+
+void dtree::MeasureStatsd::AppendMetric(std::string& line, const MeasureStatsdOptions& options, const std::string& name,
+                                        const char* metric, double value, const char* type)
+{
+    line.clear();
+    AppendName(line, options.prefix);
+    line += '.';
+    if (!options.tags)
+    {
+        AppendName(line, name);
+        line += '.';
+    }
+    line += metric;
+    line += ':';
+    char buffer[64];
+    line.append(buffer, MeasureUtils::FormatGeneral(buffer, sizeof(buffer), value));
+    line += '|';
+    line += type;
+    if (options.tags)
+    {
+        line += "|#name:";
+        AppendName(line, name);
+    }
+}
+
+#endif // MEASURE_STATSD_IS_SUPPORTED
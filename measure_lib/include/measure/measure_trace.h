@@ -0,0 +1,416 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Timeline of the measure scopes in per-thread ring buffers, with Chrome trace JSON export.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <fstream>
+#include <algorithm>
+
+#include "measure/measure_utils.h"
+
+// number of events in the ring buffer of a thread, must be a power of two, an event is 24 bytes
+#ifndef MEASURE_TRACE_CAPACITY
+    #define MEASURE_TRACE_CAPACITY 16384
+#endif
+
+namespace dtree
+{
+    template<typename TimeDiff> struct TimeDiffTraits;
+    template<typename MeasureRecord> struct TMeasureScope;
+    template<typename MeasureRecord> struct MeasureScopeRSafe;
+    template<typename MeasureRecord> struct MeasureTreeScope;
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief per-thread ring buffers of the finished scopes of a backend, for a timeline of the calls
+     *
+     * Every finished scope writes one complete event (record, start and duration in raw ticks)
+     * into the preallocated ring buffer of its thread, without allocation and locking, the thread is known by the ring.
+     * When the ring is full the oldest events are overwritten, so it can be always on,
+     * and the last events can be exported at any time (see ChromeTraceReport).
+     * The reader detects the events overwritten during the export by the begin and end counters of the ring
+     * (a seqlock style protocol), the writers are never blocked.
+     * The ring of a finished thread is reused by a new thread, then the events of the finished thread are dropped.
+     * The records must live as long as the reports are created (static and dynamic records always do).
+     */
+    template<typename InMeasureRecord>
+    struct MeasureTrace
+    {
+    public:
+        using MeasureRecord = InMeasureRecord;
+        using TimePoint = typename MeasureRecord::TimePoint;
+        using TimeDiffRep = typename MeasureRecord::TimeDiffRep;
+
+        static constexpr uint64_t Capacity = MEASURE_TRACE_CAPACITY;
+        static_assert((Capacity & (Capacity - 1)) == 0, "MEASURE_TRACE_CAPACITY must be a power of two");
+
+        /// @brief a copy of an event for the reports
+        struct EventData
+        {
+            const MeasureRecord* record;
+            TimeDiffRep start;      // ticks since the epoch of the backend clock
+            TimeDiffRep duration;   // ticks
+            uint32_t threadId;      // 1, 2, ... in the order of the first trace event of the threads
+        };
+
+        // add a finished scope to the ring of the current thread
+        inline static void Add(const MeasureRecord* record, TimePoint start, TimeDiffRep duration)
+        {
+            ThreadRing* ring = CurrentRing();
+            const uint64_t index = ring->endIndex.load(std::memory_order_relaxed);
+            ring->beginIndex.store(index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            Event& event = ring->events[index & (Capacity - 1)];
+            event.record.store(record, std::memory_order_relaxed);
+            event.start.store(TicksSinceEpoch(start), std::memory_order_relaxed);
+            event.duration.store(duration, std::memory_order_relaxed);
+            ring->endIndex.store(index + 1, std::memory_order_release);
+        }
+
+        // the time point in ticks, the integer backends return ticks, the CppBackend returns a std::chrono::time_point
+        inline static TimeDiffRep TicksSinceEpoch(TimePoint time)
+        {
+            return TimeDiffTraits<decltype(time - TimePoint())>::ToRep(time - TimePoint());
+        }
+
+        /// @brief copy the events of all threads, ordered by the start time
+        /// @param lastSeconds if it is positive, only the events finished in the last lastSeconds seconds
+        static std::vector<EventData> GetEvents(double lastSeconds = 0);
+
+        /// @brief print the events in Chrome trace JSON format (chrome://tracing, https://ui.perfetto.dev),
+        /// the times are relative to the first event
+        static void ChromeJsonReport(std::ostream& os, double lastSeconds = 0);
+
+    private:
+        struct Event
+        {
+            std::atomic<const MeasureRecord*> record;
+            std::atomic<TimeDiffRep> start;
+            std::atomic<TimeDiffRep> duration;
+        };
+
+        struct ThreadRing
+        {
+            Event events[Capacity];
+            std::atomic<uint64_t> beginIndex;   // the index of the event being written + 1
+            std::atomic<uint64_t> endIndex;     // the number of written events
+            std::atomic<uint64_t> firstIndex;   // the first event of the current thread
+            std::atomic<uint32_t> threadId;
+            std::atomic<bool> inUse;
+            ThreadRing* next;
+        };
+
+        // acquire a ThreadRing for the current thread, and release it at thread exit
+        struct ThreadHandle
+        {
+            ThreadHandle();
+            ~ThreadHandle();
+            ThreadRing* ring;
+        };
+
+        inline static ThreadRing* CurrentRing()
+        {
+            static thread_local ThreadHandle handle;
+            return handle.ring;
+        }
+
+        static void WriteJsonString(MeasureUtils::ReportBuffer& report, const std::string& text);
+
+        static MeasureTrace<MeasureRecord>* Instance()
+        {
+            static MeasureTrace<MeasureRecord> instance;
+            return &instance;
+        }
+
+        MeasureUtils::ThreadBlockList<ThreadRing> threadRings;
+        std::atomic<uint32_t> threadCount;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief the scope of a policy in trace mode, the wrapped scope is measured the same way,
+    /// and every scope is added to the trace too, with the same clock reads.
+    /// every call of a switched on record is measured, the sample period is not considered
+    template<typename Scope> struct MeasureTraceScope;
+
+    template<typename MeasureRecord>
+    struct MeasureTraceScope<TMeasureScope<MeasureRecord>>
+    {
+        using Trace = typename MeasureRecord::Trace;
+
+        inline MeasureTraceScope(MeasureRecord* record_)
+#if MEASURE_IS_ON
+            : record{ record_->IsActive() ? record_ : nullptr }
+            , start{ record ? record_->Now() : typename MeasureRecord::TimePoint() }
+        {
+        }
+
+        inline ~MeasureTraceScope()
+        {
+            if (!record)
+                return;
+            const typename MeasureRecord::TimeDiff time = record->Now() - start;
+            record->AddTime(time);
+            Trace::Add(record, start, TimeDiffTraits<typename MeasureRecord::TimeDiff>::ToRep(time));
+        }
+
+        // the work amount of the call (see TMeasureRecord::AddWork)
+        inline void AddBytes(uint64_t bytes)
+        {
+            if (record)
+                record->AddWork(bytes, 0);
+        }
+
+        inline void AddItems(uint64_t items)
+        {
+            if (record)
+                record->AddWork(0, items);
+        }
+
+        MeasureRecord* record;
+        typename MeasureRecord::TimePoint start;
+#else
+        {}
+        inline void AddBytes(uint64_t) {}
+        inline void AddItems(uint64_t) {}
+#endif
+    };
+
+    // the nested scopes of the same record are in the trace, but the record gets the outermost only
+    template<typename MeasureRecord>
+    struct MeasureTraceScope<MeasureScopeRSafe<MeasureRecord>>
+    {
+        using Trace = typename MeasureRecord::Trace;
+
+        inline MeasureTraceScope(MeasureRecord* record_)
+#if MEASURE_IS_ON
+            : record{ record_->IsActive() ? record_ : nullptr }
+        {
+            if (!record)
+                return;
+            record->IncrementDepth();
+            start = record->Now();
+        }
+
+        inline ~MeasureTraceScope()
+        {
+            if (!record)
+                return;
+            const typename MeasureRecord::TimeDiff time = record->Now() - start;
+            if (record->DecrementDepth())
+                record->AddTime(time);
+            Trace::Add(record, start, TimeDiffTraits<typename MeasureRecord::TimeDiff>::ToRep(time));
+        }
+
+        // only the outermost scope of a record reports the work amount, like the time
+        inline void AddBytes(uint64_t bytes)
+        {
+            if (record && record->GetDepth() == 1)
+                record->AddWork(bytes, 0);
+        }
+
+        inline void AddItems(uint64_t items)
+        {
+            if (record && record->GetDepth() == 1)
+                record->AddWork(0, items);
+        }
+
+        MeasureRecord* record;
+        typename MeasureRecord::TimePoint start;
+#else
+        {}
+        inline void AddBytes(uint64_t) {}
+        inline void AddItems(uint64_t) {}
+#endif
+    };
+
+    template<typename MeasureRecord>
+    struct MeasureTraceScope<MeasureTreeScope<MeasureRecord>>
+    {
+        using Trace = typename MeasureRecord::Trace;
+        using Tree = typename MeasureRecord::Tree;
+        using TimeDiffRep = typename MeasureRecord::TimeDiffRep;
+
+        inline MeasureTraceScope(MeasureRecord* record_)
+#if MEASURE_IS_ON
+            : record{ record_->IsActive() ? record_ : nullptr }
+            , node{ record ? Tree::Enter(record_) : nullptr }
+            , start{ record ? record_->Now() : typename MeasureRecord::TimePoint() }
+        {
+        }
+
+        inline ~MeasureTraceScope()
+        {
+            if (!record)
+                return;
+            const typename MeasureRecord::TimeDiff time = record->Now() - start;
+            const TimeDiffRep timeRep = TimeDiffTraits<typename MeasureRecord::TimeDiff>::ToRep(time);
+            if (node->outermost)
+                record->AddTime(time);
+            Tree::Leave(node, timeRep);
+            Trace::Add(record, start, timeRep);
+        }
+
+        // only the outermost scope of a record reports the work amount, like the time
+        inline void AddBytes(uint64_t bytes)
+        {
+            if (record && node->outermost)
+                record->AddWork(bytes, 0);
+        }
+
+        inline void AddItems(uint64_t items)
+        {
+            if (record && node->outermost)
+                record->AddWork(0, items);
+        }
+
+        MeasureRecord* record;
+        typename Tree::Node* node;
+        typename MeasureRecord::TimePoint start;
+#else
+        {}
+        inline void AddBytes(uint64_t) {}
+        inline void AddItems(uint64_t) {}
+#endif
+    };
+
+    /// @brief print the trace of a database in Chrome trace JSON format
+    /// @param lastSeconds if it is positive, only the calls finished in the last lastSeconds seconds
+    template<typename Database>
+    void ChromeTraceReport(std::ostream& os, double lastSeconds = 0)
+    {
+        Database::MeasureRecord::Trace::ChromeJsonReport(os, lastSeconds);
+    }
+
+    /// @brief print the trace of a database in Chrome trace JSON format to a file
+    template<typename Database>
+    void ChromeTraceReport(std::string filename = "performance_trace.json", double lastSeconds = 0)
+    {
+        std::ofstream os(filename);
+        ChromeTraceReport<Database>(os, lastSeconds);
+    }
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename MeasureRecord>
+constexpr uint64_t dtree::MeasureTrace<MeasureRecord>::Capacity;
+
+template<typename MeasureRecord>
+auto dtree::MeasureTrace<MeasureRecord>::GetEvents(double lastSeconds) -> std::vector<EventData>
+{
+    // the events finished before this time are not needed
+    const double tickSec = MeasureRecord::TicksToSec(1);
+    const TimeDiffRep now = TicksSinceEpoch(MeasureRecord::MeasureBackend::GetTick());
+    const double minEndTicks = lastSeconds > 0 ? double(now) - lastSeconds / tickSec : 0;
+
+    std::vector<EventData> events;
+    for (ThreadRing* ring = Instance()->threadRings.Head(); ring; ring = ring->next)
+    {
+        const uint64_t endIndex = ring->endIndex.load(std::memory_order_acquire);
+        const uint64_t firstIndex = std::max(ring->firstIndex.load(std::memory_order_relaxed), endIndex > Capacity ? endIndex - Capacity : 0);
+        const uint32_t threadId = ring->threadId.load(std::memory_order_relaxed);
+
+        const size_t threadBegin = events.size();
+        for (uint64_t index = firstIndex; index < endIndex; ++index)
+        {
+            const Event& event = ring->events[index & (Capacity - 1)];
+            EventData data;
+            data.record = event.record.load(std::memory_order_relaxed);
+            data.start = event.start.load(std::memory_order_relaxed);
+            data.duration = event.duration.load(std::memory_order_relaxed);
+            data.threadId = threadId;
+            events.push_back(data);
+        }
+
+        // drop the events overwritten by the owner thread during the copy
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t beginIndex = ring->beginIndex.load(std::memory_order_relaxed);
+        const uint64_t validIndex = beginIndex > Capacity ? beginIndex - Capacity : 0;
+        if (validIndex > firstIndex)
+        {
+            const size_t dropped = size_t(std::min(validIndex, endIndex) - firstIndex);
+            events.erase(events.begin() + std::ptrdiff_t(threadBegin), events.begin() + std::ptrdiff_t(threadBegin + dropped));
+        }
+    }
+
+    if (lastSeconds > 0)
+        events.erase(std::remove_if(events.begin(), events.end(),
+            [minEndTicks](const EventData& event) { return double(event.start + event.duration) < minEndTicks; }), events.end());
+
+    std::sort(events.begin(), events.end(),
+        [](const EventData& a, const EventData& b) { return a.start < b.start; });
+    return events;
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTrace<MeasureRecord>::ChromeJsonReport(std::ostream& os, double lastSeconds)
+{
+    const std::vector<EventData> events = GetEvents(lastSeconds);
+    const double tickUs = MeasureRecord::TicksToSec(1) * 1e6;
+    const TimeDiffRep origin = events.empty() ? TimeDiffRep() : events.front().start;
+
+    MeasureUtils::ReportBuffer report((events.size() + 1) * 96);
+    report.Append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    bool first = true;
+    for (const EventData& event : events)
+    {
+        report.Append(first ? "\n" : ",\n");
+        first = false;
+        report.Append("{\"name\":");
+        WriteJsonString(report, event.record->name);
+        report.Append(",\"ph\":\"X\",\"pid\":1,\"tid\":").Number(event.threadId)
+              .Append(",\"ts\":").Fixed(double(event.start - origin) * tickUs, 3)
+              .Append(",\"dur\":").Fixed(double(event.duration) * tickUs, 3)
+              .Append('}');
+    }
+    report.Append("\n]}\n");
+    report.WriteTo(os);
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTrace<MeasureRecord>::WriteJsonString(MeasureUtils::ReportBuffer& report, const std::string& text)
+{
+    report.Append('"');
+    for (const char c : text)
+    {
+        if (c == '"' || c == '\\')
+            report.Append('\\').Append(c);
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            const char* hex = "0123456789abcdef";
+            report.Append("\\u00").Append(hex[(c >> 4) & 0xf]).Append(hex[c & 0xf]);
+        }
+        else
+            report.Append(c);
+    }
+    report.Append('"');
+}
+
+template<typename MeasureRecord>
+dtree::MeasureTrace<MeasureRecord>::ThreadHandle::ThreadHandle()
+{
+    MeasureTrace<MeasureRecord>* instance = Instance();
+    const uint32_t threadId = instance->threadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // the ring of a finished thread is reused, its events are dropped
+    ring = instance->threadRings.Acquire([threadId](ThreadRing* newRing, bool reused)
+    {
+        if (reused)
+            newRing->firstIndex.store(newRing->endIndex.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        newRing->threadId.store(threadId, std::memory_order_relaxed);
+    });
+}
+
+template<typename MeasureRecord>
+dtree::MeasureTrace<MeasureRecord>::ThreadHandle::~ThreadHandle()
+{
+    MeasureUtils::ThreadBlockList<ThreadRing>::Release(ring);
+}
@@ -0,0 +1,411 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Call tree of the measure scopes: inclusive and exclusive (self) time per caller path.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <mutex>
+
+#include "measure/measure_utils.h"
+
+namespace dtree
+{
+    template<typename TimeDiff> struct TimeDiffTraits;
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * @brief per-thread call trees of the measure records of a backend
+     *
+     * Every thread has its own tree, and a thread local pointer to the node of its innermost open scope.
+     * Entering a scope looks up the child of the current node for the record:
+     * every thread caches the found children per (parent, record) edge in a small direct mapped table,
+     * so a loop calling one or more children is a hash and a pointer compare per call,
+     * otherwise the short child list of the node is searched, and a new node is added only at the first call of a path.
+     * The nodes are written only by the owner thread (relaxed load and store, like MeasureShards),
+     * the reports merge the trees of all threads by the path. The nodes are never freed,
+     * the tree of a finished thread is reused by a new thread.
+     * The records must live as long as the reports are created (static and dynamic records always do).
+     */
+    template<typename InMeasureRecord>
+    struct MeasureTree
+    {
+    public:
+        using MeasureRecord = InMeasureRecord;
+        using TimeDiffRep = typename MeasureRecord::TimeDiffRep;
+
+        struct Node
+        {
+            const MeasureRecord* record;    // nullptr in the root of a thread
+            Node* parent;
+            bool outermost;                 // there is no ancestor with the same record
+            std::atomic<Node*> firstChild;
+            Node* nextSibling;              // not changed after the node is published
+
+            std::atomic<TimeDiffRep> totalTime;
+            std::atomic<uint64_t> numCall;
+            std::atomic<TimeDiffRep> childTime; // inclusive time of the children
+            // the counters at the last Reset(), written only by the reset, the readers get them as one set
+            MeasureUtils::SeqLock resetLock;
+            std::atomic<TimeDiffRep> resetTotalTime;
+            std::atomic<uint64_t> resetNumCall;
+            std::atomic<TimeDiffRep> resetChildTime;
+        };
+
+        /// @brief a node of the merged tree of all threads, for the reports
+        struct ReportNode
+        {
+            const MeasureRecord* record = nullptr;
+            TimeDiffRep totalTime = TimeDiffRep();
+            TimeDiffRep childTime = TimeDiffRep();
+            uint64_t numCall = 0;
+            std::vector<ReportNode> children;
+        };
+
+        // move the current node of the thread to the child of the record, returns the child
+        inline static Node* Enter(const MeasureRecord* record)
+        {
+            ThreadHandle& handle = GetThreadHandle();
+            Edge& edge = handle.edges[EdgeIndex(handle.current, record)];
+            if (edge.parent != handle.current || edge.child->record != record)
+            {
+                edge.parent = handle.current;
+                edge.child = FindOrAddChild(handle.current, record);
+            }
+            handle.current = edge.child;
+            return edge.child;
+        }
+
+        // add one call to the node, and move the current node of the thread back to its parent
+        inline static void Leave(Node* node, TimeDiffRep time)
+        {
+            Add(node->totalTime, time);
+            Add(node->numCall, uint64_t(1));
+            Add(node->parent->childTime, time);
+            GetThreadHandle().current = node->parent;
+        }
+
+        // true if no scope was measured in tree mode
+        static bool IsEmpty();
+
+        // merge the trees of all threads, the root has no record
+        static ReportNode GetReportTree();
+
+        // set the counters of all nodes to 0, the owner threads are not disturbed
+        static void Reset();
+
+        // print the merged tree, indented by the depth
+        static void PrintReport(std::ostream& os);
+
+        // print the merged tree in CSV format, one line per path, the path is separated by ';'
+        static void CsvReport(std::ostream& os);
+
+    private:
+        struct ThreadTree
+        {
+            Node root;
+            std::atomic<bool> inUse;
+            ThreadTree* next;
+        };
+
+        static constexpr uint32_t EdgeCacheBits = 6;
+        static constexpr size_t EdgeCacheSize = size_t(1) << EdgeCacheBits;    // edges per thread
+
+        // a found child of a parent node, an entry of the edge cache
+        struct Edge
+        {
+            const Node* parent;
+            Node* child;
+        };
+
+        // acquire a ThreadTree for the current thread, and release it at thread exit
+        struct ThreadHandle
+        {
+            ThreadHandle();
+            ~ThreadHandle();
+            ThreadTree* tree;
+            Node* current;
+            Edge edges[EdgeCacheSize];
+        };
+
+        inline static ThreadHandle& GetThreadHandle()
+        {
+            static thread_local ThreadHandle handle;
+            return handle;
+        }
+
+        // the multiplicative hash of the edge, the high bits are the index
+        inline static size_t EdgeIndex(const Node* parent, const MeasureRecord* record)
+        {
+            const uint64_t key = uint64_t(reinterpret_cast<uintptr_t>(parent)) ^ (uint64_t(reinterpret_cast<uintptr_t>(record)) << 1);
+            return size_t((key * 0x9E3779B97F4A7C15ull) >> (64 - EdgeCacheBits));
+        }
+
+        template<typename T>
+        inline static void Add(std::atomic<T>& counter, T value)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        static Node* FindOrAddChild(Node* parent, const MeasureRecord* record);
+        static void Merge(const Node* node, ReportNode& reportNode);
+        static void ResetNode(Node* node);
+        static void PrintNode(MeasureUtils::ReportBuffer& report, const ReportNode& node, int depth);
+        static void CsvNode(MeasureUtils::ReportBuffer& report, const ReportNode& node, const std::string& parentPath);
+
+        static MeasureTree<MeasureRecord>* Instance()
+        {
+            static MeasureTree<MeasureRecord> instance;
+            return &instance;
+        }
+
+        MeasureUtils::ThreadBlockList<ThreadTree> threadTrees;
+        std::mutex resetMutex;                  // serializes the writers of the reset counters
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief a measure scope in tree mode, see MeasureTree
+    /// the record gets the time of the outermost scope of the record only, so it is recursion safe
+    /// with any policy, and it is thread safe if the record is thread safe.
+    /// every call of a switched on record is measured, the sample period is not considered
+    template<typename MeasureRecord>
+    struct MeasureTreeScope
+    {
+        using Tree = typename MeasureRecord::Tree;
+
+        inline MeasureTreeScope(MeasureRecord* record_)
+#if MEASURE_IS_ON
+            : record{ record_->IsActive() ? record_ : nullptr }
+            , node{ record ? Tree::Enter(record_) : nullptr }
+            , start{ record ? record_->Now() : typename MeasureRecord::TimePoint() }
+        {
+        }
+
+        inline ~MeasureTreeScope()
+        {
+            if (!record)
+                return;
+            const typename MeasureRecord::TimeDiff time = record->Now() - start;
+            if (node->outermost)
+                record->AddTime(time);
+            Tree::Leave(node, TimeDiffTraits<typename MeasureRecord::TimeDiff>::ToRep(time));
+        }
+
+        // the work amount of the call, only the outermost scope of a record reports it, like the time
+        inline void AddBytes(uint64_t bytes)
+        {
+            if (record && node->outermost)
+                record->AddWork(bytes, 0);
+        }
+
+        inline void AddItems(uint64_t items)
+        {
+            if (record && node->outermost)
+                record->AddWork(0, items);
+        }
+
+        MeasureRecord* record;  // nullptr if the record or the scopes are switched off
+        typename Tree::Node* node;
+        typename MeasureRecord::TimePoint start;
+#else
+        {}
+        inline void AddBytes(uint64_t) {}
+        inline void AddItems(uint64_t) {}
+#endif
+    };
+
+} // namespace dtree
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename MeasureRecord>
+constexpr uint32_t dtree::MeasureTree<MeasureRecord>::EdgeCacheBits;
+
+template<typename MeasureRecord>
+constexpr size_t dtree::MeasureTree<MeasureRecord>::EdgeCacheSize;
+
+template<typename MeasureRecord>
+bool dtree::MeasureTree<MeasureRecord>::IsEmpty()
+{
+    for (ThreadTree* tree = Instance()->threadTrees.Head(); tree; tree = tree->next)
+        if (tree->root.firstChild.load(std::memory_order_acquire) != nullptr)
+            return false;
+    return true;
+}
+
+template<typename MeasureRecord>
+auto dtree::MeasureTree<MeasureRecord>::GetReportTree() -> ReportNode
+{
+    ReportNode root;
+    for (ThreadTree* tree = Instance()->threadTrees.Head(); tree; tree = tree->next)
+        Merge(&tree->root, root);
+    return root;
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTree<MeasureRecord>::Reset()
+{
+    const std::lock_guard<std::mutex> lock(Instance()->resetMutex);
+    for (ThreadTree* tree = Instance()->threadTrees.Head(); tree; tree = tree->next)
+        ResetNode(&tree->root);
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTree<MeasureRecord>::PrintReport(std::ostream& os)
+{
+    const ReportNode root = GetReportTree();
+    if (root.children.empty())
+        return;
+
+    const size_t width = 86;
+    const std::string title = std::string(MeasureRecord::MeasureBackend::GetMeasureTitle()) + " call tree";
+    MeasureUtils::ReportBuffer report;
+    report.Title(title.c_str(), width);
+    report.Left("Name", 40)
+          .Right("Calls", 12)
+          .Right("Inclusive (ns)", 17)
+          .Right("Exclusive (ns)", 17)
+          .Append('\n').Append('-', width).Append('\n');
+    for (const ReportNode& child : root.children)
+        PrintNode(report, child, 0);
+    report.Append('-', width).Append('\n');
+    report.WriteTo(os);
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTree<MeasureRecord>::CsvReport(std::ostream& os)
+{
+    const ReportNode root = GetReportTree();
+    if (root.children.empty())
+        return;
+
+    MeasureUtils::ReportBuffer report;
+    report.Append("path,num_calls,inclusive_ns,exclusive_ns\n");
+    for (const ReportNode& child : root.children)
+        CsvNode(report, child, std::string());
+    report.WriteTo(os);
+}
+
+template<typename MeasureRecord>
+auto dtree::MeasureTree<MeasureRecord>::FindOrAddChild(Node* parent, const MeasureRecord* record) -> Node*
+{
+    for (Node* child = parent->firstChild.load(std::memory_order_relaxed); child; child = child->nextSibling)
+        if (child->record == record)
+            return child;
+
+    Node* node = new Node(); // zero initialized, never freed
+    node->record = record;
+    node->parent = parent;
+    node->outermost = true;
+    for (const Node* ancestor = parent; ancestor; ancestor = ancestor->parent)
+        if (ancestor->record == record)
+            node->outermost = false;
+    node->nextSibling = parent->firstChild.load(std::memory_order_relaxed);
+    parent->firstChild.store(node, std::memory_order_release); // only the owner thread adds children
+    return node;
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTree<MeasureRecord>::Merge(const Node* node, ReportNode& reportNode)
+{
+    // the children are added to the front of the list, the report shows them in the order of the first call
+    std::vector<const Node*> children;
+    for (const Node* child = node->firstChild.load(std::memory_order_acquire); child; child = child->nextSibling)
+        children.push_back(child);
+
+    for (auto it = children.rbegin(); it != children.rend(); ++it)
+    {
+        const Node* child = *it;
+        ReportNode* reportChild = nullptr;
+        for (ReportNode& candidate : reportNode.children)
+            if (candidate.record == child->record)
+                reportChild = &candidate;
+        if (reportChild == nullptr)
+        {
+            reportNode.children.emplace_back();
+            reportChild = &reportNode.children.back();
+            reportChild->record = child->record;
+        }
+
+        // the baselines first: a Reset() after them can't make them newer than the counters
+        TimeDiffRep resetTotalTime, resetChildTime;
+        uint64_t resetNumCall;
+        child->resetLock.Read([&]()
+        {
+            resetTotalTime = child->resetTotalTime.load(std::memory_order_relaxed);
+            resetNumCall = child->resetNumCall.load(std::memory_order_relaxed);
+            resetChildTime = child->resetChildTime.load(std::memory_order_relaxed);
+        });
+        reportChild->totalTime += child->totalTime.load(std::memory_order_relaxed) - resetTotalTime;
+        reportChild->numCall += child->numCall.load(std::memory_order_relaxed) - resetNumCall;
+        reportChild->childTime += child->childTime.load(std::memory_order_relaxed) - resetChildTime;
+        Merge(child, *reportChild);
+    }
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTree<MeasureRecord>::ResetNode(Node* node)
+{
+    const TimeDiffRep totalTime = node->totalTime.load(std::memory_order_relaxed);
+    const uint64_t numCall = node->numCall.load(std::memory_order_relaxed);
+    const TimeDiffRep childTime = node->childTime.load(std::memory_order_relaxed);
+    node->resetLock.Write([&]()
+    {
+        node->resetTotalTime.store(totalTime, std::memory_order_relaxed);
+        node->resetNumCall.store(numCall, std::memory_order_relaxed);
+        node->resetChildTime.store(childTime, std::memory_order_relaxed);
+    });
+    for (Node* child = node->firstChild.load(std::memory_order_acquire); child; child = child->nextSibling)
+        ResetNode(child);
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTree<MeasureRecord>::PrintNode(MeasureUtils::ReportBuffer& report, const ReportNode& node, int depth)
+{
+    const TimeDiffRep selfTime = node.totalTime > node.childTime ? node.totalTime - node.childTime : TimeDiffRep();
+    const std::string name = std::string(size_t(2 * depth), ' ') + node.record->name;
+    report.Left(name, 40)
+          .Number(node.numCall, 12)
+          .Ns(MeasureRecord::TicksToSec(uint64_t(node.totalTime)), 17)
+          .Ns(MeasureRecord::TicksToSec(uint64_t(selfTime)), 17)
+          .Append('\n');
+    for (const ReportNode& child : node.children)
+        PrintNode(report, child, depth + 1);
+}
+
+template<typename MeasureRecord>
+void dtree::MeasureTree<MeasureRecord>::CsvNode(MeasureUtils::ReportBuffer& report, const ReportNode& node, const std::string& parentPath)
+{
+    const TimeDiffRep selfTime = node.totalTime > node.childTime ? node.totalTime - node.childTime : TimeDiffRep();
+    const std::string path = parentPath.empty() ? node.record->name : parentPath + ";" + node.record->name;
+    report.Append(path).Append(',')
+          .Number(node.numCall).Append(',')
+          .Fixed(MeasureRecord::TicksToSec(uint64_t(node.totalTime)) * 1e9).Append(',')
+          .Fixed(MeasureRecord::TicksToSec(uint64_t(selfTime)) * 1e9)
+          .Append('\n');
+    for (const ReportNode& child : node.children)
+        CsvNode(report, child, path);
+}
+
+template<typename MeasureRecord>
+dtree::MeasureTree<MeasureRecord>::ThreadHandle::ThreadHandle()
+    : edges{}
+{
+    // the tree of a finished thread is reused, its nodes are kept
+    tree = Instance()->threadTrees.Acquire([](ThreadTree* newTree, bool reused)
+    {
+        if (!reused)
+            newTree->root.outermost = true;
+    });
+    current = &tree->root;
+}
+
+template<typename MeasureRecord>
+dtree::MeasureTree<MeasureRecord>::ThreadHandle::~ThreadHandle()
+{
+    MeasureUtils::ThreadBlockList<ThreadTree>::Release(tree);
+}
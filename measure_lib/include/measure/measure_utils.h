@@ -15,6 +15,14 @@
     #define RDTSC_MEASURE_IS_SUPPORTED 0
 #endif
 
+#if defined(_MSC_VER) && defined(_M_ARM64)
+    #define ARM64_MEASURE_IS_SUPPORTED 1
+#elif ((defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__))
+    #define ARM64_MEASURE_IS_SUPPORTED 1
+#else
+    #define ARM64_MEASURE_IS_SUPPORTED 0
+#endif
+
 #ifndef MEASURE_WINDOWS
     #ifdef _MSC_VER
         #define MEASURE_WINDOWS 1
@@ -23,22 +31,86 @@
     #endif
 #endif
 
+#ifndef MEASURE_LINUX
+    #ifdef __linux__
+        #define MEASURE_LINUX 1
+    #else
+        #define MEASURE_LINUX 0
+    #endif
+#endif
+
+#ifndef MEASURE_MACOS
+    #ifdef __APPLE__
+        #define MEASURE_MACOS 1
+    #else
+        #define MEASURE_MACOS 0
+    #endif
+#endif
+
+#ifndef MEASURE_CACHE_LINE_SIZE
+    #define MEASURE_CACHE_LINE_SIZE 64
+#endif
+
+// cache line alignment of the opt-in record extensions,
+// only if operator new respects it (C++17), otherwise the dynamic records could be misaligned
+#ifndef MEASURE_CACHE_LINE_ALIGNED
+    #if defined(__cpp_aligned_new)
+        #define MEASURE_CACHE_LINE_ALIGNED alignas(MEASURE_CACHE_LINE_SIZE)
+    #else
+        #define MEASURE_CACHE_LINE_ALIGNED alignas(16)
+    #endif
+#endif
+
 #include <string>
+#include <cstring>
+#include <cstdio>
+#include <ostream>
 #include <iomanip>
 #include <sstream>
+#include <vector>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #if RDTSC_MEASURE_IS_SUPPORTED
     #ifdef _MSC_VER
         #include <intrin.h>
     #else
         #include <x86intrin.h>
+        #include <cpuid.h>
     #endif
+#elif defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#if RDTSC_MEASURE_IS_SUPPORTED && defined(__linux__)
+    #include <fstream>
+    #include <cstring>
+    #include <linux/perf_event.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#if MEASURE_LINUX
+    #include <fstream>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#if MEASURE_MACOS
+    #include <pthread.h>
+    #include <mach/mach.h>
+    #include <mach/thread_policy.h>
 #endif
 
 #if MEASURE_WINDOWS
     #define NOMINMAX
+    #include <winsock2.h>   // before windows.h, otherwise it includes the old winsock.h (see measure_statsd.h)
     #include <wtypes.h>
     #ifdef small
         #undef small
@@ -51,18 +123,87 @@ namespace dtree
     ///////////////////////////////////////////////////////////////////////////////////////////////
     namespace MeasureUtils
     {
+        // the buffer sizes of the formatting functions below, with the terminating zero
+        constexpr size_t MaxUIntLength = 21;            // 18'446'744'073'709'551'615 without separator
+        constexpr size_t MaxSeparatedLength = 27;       // 18'446'744'073'709'551'615
+        constexpr size_t MaxTimeLength = 32;            // TimeToStr
+
+        /// @brief write a number in decimal, like std::to_chars (C++17), two digits at a time, without allocation
+        /// @param buffer at least MaxUIntLength chars, the result is zero terminated
+        /// @return the number of the written chars without the terminating zero
+        inline size_t FormatUInt(char* buffer, uint64_t num)
+        {
+            static const char digitPairs[] =
+                "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                "8081828384858687888990919293949596979899";
+            char digits[MaxUIntLength];
+            char* end = digits + sizeof(digits);
+            char* begin = end;
+            while (num >= 100)
+            {
+                const char* pair = digitPairs + 2 * (num % 100);
+                num /= 100;
+                *--begin = pair[1];
+                *--begin = pair[0];
+            }
+            if (num >= 10)
+            {
+                const char* pair = digitPairs + 2 * num;
+                *--begin = pair[1];
+                *--begin = pair[0];
+            }
+            else
+                *--begin = char('0' + num);
+            const size_t length = size_t(end - begin);
+            memcpy(buffer, begin, length);
+            buffer[length] = 0;
+            return length;
+        }
+
+        /// @brief write a number with a thousands separator (default '\''), without allocation
+        /// @param buffer at least MaxSeparatedLength chars, the result is zero terminated
+        /// @return the number of the written chars without the terminating zero
+        inline size_t FormatWithSeparator(char* buffer, uint64_t num, char separator = '\'')
+        {
+            char digits[MaxUIntLength];
+            const size_t digitNum = FormatUInt(digits, num);
+            size_t length = 0;
+            for (size_t i = 0; i < digitNum; ++i)
+            {
+                if (i != 0 && (digitNum - i) % 3 == 0)
+                    buffer[length++] = separator;
+                buffer[length++] = digits[i];
+            }
+            buffer[length] = 0;
+            return length;
+        }
+
         /// @brief Format a number with a thousands separator (default '\'').
         /// Example: 12345678 -> 12'345'678
         inline std::string FormatWithSeparator(uint64_t num, char separator = '\'')
         {
-            std::string s = std::to_string(num);
-            int n = int(s.length()) - 3;
-            while (n > 0)
-            {
-                s.insert(n, 1, separator);
-                n -= 3;
-            }
-            return s;
+            char buffer[MaxSeparatedLength];
+            return std::string(buffer, FormatWithSeparator(buffer, num, separator));
+        }
+
+        /// @brief 64 bit FNV-1a hash of a record name at compile time, the same as HashName
+        constexpr uint64_t ConstHashName(const char* name, uint64_t hash = 14695981039346656037ull)
+        {
+            return *name == 0 ? hash : ConstHashName(name + 1, (hash ^ uint8_t(*name)) * 1099511628211ull);
+        }
+
+        /// @brief 64 bit FNV-1a hash of a record name, it computes the length too
+        /// @param name zero terminated string
+        /// @param outLength the length of the name without the terminating zero
+        inline uint64_t HashName(const char* name, size_t& outLength)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            const char* c = name;
+            for (; *c != 0; ++c)
+                hash = (hash ^ uint8_t(*c)) * 1099511628211ull;
+            outLength = size_t(c - name);
+            return hash;
         }
 
         /// @brief Converts a time duration from seconds to nanoseconds.
@@ -75,39 +216,631 @@ namespace dtree
             return FormatWithSeparator(uint64_t(sec*1e9));
         }
 
+        // the same into a buffer of at least MaxSeparatedLength chars, returns the length
+        inline size_t TimeToStrNs(char* buffer, const double sec)
+        {
+            return FormatWithSeparator(buffer, uint64_t(sec*1e9));
+        }
+
+        /// @brief a rate (e.g. MB/s) with a thousands separator and one decimal digit, e.g. 1'234.5
+        /// @param buffer at least MaxSeparatedLength + 2 chars, the result is zero terminated
+        inline size_t RateToStr(char* buffer, const double rate)
+        {
+            const uint64_t tenths = uint64_t(rate * 10 + 0.5);
+            size_t length = FormatWithSeparator(buffer, tenths / 10);
+            buffer[length++] = '.';
+            buffer[length++] = char('0' + tenths % 10);
+            buffer[length] = 0;
+            return length;
+        }
+
+        inline std::string RateToStr(const double rate)
+        {
+            char buffer[MaxSeparatedLength + 2];
+            return std::string(buffer, RateToStr(buffer, rate));
+        }
+
+        /// @brief the total and average time without the calibrated overhead of the calls, in seconds, at least 0
+        /// @param overheadTicks, noiseTicks the calibration of the record type (see TMeasure::Calibrate), in ticks
+        /// @param withinNoise is set to true if the average is not distinguishable from the overhead of an empty scope
+        /// @return false if the record type is not calibrated
+        inline bool NetTime(double totalSec, uint64_t calls, double overheadTicks, double noiseTicks, double tickSec,
+                            double& netTotalSec, double& netAverageSec, bool& withinNoise)
+        {
+            if (overheadTicks <= 0 || calls == 0)
+                return false;
+            const double overheadSec = double(calls) * overheadTicks * tickSec;
+            netTotalSec = totalSec > overheadSec ? totalSec - overheadSec : 0.0;
+            netAverageSec = netTotalSec / double(calls);
+            withinNoise = netAverageSec < (3 * noiseTicks > overheadTicks ? 3 * noiseTicks : overheadTicks) * tickSec;
+            return true;
+        }
+
+        /// @brief a fixed point number, like std::fixed, but without iostream and allocation (CSV reports)
+        /// @param buffer at least size chars, the result is zero terminated and truncated to the buffer
+        inline size_t FormatFixed(char* buffer, size_t size, double value, int precision = 6)
+        {
+            const int length = snprintf(buffer, size, "%.*f", precision, value);
+            return length < 0 ? 0 : (size_t(length) < size ? size_t(length) : size - 1);
+        }
+
+        /// @brief a number in the shortest of the fixed and the exponential forms (%g), e.g. 2.5e-07, for the exporters
+        /// @param buffer at least size chars, the result is zero terminated and truncated to the buffer
+        inline size_t FormatGeneral(char* buffer, size_t size, double value, int digits = 12)
+        {
+            const int length = snprintf(buffer, size, "%.*g", digits, value);
+            return length < 0 ? 0 : (size_t(length) < size ? size_t(length) : size - 1);
+        }
+
         /// @brief Converts a time duration from seconds to a human-readable string format.
         /// @param sec Time duration in seconds.
-        /// @return A string representing the time duration in the most suitable unit: seconds, milliseconds, microseconds, or nanoseconds.
+        /// @param buffer at least MaxTimeLength chars, the result is zero terminated
+        /// @return the number of the written chars, the time duration in the most suitable unit: seconds, milliseconds, microseconds, or nanoseconds.
         /// In this format every number is short and readable,
         /// but because in this format every number has almost the same length,
         /// it's hard to compare values with different units, sometimes the longer number is the smaller.
-        inline std::string TimeToStr(const double sec)
+        inline size_t TimeToStr(char* buffer, const double sec)
         {
-            using namespace std;
-
-            ostringstream sstream;
-            sstream << fixed << setw(8) << setprecision(3);
+            int length;
             if (sec >= 10)
-                sstream << sec << " sec";
+                length = snprintf(buffer, MaxTimeLength, "%8.3f sec", sec);
             else if (sec >= 1e-2)
-                sstream << sec * 1e3 << " ms.";
+                length = snprintf(buffer, MaxTimeLength, "%8.3f ms.", sec * 1e3);
             else if (sec >= 1e-5)
-                sstream << sec * 1e6 << " us "; // console don't like "µ" character
+                length = snprintf(buffer, MaxTimeLength, "%8.3f us ", sec * 1e6); // console don't like "µ" character
             else
-                sstream << sec * 1e9 << " ns ";
-            return sstream.str();
+                length = snprintf(buffer, MaxTimeLength, "%8.3f ns ", sec * 1e9);
+            return length < 0 ? 0 : (size_t(length) < MaxTimeLength ? size_t(length) : MaxTimeLength - 1);
         }
 
+        inline std::string TimeToStr(const double sec)
+        {
+            char buffer[MaxTimeLength];
+            return std::string(buffer, TimeToStr(buffer, sec));
+        }
+
+        ///////////////////////////////////////////////////////////////////////////////////////////
+        /**
+         * @brief the text of a report, the values are formatted directly into it, without iostream and temporary strings
+         *
+         * The columns are right aligned like std::setw. The memory is reserved once (it grows only if the estimate is small),
+         * and the whole report is written to the stream by one write, after the database lock is released.
+         */
+        class ReportBuffer
+        {
+        public:
+            inline explicit ReportBuffer(size_t reserve = 4096)
+            {
+                text.reserve(reserve);
+            }
+
+            inline ReportBuffer& Append(const char* str, size_t length)
+            {
+                text.append(str, length);
+                return *this;
+            }
+
+            inline ReportBuffer& Append(const char* str)              { return Append(str, strlen(str)); }
+            inline ReportBuffer& Append(const std::string& str)       { return Append(str.data(), str.size()); }
+            inline ReportBuffer& Append(char c, size_t count = 1)     { text.append(count, c); return *this; }
+
+            // right aligned in width chars, like setw, a longer string is not truncated
+            inline ReportBuffer& Right(const char* str, size_t length, size_t width)
+            {
+                if (length < width)
+                    text.append(width - length, ' ');
+                return Append(str, length);
+            }
+
+            inline ReportBuffer& Right(const char* str, size_t width)        { return Right(str, strlen(str), width); }
+            inline ReportBuffer& Right(const std::string& str, size_t width) { return Right(str.data(), str.size(), width); }
+
+            // left aligned in width chars, like std::left and setw
+            inline ReportBuffer& Left(const std::string& str, size_t width)
+            {
+                Append(str);
+                if (str.size() < width)
+                    text.append(width - str.size(), ' ');
+                return *this;
+            }
+
+            inline ReportBuffer& Number(uint64_t num, size_t width = 0)
+            {
+                char buffer[MaxUIntLength];
+                return Right(buffer, FormatUInt(buffer, num), width);
+            }
+
+            // with thousands separator
+            inline ReportBuffer& Separated(uint64_t num, size_t width = 0)
+            {
+                char buffer[MaxSeparatedLength];
+                return Right(buffer, FormatWithSeparator(buffer, num), width);
+            }
+
+            // see TimeToStrNs
+            inline ReportBuffer& Ns(double sec, size_t width = 0)
+            {
+                char buffer[MaxSeparatedLength];
+                return Right(buffer, TimeToStrNs(buffer, sec), width);
+            }
+
+            // see RateToStr
+            inline ReportBuffer& Rate(double rate, size_t width = 0)
+            {
+                char buffer[MaxSeparatedLength + 2];
+                return Right(buffer, RateToStr(buffer, rate), width);
+            }
+
+            // see FormatFixed
+            inline ReportBuffer& Fixed(double value, int precision = 6, size_t width = 0)
+            {
+                char buffer[64];
+                return Right(buffer, FormatFixed(buffer, sizeof(buffer), value, precision), width);
+            }
+
+            // see FormatGeneral
+            inline ReportBuffer& General(double value, int digits = 12)
+            {
+                char buffer[64];
+                return Append(buffer, FormatGeneral(buffer, sizeof(buffer), value, digits));
+            }
+
+            // a title centered in a line of '-' chars
+            inline ReportBuffer& Title(const char* title, size_t width)
+            {
+                const size_t titleLen = strlen(title);
+                const size_t pad = titleLen + 2 < width ? (width - titleLen) / 2 - 1 : 0;
+                Append('-', pad).Append(' ').Append(title, titleLen).Append(' ').Append('-', pad);
+                if (pad != 0 && titleLen % 2)
+                    Append('-');
+                return Append('\n');
+            }
+
+            // reserve the memory of the next size chars
+            inline void Reserve(size_t size)        { text.reserve(text.size() + size); }
+
+            inline const std::string& Str() const   { return text; }
+            inline size_t Size() const              { return text.size(); }
+
+            inline void WriteTo(std::ostream& os) const
+            {
+                os.write(text.data(), std::streamsize(text.size()));
+                os.flush();
+            }
+
+        private:
+            std::string text;
+        };
+
+        /// @brief A hint to the processor in a spin wait loop, it saves power and lets the other hyper-thread run.
+        inline void CpuRelax() noexcept
+        {
+#if defined(_MSC_VER) && defined(_M_ARM64)
+            __yield();
+#elif RDTSC_MEASURE_IS_SUPPORTED
+            _mm_pause();
+#elif ARM64_MEASURE_IS_SUPPORTED
+            __asm__ __volatile__("yield");
+#endif
+        }
+
+        /// @brief A minimal spin lock for very short critical sections, usable with std::lock_guard.
+        /// The waiting threads spin on a plain load, so they don't steal the cache line from the owner.
+        class SpinLock
+        {
+        public:
+            inline void lock() noexcept
+            {
+                while (flag.exchange(true, std::memory_order_acquire))
+                {
+                    while (flag.load(std::memory_order_relaxed))
+                        CpuRelax();
+                }
+            }
+
+            inline void unlock() noexcept
+            {
+                flag.store(false, std::memory_order_release);
+            }
+
+        private:
+            std::atomic<bool> flag{ false };
+        };
+
+        /**
+         * @brief A lock free list of per-thread blocks, e.g. the counters of the threads.
+         *
+         * A thread acquires a block at its first use and releases it at thread exit (by a thread local handle),
+         * a new thread reuses the block of a finished thread, so the number of the blocks is the max number
+         * of the threads alive at the same time. The blocks are never freed, so the readers can walk the list
+         * any time, from Head() by the next pointers, without a lock.
+         * The Block must have `std::atomic<bool> inUse` and `Block* next` members, a new block is zero initialized.
+         */
+        template<typename Block>
+        class ThreadBlockList
+        {
+        public:
+            /// @brief the last added block, the blocks of the finished threads are in the list too
+            inline Block* Head() const
+            {
+                return head.load(std::memory_order_acquire);
+            }
+
+            /// @brief acquire a released block, or add a new one
+            /// @param init called with (block, reused) before a new block is published, and after a block is reused
+            template<typename Init>
+            Block* Acquire(Init init)
+            {
+                for (Block* block = Head(); block; block = block->next)
+                {
+                    bool expected = false;
+                    if (block->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    {
+                        init(block, true);
+                        return block;
+                    }
+                }
+
+                Block* block = new Block(); // zero initialized, never freed
+                init(block, false);
+                block->inUse.store(true, std::memory_order_relaxed);
+                block->next = head.load(std::memory_order_relaxed);
+                while (!head.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+                    ;
+                return block;
+            }
+
+            inline Block* Acquire()
+            {
+                return Acquire([](Block*, bool) {});
+            }
+
+            /// @brief the block can be reused by a new thread, its content is kept
+            inline static void Release(Block* block)
+            {
+                block->inUse.store(false, std::memory_order_release);
+            }
+
+        private:
+            std::atomic<Block*> head{ nullptr };
+        };
+
+        /**
+         * @brief A sequence lock of rarely written values, e.g. the baselines of a reset (the counters at the last reset).
+         *
+         * The readers get the values as one consistent set without stopping the writer, they retry while it writes.
+         * The writers must be serialized by the caller. The values are relaxed atomics, read and written in the callbacks.
+         * A Read() synchronizes with the Write() it has seen, so the counters read after it are not older than the
+         * counters read by that writer: a counter never goes below its baseline, the difference doesn't wrap.
+         */
+        class SeqLock
+        {
+        public:
+            template<typename Writer>
+            inline void Write(Writer write) noexcept
+            {
+                const uint64_t current = sequence.load(std::memory_order_relaxed);
+                sequence.store(current + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                write();
+                sequence.store(current + 2, std::memory_order_release);
+            }
+
+            template<typename Reader>
+            inline void Read(Reader read) const noexcept
+            {
+                for (;;)
+                {
+                    const uint64_t current = sequence.load(std::memory_order_acquire);
+                    if (current % 2 == 0)
+                    {
+                        read();
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if (sequence.load(std::memory_order_relaxed) == current)
+                            return;
+                    }
+                    CpuRelax();
+                }
+            }
+
+        private:
+            std::atomic<uint64_t> sequence{ 0 };
+        };
+
+        /// @brief Index of the highest set bit, the value must not be 0.
+        /// Example: 1 -> 0, 12 -> 3
+        inline uint32_t HighestBitIndex(uint64_t value)
+        {
+#if defined(_MSC_VER) && defined(_WIN64)
+            unsigned long index;
+            _BitScanReverse64(&index, value);
+            return uint32_t(index);
+#elif defined(_MSC_VER)
+            unsigned long index;
+            if (_BitScanReverse(&index, uint32_t(value >> 32)))
+                return uint32_t(index) + 32;
+            _BitScanReverse(&index, uint32_t(value));
+            return uint32_t(index);
+#else
+            return 63 - uint32_t(__builtin_clzll(value));
+#endif
+        }
+
+#if RDTSC_MEASURE_IS_SUPPORTED
+        /// @brief the eax, ebx, ecx, edx registers of a cpuid leaf, all 0 if the leaf is not supported
+        inline void CpuId(uint32_t leaf, uint32_t regs[4])
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, int(leaf & 0x80000000u));
+            const uint32_t maxLeaf = uint32_t(info[0]);
+            info[0] = info[1] = info[2] = info[3] = 0;
+            if (leaf <= maxLeaf)
+                __cpuidex(info, int(leaf), 0);
+            for (int i = 0; i < 4; ++i)
+                regs[i] = uint32_t(info[i]);
+#else
+            regs[0] = regs[1] = regs[2] = regs[3] = 0;
+            __get_cpuid_count(leaf, 0, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+        }
+
+        /// @brief true if the timestamp counter runs with a constant rate in every P-, C- and T-state,
+        /// so the rdtsc ticks can be converted to seconds with a fixed frequency
+        inline bool HasInvariantTsc()
+        {
+            uint32_t regs[4];
+            CpuId(0x80000007u, regs);
+            return (regs[3] & (1u << 8)) != 0;
+        }
+
+        /// @brief true if the processor supports the rdtscp instruction (see RdtscpBackend)
+        inline bool HasRdtscp()
+        {
+            uint32_t regs[4];
+            CpuId(0x80000001u, regs);
+            return (regs[3] & (1u << 27)) != 0;
+        }
+
+        /// @brief the exact timestamp counter frequency from cpuid leaf 0x15 (crystal clock * ratio), 0 if unknown
+        /// some processors don't report the crystal clock, then it is unknown
+        inline uint64_t GetCpuIdTscFrequency()
+        {
+            uint32_t regs[4];
+            CpuId(0x15, regs);
+            const uint32_t denominator = regs[0];
+            const uint32_t numerator = regs[1];
+            const uint32_t crystalHz = regs[2];
+            if (denominator != 0 && numerator != 0 && crystalHz != 0)
+                return uint64_t(crystalHz) * numerator / denominator;
+            return 0;
+        }
+
+        /// @brief the base frequency of cpuid leaf 0x16, 0 if unknown
+        /// it is a rounded nominal value in MHz (e.g. 4000 MHz for a 4008 MHz counter), not the exact frequency
+        inline uint64_t GetNominalTscFrequency()
+        {
+            uint32_t regs[4];
+            CpuId(0x16, regs);
+            const uint32_t baseMHz = regs[0] & 0xffff;
+            return uint64_t(baseMHz) * 1000000;
+        }
+
+#ifdef __linux__
+        /// @brief the timestamp counter frequency calibrated by the Linux kernel, 0 if unknown
+        /// the tsc_freq_khz sysfs entry is not available in every kernel,
+        /// otherwise the conversion parameters of the perf_event mmap page are used (time_mult, time_shift)
+        inline uint64_t GetLinuxTscFrequency()
+        {
+            std::ifstream sysfs("/sys/devices/system/cpu/cpu0/tsc_freq_khz");
+            uint64_t khz = 0;
+            if (sysfs >> khz && khz != 0)
+                return khz * 1000;
+
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_DUMMY;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            const int fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd < 0)
+                return 0;
+
+            uint64_t freq = 0;
+            const long pageSize = sysconf(_SC_PAGESIZE);
+            void* page = mmap(nullptr, size_t(pageSize), PROT_READ, MAP_SHARED, fd, 0);
+            if (page != MAP_FAILED)
+            {
+                const perf_event_mmap_page* mmapPage = static_cast<const perf_event_mmap_page*>(page);
+                // ns = (ticks * time_mult) >> time_shift
+                if (mmapPage->cap_user_time && mmapPage->time_mult != 0)
+                    freq = uint64_t(1e9 * double(uint64_t(1) << mmapPage->time_shift) / double(mmapPage->time_mult) + 0.5);
+                munmap(page, size_t(pageSize));
+            }
+            close(fd);
+            return freq;
+        }
+#endif
+
+        /// @brief the exact timestamp counter frequency in Hz without any measurement, 0 if it is unknown
+        /// the sources are cpuid leaf 0x15, then the Linux kernel, the nominal base frequency is not exact (see GetNominalTscFrequency),
+        /// the sources are queried only by the first call (the Linux kernel by a file read and a system call)
+        inline uint64_t GetKnownTscFrequency()
+        {
+            static const uint64_t freq = []() -> uint64_t
+            {
+                const uint64_t cpuIdFreq = GetCpuIdTscFrequency();
+                if (cpuIdFreq != 0)
+                    return cpuIdFreq;
+#ifdef __linux__
+                return GetLinuxTscFrequency();
+#else
+                return 0;
+#endif
+            }();
+            return freq;
+        }
+
+        /**
+         * @brief background calibration of the timestamp counter frequency
+         *
+         * Start() takes a pair of timestamp counter and steady_clock samples, then a background thread
+         * takes a new pair after a growing interval (doubling from firstInterval up to maxInterval)
+         * and publishes the ticks / seconds ratio since the first pair atomically.
+         * The sampling error is the same in every pair, so the estimate gets more accurate the longer the process runs.
+         * Call Start() at the process start, then GetProcessorFrequency() never sleeps.
+         */
+        class TscCalibration
+        {
+        public:
+            /// @brief starts the background thread
+            /// @return false if the frequency is known without measurement (see GetKnownTscFrequency) or it is already running
+            inline static bool Start(std::chrono::milliseconds firstInterval = std::chrono::milliseconds(10),
+                                     std::chrono::milliseconds maxInterval = std::chrono::milliseconds(1000))
+            {
+                if (GetKnownTscFrequency() != 0)
+                    return false;
+
+                State& state = GetState();
+                const std::lock_guard<std::mutex> lock(state.mutex);
+                if (state.running.load(std::memory_order_relaxed))
+                    return false;
+                state.running.store(true, std::memory_order_release);
+                state.stop = false;
+                state.thread = std::thread(&TscCalibration::Run, std::ref(state), firstInterval, maxInterval);
+                return true;
+            }
+
+            /// @brief stops the background thread, the last estimate remains available
+            inline static void Stop()
+            {
+                GetState().Stop();
+            }
+
+            /// @brief lock free, it is called by every GetProcessorFrequency without an estimate
+            inline static bool IsRunning()
+            {
+                return GetState().running.load(std::memory_order_acquire);
+            }
+
+            /// @brief the latest estimate in Hz, 0 if there is no estimate yet
+            inline static uint64_t GetFrequency()
+            {
+                return GetState().frequency.load(std::memory_order_acquire);
+            }
+
+            /// @brief waits for the first estimate (about firstInterval after Start), 0 if the calibration is not running
+            inline static uint64_t WaitForFrequency()
+            {
+                State& state = GetState();
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.cv.wait(lock, [&state]()
+                {
+                    return !state.running.load(std::memory_order_relaxed) || state.frequency.load(std::memory_order_relaxed) != 0;
+                });
+                return state.frequency.load(std::memory_order_relaxed);
+            }
+
+        private:
+            struct Sample
+            {
+                uint64_t tsc;
+                std::chrono::steady_clock::time_point time;
+            };
+
+            struct State
+            {
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::thread thread;
+                std::atomic<bool> running{ false };  // written under the mutex, read without it by IsRunning
+                bool stop = false;
+                std::atomic<uint64_t> frequency{ 0 };
+
+                inline void Stop()
+                {
+                    {
+                        const std::lock_guard<std::mutex> lock(mutex);
+                        stop = true;
+                    }
+                    cv.notify_all();
+                    if (thread.joinable())
+                        thread.join();
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    running.store(false, std::memory_order_release);
+                    cv.notify_all();
+                }
+
+                inline ~State()
+                {
+                    Stop();
+                }
+            };
+
+            inline static State& GetState()
+            {
+                static State state;
+                return state;
+            }
+
+            // the steady_clock sample with the shortest surrounding timestamp counter interval of a few tries,
+            // paired with the middle of that interval
+            inline static Sample TakeSample()
+            {
+                Sample best = {};
+                uint64_t bestSpread = UINT64_MAX;
+                for (int i = 0; i < 5; ++i)
+                {
+                    const uint64_t before = __rdtsc();
+                    const std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+                    const uint64_t after = __rdtsc();
+                    if (after - before < bestSpread)
+                    {
+                        bestSpread = after - before;
+                        best.tsc = before + (after - before) / 2;
+                        best.time = time;
+                    }
+                }
+                return best;
+            }
+
+            inline static void Run(State& state, std::chrono::milliseconds interval, std::chrono::milliseconds maxInterval)
+            {
+                const Sample first = TakeSample();
+                std::unique_lock<std::mutex> lock(state.mutex);
+                while (!state.cv.wait_for(lock, interval, [&state]() { return state.stop; }))
+                {
+                    const Sample last = TakeSample();
+                    const double sec = std::chrono::duration<double>(last.time - first.time).count();
+                    if (sec > 0)
+                    {
+                        state.frequency.store(uint64_t(double(last.tsc - first.tsc) / sec + 0.5), std::memory_order_release);
+                        state.cv.notify_all();
+                    }
+                    if (interval < maxInterval)
+                        interval = interval * 2 < maxInterval ? interval * 2 : maxInterval;
+                }
+            }
+        };
+#endif // RDTSC_MEASURE_IS_SUPPORTED
+
         /**
          * @brief Get the processor frequency in Hz.
          * @param measureTimeSeconds The time for which the thread should sleep in order to measure the frequency.
          * @return The processor frequency in Hz.
          *
-         * This function measures the processor frequency by sleeping for a given amount of time and
+         * If the timestamp counter frequency is known (see GetKnownTscFrequency), it is returned immediately.
+         * If the background calibration is started (see TscCalibration), its latest estimate is returned,
+         * the first call waits for the first estimate only.
+         * Otherwise this function measures the processor frequency by sleeping for a given amount of time and
          * counting the number of cycles of the processor's timestamp counter. The measured frequency
          * is then divided by the elapsed time to get the processor frequency in Hz.
+         * The nominal base frequency (see GetNominalTscFrequency) is used only if the measurement is not possible
+         * (measureTimeSeconds is not positive, or no time elapsed).
          *
-         * The function returns a static variable, so it only measures the frequency once.
+         * The measured frequency is a static variable, so it only measures the frequency once.
          *
          * Note that the measured frequency may not be exactly equal to the processor's rated frequency
          * due to various factors such as turbo boost, power saving, and differences between the
@@ -115,9 +848,27 @@ namespace dtree
          */
         inline uint64_t GetProcessorFrequency(double measureTimeSeconds = 0.25)
         {
+#if RDTSC_MEASURE_IS_SUPPORTED
+            // the calibration doesn't start if the frequency is known
+            const uint64_t knownFreq = GetKnownTscFrequency();
+            if (knownFreq != 0)
+                return knownFreq;
+            const uint64_t calibratedFreq = TscCalibration::GetFrequency();
+            if (calibratedFreq != 0)
+                return calibratedFreq;
+            if (TscCalibration::IsRunning())
+            {
+                const uint64_t firstFreq = TscCalibration::WaitForFrequency();
+                if (firstFreq != 0)
+                    return firstFreq;
+            }
+#endif
             static uint64_t freq = [measureTimeSeconds]() -> uint64_t
             {
 #if RDTSC_MEASURE_IS_SUPPORTED
+                const uint64_t nominalFreq = GetNominalTscFrequency();
+                if (measureTimeSeconds <= 0 && nominalFreq != 0)
+                    return nominalFreq;
                 auto measureTimeUs = std::chrono::nanoseconds(uint64_t(measureTimeSeconds * 1e9));
 
                 auto t1 = std::chrono::high_resolution_clock::now();
@@ -130,6 +881,8 @@ namespace dtree
 
                 std::chrono::nanoseconds elapsed = t2 - t1;
                 double elapsedSec = double(elapsed.count()) / 1e9;
+                if (elapsedSec <= 0)
+                    return nominalFreq != 0 ? nominalFreq : 3200000000ull;
                 // elapsedSec ~ measureTimeSeconds, but not equal :-(
                 return uint64_t((end - start) / elapsedSec);
 #else
@@ -141,21 +894,200 @@ namespace dtree
         }
 
 #if MEASURE_WINDOWS
-        inline void SetThreadAffinity(const DWORD_PTR coreIdx = 0)
+        /// @brief the flat processor index of the first processor of every processor group, and the total at the end
+        /// the groups are not always full (e.g. 2 x 36 processors), so the index is not Group * 64 + Number
+        inline const std::vector<unsigned>& GetProcessorGroupStarts()
+        {
+            static const std::vector<unsigned> starts = []()
+            {
+                const WORD groupNum = ::GetActiveProcessorGroupCount();
+                std::vector<unsigned> result(1, 0);
+                for (WORD group = 0; group < groupNum; ++group)
+                    result.push_back(result.back() + unsigned(::GetActiveProcessorCount(group)));
+                return result;
+            }();
+            return starts;
+        }
+#endif
+
+        /// @brief pin the calling thread to one logical processor
+        /// on macOS the kernel has no hard affinity, only an affinity tag hint (ignored on Apple silicon)
+#if MEASURE_WINDOWS
+        inline void SetThreadAffinity(const unsigned coreIdx = 0)
         {
-            const HANDLE hThread = ::GetCurrentThread();
-            ::SetThreadAffinityMask(hThread, DWORD_PTR(1) << coreIdx);
+            // the flat index is mapped to the group and the number in the group
+            const std::vector<unsigned>& starts = GetProcessorGroupStarts();
+            if (coreIdx >= starts.back())
+                return;
+            WORD group = 0;
+            while (coreIdx >= starts[group + 1])
+                ++group;
+            GROUP_AFFINITY affinity = {};
+            affinity.Group = group;
+            affinity.Mask = KAFFINITY(1) << (coreIdx - starts[group]);
+            ::SetThreadGroupAffinity(::GetCurrentThread(), &affinity, nullptr);
         }
+#elif MEASURE_LINUX
+        inline void SetThreadAffinity(const unsigned coreIdx = 0)
+        {
+            // CPU_SET doesn't check the index
+            if (coreIdx >= CPU_SETSIZE)
+                return;
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(coreIdx, &cpuSet);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        }
+#elif MEASURE_MACOS
+        inline void SetThreadAffinity(const unsigned coreIdx = 0)
+        {
+            thread_affinity_policy_data_t policy = { integer_t(coreIdx + 1) }; // 0 is the "no affinity" tag
+            thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+                              reinterpret_cast<thread_policy_t>(&policy), THREAD_AFFINITY_POLICY_COUNT);
+        }
+#else
+        inline void SetThreadAffinity(const unsigned = 0) {}
+#endif
+
+#if MEASURE_LINUX
+        inline unsigned GetCpuCount();
+        inline unsigned GetNumaNodeCount();
 
+        // the NUMA node of every logical processor, from the processor lists of the nodes in sysfs, 0 if not listed
+        inline std::vector<unsigned> ReadCpuNodes()
+        {
+            std::vector<unsigned> cpuNodes(GetCpuCount(), 0);
+            const unsigned nodeCount = GetNumaNodeCount();
+            for (unsigned node = 0; node < nodeCount; ++node)
+            {
+                // e.g. "0-3,8-11"
+                std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string ranges;
+                if (!(cpulist >> ranges))
+                    continue;
+                size_t begin = 0;
+                while (begin < ranges.size())
+                {
+                    size_t end = ranges.find(',', begin);
+                    if (end == std::string::npos)
+                        end = ranges.size();
+                    const std::string range = ranges.substr(begin, end - begin);
+                    const size_t dash = range.find('-');
+                    const unsigned first = unsigned(std::stoul(range.substr(0, dash)));
+                    const unsigned last = dash == std::string::npos ? first : unsigned(std::stoul(range.substr(dash + 1)));
+                    for (unsigned cpu = first; cpu <= last && cpu < cpuNodes.size(); ++cpu)
+                        cpuNodes[cpu] = node;
+                    begin = end + 1;
+                }
+            }
+            return cpuNodes;
+        }
+#endif
+
+        /**
+         * @brief the logical processor and the NUMA node of the calling thread, at the moment of the call
+         * @return false if the platform can't tell it (macOS), then both are UINT32_MAX
+         *
+         * On x86-64 Linux the kernel stores (node << 12) | cpu in the TSC_AUX register of every processor,
+         * so it is read by rdtscp (about 30 cycles), without system call.
+         * Elsewhere on Linux it is getcpu of glibc 2.29+, or sched_getcpu and the node of the processor in sysfs,
+         * both served by the vDSO (or rseq) without entering the kernel, on Windows GetCurrentProcessorNumberEx.
+         * The processor number is the index used by SetThreadAffinity.
+         */
+        inline bool GetCurrentCpuAndNode(unsigned& cpu, unsigned& node)
+        {
+#if MEASURE_LINUX && RDTSC_MEASURE_IS_SUPPORTED
+            static const bool hasRdtscp = HasRdtscp();
+            if (hasRdtscp)
+            {
+                unsigned aux;
+                __rdtscp(&aux);
+                cpu = aux & 0xfff;
+                node = aux >> 12;
+                return true;
+            }
+#endif
+#if MEASURE_LINUX && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+            if (getcpu(&cpu, &node) == 0)
+                return true;
+#elif MEASURE_LINUX
+            const int current = sched_getcpu();
+            if (current >= 0)
+            {
+                static const std::vector<unsigned> cpuNodes = ReadCpuNodes();
+                cpu = unsigned(current);
+                node = cpu < cpuNodes.size() ? cpuNodes[cpu] : 0;
+                return true;
+            }
+#elif MEASURE_WINDOWS
+            PROCESSOR_NUMBER processor;
+            ::GetCurrentProcessorNumberEx(&processor);
+            USHORT nodeNumber = 0;
+            ::GetNumaProcessorNodeEx(&processor, &nodeNumber);
+            const std::vector<unsigned>& starts = GetProcessorGroupStarts();
+            cpu = processor.Group + size_t(1) < starts.size() ? starts[processor.Group] + processor.Number : UINT32_MAX;
+            node = nodeNumber;
+            return true;
+#endif
+            cpu = UINT32_MAX;
+            node = UINT32_MAX;
+            return false;
+        }
+
+        // the logical processor of the calling thread, UINT32_MAX if unknown, see GetCurrentCpuAndNode
+        inline unsigned GetCurrentCpu()
+        {
+            unsigned cpu, node;
+            GetCurrentCpuAndNode(cpu, node);
+            return cpu;
+        }
+
+        // the NUMA node of the calling thread, UINT32_MAX if unknown, see GetCurrentCpuAndNode
+        inline unsigned GetCurrentNumaNode()
+        {
+            unsigned cpu, node;
+            GetCurrentCpuAndNode(cpu, node);
+            return node;
+        }
+
+        // the number of the configured logical processors, the processor numbers are below it
+        inline unsigned GetCpuCount()
+        {
+#if MEASURE_WINDOWS
+            return unsigned(::GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+#elif MEASURE_LINUX
+            const long count = sysconf(_SC_NPROCESSORS_CONF);
+            return count > 0 ? unsigned(count) : 1;
+#else
+            const unsigned count = std::thread::hardware_concurrency();
+            return count > 0 ? count : 1;
+#endif
+        }
+
+        // the number of the NUMA nodes, the node numbers are below it, 1 if the machine is not NUMA
+        inline unsigned GetNumaNodeCount()
+        {
+#if MEASURE_WINDOWS
+            ULONG highestNode = 0;
+            return ::GetNumaHighestNodeNumber(&highestNode) ? unsigned(highestNode) + 1 : 1;
+#elif MEASURE_LINUX
+            // e.g. "0-1", or "0" without NUMA
+            std::ifstream possible("/sys/devices/system/node/possible");
+            std::string nodes;
+            if (!(possible >> nodes) || nodes.empty())
+                return 1;
+            const size_t dash = nodes.find_last_of("-,");
+            return unsigned(std::stoul(dash == std::string::npos ? nodes : nodes.substr(dash + 1))) + 1;
+#else
+            return 1;
+#endif
+        }
+
+#if MEASURE_WINDOWS
+        // kept for compatibility, it was the APIC ID, which is slow (cpuid) and wrong above 255 processors
         inline unsigned GetCurrentProcessorNumberXp()
         {
-            int cpuInfo[4];
-            __cpuid(cpuInfo, 1);
-            // CPUInfo[3] is EDX, bit 9 = "APIC On-Chip."
-            if ((cpuInfo[3] & (1 << 9)) == 0)
-                return (uint32_t)-1;  // no APIC on chip
-            // CPUInfo[1] is EBX, bits 24-31 are APIC ID
-            return (unsigned)cpuInfo[1] >> 24;
+            return GetCurrentCpu();
         }
 #endif
     } // namespace MeasureUtils
@@ -51,16 +51,16 @@ namespace dtree
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #if MEASURE_IS_ON && MEASURE_WINDOWS
     #define QPC_MEASURE(NAME) \
-        static dtree::QPCMeasure::Base::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::QPCMeasure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::QPCMeasure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
     #define QPC_MEASURE_S(TITLE) \
-        static dtree::QPCMeasure::Base::MeasureRecord measureRecord(TITLE); \
+        static dtree::QPCMeasure::Base::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::QPCMeasure::Base::Scope measureScope(&measureRecord)
     #define QPC_SAFE_MEASURE(NAME, POLICY) \
-        static dtree::QPCMeasure::POLICY::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::QPCMeasure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::QPCMeasure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
     #define QPC_SAFE_MEASURE_S(TITLE, POLICY) \
-        static dtree::QPCMeasure::POLICY::MeasureRecord measureRecord(TITLE); \
+        static dtree::QPCMeasure::POLICY::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::QPCMeasure::POLICY::Scope measureScope(&measureRecord)
 #else
     #define QPC_MEASURE(NAME)
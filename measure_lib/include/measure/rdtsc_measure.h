@@ -37,6 +37,42 @@ namespace dtree
 
     using RdtscMeasure = TMeasure<RdtscBackend>;
 
+    /// @brief rdtsc with serialized scope boundaries
+    /// rdtscp waits until all the previous instructions are executed, and the lfence after it
+    /// keeps the following instructions from starting before the timestamp is read,
+    /// so the measured code can't leak out of the scope. Needs MeasureUtils::HasRdtscp().
+    struct RdtscpBackend : public RdtscBackend
+    {
+        inline static const char* GetMeasureTitle() { return "rdtscp times"; }
+
+        inline static uint64_t GetTick() noexcept
+        {
+            unsigned int aux;
+            const uint64_t tick = __rdtscp(&aux);
+            _mm_lfence();
+            return tick;
+        }
+    };
+
+    using RdtscpMeasure = TMeasure<RdtscpBackend>;
+
+    /// @brief rdtsc fenced by lfence on both sides, the same ordering as RdtscpBackend,
+    /// for the processors without rdtscp
+    struct RdtscLfenceBackend : public RdtscBackend
+    {
+        inline static const char* GetMeasureTitle() { return "lfence rdtsc times"; }
+
+        inline static uint64_t GetTick() noexcept
+        {
+            _mm_lfence();
+            const uint64_t tick = __rdtsc();
+            _mm_lfence();
+            return tick;
+        }
+    };
+
+    using RdtscLfenceMeasure = TMeasure<RdtscLfenceBackend>;
+
 } // namespace dtree
 
 #endif // RDTSC_MEASURE_IS_SUPPORTED
@@ -44,20 +80,28 @@ namespace dtree
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #if MEASURE_IS_ON && RDTSC_MEASURE_IS_SUPPORTED
     #define RDTSC_MEASURE(NAME) \
-        static dtree::RdtscMeasure::Base::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::RdtscMeasure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::RdtscMeasure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
     #define RDTSC_MEASURE_S(TITLE) \
-        static dtree::RdtscMeasure::Base::MeasureRecord measureRecord(TITLE); \
+        static dtree::RdtscMeasure::Base::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::RdtscMeasure::Base::Scope measureScope(&measureRecord)
     #define RDTSC_SAFE_MEASURE(NAME, POLICY) \
-        static dtree::RdtscMeasure::POLICY::MeasureRecord measureRecord_##NAME(""#NAME); \
+        static dtree::RdtscMeasure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
         dtree::RdtscMeasure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
     #define RDTSC_SAFE_MEASURE_S(TITLE, POLICY) \
-        static dtree::RdtscMeasure::POLICY::MeasureRecord measureRecord(TITLE); \
+        static dtree::RdtscMeasure::POLICY::MeasureRecord measureRecord(MEASURE_NAME_LITERAL(TITLE)); \
         dtree::RdtscMeasure::POLICY::Scope measureScope(&measureRecord)
+    #define RDTSCP_MEASURE(NAME) \
+        static dtree::RdtscpMeasure::Base::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::RdtscpMeasure::Base::Scope measureScope_##NAME(&measureRecord_##NAME)
+    #define RDTSCP_SAFE_MEASURE(NAME, POLICY) \
+        static dtree::RdtscpMeasure::POLICY::MeasureRecord measureRecord_##NAME(MEASURE_NAME_LITERAL(#NAME)); \
+        dtree::RdtscpMeasure::POLICY::Scope measureScope_##NAME(&measureRecord_##NAME)
 #else
     #define RDTSC_MEASURE(NAME)
     #define RDTSC_MEASURE_S(TITLE)
     #define RDTSC_SAFE_MEASURE(NAME, POLICY)
     #define RDTSC_SAFE_MEASURE_S(TITLE, POLICY)
+    #define RDTSCP_MEASURE(NAME)
+    #define RDTSCP_SAFE_MEASURE(NAME, POLICY)
 #endif
\ No newline at end of file
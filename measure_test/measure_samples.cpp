@@ -126,7 +126,7 @@ void Solution5()
         // a dangerous situation: measure with dynamic name
         for (int j = 0; j < 5; ++j)
         {
-            // GetOrAddDynamicRecord is very slow, don't call it from time critical code!
+            // building the title is slow, don't do it in time critical code!
             const std::string dynamicGeneratedTitle = std::string("DynamicMeasure_") + std::to_string(j);
             const auto record = dtree::Measure::TRSafe::GetDynamicRecord(dynamicGeneratedTitle.c_str());
 
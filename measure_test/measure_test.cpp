@@ -5,17 +5,36 @@
 #include "measure/measure_base.h"
 #include "measure/cpp_measure.h"
 #include "measure/rdtsc_measure.h"
+#include "measure/arm64_measure.h"
 #include "measure/measure.h"
 #include "measure/csv_reporter.h"
+#include "measure/measure_snapshot.h"
+#include "measure/measure_merge.h"
+#include "measure/measure_diff.h"
+#include "measure/measure_shared_memory.h"
+#include "measure/measure_interval.h"
+#include "measure/measure_benchmark.h"
+#include "measure/measure_openmetrics.h"
+#include "measure/measure_statsd.h"
 #include <iostream>
 #include <string>
 #include <chrono>
 #include <thread>
+#include <vector>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
 
 #if MEASURE_WINDOWS
     #include "measure/qpc_measure.h"
 #endif
 
+#if MEASURE_LINUX
+    #include "measure/linux_measure.h"
+    #include "measure/linux_perf_measure.h"
+#endif
+
 constexpr static uint64_t defaultLoopNum = 1llu << 26;
 
 void CppTest()
@@ -40,7 +59,7 @@ void CppTest()
         CPP_MEASURE(CppMeasureDynamicTest_1);
         for (int i = 0; i < 5; ++i)
         {
-            // this could be very slow in a time critical code!
+            // building the title could be slow in a time critical code!
             const std::string dinamicGeneratedTitle = std::string("dyn_measure_") + std::to_string(i);
             const auto record = dtree::Measure::TSafe::GetDynamicRecord(dinamicGeneratedTitle.c_str());
             dtree::Measure::TSafe::Scope scope(record);
@@ -71,6 +90,57 @@ void RDTSCTest()
         }
     }
     ENSURE(sum == loopNum * (loopNum - 1) / 2);
+
+    // the frequency is known without measurement on most processors, otherwise it is calibrated in the background
+    ENSURE(dtree::MeasureUtils::GetProcessorFrequency() > 0);
+
+    {
+        const uint64_t start = dtree::RdtscLfenceBackend::GetTick();
+        ENSURE(dtree::RdtscLfenceBackend::GetTick() >= start);
+    }
+
+    if (dtree::MeasureUtils::HasRdtscp())
+    {
+        RDTSCP_MEASURE(RDTSCPMeasureTest_1);
+        const uint64_t start = dtree::RdtscpBackend::GetTick();
+        ENSURE(dtree::RdtscpBackend::GetTick() >= start);
+    }
+}
+#endif
+
+#if RDTSC_MEASURE_IS_SUPPORTED
+void TscCalibrationTest()
+{
+    using dtree::MeasureUtils::TscCalibration;
+
+    if (dtree::MeasureUtils::GetKnownTscFrequency() != 0)
+    {
+        ENSURE(!TscCalibration::Start());
+        return;
+    }
+
+    // started by main
+    ENSURE(TscCalibration::IsRunning());
+    ENSURE(!TscCalibration::Start());
+    const uint64_t firstFreq = TscCalibration::WaitForFrequency();
+    ENSURE(firstFreq != 0);
+
+    // a direct measurement over a longer window
+    const uint64_t startTsc = __rdtsc();
+    const auto startTime = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const uint64_t endTsc = __rdtsc();
+    const auto endTime = std::chrono::steady_clock::now();
+    const double measuredFreq = double(endTsc - startTsc) / std::chrono::duration<double>(endTime - startTime).count();
+
+    const uint64_t freq = TscCalibration::GetFrequency();
+    ENSURE(std::abs(double(freq) - measuredFreq) < measuredFreq * 0.01);
+
+    // the last estimate remains
+    TscCalibration::Stop();
+    ENSURE(!TscCalibration::IsRunning());
+    ENSURE(TscCalibration::GetFrequency() != 0);
+    ENSURE(dtree::MeasureUtils::GetProcessorFrequency() == TscCalibration::GetFrequency());
 }
 #endif
 
@@ -94,108 +164,1750 @@ void QPCTest()
 }
 #endif
 
-template<typename TestedMeasure>
-void PerformanceTestTemplate(const char *title)
+#if ARM64_MEASURE_IS_SUPPORTED
+void Arm64Test()
 {
-    using namespace std;
+    ARM64_MEASURE(Arm64BasicTests);
 
-    constexpr uint64_t loopNum = defaultLoopNum;
-    constexpr double freqDetectTime = 1.0;
-    const uint64_t freq = dtree::MeasureUtils::GetProcessorFrequency(freqDetectTime);
-    const auto targetRecord = dtree::CppMeasure::Base::GetDynamicRecord(title);
-    std::string referenceTitle = title + std::string("_reference");
-    const auto referenceRecord = dtree::CppMeasure::Base::GetDynamicRecord(referenceTitle.c_str());
+    constexpr uint64_t loopNum = defaultLoopNum / 10;
     volatile uint64_t sum;
 
-#if MEASURE_WINDOWS
-    dtree::MeasureUtils::SetThreadAffinity(0);
+    sum = 0;
+    {
+        ARM64_MEASURE(Arm64MeasureTest_1);
+        for (uint64_t i = 0; i < loopNum; ++i)
+        {
+            ARM64_MEASURE(Arm64MeasureTest_Core);
+            sum += i;
+        }
+    }
+    ENSURE(sum == loopNum * (loopNum - 1) / 2);
+
+    ENSURE(dtree::Arm64CounterBackend::GetFrequency() > 0);
+    const uint64_t start = dtree::Arm64CounterIsbBackend::GetTick();
+    ENSURE(dtree::Arm64CounterIsbBackend::GetTick() >= start);
+}
 #endif
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+#if MEASURE_LINUX
+void LinuxTest()
+{
+    LINUX_MEASURE(LinuxBasicTests);
+
+    constexpr uint64_t loopNum = defaultLoopNum / 10;
+    volatile uint64_t sum;
 
-    // warm up
     sum = 0;
     {
-        for (uint64_t i = 0; i < loopNum; i++)
+        LINUX_MEASURE(LinuxMeasureTest_1);
+        for (uint64_t i = 0; i < loopNum; ++i)
         {
-            static typename TestedMeasure::MeasureRecord record("warm up");
-            typename TestedMeasure::Scope subScope(&record);
+            LINUX_MEASURE(LinuxMeasureTest_Core);
             sum += i;
         }
     }
+    ENSURE(sum == loopNum * (loopNum - 1) / 2);
 
-    // base time
-    sum = 0;
+    // the coarse clock is cheap, but it ticks only at the timer interrupts
     {
-        dtree::CppMeasure::Base::Scope scope(referenceRecord);
-        for (uint64_t i = 0; i < loopNum; i++)
+        static dtree::LinuxCoarseMeasure::Base::MeasureRecord record("LinuxCoarseMeasureTest_Sleep");
+        dtree::LinuxCoarseMeasure::Base::Scope scope(&record);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    ENSURE(dtree::ClockGettimeCoarseBackend::GetResolution() >= dtree::ClockGettimeRawBackend::GetResolution());
+
+    const int64_t start = dtree::ClockGettimeRawBackend::GetTick();
+    ENSURE(dtree::ClockGettimeRawBackend::GetTick() >= start);
+}
+#endif
+
+#if PERF_MEASURE_IS_SUPPORTED
+void PerfTest()
+{
+    using dtree::PerfCounter;
+    using dtree::PerfSample;
+
+    PerfSample a(100);
+    a.counters[int(PerfCounter::Cycles)] = 1000;
+    PerfSample b(40);
+    b.counters[int(PerfCounter::Cycles)] = 400;
+    PerfSample diff = a - b;
+    ENSURE(diff.time == 60 && diff.Get(PerfCounter::Cycles) == 600);
+    diff += b;
+    ENSURE(diff.time == 100 && diff.Get(PerfCounter::Cycles) == 1000);
+    const PerfSample scaled = dtree::TimeDiffTraits<PerfSample>::Scale(diff, 2.0);
+    ENSURE(scaled.time == 200 && scaled.Get(PerfCounter::Cycles) == 2000);
+
+    // a difference with a multiplexed sample is an estimate
+    ENSURE(!diff.IsScaled(PerfCounter::Cycles));
+    b.scaled = 1u << int(PerfCounter::LLCMisses);
+    const PerfSample estimate = a - b;
+    ENSURE(estimate.IsScaled(PerfCounter::LLCMisses) && !estimate.IsScaled(PerfCounter::Cycles));
+    diff += estimate;
+    ENSURE(diff.IsScaled(PerfCounter::LLCMisses));
+
+    volatile uint64_t sum = 0;
+    static dtree::PerfMeasure::TSafe::MeasureRecord record("PerfTest_loop");
+    for (int i = 0; i < 10; ++i)
+    {
+        dtree::PerfMeasure::TSafe::Scope scope(&record);
+        for (uint64_t j = 0; j < 100000; ++j)
+            sum += j;
+    }
+
+    // the counters are not available in every environment (virtual machines, perf_event_paranoid)
+    PerfSample total;
+    uint64_t numCall;
+    record.GetCounters(total, numCall);
+    ENSURE(numCall == 10 && total.time > 0);
+    if (dtree::PerfEventBackend::IsCounterAvailable(PerfCounter::Instructions))
+        ENSURE(total.Get(PerfCounter::Instructions) >= 10 * 100000);
+    std::cout << "  cycles: " << (dtree::PerfEventBackend::IsCounterAvailable(PerfCounter::Cycles) ? "yes" : "no")
+              << ", rdpmc: " << (dtree::PerfEventBackend::IsUserSpaceRead(PerfCounter::Cycles) ? "yes" : "no") << "\n";
+
+    std::ostringstream report;
+    dtree::PerfMeasure::Database::PrintReport(report);
+    ENSURE(report.str().find("perf_event counters per call") != std::string::npos);
+    ENSURE(report.str().find("IPC") != std::string::npos);
+}
+#endif
+
+// deterministic backend for the tests, every GetTick() call returns the previous value + 1 (per thread),
+// so every (not nested) scope is exactly 1 tick long
+struct CountingBackend
+{
+    inline static const char* GetMeasureTitle() { return "counting ticks"; }
+
+    inline static int64_t GetTick() noexcept
+    {
+        static thread_local int64_t tick = 0;
+        return ++tick;
+    }
+
+    inline static double TimeDiffToSec(int64_t time)
+    {
+        return double(time);
+    }
+};
+
+using CountingMeasure = dtree::TMeasure<CountingBackend>;
+
+// backend for the tests, the time is set by the test
+struct ManualBackend
+{
+    inline static const char* GetMeasureTitle() { return "manual ticks"; }
+
+    inline static int64_t GetTick() noexcept
+    {
+        return Now();
+    }
+
+    inline static double TimeDiffToSec(int64_t time)
+    {
+        return double(time) * 1e-9; // 1 tick = 1 ns
+    }
+
+    static int64_t& Now()
+    {
+        static int64_t now = 0;
+        return now;
+    }
+};
+
+using ManualMeasure = dtree::TMeasure<ManualBackend>;
+
+template<typename TestedMeasure>
+void MultiThreadTestTemplate(typename TestedMeasure::MeasureRecord* record, int threadNum, uint64_t loopNum)
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadNum; ++t)
+        threads.emplace_back([record, loopNum]()
         {
-            sum += i;
+            for (uint64_t i = 0; i < loopNum; ++i)
+                typename TestedMeasure::Scope scope(record);
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void ShardedTest()
+{
+    constexpr int threadNum = 8;
+    constexpr uint64_t loopNum = 100000;
+    static CountingMeasure::Sharded::MeasureRecord record("ShardedTest");
+
+    MultiThreadTestTemplate<CountingMeasure::Sharded>(&record, threadNum, loopNum);
+    ENSURE(record.GetNumCall() == threadNum * loopNum);
+    ENSURE(record.GetTotalTime() == int64_t(threadNum * loopNum));
+
+    // the blocks of the finished threads are reused, their counters are kept
+    MultiThreadTestTemplate<CountingMeasure::Sharded>(&record, threadNum, loopNum);
+    ENSURE(record.GetNumCall() == 2 * threadNum * loopNum);
+
+    const auto dynamicRecord = CountingMeasure::Sharded::GetDynamicRecord("ShardedTest_dynamic");
+    MultiThreadTestTemplate<CountingMeasure::Sharded>(dynamicRecord, threadNum, loopNum);
+    ENSURE(dynamicRecord->GetNumCall() == threadNum * loopNum);
+    ENSURE(CountingMeasure::Database::FindMeasureRecord("ShardedTest_dynamic")->GetNumCall() == threadNum * loopNum);
+
+    CountingMeasure::Database::ResetAll();
+    ENSURE(record.GetNumCall() == 0);
+    ENSURE(record.GetTotalTime() == 0);
+
+    MultiThreadTestTemplate<CountingMeasure::Sharded>(&record, 1, loopNum);
+    ENSURE(record.GetNumCall() == loopNum);
+    ENSURE(record.GetTotalTime() == int64_t(loopNum));
+}
+
+void AtomicTest()
+{
+    constexpr int threadNum = 8;
+    constexpr uint64_t loopNum = 100000;
+    static CountingMeasure::Atomic::MeasureRecord record("AtomicTest");
+
+    MultiThreadTestTemplate<CountingMeasure::Atomic>(&record, threadNum, loopNum);
+    ENSURE(record.GetNumCall() == threadNum * loopNum);
+    ENSURE(record.GetTotalTime() == int64_t(threadNum * loopNum));
+    ENSURE(CountingMeasure::Database::FindMeasureRecord("AtomicTest")->GetNumCall() == threadNum * loopNum);
+
+    record.Reset();
+    ENSURE(record.GetNumCall() == 0);
+    ENSURE(record.GetTotalTime() == 0);
+}
+
+template<typename TestedMeasure>
+void RecursiveScope(typename TestedMeasure::MeasureRecord* record, int level)
+{
+    typename TestedMeasure::Scope scope(record);
+    if (level > 0)
+        RecursiveScope<TestedMeasure>(record, level - 1);
+}
+
+template<typename TestedMeasure>
+void ThreadRecursionTestTemplate(const char* title)
+{
+    constexpr int threadNum = 8;
+    constexpr uint64_t loopNum = 10000;
+    constexpr int level = 5;
+    typename TestedMeasure::MeasureRecord record(title, false);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadNum; ++t)
+        threads.emplace_back([&record]()
+        {
+            for (uint64_t i = 0; i < loopNum; ++i)
+                RecursiveScope<TestedMeasure>(&record, level);
+            ENSURE(record.GetDepth() == 0);
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // only the outermost scopes are counted, every outermost scope is 1 tick long
+    ENSURE(record.GetNumCall() == threadNum * loopNum);
+    ENSURE(record.GetTotalTime() == int64_t(threadNum * loopNum));
+    ENSURE(record.GetDepth() == 0);
+}
+
+void SamplingTest()
+{
+    CountingMeasure::Base::MeasureRecord record("SamplingTest", false);
+    auto addCalls = [&record](int num)
+    {
+        for (int i = 0; i < num; ++i)
+            CountingMeasure::Base::Scope scope(&record);
+    };
+
+    addCalls(10);
+    ENSURE(record.GetNumCall() == 10 && record.GetTotalTime() == 10);
+
+    // a switched off scope doesn't read the clock
+    dtree::MeasureControl::SetEnabled(false);
+    const int64_t tick = CountingBackend::GetTick();
+    addCalls(10);
+    ENSURE(CountingBackend::GetTick() == tick + 1);
+    dtree::MeasureControl::SetEnabled(true);
+    ENSURE(record.GetNumCall() == 10 && record.GetSkippedCalls() == 0);
+
+    record.SetEnabled(false);
+    addCalls(10);
+    ENSURE(!record.IsEnabled() && record.GetNumCall() == 10);
+
+    // 1 in 4 calls is measured, the counters are scaled up to all the calls
+    record.Reset();
+    record.SetSamplePeriod(4);
+    addCalls(100);
+    ENSURE(record.GetSkippedCalls() == 75);
+    ENSURE(record.GetNumCall() == 100 && record.GetTotalTime() == 100);
+    record.Reset();
+    ENSURE(record.GetNumCall() == 0 && record.GetSkippedCalls() == 0);
+
+    // only the outermost scope is sampled
+    CountingMeasure::RSafe::MeasureRecord recursiveRecord("SamplingTest_recursive", false);
+    recursiveRecord.SetSamplePeriod(2);
+    for (int i = 0; i < 10; ++i)
+        RecursiveScope<CountingMeasure::RSafe>(&recursiveRecord, 3);
+    ENSURE(recursiveRecord.GetDepth() == 0 && recursiveRecord.GetSkippedCalls() == 5 && recursiveRecord.GetNumCall() == 10);
+
+    // every thread counts down its own calls, so the skipped calls are exact with concurrent threads too
+    CountingMeasure::Sharded::MeasureRecord shardedRecord("SamplingTest_sharded", false);
+    shardedRecord.SetSamplePeriod(4);
+    MultiThreadTestTemplate<CountingMeasure::Sharded>(&shardedRecord, 8, 1000);
+    ENSURE(shardedRecord.GetSkippedCalls() == 8 * 750 && shardedRecord.GetNumCall() == 8 * 1000);
+    shardedRecord.Reset();
+    ENSURE(shardedRecord.GetSkippedCalls() == 0 && shardedRecord.GetNumCall() == 0);
+
+    // the tree mode measures every call of a switched on record
+    using Tree = ManualMeasure::CallTree;
+    using ReportNode = ManualMeasure::MeasureRecordBase::Tree::ReportNode;
+    static Tree::MeasureRecord treeRecord("SamplingTest_tree");
+    treeRecord.SetSamplePeriod(0);
+    {
+        Tree::Scope scope(&treeRecord);
+    }
+    const ReportNode root = ManualMeasure::MeasureRecordBase::Tree::GetReportTree();
+    for (const ReportNode& child : root.children)
+        ENSURE(child.record != &treeRecord);
+    treeRecord.SetSamplePeriod(3);
+    for (int i = 0; i < 3; ++i)
+        Tree::Scope scope(&treeRecord);
+    ENSURE(treeRecord.GetNumCall() == 3 && treeRecord.GetSkippedCalls() == 0);
+
+    // the new records get the default period
+    dtree::MeasureControl::SetDefaultSamplePeriod(0);
+    CountingMeasure::Base::MeasureRecord idleRecord("SamplingTest_idle", false);
+    dtree::MeasureControl::SetDefaultSamplePeriod(1);
+    {
+        CountingMeasure::Base::Scope scope(&idleRecord);
+    }
+    ENSURE(idleRecord.GetSamplePeriod() == 0 && idleRecord.GetNumCall() == 0);
+}
+
+void NameTest()
+{
+    static_assert(dtree::MeasureUtils::ConstHashName("") == 14695981039346656037ull, "FNV-1a offset basis");
+    static_assert(dtree::MeasureUtils::ConstHashName("a") == 0xaf63dc4c8601ec8cull, "FNV-1a of a");
+
+    size_t length;
+    ENSURE(dtree::MeasureUtils::HashName("NameTest_literal", length) == dtree::MeasureUtils::ConstHashName("NameTest_literal"));
+
+    // a literal name is not copied
+    static const char literal[] = "NameTest_literal";
+    static CountingMeasure::Base::MeasureRecord literalRecord(dtree::MeasureName(literal, dtree::MeasureUtils::ConstHashName(literal)));
+    static CountingMeasure::Base::MeasureRecord macroRecord(MEASURE_NAME_LITERAL("NameTest_macro"));
+    ENSURE(literalRecord.name == literal);
+    ENSURE(macroRecord.nameId == dtree::MeasureUtils::HashName("NameTest_macro", length));
+
+    // a temporary name is copied
+    static CountingMeasure::Base::MeasureRecord copiedRecord((std::string("NameTest_") + "copied").c_str());
+    ENSURE(std::string(copiedRecord.name) == "NameTest_copied");
+    ENSURE(copiedRecord.nameId == dtree::MeasureUtils::ConstHashName("NameTest_copied"));
+
+    // O(1) lookups by the name and by the id
+    ENSURE(CountingMeasure::Database::FindMeasureRecord("NameTest_copied") == &copiedRecord);
+    ENSURE(CountingMeasure::Database::FindMeasureRecord("NameTest_macro") == &macroRecord);
+    ENSURE(CountingMeasure::Database::FindMeasureRecord("NameTest_missing") == nullptr);
+    ENSURE(CountingMeasure::Database::FindMeasureRecordById(dtree::MeasureUtils::ConstHashName("NameTest_literal")) == &literalRecord);
+    ENSURE(CountingMeasure::Database::FindMeasureRecordById(dtree::MeasureUtils::ConstHashName("NameTest_missing")) == nullptr);
+
+    // the snapshots carry the ids
+    const dtree::MeasureSnapshot snapshot = dtree::MeasureSnapshot::Take<CountingMeasure::Database>();
+    bool found = false;
+    for (const dtree::MeasureSnapshot::Record& record : snapshot.records)
+        found = found || (record.name == "NameTest_macro" && record.nameId == macroRecord.nameId);
+    ENSURE(found);
+}
+
+void ArenaTest()
+{
+    struct alignas(128) Aligned
+    {
+        explicit Aligned(int inValue, int& inDestroyed) : value(inValue), destroyed(inDestroyed) {}
+        ~Aligned() { ++destroyed; }
+        int value;
+        int& destroyed;
+    };
+
+    int destroyed = 0;
+    {
+        dtree::MeasureArena<Aligned> arena;
+        const int num = int(3 * dtree::MeasureArena<Aligned>::ChunkSize + 1);
+        std::vector<Aligned*> objects;
+        for (int i = 0; i < num; ++i)
+            objects.push_back(arena.Create(i, destroyed));
+        ENSURE(arena.Size() == size_t(num));
+        for (int i = 0; i < num; ++i)
+        {
+            ENSURE(objects[i]->value == i && &arena[i] == objects[i]);
+            ENSURE(reinterpret_cast<uintptr_t>(objects[i]) % alignof(Aligned) == 0);
         }
+        ENSURE(objects[1] == objects[0] + 1);
+        ENSURE(destroyed == 0);
     }
+    ENSURE(destroyed == int(3 * dtree::MeasureArena<Aligned>::ChunkSize + 1));
+}
 
-    // test
-    sum = 0;
+void DynamicRecordTest()
+{
+    using DynamicDatabase = CountingMeasure::Sharded::DynamicDatabase;
+    constexpr int nameNum = 1000;
+    constexpr int threadNum = 4;
+
+    // the table grows several times
+    std::vector<CountingMeasure::Sharded::MeasureRecord*> records;
+    for (int i = 0; i < nameNum; ++i)
+        records.push_back(CountingMeasure::Sharded::GetDynamicRecord(("DynamicRecordTest_" + std::to_string(i)).c_str()));
+    for (int i = 0; i < nameNum; ++i)
     {
-        dtree::CppMeasure::Base::Scope scope(targetRecord);
-        for (uint64_t i = 0; i < loopNum; i++)
+        const std::string name = "DynamicRecordTest_" + std::to_string(i);
+        ENSURE(records[i]->name == name);
+        ENSURE(CountingMeasure::Sharded::GetDynamicRecord(name.c_str()) == records[i]);
+        ENSURE(CountingMeasure::Database::FindMeasureRecord(name.c_str()) == records[i]);
+    }
+
+    // the records of the arena are contiguous
+    ENSURE(records[2] == records[1] + 1);
+
+    // the same name in a different buffer, and a precomputed hash
+    const char name[] = "DynamicRecordTest_7";
+    size_t length;
+    const uint64_t hash = dtree::MeasureUtils::HashName(name, length);
+    ENSURE(length == strlen(name));
+    ENSURE(DynamicDatabase::GetOrAddDynamicRecord(name, length, hash) == records[7]);
+    ENSURE(DynamicDatabase::GetOrAddDynamicRecord("DynamicRecordTest_70") == records[70]);
+
+    // concurrent lookups and insertions find the same records
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadNum; ++t)
+        threads.emplace_back([&records]()
         {
-            static typename TestedMeasure::MeasureRecord record("SubMeasure_3");
-            typename TestedMeasure::Scope subScope(&record);
-            sum += i;
+            for (int i = 0; i < 2 * nameNum; ++i)
+            {
+                const std::string recordName = "DynamicRecordTest_" + std::to_string(i);
+                CountingMeasure::Sharded::MeasureRecord* record = CountingMeasure::Sharded::GetDynamicRecord(recordName.c_str());
+                ENSURE(record->name == recordName && (i >= nameNum || record == records[i]));
+                CountingMeasure::Sharded::Scope scope(record);
+            }
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    for (int i = 0; i < 2 * nameNum; ++i)
+        ENSURE(CountingMeasure::Sharded::GetDynamicRecord(("DynamicRecordTest_" + std::to_string(i)).c_str())->GetNumCall() == threadNum);
+
+    // the macro uses the dynamic record of its own policy
+    {
+        SAFE_MEASURE_DYNAMIC_S(name, Sharded);
+    }
+    ENSURE(dtree::Measure::Sharded::GetDynamicRecord(name)->GetNumCall() == 1);
+}
+
+void ThreadRecursionTest()
+{
+    ThreadRecursionTestTemplate<CountingMeasure::TRSafe>("ThreadRecursionTest_TRSafe");
+    ThreadRecursionTestTemplate<CountingMeasure::TRSharded>("ThreadRecursionTest_TRSharded");
+}
+
+void HistogramTest()
+{
+    using Histogram = dtree::MeasureHistogram;
+
+    // every value is in its own bucket, and the buckets are continuous
+    for (uint64_t value = 0; value < 100000; ++value)
+    {
+        const uint32_t index = Histogram::BucketIndex(value);
+        ENSURE(Histogram::BucketLowerBound(index) <= value && value <= Histogram::BucketUpperBound(index));
+        ENSURE(value == 0 || Histogram::BucketIndex(value - 1) + 1 >= index);
+    }
+    ENSURE(Histogram::BucketIndex(UINT64_MAX) == Histogram::BucketCount - 1);
+    ENSURE(Histogram::BucketUpperBound(Histogram::BucketCount - 1) == UINT64_MAX);
+
+    // durations: 1, 2, ... 1000 ns
+    static ManualMeasure::Histogram::MeasureRecord record("HistogramTest");
+    for (int64_t i = 1; i <= 1000; ++i)
+    {
+        ManualMeasure::Histogram::Scope scope(&record);
+        ManualBackend::Now() += i;
+    }
+
+    const Histogram* histogram = record.GetHistogram();
+    ENSURE(histogram != nullptr);
+    ENSURE(histogram->GetTotalCount() == 1000);
+    ENSURE(histogram->GetMax() == 1000);
+    ENSURE(record.GetNumCall() == 1000);
+    ENSURE(record.GetTotalTime() == 1000 * 1001 / 2);
+
+    const double maxError = 1.0 / Histogram::SubBucketCount;
+    ENSURE(std::abs(double(histogram->GetPercentile(0.5)) - 500.0) <= 500.0 * maxError);
+    ENSURE(std::abs(double(histogram->GetPercentile(0.9)) - 900.0) <= 900.0 * maxError);
+    ENSURE(std::abs(double(histogram->GetPercentile(0.99)) - 990.0) <= 990.0 * maxError);
+    ENSURE(histogram->GetPercentile(1.0) == 1000);
+
+    // the thread safe version with recursion
+    static ManualMeasure::WithHistogram<ManualMeasure::TRSafe>::MeasureRecord recursiveRecord("HistogramTest_TRSafe");
+    {
+        ManualMeasure::WithHistogram<ManualMeasure::TRSafe>::Scope scope1(&recursiveRecord);
+        ManualMeasure::WithHistogram<ManualMeasure::TRSafe>::Scope scope2(&recursiveRecord);
+        ManualBackend::Now() += 10;
+    }
+    ENSURE(recursiveRecord.GetNumCall() == 1);
+    ENSURE(recursiveRecord.GetHistogram()->GetMax() == 10);
+
+    std::ostringstream report;
+    ManualMeasure::Database::PrintReport(report);
+    ENSURE(report.str().find("p99.9 (ns)") != std::string::npos);
+
+    std::ostringstream csvReport;
+    dtree::CsvReport<ManualMeasure::Database>(csvReport);
+    ENSURE(csvReport.str().find("name,num_calls,total_ns,average_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n") == 0);
+
+    ManualMeasure::Database::ResetAll();
+    ENSURE(histogram->GetTotalCount() == 0);
+    ENSURE(record.GetNumCall() == 0);
+}
+
+void StatsTest()
+{
+    // durations: 1, 2, ... 1000 ns
+    static ManualMeasure::Stats::MeasureRecord record("StatsTest");
+    for (int64_t i = 1; i <= 1000; ++i)
+    {
+        ManualMeasure::Stats::Scope scope(&record);
+        ManualBackend::Now() += i;
+    }
+
+    dtree::MeasureStats stats;
+    ENSURE(record.GetStats(stats));
+    ENSURE(stats.GetCount() == 1000);
+    ENSURE(stats.GetMin() == 1);
+    ENSURE(stats.GetMax() == 1000);
+    ENSURE(std::abs(stats.GetMean() - 500.5) < 1e-9);
+    ENSURE(std::abs(stats.GetVariance() - 1000.0 * 1001.0 / 12.0) < 1e-6); // sample variance of 1..n is n(n+1)/12
+
+    // the base policy has no stats
+    static ManualMeasure::Base::MeasureRecord baseRecord("StatsTest_base");
+    ENSURE(!baseRecord.GetStats(stats));
+
+    // thread safe, every duration is 1 tick
+    constexpr int threadNum = 8;
+    constexpr uint64_t loopNum = 10000;
+    static CountingMeasure::WithStats<CountingMeasure::Sharded>::MeasureRecord threadRecord("StatsTest_Sharded");
+    MultiThreadTestTemplate<CountingMeasure::WithStats<CountingMeasure::Sharded>>(&threadRecord, threadNum, loopNum);
+    ENSURE(threadRecord.GetStats(stats));
+    ENSURE(stats.GetCount() == threadNum * loopNum);
+    ENSURE(threadRecord.GetNumCall() == threadNum * loopNum);
+    ENSURE(stats.GetMin() == 1 && stats.GetMax() == 1);
+    ENSURE(stats.GetVariance() == 0);
+
+    std::ostringstream report;
+    ManualMeasure::Database::PrintReport(report);
+    ENSURE(report.str().find("Std dev (ns)") != std::string::npos);
+
+    std::ostringstream csvReport;
+    dtree::CsvReport<ManualMeasure::Database>(csvReport);
+    ENSURE(csvReport.str().find("name,num_calls,total_ns,average_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,min_ns,stddev_ns\n") == 0);
+
+    record.Reset();
+    ENSURE(record.GetStats(stats) && stats.GetCount() == 0);
+    threadRecord.Reset();
+    ENSURE(threadRecord.GetStats(stats) && stats.GetCount() == 0);
+}
+
+// an awaiter for the test of MeasureAwait, without coroutines
+struct TestAwaiter
+{
+    bool ready;
+    bool await_ready() { return ready; }
+    bool await_suspend(int) { ManualBackend::Now() += 1000; return true; } // the suspended time
+    int await_resume() { return 42; }
+};
+
+void WorkTest()
+{
+    // 10 calls of 100 ns, 1000 bytes and 2 items each: 10'000 MB/s, 20'000'000 items/s
+    static ManualMeasure::Atomic::MeasureRecord record("WorkTest");
+    for (int i = 0; i < 10; ++i)
+    {
+        ManualMeasure::Atomic::Scope scope(&record);
+        ManualBackend::Now() += 100;
+        scope.AddBytes(1000);
+        scope.AddItems(2);
+    }
+    uint64_t bytes, items;
+    record.GetWork(bytes, items);
+    ENSURE(bytes == 10000 && items == 20);
+
+    // only the outermost scope of a recursive record reports the work
+    static ManualMeasure::RSafe::MeasureRecord recursiveRecord("WorkTest_recursive");
+    {
+        ManualMeasure::RSafe::Scope outer(&recursiveRecord);
+        ManualMeasure::RSafe::Scope inner(&recursiveRecord);
+        ManualBackend::Now() += 100;
+        inner.AddBytes(500);
+        outer.AddBytes(1000);
+    }
+    recursiveRecord.GetWork(bytes, items);
+    ENSURE(bytes == 1000 && items == 0);
+
+    // a sampled record is scaled up like the time: 1 of 4 calls is measured
+    static ManualMeasure::Base::MeasureRecord sampledRecord("WorkTest_sampled");
+    sampledRecord.SetSamplePeriod(4);
+    for (int i = 0; i < 8; ++i)
+    {
+        ManualMeasure::Base::Scope scope(&sampledRecord);
+        scope.AddItems(1);
+    }
+    sampledRecord.GetWork(bytes, items);
+    ENSURE(sampledRecord.GetNumCall() == 8 && items == 8);
+    sampledRecord.SetSamplePeriod(1);
+
+    // the sharded records keep the work per thread, the merge sums the threads
+    static ManualMeasure::TRSharded::MeasureRecord shardedRecord("WorkTest_sharded");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([]()
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                ManualMeasure::TRSharded::Scope scope(&shardedRecord);
+                scope.AddBytes(10);
+                scope.AddItems(1);
+            }
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    shardedRecord.GetWork(bytes, items);
+    ENSURE(bytes == 4000 && items == 400);
+    shardedRecord.Reset();
+    shardedRecord.GetWork(bytes, items);
+    ENSURE(bytes == 0 && items == 0);
+    {
+        ManualMeasure::TRSharded::Scope scope(&shardedRecord);
+        scope.AddBytes(7);
+    }
+    shardedRecord.GetWork(bytes, items);
+    ENSURE(bytes == 7 && items == 0);
+    shardedRecord.Reset();
+
+    // the work of the string title macros
+    {
+        SAFE_MEASURE_S("WorkTest_macro", Sharded);
+        MEASURE_BYTES_S(100);
+        MEASURE_ITEMS_S(3);
+    }
+    dtree::Measure::Database::FindMeasureRecord("WorkTest_macro")->GetWork(bytes, items);
+    ENSURE(bytes == 100 && items == 3);
+
+    std::ostringstream report;
+    ManualMeasure::Database::PrintReport(report);
+    ENSURE(report.str().find("MB/s") != std::string::npos);
+    ENSURE(report.str().find("10'000.0") != std::string::npos);
+    ENSURE(report.str().find("20'000'000.0") != std::string::npos);
+
+    std::ostringstream csvReport;
+    dtree::CsvReport<ManualMeasure::Database>(csvReport);
+    ENSURE(csvReport.str().find("name,num_calls,total_ns,average_ns,bytes,items,bytes_per_sec,items_per_sec") == 0);
+    ENSURE(csvReport.str().find("\nWorkTest,10,1000.000000,100.000000,10000,20,") != std::string::npos);
+
+    record.Reset();
+    recursiveRecord.Reset();
+    sampledRecord.Reset();
+    record.GetWork(bytes, items);
+    ENSURE(bytes == 0 && items == 0);
+}
+
+void FormatTest()
+{
+    using namespace dtree::MeasureUtils;
+    char buffer[MaxTimeLength];
+    ENSURE(FormatUInt(buffer, 0) == 1 && std::string(buffer) == "0");
+    ENSURE(FormatUInt(buffer, 1234567) == 7 && std::string(buffer) == "1234567");
+    ENSURE(FormatUInt(buffer, UINT64_MAX) == 20 && std::string(buffer) == std::to_string(UINT64_MAX));
+    ENSURE(FormatWithSeparator(buffer, 999) == 3 && std::string(buffer) == "999");
+    ENSURE(FormatWithSeparator(buffer, 12345678) == 10 && std::string(buffer) == "12'345'678");
+    ENSURE(FormatWithSeparator(UINT64_MAX) == "18'446'744'073'709'551'615");
+    ENSURE(RateToStr(1234.56) == "1'234.6");
+    ENSURE(FormatFixed(buffer, sizeof(buffer), 2.5) == 8 && std::string(buffer) == "2.500000");
+    ENSURE(TimeToStr(12.5) == "  12.500 sec");
+    ENSURE(TimeToStr(2.5e-8) == "  25.000 ns ");
+
+    // the columns are right aligned like setw and the whole text is written at once
+    ReportBuffer report(16);
+    report.Title("ab", 10).Right("x", 3).Number(42, 4).Separated(1000, 7).Ns(1.5e-6).Append('\n');
+    ENSURE(report.Str() == "--- ab ---\n  x  42  1'0001'500\n");
+    std::ostringstream os;
+    report.WriteTo(os);
+    ENSURE(os.str() == report.Str());
+}
+
+void TokenTest()
+{
+    using Policy = ManualMeasure::TSafe;
+    static Policy::MeasureRecord record("TokenTest");
+
+    // started on this thread, stopped on an other one
+    dtree::MeasureToken<Policy> token(&record);
+    ENSURE(token.IsActive() && !token.IsPaused());
+    ManualBackend::Now() += 10;
+    std::thread thread([](dtree::MeasureToken<Policy> movedToken)
+    {
+        ManualBackend::Now() += 5;
+        movedToken.Stop();
+        ENSURE(!movedToken.IsActive());
+    }, std::move(token));
+    thread.join();
+    ENSURE(!token.IsActive());
+    ENSURE(record.GetNumCall() == 1 && record.GetTotalTime() == 15);
+
+    // the paused time is excluded
+    dtree::MeasureToken<Policy> pausedToken(&record);
+    ManualBackend::Now() += 10;
+    pausedToken.Pause();
+    ENSURE(pausedToken.IsPaused() && pausedToken.GetElapsed() == 10);
+    ManualBackend::Now() += 1000;
+    pausedToken.Resume();
+    ManualBackend::Now() += 20;
+    ENSURE(pausedToken.GetElapsed() == 30);
+    pausedToken.Stop();
+    ENSURE(record.GetNumCall() == 2 && record.GetTotalTime() == 45);
+
+    // the awaiter wrapper pauses the token while the coroutine is suspended
+    {
+        dtree::MeasureToken<Policy> awaitToken(&record);
+        auto awaiter = dtree::MeasureAwait(awaitToken, TestAwaiter{ false });
+        ENSURE(!awaiter.await_ready());
+        ENSURE(awaiter.await_suspend(0));
+        ENSURE(awaitToken.IsPaused());
+        ENSURE(awaiter.await_resume() == 42);
+        ENSURE(!awaitToken.IsPaused());
+        ManualBackend::Now() += 7;
+
+        // not suspended, the token keeps running
+        auto readyAwaiter = dtree::MeasureAwait(awaitToken, TestAwaiter{ true });
+        ENSURE(readyAwaiter.await_ready() && readyAwaiter.await_resume() == 42);
+        ENSURE(awaitToken.GetElapsed() == 7);
+    } // stopped by the destructor
+    ENSURE(record.GetNumCall() == 3 && record.GetTotalTime() == 52);
+
+    // move assignment stops the current measurement, cancel drops it
+    dtree::MeasureToken<Policy> first(&record);
+    dtree::MeasureToken<Policy> second(&record);
+    ManualBackend::Now() += 3;
+    first = std::move(second);
+    ENSURE(record.GetNumCall() == 4 && record.GetTotalTime() == 55);
+    first.Cancel();
+    ENSURE(record.GetNumCall() == 4);
+
+    // the switched off record is not measured
+    record.SetEnabled(false);
+    dtree::MeasureToken<Policy> offToken(&record);
+    ENSURE(!offToken.IsActive());
+    record.SetEnabled(true);
+
+    record.Reset();
+}
+
+void CpuTest()
+{
+    const unsigned cpuCount = dtree::MeasureUtils::GetCpuCount();
+    ENSURE(cpuCount >= 1 && dtree::MeasureUtils::GetNumaNodeCount() >= 1);
+
+    using CpuMeasure = ManualMeasure::WithCpu<ManualMeasure::Atomic>;
+    using NodeMeasure = ManualMeasure::WithCpu<ManualMeasure::Base, dtree::MeasureCpuKey::Node>;
+    static CpuMeasure::MeasureRecord cpuRecord("CpuTest_cpu");
+    static NodeMeasure::MeasureRecord nodeRecord("CpuTest_node");
+
+    // pinned to the last processor, in a new thread, so the affinity of the test thread doesn't change
+    const unsigned lastCpu = cpuCount - 1;
+    unsigned cpu = 0;
+    unsigned node = 0;
+    bool known = false;
+    std::thread thread([&]()
+    {
+        dtree::MeasureUtils::SetThreadAffinity(lastCpu);
+        for (int i = 0; i < 100; ++i)
+        {
+            CpuMeasure::Scope cpuScope(&cpuRecord);
+            NodeMeasure::Scope nodeScope(&nodeRecord);
+            ManualBackend::Now() += 10;
+        }
+        known = dtree::MeasureUtils::GetCurrentCpuAndNode(cpu, node);
+    });
+    thread.join();
+
+    const dtree::MeasureCpuBreakdown* cpuBreakdown = cpuRecord.GetCpuBreakdown();
+    const dtree::MeasureCpuBreakdown* nodeBreakdown = nodeRecord.GetCpuBreakdown();
+    ENSURE(cpuBreakdown && nodeBreakdown);
+    ENSURE(cpuBreakdown->GetKey() == dtree::MeasureCpuKey::Core && cpuBreakdown->GetSlotNum() == cpuCount);
+    ENSURE(nodeBreakdown->GetKey() == dtree::MeasureCpuKey::Node);
+#if MEASURE_WINDOWS || MEASURE_LINUX
+    ENSURE(known && cpu == lastCpu && node < nodeBreakdown->GetSlotNum());
+    ENSURE(cpuBreakdown->GetCalls(lastCpu) == 100 && cpuBreakdown->GetTicks(lastCpu) == 1000);
+    ENSURE(nodeBreakdown->GetCalls(node) == 100);
+#endif
+    ENSURE(cpuRecord.GetNumCall() == 100 && nodeRecord.GetNumCall() == 100);
+
+    std::ostringstream report;
+    ManualMeasure::Database::PrintReport(report);
+    ENSURE(report.str().find("per processor and NUMA node") != std::string::npos);
+#if MEASURE_WINDOWS || MEASURE_LINUX
+    ENSURE(report.str().find("cpu " + std::to_string(lastCpu)) != std::string::npos);
+    ENSURE(report.str().find("1.00x") != std::string::npos);
+#endif
+
+    // the base policy has no breakdown
+    static ManualMeasure::Base::MeasureRecord baseRecord("CpuTest_base");
+    ENSURE(baseRecord.GetCpuBreakdown() == nullptr);
+
+    cpuRecord.Reset();
+    ENSURE(cpuBreakdown->GetCalls(lastCpu) == 0 && cpuBreakdown->GetTicks(lastCpu) == 0);
+    nodeRecord.Reset();
+}
+
+void TreeTest()
+{
+    using Tree = ManualMeasure::CallTree;
+    using ReportNode = ManualMeasure::MeasureRecordBase::Tree::ReportNode;
+    static Tree::MeasureRecord recordA("TreeTest_A");
+    static Tree::MeasureRecord recordB("TreeTest_B");
+    static Tree::MeasureRecord helper("TreeTest_helper");
+    auto callHelper = [](int64_t time)
+    {
+        Tree::Scope scope(&helper);
+        ManualBackend::Now() += time;
+    };
+
+    // A: 10 + helper 3 * 5
+    {
+        Tree::Scope scope(&recordA);
+        ManualBackend::Now() += 10;
+        for (int i = 0; i < 3; ++i)
+            callHelper(5);
+    }
+    // B: helper 100 + recursive B 1
+    {
+        Tree::Scope scope(&recordB);
+        callHelper(100);
+        Tree::Scope recursiveScope(&recordB);
+        ManualBackend::Now() += 1;
+    }
+    // A in an other thread, merged into the same path
+    std::thread([]() { Tree::Scope scope(&recordA); }).join();
+
+    // the flat records
+    ENSURE(helper.GetNumCall() == 4 && helper.GetTotalTime() == 115);
+    ENSURE(recordA.GetNumCall() == 2 && recordA.GetTotalTime() == 25);
+    ENSURE(recordB.GetNumCall() == 1 && recordB.GetTotalTime() == 101); // the outermost scope only
+
+    auto findChild = [](const ReportNode& node, const Tree::MeasureRecord& record) -> const ReportNode*
+    {
+        for (const ReportNode& child : node.children)
+            if (child.record == &record)
+                return &child;
+        return nullptr;
+    };
+    const ReportNode root = ManualMeasure::MeasureRecordBase::Tree::GetReportTree();
+    const ReportNode* nodeA = findChild(root, recordA);
+    ENSURE(nodeA && nodeA->numCall == 2 && nodeA->totalTime == 25 && nodeA->childTime == 15);
+    const ReportNode* nodeAHelper = findChild(*nodeA, helper);
+    ENSURE(nodeAHelper && nodeAHelper->numCall == 3 && nodeAHelper->totalTime == 15);
+    const ReportNode* nodeB = findChild(root, recordB);
+    ENSURE(nodeB && nodeB->numCall == 1 && nodeB->totalTime == 101 && nodeB->childTime == 101);
+    const ReportNode* nodeBB = findChild(*nodeB, recordB);
+    ENSURE(nodeBB && nodeBB->numCall == 1 && nodeBB->totalTime == 1 && nodeBB->children.empty());
+    ENSURE(findChild(root, helper) == nullptr);
+
+    std::ostringstream report;
+    ManualMeasure::Database::PrintReport(report);
+    ENSURE(report.str().find("manual ticks call tree") != std::string::npos);
+    ENSURE(report.str().find("\n  TreeTest_helper ") != std::string::npos);
+
+    std::ostringstream csvReport;
+    dtree::CsvTreeReport<ManualMeasure::Database>(csvReport);
+    ENSURE(csvReport.str().find("path,num_calls,inclusive_ns,exclusive_ns\n") == 0);
+    ENSURE(csvReport.str().find("\nTreeTest_A,2,25.000000,10.000000\n") != std::string::npos);
+    ENSURE(csvReport.str().find("\nTreeTest_A;TreeTest_helper,3,15.000000,15.000000\n") != std::string::npos);
+    ENSURE(csvReport.str().find("\nTreeTest_B;TreeTest_B,1,1.000000,1.000000\n") != std::string::npos);
+    // the reports don't change the flags of the stream
+    ENSURE(!(csvReport.flags() & std::ios::fixed) && !(report.flags() & std::ios::left));
+
+    ManualMeasure::Database::ResetAll();
+    const ReportNode resetRoot = ManualMeasure::MeasureRecordBase::Tree::GetReportTree();
+    ENSURE(findChild(resetRoot, recordA) && findChild(resetRoot, recordA)->numCall == 0);
+}
+
+void TraceTest()
+{
+    using Traced = ManualMeasure::Traced;
+    using RSafeTraced = ManualMeasure::WithTrace<ManualMeasure::RSafe>;
+    using Trace = ManualMeasure::MeasureRecordBase::Trace;
+    static Traced::MeasureRecord record("TraceTest");
+    static RSafeTraced::MeasureRecord recursiveRecord("TraceTest_recursive");
+    static Traced::MeasureRecord overwriteRecord("TraceTest_overwrite");
+
+    auto eventsOf = [](const ManualMeasure::MeasureRecordBase& measureRecord, double lastSeconds)
+    {
+        std::vector<Trace::EventData> events;
+        for (const Trace::EventData& event : Trace::GetEvents(lastSeconds))
+            if (event.record == &measureRecord)
+                events.push_back(event);
+        return events;
+    };
+
+    const int64_t start = ManualBackend::Now();
+    {
+        Traced::Scope scope(&record);
+        ManualBackend::Now() += 1000;
+    }
+    {
+        RSafeTraced::Scope scope(&recursiveRecord);
+        ManualBackend::Now() += 10;
+        RSafeTraced::Scope recursiveScope(&recursiveRecord);
+        ManualBackend::Now() += 20;
+    }
+
+    // every call is in the trace, but the record counts the outermost recursive call only
+    std::vector<Trace::EventData> events = eventsOf(record, 0);
+    ENSURE(events.size() == 1 && events[0].start == start && events[0].duration == 1000);
+    ENSURE(record.GetNumCall() == 1 && record.GetTotalTime() == 1000);
+    events = eventsOf(recursiveRecord, 0);
+    ENSURE(events.size() == 2 && events[0].duration == 30 && events[1].duration == 20);
+    ENSURE(events[0].start == start + 1000 && events[1].start == start + 1010);
+    ENSURE(recursiveRecord.GetNumCall() == 1 && recursiveRecord.GetTotalTime() == 30);
+    const uint32_t mainThreadId = events[0].threadId;
+
+    // the oldest events are overwritten
+    const uint64_t capacity = Trace::Capacity;
+    std::thread([capacity]()
+    {
+        for (uint64_t i = 0; i < capacity + 10; ++i)
+        {
+            Traced::Scope scope(&overwriteRecord);
+            ManualBackend::Now() += 1;
         }
+    }).join();
+    events = eventsOf(overwriteRecord, 0);
+    ENSURE(events.size() == capacity);
+    ENSURE(events[0].start == start + 1030 + 10 && events[0].threadId != mainThreadId);
+
+    // the ring of the finished thread is reused, its events are dropped
+    std::thread([]() { Traced::Scope scope(&record); }).join();
+    ENSURE(eventsOf(overwriteRecord, 0).empty());
+    ENSURE(eventsOf(record, 0).size() == 2);
+
+    // only the last second
+    ManualBackend::Now() += 10000000000ll;
+    {
+        Traced::Scope scope(&record);
+        ManualBackend::Now() += 1000;
     }
+    ENSURE(Trace::GetEvents(1.0).size() == 1);
+
+    std::ostringstream report;
+    dtree::ChromeTraceReport<ManualMeasure::Database>(report);
+    ENSURE(report.str().find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n") == 0);
+    ENSURE(report.str().find("{\"name\":\"TraceTest\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(mainThreadId) + ",\"ts\":0.000,\"dur\":1.000}") != std::string::npos);
+    std::ostringstream lastReport;
+    dtree::ChromeTraceReport<ManualMeasure::Database>(lastReport, 1.0);
+    ENSURE(lastReport.str().find("\"ts\":0.000,\"dur\":1.000}\n]}\n") != std::string::npos);
+    ENSURE(!(report.flags() & std::ios::fixed) && report.precision() == 6);
+}
+
+void SnapshotTest()
+{
+    using Snapshot = dtree::MeasureSnapshot;
+    static ManualMeasure::Base::MeasureRecord record("SnapshotTest");
+    static ManualMeasure::Base::MeasureRecord removedRecord("SnapshotTest_removed");
+    for (int i = 0; i < 4; ++i)
+    {
+        ManualMeasure::Base::Scope scope(&record);
+        ManualBackend::Now() += 250;
+    }
+
+    auto find = [](const Snapshot& snapshot, const std::string& name) -> const Snapshot::Record*
+    {
+        for (const Snapshot::Record& snapshotRecord : snapshot.records)
+            if (snapshotRecord.name == name)
+                return &snapshotRecord;
+        return nullptr;
+    };
 
-    const double baseTime = referenceRecord->GetTotalSec();
-    const double withMeasureTime = targetRecord->GetTotalSec();
-    const double measureTime = withMeasureTime - baseTime;
+    const Snapshot snapshot = Snapshot::Take<ManualMeasure::Database>();
+    ENSURE(snapshot.title == ManualBackend::GetMeasureTitle() && snapshot.secondsPerTick == 1e-9);
+    ENSURE(snapshot.records.size() == ManualMeasure::Database::GetRecords().size());
+    ENSURE(find(snapshot, "SnapshotTest")->totalTicks == 1000 && find(snapshot, "SnapshotTest")->numCall == 4);
 
-    cout
-        << setw(22) << title << ": "
-        << "~ " << fixed << setw(6) << setprecision(3) << measureTime * 1000000000 / loopNum << " ns/call, "
-        << "~ " << fixed << setw(5) << setprecision(1) << measureTime * freq / loopNum << " clock/call, "
-        << "~ " << fixed << 1.0 / (measureTime / loopNum) << " call/sec"
-        << endl;
+    // the binary form keeps everything
+    const std::vector<char> data = snapshot.Serialize();
+    Snapshot loaded;
+    ENSURE(loaded.Deserialize(data.data(), data.size()));
+    ENSURE(loaded.title == snapshot.title && loaded.secondsPerTick == snapshot.secondsPerTick && loaded.timestampNs == snapshot.timestampNs);
+    ENSURE(loaded.records.size() == snapshot.records.size());
+    for (size_t i = 0; i < loaded.records.size(); ++i)
+        ENSURE(loaded.records[i].name == snapshot.records[i].name
+            && loaded.records[i].totalTicks == snapshot.records[i].totalTicks
+            && loaded.records[i].numCall == snapshot.records[i].numCall);
+
+    // truncated or foreign data is rejected
+    ENSURE(!loaded.Deserialize(data.data(), data.size() - 1));
+    ENSURE(!loaded.Deserialize(data.data(), sizeof(Snapshot::FileHeader) - 1));
+    std::vector<char> foreign = data;
+    foreign[0] = 'X';
+    ENSURE(!loaded.Deserialize(foreign.data(), foreign.size()));
+
+    const std::string fileName = "measure_test.snapshot";
+    ENSURE(dtree::SnapshotReport<ManualMeasure::Database>(fileName));
+    Snapshot fromFile;
+    ENSURE(fromFile.ReadFile(fileName));
+    std::remove(fileName.c_str());
+    ENSURE(find(fromFile, "SnapshotTest")->totalTicks == 1000);
+    ENSURE(!fromFile.ReadFile(fileName));
+
+    // the file keeps the extra values too, so the loaded snapshot has the same reports
+    std::ostringstream loadedCsvReport;
+    loaded.CsvReport(loadedCsvReport);
+    std::ostringstream csvReport;
+    snapshot.CsvReport(csvReport);
+    ENSURE(loadedCsvReport.str() == csvReport.str());
+
+    // a record without extra values has no optional columns
+    Snapshot plain = loaded;
+    plain.records.assign(1, *find(loaded, "SnapshotTest"));
+    std::ostringstream report;
+    plain.PrintReport(report);
+    ENSURE(report.str().find("SnapshotTest           4            1'000              250\n") != std::string::npos);
+    csvReport.str("");
+    plain.CsvReport(csvReport);
+    ENSURE(csvReport.str() == "name,num_calls,total_ns,average_ns\nSnapshotTest,4,1000.000000,250.000000\n");
+
+    // the reports of the database are rendered from a snapshot
+    std::ostringstream databaseCsvReport;
+    dtree::CsvReport<ManualMeasure::Database>(databaseCsvReport);
+    csvReport.str("");
+    snapshot.CsvReport(csvReport);
+    ENSURE(csvReport.str() == databaseCsvReport.str());
+
+    // the diff matches the records by name
+    Snapshot before = snapshot;
+    before.records.erase(before.records.begin(), before.records.end() - 2);
+    before.records.back().name = "SnapshotTest_removed";
+    before.records.back().numCall = 3;
+    before.records.front().numCall = 2;
+    before.records.front().totalTicks = 200;
+    Snapshot after = snapshot;
+    after.records.erase(after.records.begin(), after.records.end() - 2);
+    after.records.back().name = "SnapshotTest_new";
+    std::ostringstream diff;
+    Snapshot::PrintDiff(diff, before, after);
+    ENSURE(diff.str().find("SnapshotTest           4          +2              250             +150") != std::string::npos);
+    ENSURE(diff.str().find("SnapshotTest_new (new)") != std::string::npos);
+    ENSURE(diff.str().find("SnapshotTest_removed (removed)           0          -3") != std::string::npos);
+
+    // fewer calls, a faster average by less than 1 ns, and a title longer than the line
+    before.records.front().numCall = 5;
+    before.records.front().totalTicks = 1252;
+    after.title = std::string(120, 'x');
+    diff.str("");
+    Snapshot::PrintDiff(diff, before, after);
+    ENSURE(diff.str().find(" " + after.title + " difference \n") == 0);
+    ENSURE(diff.str().find("SnapshotTest           4          -1              250               -0") != std::string::npos);
+
+    ManualMeasure::Database::ResetAll();
 }
 
-void PerformanceTest()
+// the merged snapshots are the same as if one process had made all the calls, in any merge order
+void MergeTest()
 {
-    std::cout << "time consumptions: \n";
+    using Snapshot = dtree::MeasureSnapshot;
+    auto makeSnapshot = [](const std::vector<uint64_t>& values, const char* otherName, double secondsPerTick)
+    {
+        Snapshot snapshot;
+        snapshot.title = "MergeTest";
+        snapshot.secondsPerTick = secondsPerTick;
+        Snapshot::Record record;
+        record.name = "MergeTest";
+        dtree::MeasureHistogram histogram;
+        for (const uint64_t value : values)
+        {
+            record.totalTicks += int64_t(value);
+            ++record.numCall;
+            histogram.Add<false>(value);
+            record.stats.Add(value);
+        }
+        histogram.CopyTo(record.histogram);
+        record.hasHistogram = record.hasStats = true;
+        record.bytes = 1000;
+        snapshot.records.push_back(record);
+        Snapshot::Record other;
+        other.name = otherName;
+        other.numCall = 1;
+        other.totalTicks = 10;
+        snapshot.records.push_back(other);
+        return snapshot;
+    };
+    const std::vector<Snapshot> snapshots = {
+        makeSnapshot({ 100, 200, 300 }, "MergeTest_a", 1e-9),
+        makeSnapshot({ 1000, 5000 }, "MergeTest_b", 1e-9),
+        makeSnapshot({ 50 }, "MergeTest_a", 1e-9) };
 
-    // the dummy measure always returns 0 as run time
-    using DummyMeasure = dtree::TMeasure<dtree::MeasureBackend>;
-    PerformanceTestTemplate<DummyMeasure::Base>("DummyMeasure::Base");
-    PerformanceTestTemplate<DummyMeasure::TSafe>("DummyMeasure::TSafe");
-    PerformanceTestTemplate<DummyMeasure::RSafe>("DummyMeasure::RSafe");
-    PerformanceTestTemplate<DummyMeasure::TRSafe>("DummyMeasure::TRSafe");
+    // the binary form keeps the extra values
+    for (const Snapshot& snapshot : snapshots)
+    {
+        const std::vector<char> data = snapshot.Serialize();
+        Snapshot loaded;
+        ENSURE(loaded.Deserialize(data.data(), data.size()));
+        const Snapshot::Record& record = loaded.records[0];
+        ENSURE(record.hasHistogram && record.hasStats && record.bytes == 1000 && !loaded.records[1].hasHistogram);
+        ENSURE(record.histogram.buckets == snapshot.records[0].histogram.buckets && record.histogram.maxValue == snapshot.records[0].histogram.maxValue);
+        ENSURE(record.stats.GetCount() == snapshot.records[0].stats.GetCount() && record.stats.GetM2() == snapshot.records[0].stats.GetM2());
+        ENSURE(!loaded.Deserialize(data.data(), data.size() - loaded.records[1].name.size() - loaded.title.size() - 1));
+    }
 
-    PerformanceTestTemplate<dtree::CppMeasure::Base>("CppMeasure::Base");
-    PerformanceTestTemplate<dtree::CppMeasure::TSafe>("CppMeasure::TSafe");
-    PerformanceTestTemplate<dtree::CppMeasure::RSafe>("CppMeasure::RSafe");
-    PerformanceTestTemplate<dtree::CppMeasure::TRSafe>("CppMeasure::TRSafe");
+    // the files of the previous version have no extra values
+    Snapshot plain = snapshots[0];
+    plain.records.resize(1);
+    plain.records[0] = snapshots[0].records[1];
+    std::vector<char> previous = plain.Serialize();
+    Snapshot::FileHeader header;
+    memcpy(&header, previous.data(), sizeof(header));
+    ENSURE(header.extraSize == 0);
+    header.version = 2;
+    memcpy(previous.data(), &header, sizeof(header));
+    Snapshot loaded;
+    ENSURE(loaded.Deserialize(previous.data(), previous.size()) && loaded.records[0].name == "MergeTest_a" && loaded.records[0].numCall == 1);
 
-#if MEASURE_WINDOWS
-    PerformanceTestTemplate<dtree::QPCMeasure::Base>("QPCMeasure::Base");
-    PerformanceTestTemplate<dtree::QPCMeasure::TSafe>("QPCMeasure::TSafe");
-    PerformanceTestTemplate<dtree::QPCMeasure::RSafe>("QPCMeasure::RSafe");
-    PerformanceTestTemplate<dtree::QPCMeasure::TRSafe>("QPCMeasure::TRSafe");
+    dtree::MeasureMerge merge;
+    for (size_t i = 0; i < snapshots.size(); ++i)
+        merge.Add(snapshots[i], i);
+    const Snapshot merged = merge.GetSnapshot();
+    ENSURE(merge.GetSourceCount() == 3 && merged.title == "MergeTest" && merged.records.size() == 3);
+    ENSURE(merged.records[0].name == "MergeTest" && merged.records[1].name == "MergeTest_a" && merged.records[2].name == "MergeTest_b");
+
+    const Snapshot all = makeSnapshot({ 100, 200, 300, 1000, 5000, 50 }, "", 1e-9);
+    const Snapshot::Record& record = merged.records[0];
+    ENSURE(record.numCall == 6 && record.totalTicks == all.records[0].totalTicks && record.bytes == 3000);
+    ENSURE(record.histogram.buckets == all.records[0].histogram.buckets && record.histogram.maxValue == 5000);
+    ENSURE(record.histogram.GetPercentile(0.5) == all.records[0].histogram.GetPercentile(0.5));
+    ENSURE(record.stats.GetCount() == 6 && record.stats.GetMin() == 50 && record.stats.GetMax() == 5000);
+    ENSURE(std::abs(record.stats.GetStdDev() - all.records[0].stats.GetStdDev()) < 1e-6);
+    ENSURE(merged.records[1].numCall == 2 && merged.records[1].totalTicks == 20);
+
+    // the sources of the smallest and the largest average
+    const std::vector<dtree::MeasureMerge::Spread> spreads = merge.GetSpreads();
+    ENSURE(spreads[0].sourceCount == 3 && spreads[0].minSource == 2 && spreads[0].maxSource == 1);
+    ENSURE(std::abs(spreads[0].minAverageSec - 50e-9) < 1e-15 && std::abs(spreads[0].maxAverageSec - 3000e-9) < 1e-15);
+    ENSURE(spreads[1].sourceCount == 2 && spreads[2].sourceCount == 1);
+
+    // the partial merges give the same result
+    dtree::MeasureMerge first, second;
+    second.Add(snapshots[2], 2);
+    first.Add(snapshots[1], 1);
+    first.Add(snapshots[0], 0);
+    second.Add(first);
+    const Snapshot partial = second.GetSnapshot();
+    ENSURE(partial.records.size() == 3 && partial.records[0].name == "MergeTest" && partial.records[2].name == "MergeTest_b");
+    ENSURE(partial.records[0].histogram.buckets == record.histogram.buckets && partial.records[0].totalTicks == record.totalTicks);
+    ENSURE(second.GetSpreads()[0].minSource == 2);
+
+    // the ticks of another length are converted
+    merge.Add(makeSnapshot({ 200 }, "MergeTest_a", 0.5e-9), 3);
+    const Snapshot convertedSnapshot = merge.GetSnapshot();
+    const Snapshot::Record& converted = convertedSnapshot.records[0];
+    ENSURE(converted.numCall == 7 && converted.totalTicks == record.totalTicks + 100 && converted.stats.GetMin() == 50);
+    ENSURE(converted.histogram.GetTotalCount() == 7);
+
+    std::ostringstream report;
+    merge.PrintReport(report, { "first", "second", "third", "fourth" });
+    ENSURE(report.str().find("MergeTest, 4 snapshots merged") != std::string::npos);
+    ENSURE(report.str().find("           MergeTest         4               50            3'000                         third                        second\n") != std::string::npos);
+    std::ostringstream csvReport;
+    merge.CsvReport(csvReport, { "first", "second", "third", "fourth" });
+    ENSURE(csvReport.str().find("\n\nname,sources,min_average_ns,max_average_ns,min_source,max_source\nMergeTest,4,50.000000,3000.000000,third,second\n") != std::string::npos);
+}
+
+// the regressions are the significant slowdowns above the threshold, sorted by the time they cost
+void DiffTest()
+{
+    using Snapshot = dtree::MeasureSnapshot;
+    using Status = dtree::MeasureDiff::Status;
+    auto addRecord = [](Snapshot& snapshot, const char* name, const std::vector<uint64_t>& values, size_t repeat, bool withStats, bool withHistogram)
+    {
+        Snapshot::Record record;
+        record.name = name;
+        dtree::MeasureHistogram histogram;
+        for (size_t i = 0; i < repeat; ++i)
+            for (const uint64_t value : values)
+            {
+                record.totalTicks += int64_t(value);
+                ++record.numCall;
+                record.stats.Add(value);
+                histogram.Add<false>(value);
+            }
+        record.hasStats = withStats;
+        record.hasHistogram = withHistogram;
+        if (withHistogram)
+            histogram.CopyTo(record.histogram);
+        snapshot.records.push_back(record);
+    };
+
+    Snapshot before, after;
+    before.title = after.title = "DiffTest";
+    before.secondsPerTick = after.secondsPerTick = 1e-9;
+    addRecord(before, "DiffTest_fast", { 200 }, 50, true, false);
+    addRecord(after, "DiffTest_fast", { 100 }, 50, true, false);
+    addRecord(before, "DiffTest_hot", { 90, 110 }, 500, true, false);
+    addRecord(after, "DiffTest_hot", { 108, 132 }, 500, true, false);
+    addRecord(before, "DiffTest_noisy", { 10, 1000 }, 50, true, false);
+    addRecord(after, "DiffTest_noisy", { 10, 1060 }, 50, true, false);
+    addRecord(before, "DiffTest_plain", { 100 }, 10, false, false);
+    addRecord(after, "DiffTest_plain", { 110 }, 10, false, false);
+    addRecord(before, "DiffTest_histogram", { 1000, 1100 }, 100, false, true);
+    addRecord(after, "DiffTest_histogram", { 1500, 1600 }, 100, false, true);
+    addRecord(before, "DiffTest_removed", { 100 }, 1, false, false);
+    addRecord(after, "DiffTest_new", { 100 }, 1, false, false);
+
+    const dtree::MeasureDiff diff = dtree::MeasureDiff::Compare(before, after);
+    ENSURE(diff.HasRegression() && diff.entries.size() == 7);
+    const char* order[] = { "DiffTest_histogram", "DiffTest_hot", "DiffTest_noisy", "DiffTest_plain", "DiffTest_fast", "DiffTest_new", "DiffTest_removed" };
+    const Status statuses[] = { Status::Regression, Status::Regression, Status::Same, Status::Regression, Status::Improved, Status::New, Status::Removed };
+    for (size_t i = 0; i < diff.entries.size(); ++i)
+        ENSURE(diff.entries[i].name == order[i] && diff.entries[i].status == statuses[i]);
+
+    const dtree::MeasureDiff::Entry& hot = diff.entries[1];
+    ENSURE(hot.callsBefore == 1000 && hot.callsAfter == 1000 && std::abs(hot.changePercent - 20) < 1e-9);
+    ENSURE(std::abs(hot.impactSec - 20e-6) < 1e-12 && hot.hasZScore && hot.zScore > 3 && !hot.hasPercentiles);
+    ENSURE(diff.entries[0].hasPercentiles && diff.entries[0].hasZScore && diff.entries[0].p50AfterSec > diff.entries[0].p50BeforeSec);
+    ENSURE(diff.entries[2].hasZScore && diff.entries[2].zScore < 1 && !diff.entries[3].hasZScore);
+    ENSURE(std::isinf(diff.entries[4].zScore) && diff.entries[4].zScore < 0);
+
+    // the options
+    dtree::MeasureDiffOptions options;
+    options.thresholdPercent = 60;
+    ENSURE(!dtree::MeasureDiff::Compare(before, after, options).HasRegression());
+    options = dtree::MeasureDiffOptions();
+    options.minCalls = 20;
+    ENSURE(dtree::MeasureDiff::Compare(before, after, options).entries[3].status == Status::NotJudged);
+
+    std::ostringstream report;
+    diff.PrintReport(report, after.title);
+    ENSURE(report.str().find(" DiffTest difference ") != std::string::npos);
+    ENSURE(report.str().find("                            DiffTest_hot        1000          +0          +20'000           120           +20    +20.0%          +20'000") != std::string::npos);
+    ENSURE(report.str().find("REGRESSION\n") != std::string::npos);
+    std::ostringstream csvReport;
+    diff.CsvReport(csvReport);
+    ENSURE(csvReport.str().find("name,status,calls_before,calls_after,total_before_ns,total_after_ns,average_before_ns,average_after_ns,"
+                                "average_change_percent,impact_ns,p50_before_ns,p50_after_ns,p99_before_ns,p99_after_ns,z_score\n") == 0);
+    ENSURE(csvReport.str().find("\nDiffTest_plain,REGRESSION,10,10,1000.000000,1100.000000,100.000000,110.000000,10.000000,100.000000,,,,,\n") != std::string::npos);
+    ENSURE(csvReport.str().find("\nDiffTest_fast,improved,50,50,10000.000000,5000.000000,200.000000,100.000000,-50.000000,-5000.000000,,,,,-inf\n") != std::string::npos);
+}
+
+// the snapshot reads the time and the number of calls of a record together, while the threads are adding calls of 10 ticks
+template<typename Policy>
+void ConsistentSnapshotTestTemplate(const char* name, int64_t tolerance)
+{
+    static typename Policy::MeasureRecord record(name);
+    const std::vector<typename Policy::MeasureRecord*> records(1, &record);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i)
+        threads.emplace_back([&stop]()
+        {
+            while (!stop.load(std::memory_order_relaxed))
+                record.AddTime(10);
+        });
+    for (int i = 0; i < 2000; ++i)
+    {
+        const dtree::MeasureSnapshot snapshot = dtree::MeasureSnapshot::FromRecords(records);
+        const int64_t difference = snapshot.records[0].totalTicks - 10 * int64_t(snapshot.records[0].numCall);
+        ENSURE(difference >= -tolerance && difference <= tolerance);
+    }
+    stop.store(true);
+    for (std::thread& thread : threads)
+        thread.join();
+    record.Reset();
+}
+
+void ConsistentSnapshotTest()
+{
+    ConsistentSnapshotTestTemplate<ManualMeasure::TSafe>("ConsistentSnapshotTest_TSafe", 0);
+    ConsistentSnapshotTestTemplate<ManualMeasure::Sharded>("ConsistentSnapshotTest_Sharded", 0);
+    // the shared atomic counters may differ by the calls in progress, at most one per thread
+    ConsistentSnapshotTestTemplate<ManualMeasure::Atomic>("ConsistentSnapshotTest_Atomic", 3 * 10);
+}
+
+// a backend of its own, so ResetAll doesn't touch the records of the other tests
+struct ResetRaceBackend : public ManualBackend
+{
+    inline static const char* GetMeasureTitle() { return "reset race ticks"; }
+};
+
+using ResetRaceMeasure = dtree::TMeasure<ResetRaceBackend>;
+
+// the snapshots don't see a baseline newer than the counters, while ResetAll runs concurrently
+void ResetSnapshotTest()
+{
+    static ResetRaceMeasure::Sharded::MeasureRecord shardedRecord("ResetSnapshotTest_Sharded");
+    static ResetRaceMeasure::TRSharded::MeasureRecord trShardedRecord("ResetSnapshotTest_TRSharded");
+    static ResetRaceMeasure::CallTree::MeasureRecord treeRecord("ResetSnapshotTest_tree");
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i)
+        threads.emplace_back([&stop]()
+        {
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                shardedRecord.AddTime(10);
+                trShardedRecord.AddTime(10);
+                trShardedRecord.AddWork(1, 2);
+                ResetRaceMeasure::CallTree::Scope scope(&treeRecord);
+            }
+        });
+    threads.emplace_back([&stop]()
+    {
+        while (!stop.load(std::memory_order_relaxed))
+            ResetRaceMeasure::Database::ResetAll();
+    });
+
+    const uint64_t maxCalls = uint64_t(1) << 40;
+    using ReportNode = ResetRaceMeasure::MeasureRecordBase::Tree::ReportNode;
+    for (int i = 0; i < 2000; ++i)
+    {
+        const dtree::MeasureSnapshot snapshot = ResetRaceMeasure::Database::Snapshot();
+        for (const dtree::MeasureSnapshot::Record& record : snapshot.records)
+        {
+            ENSURE(record.numCall < maxCalls && record.bytes < maxCalls && record.items < maxCalls);
+            if (record.name != "ResetSnapshotTest_tree")
+                ENSURE(record.totalTicks == 10 * int64_t(record.numCall));
+        }
+        const ReportNode root = ResetRaceMeasure::MeasureRecordBase::Tree::GetReportTree();
+        for (const ReportNode& child : root.children)
+            ENSURE(child.numCall < maxCalls);
+    }
+    stop.store(true);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void OpenMetricsTest()
+{
+    // 4 calls of 250 ns and 1 call of 2 us
+    static ManualMeasure::Histogram::MeasureRecord record("OpenMetricsTest");
+    static ManualMeasure::Base::MeasureRecord quotedRecord("OpenMetricsTest \"quoted\"\\path");
+    for (int i = 0; i < 5; ++i)
+    {
+        ManualMeasure::Histogram::Scope scope(&record);
+        ManualBackend::Now() += i < 4 ? 250 : 2000;
+    }
+    const std::vector<ManualMeasure::Base::MeasureRecord*> records = { &record, &quotedRecord };
+
+    std::ostringstream os;
+    dtree::MeasureOpenMetrics::Render(os, dtree::MeasureSnapshot::FromRecords(records));
+    const std::string text = os.str();
+    ENSURE(text.find("# TYPE measure_seconds counter\n# UNIT measure_seconds seconds\n") == 0);
+    ENSURE(text.find("\nmeasure_seconds_total{name=\"OpenMetricsTest\"} 3e-06\n") != std::string::npos);
+    ENSURE(text.find("\n# TYPE measure_calls counter\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_calls_total{name=\"OpenMetricsTest\"} 5\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_calls_total{name=\"OpenMetricsTest \\\"quoted\\\"\\\\path\"} 0\n") != std::string::npos);
+
+    // the bucket of 250 ns is [240, 255] ns, it is counted only where the whole bucket is below the bound
+    ENSURE(text.find("\n# TYPE measure_duration_seconds histogram\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_duration_seconds_bucket{name=\"OpenMetricsTest\",le=\"2.5e-07\"} 0\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_duration_seconds_bucket{name=\"OpenMetricsTest\",le=\"5e-07\"} 4\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_duration_seconds_bucket{name=\"OpenMetricsTest\",le=\"1e-06\"} 4\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_duration_seconds_bucket{name=\"OpenMetricsTest\",le=\"2.5e-06\"} 5\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_duration_seconds_bucket{name=\"OpenMetricsTest\",le=\"+Inf\"} 5\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_duration_seconds_count{name=\"OpenMetricsTest\"} 5\n") != std::string::npos);
+    ENSURE(text.find("\nmeasure_duration_seconds_sum{name=\"OpenMetricsTest\"} 3e-06\n") != std::string::npos);
+    ENSURE(text.find("duration_seconds_bucket{name=\"OpenMetricsTest \\\"quoted") == std::string::npos);
+    ENSURE(text.size() > 6 && text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+
+    // the records of the same name are one series: 3 more calls of 1 us without histogram
+    ManualMeasure::TSafe::MeasureRecord sameNameRecord("OpenMetricsTest", false);
+    for (int i = 0; i < 3; ++i)
+    {
+        ManualMeasure::TSafe::Scope scope(&sameNameRecord);
+        ManualBackend::Now() += 1000;
+    }
+    const std::vector<ManualMeasure::Base::MeasureRecord*> sameNameRecords = { &record, &sameNameRecord, &record };
+    std::ostringstream foldedOs;
+    dtree::MeasureOpenMetrics::Render(foldedOs, dtree::MeasureSnapshot::FromRecords(sameNameRecords));
+    const std::string folded = foldedOs.str();
+    const size_t seriesPos = folded.find("\nmeasure_calls_total{name=\"OpenMetricsTest\"} 13\n");
+    ENSURE(seriesPos != std::string::npos);
+    ENSURE(folded.find("\nmeasure_calls_total{", seriesPos + 1) == std::string::npos);
+    ENSURE(folded.find("\nmeasure_seconds_total{name=\"OpenMetricsTest\"} 9e-06\n") != std::string::npos);
+    ENSURE(folded.find("\nmeasure_duration_seconds_bucket{name=\"OpenMetricsTest\",le=\"5e-07\"} 8\n") != std::string::npos);
+    ENSURE(folded.find("\nmeasure_duration_seconds_count{name=\"OpenMetricsTest\"} 10\n") != std::string::npos);
+
+    ENSURE(dtree::MeasureOpenMetrics::MetricName("my-app.v2") == "my_app_v2");
+    ENSURE(dtree::MeasureOpenMetrics::MetricName("2x") == "_x");
+    record.Reset();
+}
+
+#if MEASURE_STATSD_IS_SUPPORTED
+void StatsdTest()
+{
+    using Statsd = dtree::MeasureStatsd;
+    dtree::MeasureInterval interval;
+    interval.records.push_back({ "StatsdTest", 0, 4, 1e-3, 400, 2.5e-4 });
+
+    std::vector<std::string> datagrams = Statsd::Format(interval);
+    ENSURE(datagrams.size() == 1);
+    ENSURE(datagrams[0] == "measure.StatsdTest.calls:4|c\nmeasure.StatsdTest.total_ms:1|c\nmeasure.StatsdTest.average_ms:0.25|g");
+
+    // DogStatsD tags, the reserved characters of the protocol are replaced
+    dtree::MeasureStatsdOptions options;
+    options.tags = true;
+    interval.records[0].name = "Statsd Test|#:";
+    datagrams = Statsd::Format(interval, options);
+    ENSURE(datagrams.size() == 1 && datagrams[0].find("measure.calls:4|c|#name:Statsd_Test___\n") == 0);
+
+    // the lines are batched into the datagrams up to the size limit
+    options.tags = false;
+    options.maxDatagramSize = 200;
+    for (int i = 0; i < 40; ++i)
+        interval.records.push_back({ "StatsdTest_" + std::to_string(i), 0, 1, 1e-3, 100, 1e-3 });
+    datagrams = Statsd::Format(interval, options);
+    size_t lineCount = 0;
+    for (const std::string& datagram : datagrams)
+    {
+        ENSURE(datagram.size() <= 200);
+        lineCount += size_t(std::count(datagram.begin(), datagram.end(), '\n')) + 1;
+    }
+    ENSURE(datagrams.size() > 1 && lineCount == 3 * 41);
+
+#if MEASURE_LINUX || MEASURE_MACOS
+    // send the datagrams to a local socket
+    const int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    ENSURE(receiver >= 0 && bind(receiver, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    ENSURE(getsockname(receiver, reinterpret_cast<sockaddr*>(&address), &addressLength) == 0);
+    timeval timeout = { 5, 0 };
+    setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    auto client = std::make_shared<Statsd>();
+    ENSURE(client->Open("127.0.0.1", ntohs(address.sin_port), options));
+    Statsd::Sink(client)(interval);
+    char buffer[2048];
+    const ssize_t received = recv(receiver, buffer, sizeof(buffer), 0);
+    ENSURE(received > 0 && std::string(buffer, size_t(received)) == datagrams[0]);
+    close(receiver);
+#endif
+}
 #endif
 
-#if RDTSC_MEASURE_IS_SUPPORTED
-    PerformanceTestTemplate<dtree::RdtscMeasure::Base>("RdtscMeasure::Base");
-    PerformanceTestTemplate<dtree::RdtscMeasure::TSafe>("RdtscMeasure::TSafe");
-    PerformanceTestTemplate<dtree::RdtscMeasure::RSafe>("RdtscMeasure::RSafe");
-    PerformanceTestTemplate<dtree::RdtscMeasure::TRSafe>("RdtscMeasure::TRSafe");
+#if MEASURE_SHARED_MEMORY_IS_SUPPORTED
+void SharedMemoryTest()
+{
+    using Export = dtree::MeasureSharedMemoryExport<ManualMeasure::Database>;
+    static ManualMeasure::Base::MeasureRecord record("SharedMemoryTest");
+    const std::string name = "dtree_measure_test";
+
+    auto read = [](const dtree::MeasureSharedMemory& memory, const std::string& recordName) -> uint64_t
+    {
+        std::vector<char> data;
+        dtree::MeasureSnapshot snapshot;
+        ENSURE(memory.Read(data) && snapshot.Deserialize(data.data(), data.size()));
+        for (const dtree::MeasureSnapshot::Record& snapshotRecord : snapshot.records)
+            if (snapshotRecord.name == recordName)
+                return snapshotRecord.numCall;
+        return UINT64_MAX;
+    };
+
+    dtree::MeasureSharedMemory reader;
+    ENSURE(!Export::Publish());
+    ENSURE(Export::Start(name, std::chrono::milliseconds(10000)));
+    ENSURE(!Export::Start(name));
+    ENSURE(Export::IsRunning());
+
+    // a second writer of the same name is rejected, it would wipe the segment of the first one
+    dtree::MeasureSharedMemory second;
+    ENSURE(!second.Create(name));
+
+    // the first snapshot is published immediately by the thread
+    ENSURE(reader.Open(name));
+    {
+        std::vector<char> data;
+        for (int i = 0; i < 1000 && !reader.Read(data); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ENSURE(read(reader, "SharedMemoryTest") == 0);
+
+    for (int i = 0; i < 3; ++i)
+        ManualMeasure::Base::Scope scope(&record);
+    ENSURE(Export::Publish());
+    ENSURE(read(reader, "SharedMemoryTest") == 3);
+
+    // the writer side is not writable by a reader, and a too big content is rejected
+    ENSURE(!reader.Write(std::vector<char>(10)));
+    dtree::MeasureSharedMemory small;
+    ENSURE(small.Create(name + "_small", 16));
+    ENSURE(small.Write(std::vector<char>(16)));
+    ENSURE(!small.Write(std::vector<char>(17)));
+    small.Close();
+
+    // the segment is removed by Stop, but the mapping of the reader remains valid
+    Export::Stop();
+    ENSURE(!Export::IsRunning());
+    ENSURE(read(reader, "SharedMemoryTest") == 3);
+    reader.Close();
+#if !MEASURE_WINDOWS
+    ENSURE(!reader.Open(name));
+    ENSURE(!reader.Open(name + "_small"));
 #endif
+
+    ManualMeasure::Database::ResetAll();
+}
+#endif
+
+void IntervalTest()
+{
+    using Reporter = dtree::MeasureIntervalReporter<ManualMeasure::Database>;
+    static ManualMeasure::Base::MeasureRecord record("IntervalTest");
+
+    std::vector<dtree::MeasureInterval> intervals;
+    auto find = [](const dtree::MeasureInterval& interval) -> const dtree::MeasureInterval::Record*
+    {
+        for (const dtree::MeasureInterval::Record& intervalRecord : interval.records)
+            if (intervalRecord.name == "IntervalTest")
+                return &intervalRecord;
+        return nullptr;
+    };
+    auto addCalls = [](int num, int64_t ticks)
+    {
+        for (int i = 0; i < num; ++i)
+        {
+            ManualMeasure::Base::Scope scope(&record);
+            ManualBackend::Now() += ticks;
+        }
+    };
+
+    ENSURE(!Reporter::Report());
+    ENSURE(Reporter::Start([&intervals](const dtree::MeasureInterval& interval) { intervals.push_back(interval); },
+                           std::chrono::milliseconds(3600000)));
+    ENSURE(!Reporter::Start(nullptr));
+
+    addCalls(5, 100);
+    ENSURE(Reporter::Report());
+    ENSURE(intervals.size() == 1 && intervals[0].seconds > 0);
+    const dtree::MeasureInterval::Record* delta = find(intervals[0]);
+    ENSURE(delta && delta->numCall == 5 && std::fabs(delta->totalSec - 500e-9) < 1e-15);
+    ENSURE(std::fabs(delta->averageSec - 100e-9) < 1e-15 && delta->callsPerSec > 0);
+
+    // only the calls of the interval, the cumulative counters are kept
+    addCalls(2, 300);
+    ENSURE(Reporter::Report());
+    delta = find(intervals[1]);
+    ENSURE(delta && delta->numCall == 2 && std::fabs(delta->averageSec - 300e-9) < 1e-15);
+    ENSURE(record.GetNumCall() == 7);
+
+    // the idle records are not listed
+    ENSURE(Reporter::Report());
+    ENSURE(find(intervals[2]) == nullptr);
+
+    // after a reset the current counters are the difference
+    ManualMeasure::Database::ResetAll();
+    addCalls(1, 50);
+    ENSURE(Reporter::Report());
+    delta = find(intervals[3]);
+    ENSURE(delta && delta->numCall == 1 && std::fabs(delta->totalSec - 50e-9) < 1e-15);
+
+    std::ostringstream report;
+    intervals[3].PrintReport(report);
+    ENSURE(report.str().find("Calls/sec") != std::string::npos);
+    ENSURE(report.str().find("IntervalTest           1") != std::string::npos);
+    std::ostringstream csvReport;
+    intervals[3].CsvReport(csvReport, true);
+    ENSURE(csvReport.str().find("timestamp_ms,name,num_calls,calls_per_sec,average_ns\n") == 0);
+    ENSURE(csvReport.str().find(",IntervalTest,1,") != std::string::npos);
+    ENSURE(!(csvReport.flags() & std::ios::fixed));
+
+    // a title longer than the line
+    dtree::MeasureInterval longTitle = intervals[3];
+    longTitle.title = std::string(100, 'x');
+    report.str("");
+    longTitle.PrintReport(report);
+    ENSURE(report.str().find(" " + longTitle.title + " in the last ") == 0);
+
+    // the reset is known from the snapshots, even if there are more calls after it than before
+    ManualMeasure::Database::ResetAll();
+    addCalls(3, 20);
+    ENSURE(Reporter::Report());
+    delta = find(intervals[4]);
+    ENSURE(delta && delta->numCall == 3 && std::fabs(delta->totalSec - 60e-9) < 1e-15);
+
+    Reporter::Stop();
+    ENSURE(!Reporter::IsRunning() && !Reporter::Report());
+
+    // a slow sink doesn't block the reporter
+    {
+        std::mutex sinkMutex;
+        std::condition_variable sinkCv;
+        bool inSink = false;
+        bool release = false;
+        ENSURE(Reporter::Start([&](const dtree::MeasureInterval&)
+            {
+                std::unique_lock<std::mutex> lock(sinkMutex);
+                inSink = true;
+                sinkCv.notify_all();
+                sinkCv.wait(lock, [&release]() { return release; });
+            }, std::chrono::milliseconds(3600000)));
+        std::thread reporting([]() { Reporter::Report(); });
+        {
+            std::unique_lock<std::mutex> lock(sinkMutex);
+            ENSURE(sinkCv.wait_for(lock, std::chrono::seconds(10), [&inSink]() { return inSink; }));
+        }
+        ENSURE(Reporter::IsRunning());
+        {
+            const std::lock_guard<std::mutex> lock(sinkMutex);
+            release = true;
+        }
+        sinkCv.notify_all();
+        reporting.join();
+        Reporter::Stop();
+    }
+
+    // the background thread reports in every interval
+    std::mutex mutex;
+    std::condition_variable cv;
+    int reportNum = 0;
+    ENSURE(Reporter::Start([&](const dtree::MeasureInterval&)
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            ++reportNum;
+            cv.notify_all();
+        }, std::chrono::milliseconds(10)));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ENSURE(cv.wait_for(lock, std::chrono::seconds(10), [&reportNum]() { return reportNum >= 2; }));
+    }
+    Reporter::Stop();
+
+    ManualMeasure::Database::ResetAll();
+}
+
+void CalibrationTest()
+{
+    // an empty scope is exactly 1 tick long with the counting backend, without noise
+    ENSURE(CountingMeasure::Calibrate<CountingMeasure::TSafe>(1000, 5) == 1.0);
+
+    // a switched off measurement doesn't overwrite the overhead, and the repeated calibration reuses its record
+    dtree::MeasureControl::SetEnabled(false);
+    ENSURE(CountingMeasure::Calibrate<CountingMeasure::TSafe>(1000, 5) == 0.0);
+    dtree::MeasureControl::SetEnabled(true);
+    for (int i = 0; i < 5000; ++i)
+        CountingMeasure::Calibrate<CountingMeasure::TRSharded>(1, 1);
+
+    // every scope is 1 tick + 10 ticks of work
+    static CountingMeasure::TSafe::MeasureRecord record("CalibrationTest");
+    for (int i = 0; i < 100; ++i)
+    {
+        CountingMeasure::TSafe::Scope scope(&record);
+        for (int j = 0; j < 10; ++j)
+            CountingBackend::GetTick();
+    }
+    static CountingMeasure::TSafe::MeasureRecord emptyRecord("CalibrationTest_empty");
+    for (int i = 0; i < 100; ++i)
+        CountingMeasure::TSafe::Scope scope(&emptyRecord);
+
+    double netTotalSec, netAverageSec;
+    bool withinNoise;
+    ENSURE(record.GetOverheadTicks() == 1.0 && record.GetOverheadNoiseTicks() == 0.0);
+    ENSURE(record.GetNetTime(record.GetTotalSec(), record.GetNumCall(), netTotalSec, netAverageSec, withinNoise));
+    ENSURE(netTotalSec == 1000.0 && netAverageSec == 10.0 && !withinNoise);
+    ENSURE(emptyRecord.GetNetTime(emptyRecord.GetTotalSec(), emptyRecord.GetNumCall(), netTotalSec, netAverageSec, withinNoise));
+    ENSURE(netTotalSec == 0.0 && withinNoise);
+
+    // every record type has its own overhead
+    static CountingMeasure::Base::MeasureRecord baseRecord("CalibrationTest_base");
+    {
+        CountingMeasure::Base::Scope scope(&baseRecord);
+    }
+    ENSURE(baseRecord.GetOverheadTicks() == 0.0);
+    ENSURE(!baseRecord.GetNetTime(baseRecord.GetTotalSec(), baseRecord.GetNumCall(), netTotalSec, netAverageSec, withinNoise));
+
+    std::ostringstream report;
+    CountingMeasure::Database::PrintReport(report);
+    ENSURE(report.str().find("Net average (ns)") != std::string::npos);
+
+    std::ostringstream csvReport;
+    dtree::CsvReport<CountingMeasure::Database>(csvReport);
+    ENSURE(csvReport.str().find(",net_total_ns,net_average_ns,within_noise\n") != std::string::npos);
+    ENSURE(csvReport.str().find("\nCalibrationTest_empty,100,") != std::string::npos);
+}
+
+void BenchmarkTest()
+{
+    using Benchmark = dtree::TMeasureBenchmark<ManualBackend>;
+
+    // every iteration is 10 ticks, the 3rd repetition has a spike of 100000 ticks
+    uint64_t calls = 0;
+    uint64_t spikeAt = 0;
+    auto body = [&calls, &spikeAt](uint64_t iterations)
+    {
+        ++calls;
+        ManualBackend::Now() += int64_t(iterations) * 10;
+        if (calls == spikeAt)
+            ManualBackend::Now() += 100000;
+    };
+
+    dtree::MeasureBenchmarkOptions options;
+    options.minSec = 0.9e-6;    // 900 ticks
+    options.warmupSec = 0;
+    options.repetitions = 7;
+
+    // the scaling runs: 1, 10, 100 iterations
+    spikeAt = 3 + 3;
+    const Benchmark::Result result = Benchmark::RunBody("BenchmarkTest_manual", body, options);
+    ENSURE(result.name == "BenchmarkTest_manual");
+    ENSURE(result.iterations == 100);
+    ENSURE(calls == 3 + 7);
+    ENSURE(result.outliers == 1 && result.repetitions == 6);
+    ENSURE(std::fabs(result.medianSec - 10e-9) < 1e-15);
+    ENSURE(result.madSec < 1e-15);
+    ENSURE(std::fabs(result.maxSec - 10e-9) < 1e-15);
+
+    // the registered functions, the function is called once per iteration
+    uint64_t sum = 0;
+    Benchmark::Register("BenchmarkTest_sum", [&sum]()
+    {
+        ++sum;
+        dtree::DoNotOptimize(sum);
+        ManualBackend::Now() += 5;
+    });
+    Benchmark::Register("BenchmarkTest_other", []() { ManualBackend::Now() += 1; });
+    const std::vector<Benchmark::Result> results = Benchmark::RunAll(options, "_sum");
+    ENSURE(results.size() == 1 && results[0].name == "BenchmarkTest_sum");
+    ENSURE(results[0].outliers == 0 && std::fabs(results[0].medianSec - 5e-9) < 1e-15);
+    ENSURE(sum == results[0].iterations * (options.repetitions + 1) + 1 + 10 + 100);
+
+    std::ostringstream csvReport;
+    Benchmark::CsvReport(csvReport, results);
+    ENSURE(csvReport.str().find("name,iterations,repetitions,outliers,median_ns,mad_ns,min_ns,max_ns\n") == 0);
+    ENSURE(csvReport.str().find("\nBenchmarkTest_sum," + std::to_string(results[0].iterations) + ",7,0,5.000000,") != std::string::npos);
+
+    std::ostringstream report;
+    Benchmark::PrintReport(report, results);
+    ENSURE(report.str().find("BenchmarkTest_sum") != std::string::npos && report.str().find("       5.000") != std::string::npos);
+    ENSURE(!(report.flags() & std::ios::fixed) && report.precision() == 6 && !(csvReport.flags() & std::ios::fixed));
 }
 
 int main()
 {
     using namespace std;
 
+#if RDTSC_MEASURE_IS_SUPPORTED
+    // GetProcessorFrequency won't block for the measurement
+    dtree::MeasureUtils::TscCalibration::Start();
+#endif
+
     cout << "GetProcessorFrequency ...\n";
     uint64_t freq = dtree::MeasureUtils::GetProcessorFrequency(2);
     cout << "processor frquency= " << fixed << setprecision(2) << double(freq) / double(1000000) << " MHz\n";
+#if RDTSC_MEASURE_IS_SUPPORTED
+    cout << "invariant tsc= " << (dtree::MeasureUtils::HasInvariantTsc() ? "yes" : "no")
+         << ", known tsc frequency= " << double(dtree::MeasureUtils::GetKnownTscFrequency()) / double(1000000) << " MHz\n";
+#endif
 
 #if MEASURE_WINDOWS
     uint64_t qpcFreq = dtree::QPCBackend::GetFrequency();
@@ -211,6 +1923,9 @@ int main()
 #if RDTSC_MEASURE_IS_SUPPORTED
     cout << "RDTSCTest\n";
     RDTSCTest();
+
+    cout << "TscCalibrationTest\n";
+    TscCalibrationTest();
 #endif
 
 #if MEASURE_WINDOWS
@@ -218,8 +1933,102 @@ int main()
     QPCTest();
 #endif
 
-    cout << "PerformanceTest\n";
-    PerformanceTest();
+#if ARM64_MEASURE_IS_SUPPORTED
+    cout << "Arm64Test\n";
+    Arm64Test();
+#endif
+
+#if MEASURE_LINUX
+    cout << "LinuxTest\n";
+    LinuxTest();
+#endif
+
+#if PERF_MEASURE_IS_SUPPORTED
+    cout << "PerfTest\n";
+    PerfTest();
+#endif
+
+    cout << "ShardedTest\n";
+    ShardedTest();
+
+    cout << "AtomicTest\n";
+    AtomicTest();
+
+    cout << "SamplingTest\n";
+    SamplingTest();
+
+    cout << "NameTest\n";
+    NameTest();
+
+    cout << "ArenaTest\n";
+    ArenaTest();
+
+    cout << "DynamicRecordTest\n";
+    DynamicRecordTest();
+
+    cout << "ThreadRecursionTest\n";
+    ThreadRecursionTest();
+
+    cout << "HistogramTest\n";
+    HistogramTest();
+
+    cout << "StatsTest\n";
+    StatsTest();
+
+    cout << "WorkTest\n";
+    WorkTest();
+
+    cout << "FormatTest\n";
+    FormatTest();
+
+    cout << "TokenTest\n";
+    TokenTest();
+
+    cout << "CpuTest\n";
+    CpuTest();
+
+    cout << "TreeTest\n";
+    TreeTest();
+
+    cout << "TraceTest\n";
+    TraceTest();
+
+    cout << "SnapshotTest\n";
+    SnapshotTest();
+
+    cout << "MergeTest\n";
+    MergeTest();
+
+    cout << "DiffTest\n";
+    DiffTest();
+
+    cout << "ConsistentSnapshotTest\n";
+    ConsistentSnapshotTest();
+
+    cout << "ResetSnapshotTest\n";
+    ResetSnapshotTest();
+
+    cout << "OpenMetricsTest\n";
+    OpenMetricsTest();
+
+#if MEASURE_STATSD_IS_SUPPORTED
+    cout << "StatsdTest\n";
+    StatsdTest();
+#endif
+
+#if MEASURE_SHARED_MEMORY_IS_SUPPORTED
+    cout << "SharedMemoryTest\n";
+    SharedMemoryTest();
+#endif
+
+    cout << "IntervalTest\n";
+    IntervalTest();
+
+    cout << "CalibrationTest\n";
+    CalibrationTest();
+
+    cout << "BenchmarkTest\n";
+    BenchmarkTest();
 
     cout << "reports:\n";
     dtree::CppMeasure::Database::PrintReport();
@@ -228,6 +2037,18 @@ int main()
     dtree::RdtscMeasure::Database::PrintReport();
 #endif
 
+#if ARM64_MEASURE_IS_SUPPORTED
+    dtree::Arm64Measure::Database::PrintReport();
+#endif
+
+#if MEASURE_LINUX
+    dtree::LinuxMeasure::Database::PrintReport();
+#endif
+
+#if PERF_MEASURE_IS_SUPPORTED
+    dtree::PerfMeasure::Database::PrintReport();
+#endif
+
 #if MEASURE_WINDOWS
     dtree::QPCMeasure::Database::PrintReport();
 #endif
@@ -238,22 +2059,3 @@ int main()
     return 0;
 }
 
-/*
-time consumptions, core i5 @ 3.2GHz, VS2022:
-    DummyMeasure::Base: ~ -0.003 ns/call, ~  -0.0 clock/call, ~ ??? call/sec
-   DummyMeasure::TSafe: ~ 16.530 ns/call, ~  52.9 clock/call, ~ 60496941.5 call/sec
-   DummyMeasure::RSafe: ~  1.179 ns/call, ~   3.8 clock/call, ~ 848047272.1 call/sec
-  DummyMeasure::TRSafe: ~ 62.771 ns/call, ~ 200.8 clock/call, ~ 15930940.5 call/sec
-      CppMeasure::Base: ~ 31.490 ns/call, ~ 100.7 clock/call, ~ 31756495.2 call/sec
-     CppMeasure::TSafe: ~ 51.182 ns/call, ~ 163.7 clock/call, ~ 19538144.3 call/sec
-     CppMeasure::RSafe: ~ 30.757 ns/call, ~  98.4 clock/call, ~ 32512774.7 call/sec
-    CppMeasure::TRSafe: ~ 97.524 ns/call, ~ 311.9 clock/call, ~ 10253889.3 call/sec
-      QPCMeasure::Base: ~ 24.475 ns/call, ~  78.3 clock/call, ~ 40857818.0 call/sec
-     QPCMeasure::TSafe: ~ 44.064 ns/call, ~ 140.9 clock/call, ~ 22694032.5 call/sec
-     QPCMeasure::RSafe: ~ 25.006 ns/call, ~  80.0 clock/call, ~ 39990870.7 call/sec
-    QPCMeasure::TRSafe: ~ 90.124 ns/call, ~ 288.2 clock/call, ~ 11095829.0 call/sec
-    RdtscMeasure::Base: ~ 10.533 ns/call, ~  33.7 clock/call, ~ 94941924.7 call/sec
-   RdtscMeasure::TSafe: ~ 30.258 ns/call, ~  96.8 clock/call, ~ 33049643.3 call/sec
-   RdtscMeasure::RSafe: ~ 10.546 ns/call, ~  33.7 clock/call, ~ 94821272.1 call/sec
-  RdtscMeasure::TRSafe: ~ 76.112 ns/call, ~ 243.4 clock/call, ~ 13138504.5 call/sec
-*/
@@ -0,0 +1,123 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Tests of the C++17/20 API (see measure_modern.h), the other tests are built with C++11 (see measure_test.cpp).
+
+#include "measure_test.h"
+#include "measure/measure_modern.h"
+#include <iostream>
+#include <string>
+#include <type_traits>
+
+#if MEASURE_MODERN_IS_SUPPORTED
+
+static_assert(std::is_same<dtree::MeasurePolicyOf<dtree::MeasurePolicy::TSafe, dtree::CppMeasure>, dtree::CppMeasure::TSafe>::value, "");
+static_assert(std::is_same<dtree::MeasurePolicyOf<dtree::MeasurePolicy::TRSharded>, dtree::Measure::TRSharded>::value, "");
+static_assert(std::is_same<dtree::MeasureRecordOf<dtree::MeasurePolicy::RSafe>::Scope, dtree::Measure::RSafe::Scope>::value, "");
+
+inline dtree::MeasureRecordOf<dtree::MeasurePolicy::TSafe> modernRecord{ MEASURE_NAME_LITERAL("ModernTest") };
+inline dtree::MeasureRecordOf<dtree::MeasurePolicy::RSafe> recursiveRecord{ MEASURE_NAME_LITERAL("ModernTest_recursive") };
+inline dtree::TMeasureRecordOf<dtree::Measure::WithStats<dtree::Measure::Sharded>> statsRecord{ "ModernTest_stats" };
+
+namespace
+{
+    bool IsRegistered(const std::string& name)
+    {
+        for (const auto* record : dtree::Measure::Database::GetRecords())
+            if (name == record->name)
+                return true;
+        return false;
+    }
+
+    uint64_t GetCalls(const dtree::Measure::Database::MeasureRecord& record)
+    {
+        dtree::Measure::Database::MeasureRecord::TimeDiff totalTime;
+        uint64_t numCall;
+        record.GetCounters(totalTime, numCall);
+        return numCall;
+    }
+
+    int Recursive(int depth)
+    {
+        dtree::MeasureScope scope(recursiveRecord);
+        return depth ? Recursive(depth - 1) + 1 : 0;
+    }
+
+#if MEASURE_SOURCE_LOCATION_IS_SUPPORTED
+    dtree::MeasureRecordOf<>& AutoNamedFunction()
+    {
+        static dtree::MeasureRecordOf<> record;
+        dtree::MeasureScope scope(record);
+        return record;
+    }
+#endif
+}
+
+// the namespace scope records are registered before main, the scopes are deduced from the records
+void ModernTest()
+{
+    ENSURE(IsRegistered("ModernTest") && IsRegistered("ModernTest_stats"));
+    for (int i = 0; i < 3; ++i)
+    {
+        dtree::MeasureScope scope(modernRecord);
+        scope.AddItems(2);
+    }
+    ENSURE(GetCalls(modernRecord) == 3 && modernRecord.nameId == dtree::MeasureUtils::ConstHashName("ModernTest"));
+    uint64_t bytes, items;
+    modernRecord.GetWork(bytes, items);
+    ENSURE(items == 6);
+
+    ENSURE(Recursive(4) == 4 && GetCalls(recursiveRecord) == 1);
+    {
+        dtree::MeasureScope scope(statsRecord);
+    }
+    ENSURE(GetCalls(statsRecord) == 1);
+    dtree::MeasureStats stats;
+    ENSURE(statsRecord.GetStats(stats) && stats.GetCount() == 1);
+
+#if MEASURE_SOURCE_LOCATION_IS_SUPPORTED
+    AutoNamedFunction();
+    dtree::MeasureRecordOf<>& autoRecord = AutoNamedFunction();
+    ENSURE(std::string(autoRecord.name).find("AutoNamedFunction") != std::string::npos && GetCalls(autoRecord) == 2);
+#endif
+}
+
+#if MEASURE_NAMED_SCOPE_IS_SUPPORTED
+// the records of the names are at namespace scope, one record per name and policy
+void NamedScopeTest()
+{
+    ENSURE(IsRegistered("NamedScopeTest"));
+    for (int i = 0; i < 2; ++i)
+    {
+        dtree::MeasureNamedScope<"NamedScopeTest"> scope;
+    }
+    {
+        dtree::MeasureNamedScope<"NamedScopeTest"> scope;
+        dtree::MeasureNamedScope<"NamedScopeTest", dtree::MeasurePolicy::Atomic> atomicScope;
+    }
+    ENSURE(GetCalls(dtree::measureRecordOf<"NamedScopeTest">) == 3);
+    ENSURE(GetCalls(dtree::measureRecordOf<"NamedScopeTest", dtree::MeasurePolicy::Atomic>) == 1);
+    ENSURE(dtree::MeasureNamedScope<"NamedScopeTest">::GetRecord() == &dtree::measureRecordOf<"NamedScopeTest">);
+    ENSURE(dtree::measureRecordOf<"NamedScopeTest">.nameId == dtree::MeasureUtils::ConstHashName("NamedScopeTest"));
+}
+#endif
+
+#endif // MEASURE_MODERN_IS_SUPPORTED
+
+int main()
+{
+    using namespace std;
+
+#if MEASURE_MODERN_IS_SUPPORTED
+    cout << "ModernTest\n";
+    ModernTest();
+
+#if MEASURE_NAMED_SCOPE_IS_SUPPORTED
+    cout << "NamedScopeTest\n";
+    NamedScopeTest();
+#endif
+#endif
+
+    cout << "test Ok.\n";
+    return 0;
+}
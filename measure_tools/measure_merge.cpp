@@ -0,0 +1,103 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Merges the binary snapshots of many processes (see SnapshotReport) into one report (see MeasureMerge).
+//
+// usage:
+//   measure_merge [--csv] [--jobs <n>] [--output <file>] <file>...
+// The files are read and folded by n threads (default: the number of the processors), every thread holds
+// one file and its partial merge at a time, so the memory doesn't grow with the number of the files.
+// The merged snapshot can be written into a file with --output, and merged again, e.g. per host first.
+
+#include "measure/measure_merge.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    int Usage()
+    {
+        std::cerr << "usage:\n"
+                  << "  measure_merge [--csv] [--jobs <n>] [--output <file>] <file>...\n";
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace dtree;
+
+    bool csv = false;
+    long jobs = long(std::thread::hardware_concurrency());
+    std::string outputName;
+    std::vector<std::string> fileNames;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--csv")
+            csv = true;
+        else if (arg == "--jobs" && i + 1 < argc)
+            jobs = std::strtol(argv[++i], nullptr, 10);
+        else if (arg == "--output" && i + 1 < argc)
+            outputName = argv[++i];
+        else if (arg[0] != '-')
+            fileNames.push_back(arg);
+        else
+            return Usage();
+    }
+    if (fileNames.empty())
+        return Usage();
+    if (jobs <= 0)
+        jobs = 1;
+    if (size_t(jobs) > fileNames.size())
+        jobs = long(fileNames.size());
+
+    // the threads take the next file, the result doesn't depend on which thread merges which file
+    std::vector<MeasureMerge> partials(jobs);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex errorMutex;
+    auto work = [&](MeasureMerge& partial)
+    {
+        MeasureSnapshot snapshot;
+        for (size_t i = next++; i < fileNames.size(); i = next++)
+        {
+            if (snapshot.ReadFile(fileNames[i]))
+            {
+                partial.Add(snapshot, i);
+                continue;
+            }
+            failed = true;
+            std::lock_guard<std::mutex> lock(errorMutex);
+            std::cerr << "measure_merge: " << fileNames[i] << " is not a valid snapshot file\n";
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (long i = 1; i < jobs; ++i)
+        threads.emplace_back(work, std::ref(partials[i]));
+    work(partials[0]);
+    for (std::thread& thread : threads)
+        thread.join();
+    for (long i = 1; i < jobs; ++i)
+        partials[0].Add(partials[i]);
+    if (failed)
+        return 1;
+
+    const MeasureMerge& merge = partials[0];
+    if (!outputName.empty() && !merge.GetSnapshot().WriteFile(outputName))
+    {
+        std::cerr << "measure_merge: cannot write " << outputName << "\n";
+        return 1;
+    }
+    if (csv)
+        merge.CsvReport(std::cout, fileNames);
+    else
+        merge.PrintReport(std::cout, fileNames);
+    return 0;
+}
@@ -0,0 +1,104 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Offline converter of the binary snapshots (see SnapshotReport) into the human readable and CSV reports.
+//
+// usage:
+//   measure_snapshot <file>                print the human readable report
+//   measure_snapshot --csv <file>          print the CSV report
+//   measure_snapshot --diff [--csv] [--threshold <percent>] [--min-z <score>] [--min-calls <n>] <old> <new>
+//                                          print the differences of two snapshots (see MeasureDiff),
+//                                          the exit status is 3 if there is a regression, e.g. for a CI pipeline
+
+#include "measure/measure_snapshot.h"
+#include "measure/measure_diff.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+namespace
+{
+    int Usage()
+    {
+        std::cerr
+            << "usage:\n"
+            << "  measure_snapshot <file>\n"
+            << "  measure_snapshot --csv <file>\n"
+            << "  measure_snapshot --diff [--csv] [--threshold <percent>] [--min-z <score>] [--min-calls <n>] <old> <new>\n";
+        return 2;
+    }
+
+    bool Read(const std::string& fileName, dtree::MeasureSnapshot& snapshot)
+    {
+        if (snapshot.ReadFile(fileName))
+            return true;
+        std::cerr << "measure_snapshot: " << fileName << " is not a valid snapshot file\n";
+        return false;
+    }
+
+    int Diff(int argc, char* argv[])
+    {
+        using namespace dtree;
+
+        bool csv = false;
+        MeasureDiffOptions options;
+        std::vector<std::string> fileNames;
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--csv")
+                csv = true;
+            else if (arg == "--threshold" && i + 1 < argc)
+                options.thresholdPercent = std::strtod(argv[++i], nullptr);
+            else if (arg == "--min-z" && i + 1 < argc)
+                options.minZScore = std::strtod(argv[++i], nullptr);
+            else if (arg == "--min-calls" && i + 1 < argc)
+                options.minCalls = std::strtoull(argv[++i], nullptr, 10);
+            else if (arg[0] != '-')
+                fileNames.push_back(arg);
+            else
+                return Usage();
+        }
+        if (fileNames.size() != 2)
+            return Usage();
+
+        MeasureSnapshot before, after;
+        if (!Read(fileNames[0], before) || !Read(fileNames[1], after))
+            return 1;
+        const MeasureDiff diff = MeasureDiff::Compare(before, after, options);
+        if (csv)
+            diff.CsvReport(std::cout);
+        else
+            diff.PrintReport(std::cout, after.title);
+        return diff.HasRegression() ? 3 : 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using dtree::MeasureSnapshot;
+
+    if (argc == 2 && argv[1][0] != '-')
+    {
+        MeasureSnapshot snapshot;
+        if (!Read(argv[1], snapshot))
+            return 1;
+        snapshot.PrintReport(std::cout);
+        return 0;
+    }
+
+    if (argc == 3 && std::string(argv[1]) == "--csv")
+    {
+        MeasureSnapshot snapshot;
+        if (!Read(argv[2], snapshot))
+            return 1;
+        snapshot.CsvReport(std::cout);
+        return 0;
+    }
+
+    if (argc >= 4 && std::string(argv[1]) == "--diff")
+        return Diff(argc, argv);
+
+    return Usage();
+}
@@ -0,0 +1,88 @@
+﻿// Copyright 2025 Gurzó Péter.
+// Licensed under the MIT License. See LICENSE.txt.
+
+// Live view of the measure records of a running process (see MeasureSharedMemoryExport).
+//
+// usage:
+//   measure_top [--csv] [--once] [--interval <ms>] [<name>]
+// the default name is dtree_measure, the default interval is 1000 ms
+
+#include "measure/measure_shared_memory.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+
+#if MEASURE_SHARED_MEMORY_IS_SUPPORTED
+
+namespace
+{
+    int Usage()
+    {
+        std::cerr << "usage:\n"
+                  << "  measure_top [--csv] [--once] [--interval <ms>] [<name>]\n";
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace dtree;
+
+    std::string name = "dtree_measure";
+    bool csv = false;
+    bool once = false;
+    long intervalMs = 1000;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--csv")
+            csv = true;
+        else if (arg == "--once")
+            once = true;
+        else if (arg == "--interval" && i + 1 < argc)
+            intervalMs = std::strtol(argv[++i], nullptr, 10);
+        else if (arg[0] != '-')
+            name = arg;
+        else
+            return Usage();
+    }
+    if (intervalMs <= 0)
+        return Usage();
+
+    MeasureSharedMemory memory;
+    std::vector<char> data;
+    MeasureSnapshot snapshot;
+    for (;;)
+    {
+        const bool valid = (memory.IsOpen() || memory.Open(name)) && memory.Read(data) && snapshot.Deserialize(data.data(), data.size());
+        if (!once)
+            std::cout << "\x1b[2J\x1b[H"; // clear the terminal
+        if (valid && csv)
+            snapshot.CsvReport(std::cout);
+        else if (valid)
+            snapshot.PrintReport(std::cout);
+        else
+        {
+            std::cerr << "measure_top: waiting for " << name << "\n";
+            // the process may have restarted, its new segment is opened again
+            memory.Close();
+        }
+        std::cout.flush();
+
+        if (once)
+            return valid ? 0 : 1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+}
+
+#else
+
+int main()
+{
+    std::cerr << "measure_top: shared memory is not supported on this platform\n";
+    return 1;
+}
+
+#endif // MEASURE_SHARED_MEMORY_IS_SUPPORTED